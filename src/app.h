@@ -65,6 +65,8 @@
   typedef struct ImageReader    ImageReader;
   typedef struct StringNode     StringNode;
   typedef struct StringTable    StringTable;
+  typedef struct TextLine       TextLine;
+  typedef struct TextLayout     TextLayout;
 
 /*
  *  Private platform-specific declarations:
@@ -115,6 +117,12 @@
   typedef int (*ImageMessageFunc) (ImageReader *reader, char *message);
   typedef int (*ImageProgressFunc)(ImageReader *reader);
 
+/*
+ *  Image call-backs:
+ */
+
+  typedef void (*ImageReleaseFunc)(void *pixels);
+
 
 /*
  *  Drawing operation prototypes:
@@ -275,8 +283,7 @@
 	char *          name;               /* family name of font */
 	int             style;              /* style bit-field */
 	App *           app;                /* back-pointer to App */
-	int             num_subfonts;       /* cache of subfonts */
-	Subfont **      subfonts;
+	void *          cache;              /* shared cache of subfonts */
     void *          ft_face;            /* for FreeType support */
   };
 
@@ -318,6 +325,7 @@
 	ControlFunc *   update;             /* used when any data changes */
 	ControlFunc *   refocus;            /* used when focus changes */
 	ControlFunc *   del;                /* used during deletion */
+	ControlFunc *   get_text;           /* used before text is read */
   };
 
   struct MenuBar {
@@ -385,6 +393,11 @@
 	Colour *        cmap;
 	byte **         data8;              /* indexed 8-bit data, or */
 	Colour **       data32;             /* direct 32-bit data */
+	int             stride;             /* bytes from one row to next */
+	byte *          pixels;             /* the rows point in here */
+	ImageReleaseFunc release;           /* frees caller-owned pixels */
+	long            generation;         /* changes with the pixels */
+	void *          cache;              /* Bitmap last drawn from this */
   };
 
   struct ImageList {
@@ -400,6 +413,8 @@
 	Palette *           src_pal;            /* dither to this palette */
 	int                 max_cmap_size;      /* only use this many colours */
 	int                 required_depth;     /* 8 or 32 */
+	int                 max_width;          /* shrink to fit, if > 0 */
+	int                 max_height;         /* shrink to fit, if > 0 */
 
 	ImageMessageFunc    message_func;       /* to report some problem */
 	ImageProgressFunc   error_func;         /* if error occurs, tidy up */
@@ -438,6 +453,32 @@
 	StringNode **   nodes;
   };
 
+  struct TextLine {
+	int             start;              /* byte offset in text */
+	int             nbytes;             /* bytes of text used */
+	int             offset;             /* line's offset in buf */
+	int             length;             /* bytes of line in buf */
+	int             width;              /* in pixels, -1 if unknown */
+  };
+
+  struct TextLayout {
+	Font *          font;               /* font used to wrap text */
+	char *          text;               /* copy of the text */
+	int             nbytes;
+	int             wrapped;            /* lines found for width? */
+	int             width;              /* pixel width of lines */
+	int             num_lines;          /* list of wrapped lines */
+	int             max_lines;
+	TextLine *      lines;
+	char *          buf;                /* lines with tabs expanded */
+	int             buf_used;
+	int             buf_size;
+	int             num_paras;          /* list of paragraphs */
+	int *           para_start;         /* byte offset of each */
+	int *           para_line;          /* first line of each */
+	int *           para_width;         /* widest line of each */
+  };
+
 
 /*
  *  ANSI character codes:
@@ -547,6 +588,8 @@ int 	app_do_event(App *app);
 int 	app_peek_event(App *app);
 
 int 	app_get_mouse_event(App *app, int *buttons, Point *p);
+void	app_set_mouse_compression(App *app, int on);
+int 	app_get_mouse_history(App *app, Point *list, int max);
 
 void	app_pass_event(Control *c);
 
@@ -573,6 +616,12 @@ void	app_del_timer(Timer *t);
 void	app_reset_timer(Timer *t, int milliseconds);
 
 
+/*
+ *  Worker threads:
+ */
+void	app_set_worker_threads(int n);
+
+
 /*
  *  Sound:
  */
@@ -680,6 +729,7 @@ char *	app_get_file_name(const char *filepath);
 #define CENTRED         0x00004000L
 #define POPUP           0x00008000L
 #define BASE            0x00010000L
+#define BUFFERED        0x00020000L
 #define TEMP_CURSOR     0x80000000L
 
 #define STANDARD_WINDOW (TITLEBAR|CLOSEBOX|RESIZE|MAXIMIZE|MINIMIZE)
@@ -774,6 +824,7 @@ void	app_on_control_action    (Control *c, ControlFunc action);
 void	app_on_control_update    (Control *c, ControlFunc update);
 void	app_on_control_refocus   (Control *c, ControlFunc refocus);
 void	app_on_control_deletion  (Control *c, ControlFunc del);
+void	app_on_control_get_text  (Control *c, ControlFunc get_text);
 
 void	app_set_control_background(Control *c, Colour col);
 Colour	app_get_control_background(Control *c);
@@ -1062,6 +1113,7 @@ void    app_set_default_font(Graphics *g);
 
 void	app_set_clip_rect(Graphics *g, Rect r);
 void	app_set_clip_region(Graphics *g, Region *rgn);
+Rect	app_get_clip_rect(Graphics *g);
 
 void	app_set_xor_mode(Graphics *g, Colour bgcol);
 void	app_set_paint_mode(Graphics *g);
@@ -1125,6 +1177,11 @@ enum TextFormat {
 int     app_text_line_length(Font *f, int pixel_width, const char *utf8, int nb);
 int     app_text_width(Font *f, int pixel_width, const char *utf8, int nbytes);
 int     app_text_height(Font *f, int pixel_width, const char *utf8, int nbytes);
+
+TextLayout * app_new_text_layout(Font *f, const char *utf8, int nbytes);
+void    app_del_text_layout(TextLayout *t);
+int     app_text_layout_height(TextLayout *t, int pixel_width);
+char *  app_draw_text_layout(Graphics *g, Rect r, int align, TextLayout *t);
 char *app_draw_text(Graphics *g, Rect r, int align, const char *utf8, int nbytes);
 
 
@@ -1146,12 +1203,19 @@ void    app_del_font(Font *f);
 
 int     app_font_height(Font *f);
 int     app_font_width(Font *f, const char *utf8, int nbytes);
+int     app_font_widths(Font *f, int count, const char **utf8,
+			const int *nbytes, int *widths);
+int     app_font_prefix_widths(Font *f, const char *utf8, int nbytes, int *x);
 
 Font *  app_find_default_font(App *app);
 void    app_change_default_font(const char *fontname);
 
 Subfont *app_font_char_info(Font *f, unsigned long ch, int *width);
 
+void    app_set_font_cache_size(long bytes);
+int     app_write_font_pack(const char *folder, int height, int style,
+			const char *filename);
+
 
 /*
  *  Cursors:
@@ -1190,7 +1254,23 @@ void    app_set_cursor_position(App *app, Point p);
  *  Images:
  */
 
+enum ImageFilter {
+	NEAREST_FILTER  = 0,    /* nearest pixel, no smoothing */
+	BOX_FILTER      = 1,    /* average of the pixels covered */
+	BILINEAR_FILTER = 2,    /* linear interpolation */
+	BICUBIC_FILTER  = 3,    /* Catmull-Rom cubic interpolation */
+	LANCZOS_FILTER  = 4     /* Lanczos-3 windowed sinc */
+};
+
+enum DitherMethod {
+	NO_DITHER        = 0,   /* nearest colour only */
+	ORDERED_DITHER   = 1,   /* 8x8 ordered pattern */
+	DIFFUSION_DITHER = 2    /* Floyd-Steinberg error diffusion */
+};
+
 Image *	app_new_image(int width, int height, int depth);
+Image *	app_wrap_image(int width, int height, int depth, int stride,
+			void *pixels, ImageReleaseFunc release);
 void	app_del_image(Image *img);
 
 Rect	app_get_image_area(const Image *img);
@@ -1198,6 +1278,7 @@ Rect	app_get_image_rect(const Image *img);
 
 Image *	app_copy_image(const Image *img);
 void	app_set_image_cmap(Image *img, int cmap_size, Colour *cmap);
+void	app_image_changed(Image *img);
 
 int 	app_image_has_transparent_pixels(const Image *img);
 
@@ -1205,6 +1286,8 @@ Image *	app_image_convert_32_to_8(const Image *img);
 Image *	app_image_convert_8_to_32(const Image *img);
 void	app_image_sort_palette(Image *img);
 Image *	app_scale_image(const Image *src, Rect dr, Rect sr);
+Image *	app_scale_image_ex(const Image *src, Rect dr, Rect sr, int filter);
+Image *	app_quantize_image(const Image *img, int max_colours, int dither);
 
 int 	app_draw_image(Graphics *g, Rect dr, Image *img, Rect sr);
 int 	app_draw_image_monochrome(Graphics *g, Rect dr, Image *src, Rect sr);
@@ -1260,6 +1343,7 @@ int     app_find_image_format_in_memory(byte *memsrc, int memsize);
 
 int     app_write_image(Image *img, const char *filename);
 int     app_write_image_at(Image *img, const char *filename, int dpi, int interlace);
+byte *  app_write_image_memory(Image *img, int format, int *size);
 
 
 /*
@@ -52,7 +52,8 @@ OS_OBJECTS    = bmap.$(OBJ)      bmapimg.$(OBJ)   clipbrd.$(OBJ)  \
 		cursor.$(OBJ)    drawbmap.$(OBJ)  drawwin.$(OBJ)  \
 		event.$(OBJ)     folder.$(OBJ)    font.$(OBJ)     \
 		graphics.$(OBJ)  init.$(OBJ)      timer.$(OBJ)    \
-		win.$(OBJ)       keys2ucs.$(OBJ)  clut.$(OBJ)
+		win.$(OBJ)       keys2ucs.$(OBJ)  clut.$(OBJ)     \
+		thread.$(OBJ)
 
 IMGFMT_OBJECTS= imgread.$(OBJ)   imgwrite.$(OBJ)  readgif.$(OBJ)  \
 		readh.$(OBJ)     readjpg.$(OBJ)   readpng.$(OBJ)  \
@@ -716,6 +717,9 @@ init.$(OBJ): $(OSDIR)init.c
 keys2ucs.$(OBJ): $(OSDIR)keys2ucs.c
 	$(CC) $(CFLAGS) $(OSDIR)keys2ucs.c
 
+thread.$(OBJ): $(OSDIR)thread.c
+	$(CC) $(CFLAGS) $(OSDIR)thread.c
+
 timer.$(OBJ): $(OSDIR)timer.c
 	$(CC) $(CFLAGS) $(OSDIR)timer.c
 
@@ -9,7 +9,7 @@ INC      = -I
 EXTRAINC = -I/usr/X11R6/include
 GALIB    = libapp.a
 COPTS    = -O2 -Wall
-OSLIBS   = -L/usr/X11R6/lib -lX11 -lc -lm
+OSLIBS   = -L/usr/X11R6/lib -lX11 -lXext -lXrender -lpthread -lc -lm
 LINK     = ar rc  
 CL       = gcc -o 
 CC       = gcc -c 
@@ -9,7 +9,7 @@ INC      = -I
 EXTRAINC = 
 GALIB    = libapp.a
 COPTS    = -O -fast
-OSLIBS   = -lX11 -lc -lm
+OSLIBS   = -lX11 -lXext -lXrender -lpthread -lc -lm
 LINK     = ar rc 
 CL       = cc -o 
 CC       = cc -c 
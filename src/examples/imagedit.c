@@ -128,6 +128,7 @@ void reduce_palette(Image *img)
 	for (y=0; y < img->height; y++)
 	  for (x=0; x < img->width; x++)
 		img->data8[y][x] = translate[img->data8[y][x]];
+	app_image_changed(img);
 
 	/* Clean up: */
 	free(translate);
@@ -184,7 +185,7 @@ void prepare_for_change(ImageEditor *editor)
 	editor->prev_img = img_copy;
 }
 
-void image_changed(ImageEditor *editor)
+void editor_changed(ImageEditor *editor)
 {
 	if (editor->changed == 0) {
 		enable_menu_item(editor->undo_item);
@@ -348,7 +349,7 @@ void handle_pixedit_drag(Control *pixedit, int buttons, Point p)
 		draw_pixel_block(g, colour, r);
 		del_graphics(g);
 		draw_control(editor->display);
-		image_changed(editor);
+		editor_changed(editor);
 	}
 }
 
@@ -492,7 +493,7 @@ void add_colour(Control *btn)
 	set_image_cmap(img, palsize+1, palette2);
 	draw_control(editor->paledit);
 	draw_control(editor->display);
-	image_changed(editor);
+	editor_changed(editor);
 }
 
 void change_colour(Control *btn)
@@ -532,7 +533,7 @@ void change_colour(Control *btn)
 	draw_control(editor->paledit);
 	draw_control(editor->pixedit);
 	draw_control(editor->display);
-	image_changed(editor);
+	editor_changed(editor);
 }
 
 void update_scrollbars(ImageEditor *editor)
@@ -891,7 +892,7 @@ void do_reduce_palette(MenuItem *mi)
 	prepare_for_change(editor);
 	reduce_palette(editor->img);
 	reset_editor(editor);
-	image_changed(editor);
+	editor_changed(editor);
 }
 
 void do_sort_palette(MenuItem *mi)
@@ -902,7 +903,7 @@ void do_sort_palette(MenuItem *mi)
 	prepare_for_change(editor);
 	image_sort_palette(editor->img);
 	reset_editor(editor);
-	image_changed(editor);
+	editor_changed(editor);
 }
 
 ImageEditor *create_image_editor(App *app)
@@ -331,6 +331,8 @@ void lighten_image(Viewer *v)
 				i->data32[y][x] = c;
 			}
 
+		app_image_changed(i);
+
 		/* update the bitmap and window */
 		r = get_image_area(i);
 		r = display_area(v->win, r);
@@ -377,6 +379,8 @@ void darken_image(Viewer *v)
 				i->data32[y][x] = c;
 			}
 
+		app_image_changed(i);
+
 		/* update the bitmap and window */
 		r = get_image_area(i);
 		r = display_area(v->win, r);
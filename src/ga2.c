@@ -1383,58 +1383,46 @@ void delimage(Image *img)
 
 void setpixels(Image *img, byte pixels[])
 {
-	int i, w, h;
-	unsigned long c;
+	int h;
+	long rowbytes;
+
+	/* the linear data has the same byte layout as the image rows */
+	rowbytes = (long) img->width * (img->depth/8);
 
-	i = 0;
 	if (img->depth == 8)
 		for (h=0; h < img->height; h++)
-			for (w=0; w < img->width; i++)
-				img->data8[h][w] = pixels[i++];
-	else
+			memcpy(img->data8[h], pixels + h * rowbytes, rowbytes);
+	else if (img->depth == 32)
 		for (h=0; h < img->height; h++)
-			for (w=0; w < img->width; i++) {
-				c = 0;
-				c |= pixels[i++];
-				c <<= 8;
-				c |= pixels[i++];
-				c <<= 8;
-				c |= pixels[i++];
-				c <<= 8;
-				c |= pixels[i++];
-				img->data8[h][w] = c;
-			}
+			memcpy(img->data32[h], pixels + h * rowbytes, rowbytes);
+
+	app_image_changed(img);
 }
 
 byte * getpixels(Image *img) /* convert to a linear memory model */
 {
-	int i, w, h;
+	int h;
+	long rowbytes;
 	byte *data;
 
 	data = get_association(img, ASSOC_DATA);
 	if (data)
 		app_free(data);
-	data = app_alloc(img->width * img->height * (img->depth/8));
+	rowbytes = (long) img->width * (img->depth/8);
+	data = app_alloc(rowbytes * img->height);
 	if (data == NULL)
 		return NULL;
 	add_association(img, ASSOC_DATA, data);
 
-	if (img->depth == 8) {
-		i = 0;
+	/* each Colour is stored as alpha, red, green, blue bytes */
+	if (img->pixels && (img->stride == rowbytes))
+		memcpy(data, img->pixels, rowbytes * img->height);
+	else if (img->depth == 8)
 		for (h=0; h < img->height; h++)
-			for (w=0; w < img->width; w++)
-				data[i++] = img->data8[h][w];
-	}
-	else if (img->depth == 32) {
-		i = 0;
+			memcpy(data + h * rowbytes, img->data8[h], rowbytes);
+	else if (img->depth == 32)
 		for (h=0; h < img->height; h++)
-			for (w=0; w < img->width; w++) {
-				data[i++] = img->data32[h][w].alpha;
-				data[i++] = img->data32[h][w].red;
-				data[i++] = img->data32[h][w].green;
-				data[i++] = img->data32[h][w].blue;
-			}
-	}
+			memcpy(data + h * rowbytes, img->data32[h], rowbytes);
 	return data;
 }
 
@@ -85,6 +85,7 @@
 #define del_region                   app_del_region
 #define del_string                   app_del_string
 #define del_string_table             app_del_string_table
+#define del_text_layout              app_del_text_layout
 #define del_timer                    app_del_timer
 #define del_window                   app_del_window
 #define delay                        app_delay
@@ -109,6 +110,7 @@
 #define draw_round_rect              app_draw_round_rect
 #define draw_shadow_rect             app_draw_shadow_rect
 #define draw_text                    app_draw_text
+#define draw_text_layout             app_draw_text_layout
 #define draw_utf8(g,p,utf8,nb)       ((g)->draw_utf8((g),(p),(utf8),(nb)))
 #define draw_window                  app_draw_window
 #define enable                       app_enable
@@ -131,11 +133,14 @@
 #define flash_control                app_flash_control
 #define font_char_info               app_font_char_info
 #define font_height                  app_font_height
+#define font_prefix_widths           app_font_prefix_widths
 #define font_width                   app_font_width
+#define font_widths                  app_font_widths
 #define form_file_path               app_form_file_path
 #define free                         app_free
 #define get_bitmap_area              app_get_bitmap_area
 #define get_bitmap_graphics          app_get_bitmap_graphics
+#define get_clip_rect                app_get_clip_rect
 #define get_clipboard_text           app_get_clipboard_text
 #define get_control_area             app_get_control_area
 #define get_control_background       app_get_control_background
@@ -159,6 +164,7 @@
 #define get_menu_item_foreground     app_get_menu_item_foreground
 #define get_menu_item_value          app_get_menu_item_value
 #define get_mouse_event              app_get_mouse_event
+#define get_mouse_history            app_get_mouse_history
 #define get_standard_cursor          app_get_standard_cursor
 #define get_string                   app_get_string
 #define get_window_area              app_get_window_area
@@ -243,10 +249,12 @@
 #define new_sub_menu                 app_new_sub_menu
 #define new_tab_button               app_new_tab_button
 #define new_text_box                 app_new_text_box
+#define new_text_layout              app_new_text_layout
 #define new_timer                    app_new_timer
 #define new_window                   app_new_window
 #define on_control_action            app_on_control_action
 #define on_control_deletion          app_on_control_deletion
+#define on_control_get_text          app_on_control_get_text
 #define on_control_key_action        app_on_control_key_action
 #define on_control_key_down          app_on_control_key_down
 #define on_control_mouse_down        app_on_control_mouse_down
@@ -282,9 +290,11 @@
 #define pop_up_list                  app_pop_up_list
 #define portable_draw_line           app_portable_draw_line
 #define process_events               app_process_events
+#define quantize_image               app_quantize_image
 #define read_folder                  app_read_folder
 #define read_image                   app_read_image
 #define read_image_file              app_read_image_file
+#define read_image_memory            app_read_image_memory
 #define read_image_progressively     app_read_image_progressively
 #define read_latin1_file             app_read_latin1_file
 #define read_latin1_line             app_read_latin1_line
@@ -314,6 +324,7 @@
 #define reset_list_box               app_reset_list_box
 #define rgbs_equal                   app_rgbs_equal
 #define scale_image                  app_scale_image
+#define scale_image_ex               app_scale_image_ex
 #define select_text                  app_select_text
 #define send_control_to_back         app_send_control_to_back
 #define set_clip_rect                app_set_clip_rect
@@ -343,6 +354,7 @@
 #define set_field_disallowed_chars   app_set_field_disallowed_chars
 #define set_focus                    app_set_focus
 #define set_font                     app_set_font
+#define set_font_cache_size          app_set_font_cache_size
 #define set_image_cmap               app_set_image_cmap
 #define set_line_width               app_set_line_width
 #define set_list_box_item            app_set_list_box_item
@@ -352,6 +364,7 @@
 #define set_menu_item_font           app_set_menu_item_font
 #define set_menu_item_foreground     app_set_menu_item_foreground
 #define set_menu_item_value          app_set_menu_item_value
+#define set_mouse_compression        app_set_mouse_compression
 #define set_paint_mode               app_set_paint_mode
 #define set_rgb                      app_set_rgb
 #define set_rgbindex                 app_set_rgbindex
@@ -363,6 +376,7 @@
 #define set_window_icon              app_set_window_icon
 #define set_window_palette           app_set_window_palette
 #define set_window_title             app_set_window_title
+#define set_worker_threads           app_set_worker_threads
 #define set_xor_mode                 app_set_xor_mode
 #define show_control                 app_show_control
 #define show_window                  app_show_window
@@ -370,6 +384,7 @@
 #define size_window                  app_size_window
 #define subtract_region              app_subtract_region
 #define text_height                  app_text_height
+#define text_layout_height           app_text_layout_height
 #define text_line_length             app_text_line_length
 #define text_selection               app_text_selection
 #define text_width                   app_text_width
@@ -389,7 +404,10 @@
 #define utf8_to_latin1               app_utf8_to_latin1
 #define utf8_to_unicode              app_utf8_to_unicode
 #define wait_event                   app_wait_event
+#define wrap_image                   app_wrap_image
+#define write_font_pack              app_write_font_pack
 #define write_image                  app_write_image
+#define write_image_memory           app_write_image_memory
 #define write_latin1                 app_write_latin1
 #define write_utf8                   app_write_utf8
 #define xor_region                   app_xor_region
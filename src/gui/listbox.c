@@ -19,6 +19,7 @@
  *  Version: 3.56  2005/08/09  Silenced some size_t conversion warnings.
  *  Version: 3.60  2007/06/06  Unified window/control adding code.
  *  Version: 3.62  2010/06/29  Various enhancements.
+ *  Version: 3.73  2026/10/17  Measures plain items all at once.
  */
 
 /* Copyright (c) L. Patrick
@@ -543,7 +544,16 @@ static void app_listbox_resize(Control *c)	//!!
 	app_change_scroll_bar(lb->vert, lb->top, max, pagesize);
 
 	/* find maximum item width */
-	if (list != NULL) {
+	if ((list != NULL)
+	 && (lb->get_item_width == app_listbox_get_item_width))
+	{
+		/* plain text items can be measured all at once */
+		for (i=0; list[i] != NULL; i++)
+			continue;
+		max = app_font_widths(lb->parent->font, i,
+				(const char **) list, NULL, NULL);
+	}
+	else if (list != NULL) {
 		for (i=max=0; list[i] != NULL; i++) {
 			w = lb->get_item_width(c, i);
 			if (max < w)
@@ -29,6 +29,7 @@
  *  Version: 3.56  2005/08/09  Silenced some size_t conversion warnings.
  *  Version: 3.57  2005/08/16  CTRL+INS=copy, SHIFT+INS=paste, SHIFT+DEL=cut.
  *  Version: 3.60  2007/06/06  Unified window/control adding code.
+ *  Version: 3.74  2026/10/17  Gap buffer text, re-wraps only edited lines.
  */
 
 /* Copyright (c) L. Patrick
@@ -63,184 +64,328 @@ static Font * app_get_text_box_font(Control *c)
 }
 
 /*
- *  Recompute the starting byte locations for the entire text.
+ *  The text of a text box is kept in t->buf rather than in the
+ *  control's text string. It has a gap of unused bytes at the place
+ *  last edited, so typing a character only moves the bytes between
+ *  one edit and the next, instead of everything after the caret.
+ *  The buffer always has one more byte after the text and the gap,
+ *  which holds a '\0'. The control's text string is made from the
+ *  buffer only when app_get_control_text asks for it.
  */
-static void app_recompute_text_lines(TextBox *t)
+
+/*
+ *  Return the byte at a position in the text.
+ */
+static char app_text_box_char(TextBox *t, long pos)
+{
+	if (pos < t->gap_start)
+		return t->buf[pos];
+	return t->buf[pos + t->gap_size];
+}
+
+/*
+ *  Move the gap to a byte-position in the text.
+ */
+static void app_text_box_move_gap(TextBox *t, long pos)
+{
+	char *text = t->buf;
+
+	if (pos < t->gap_start)
+		memmove(text + pos + t->gap_size, text + pos,
+			t->gap_start - pos);
+	else if (pos > t->gap_start)
+		memmove(text + t->gap_start,
+			text + t->gap_start + t->gap_size,
+			pos - t->gap_start);
+	t->gap_start = pos;
+}
+
+/*
+ *  Return a pointer to nbytes of text starting at a byte-position,
+ *  moving the gap out of the way if the bytes are on both sides of it.
+ *  The pointer can only be used until the gap is next moved.
+ */
+static char * app_text_box_bytes(TextBox *t, long pos, long nbytes)
+{
+	if ((pos < t->gap_start) && (pos + nbytes > t->gap_start))
+		app_text_box_move_gap(t, pos);
+	if (pos < t->gap_start)
+		return t->buf + pos;
+	return t->buf + pos + t->gap_size;
+}
+
+/*
+ *  Copy nbytes of text starting at a byte-position.
+ */
+static void app_text_box_copy_bytes(TextBox *t, char *dest,
+		long pos, long nbytes)
+{
+	long before;
+
+	before = (pos < t->gap_start) ? t->gap_start - pos : 0;
+	if (before > nbytes)
+		before = nbytes;
+	memcpy(dest, t->buf + pos, before);
+	memcpy(dest + before, t->buf + pos + before + t->gap_size,
+		nbytes - before);
+}
+
+/*
+ *  Ensure the gap can hold at least the given number of bytes.
+ *  Returns zero if there is not enough memory.
+ */
+static int app_text_box_grow_gap(TextBox *t, long needed)
 {
-	int i, nb, total;
-	int num = 32; /* an initial guess */
-	int length = 0;
-	long offset;
+	long size;
 	char *text;
-	int width;
-	Font *f;
 
-	if (t->lines)
-		app_free(t->lines);
-	t->num_lines = 0;
+	if (t->gap_size >= needed)
+		return 1;
 
-	text = t->parent->text;
-	width = t->box->area.width - 8;
+	size = needed + 64 + t->text_length / 4;
+	text = app_realloc(t->buf, t->text_length + size + 1);
+	if (text == NULL)
+		return 0;
 
-	/* start with some appropriate number of lines */
-	t->lines = app_alloc(num * sizeof(t->lines[0]));
-	t->lines[0] = 0;
-	t->lines[1] = 0;
-	t->lines[2] = 0;
-	if (text)
-		nb = total = t->text_length;
-	else
-		nb = total = num = 0;
+	/* move the bytes after the gap, and the '\0', to the end */
+	memmove(text + t->gap_start + size,
+		text + t->gap_start + t->gap_size,
+		t->text_length - t->gap_start + 1);
+	t->buf = text;
+	t->gap_size = size;
+	return 1;
+}
 
-	if (t->caret > nb)
-		t->caret = nb;
+/*
+ *  Count the Chars in some UTF-8 bytes, which is the number
+ *  of bytes that don't continue a character.
+ */
+static int app_text_box_count_chars(const char *utf8, long nbytes)
+{
+	long i;
+	int count = 0;
 
-	f = app_get_text_box_font(t->parent);
+	for (i=0; i < nbytes; i++)
+		if ((utf8[i] & 0xC0) != 0x80)
+			count++;
+	return count;
+}
 
-	/* compute other line-start positions */
-	for (offset=i=0; i < num; i++)
-	{
-		if (i == num-2) {	/* filled up (leave two spots) */
-			num *= 2;	/* double size of array */
-			t->lines = app_realloc(t->lines,
-				num * sizeof(t->lines[0]));
-		}
-		t->lines[i] = offset;
-		if (nb == 0) {
-			t->lines[i+1] = offset;
-			break;
-		}
-		length = app_text_line_length(f, width, text, nb);
-		offset += length;
-		text += length;
-		nb -= length;
+/*
+ *  Copy the control's text string into the text buffer.
+ *  Returns zero, keeping the old text, if there is not
+ *  enough memory.
+ */
+static int app_text_box_load_text(TextBox *t)
+{
+	char *text = t->parent->text;
+	char *buf;
+	long length;
+
+	length = text ? (long) strlen(text) : 0;
+
+	buf = app_alloc(length + 1);
+	if (buf == NULL)
+		return 0;
+	if (length > 0)
+		memcpy(buf, text, length);
+	buf[length] = '\0';
+
+	if (t->buf)
+		app_free(t->buf);
+	t->buf = buf;
+
+	t->text_length = length;
+	t->num_chars = app_text_box_count_chars(t->buf, length);
+	t->gap_start = length;
+	t->gap_size = 0;
+	return 1;
+}
+
+/*
+ *  Make the control's text string from the text buffer,
+ *  if it has been edited since the string was last made.
+ */
+static void app_text_box_get_text(Control *c)
+{
+	TextBox *t = c->extra;
+
+	if (c->text != NULL)
+		return;
+	c->text = app_alloc(t->text_length + 1);
+	if (c->text == NULL)
+		return;
+	app_text_box_copy_bytes(t, c->text, 0, t->text_length);
+	c->text[t->text_length] = '\0';
+}
+
+/*
+ *  The lines array holds the byte-position where each line starts,
+ *  followed by the length of the text. It also has a gap, at index
+ *  t->line_gap, and the entries after the gap are counted back from
+ *  the end of the text, so they stay correct while text is inserted
+ *  or deleted in front of them.
+ */
+
+/*
+ *  Return where a line starts, or the end of the text.
+ */
+static long app_text_box_line(TextBox *t, int i)
+{
+	if (i < t->line_gap)
+		return t->lines[i];
+	if (i > t->num_lines)
+		return t->text_length;
+	return t->text_length - t->lines[i + t->line_gap_size];
+}
+
+/*
+ *  Find the line which contains a byte-position.
+ */
+static int app_text_box_find_line(TextBox *t, long pos)
+{
+	int low, high, mid;
+
+	low = 0;
+	high = t->num_lines - 1;
+	while (low < high) {
+		mid = (low + high + 1) / 2;
+		if (app_text_box_line(t, mid) <= pos)
+			low = mid;
+		else
+			high = mid - 1;
 	}
+	return low;
+}
 
-	/* a newline at the end of the text means an extra line */
-	text = t->parent->text;
-	if ((total > 0) && (text[total-1] == '\n')) {
-		i++;
-		t->lines[i+1] = t->lines[i];
+/*
+ *  Move the gap in the lines array to just before the given line.
+ */
+static void app_text_box_move_line_gap(TextBox *t, int i)
+{
+	long *lines = t->lines;
+	int gap = t->line_gap_size;
+
+	while (t->line_gap > i) {
+		t->line_gap--;
+		lines[t->line_gap + gap] = t->text_length
+					- lines[t->line_gap];
 	}
-	else if (total == 0) {
-		i++;
-		t->lines[i] = t->lines[i+1] = 0;
+	while (t->line_gap < i) {
+		lines[t->line_gap] = t->text_length
+					- lines[t->line_gap + gap];
+		t->line_gap++;
 	}
+}
 
-	/* resize to smallest array size */
-	t->num_lines = i;
-	t->lines = app_realloc(t->lines, (i+2) * sizeof(t->lines[0]));
+/*
+ *  Add a line-start into the gap in the lines array.
+ */
+static void app_text_box_add_line(TextBox *t, long start)
+{
+	int size, after;
+	long *lines;
 
-	/* fix previous selection */
-	if (total > t->prev_start)
-		t->prev_start = total;
-	if (total > t->prev_end)
-		t->prev_end = total;
+	if (t->line_gap_size == 0) {	/* filled up */
+		size = t->max_lines + t->max_lines / 2 + 32;
+		lines = app_realloc(t->lines, size * sizeof(t->lines[0]));
+		if (lines == NULL)
+			return;
+		after = t->max_lines - t->line_gap;
+		memmove(lines + size - after, lines + t->line_gap,
+			after * sizeof(lines[0]));
+		t->lines = lines;
+		t->line_gap_size = size - t->max_lines;
+		t->max_lines = size;
+	}
+	t->lines[t->line_gap++] = start;
+	t->line_gap_size--;
+	t->num_lines = t->max_lines - t->line_gap_size - 1;
 }
 
 /*
- *  Recompute the starting byte locations for the text,
- *  starting from the specified line.
+ *  Remove the line-start just after the gap in the lines array.
  */
-static int app_recompute_text_lines_and_resync(TextBox *t,
-		int old_first_line, long *old_lines, int old_num_lines,
-		int inserted)
+static void app_text_box_drop_line(TextBox *t)
 {
-	int i, nb, total;
-	int num = 32; /* an initial guess */
-	int length = 0;
-	long offset;
-	char *text;
+	t->line_gap_size++;
+	t->num_lines = t->max_lines - t->line_gap_size - 1;
+}
+
+/*
+ *  Wrap the text into lines, from a line-start onwards, adding
+ *  the new line-starts into the gap in the lines array. The old
+ *  line-starts after the gap are removed as they're passed, but
+ *  if a line starts where an old line did, and not before the
+ *  byte-position 'unchanged', the old lines are still correct.
+ *  Returns 1 if it stopped there, 0 if it wrapped to the end.
+ */
+static int app_text_box_wrap_lines(TextBox *t, long offset, long unchanged)
+{
+	long total;
 	int width;
+	char *text;
 	Font *f;
-	int resync, first_resync;
 
-	if (t->lines)
-		app_free(t->lines);
-	t->num_lines = 0;
-
-	text = t->parent->text;
+	f = app_get_text_box_font(t->parent);
 	width = t->box->area.width - 8;
+	total = t->text_length;
 
-	/* start with some appropriate number of lines */
-	t->lines = app_alloc(num * sizeof(t->lines[0]));
-	t->lines[0] = 0;
-	t->lines[1] = 0;
-	t->lines[2] = 0;
-	if (text)
-		nb = total = t->text_length;
-	else
-		nb = total = num = 0;
+	/* make the text from offset onwards contiguous */
+	if (t->gap_start < total)
+		app_text_box_move_gap(t, offset);
+	text = (offset < t->gap_start) ? t->buf : t->buf + t->gap_size;
 
-	if (t->caret > nb)
-		t->caret = nb;
+	while (offset < total)
+	{
+		offset += app_text_line_length(f, width,
+				text + offset, total - offset);
 
-	f = app_get_text_box_font(t->parent);
+		while ((t->line_gap <= t->num_lines) &&
+		       (app_text_box_line(t, t->line_gap) < offset))
+			app_text_box_drop_line(t);
 
-	/* compute other line-start positions */
-	resync = 0;
-	first_resync = -1;
-	for (offset=i=0; i < num; i++)
-	{
-		if (i == num-2) {	/* filled up (leave two spots) */
-			num *= 2;	/* double size of array */
-			t->lines = app_realloc(t->lines,
-				num * sizeof(t->lines[0]));
-		}
-		t->lines[i] = offset;
-		if (nb == 0) {
-			/* No bytes left, stop here. */
-			t->lines[i+1] = offset;
+		if (offset == total)
 			break;
-		}
-		if (i < old_first_line) {
-			/* Before first changed line, so copy from old. */
-			length = old_lines[i+1] - old_lines[i];
-		}
-		else if ((resync < old_num_lines) &&
-			 (t->lines[i] == old_lines[resync] + inserted))
-		{
-			/* Found a line which just shifted up or down. */
-			length = old_lines[resync + 1] - old_lines[resync];
-			first_resync = resync;
-			resync++;
-		}
-		else {
-			/* Changed line, recalculate line length. */
-			length = app_text_line_length(f, width, text, nb);
-			while ((resync < old_num_lines) &&
-			  (t->lines[i] + length > old_lines[resync] + inserted))
-				resync++;
-		}
-		offset += length;
-		text += length;
-		nb -= length;
+		if ((offset >= unchanged) && (t->line_gap <= t->num_lines)
+		 && (app_text_box_line(t, t->line_gap) == offset))
+			return 1;
+		app_text_box_add_line(t, offset);
 	}
 
+	while (t->line_gap <= t->num_lines)
+		app_text_box_drop_line(t);
+
 	/* a newline at the end of the text means an extra line */
-	text = t->parent->text;
-	if ((total > 0) && (text[total-1] == '\n')) {
-		i++;
-		t->lines[i+1] = t->lines[i];
-	}
-	else if (total == 0) {
-		i++;
-		t->lines[i] = t->lines[i+1] = 0;
-	}
+	if ((total > 0) && (app_text_box_char(t, total-1) == '\n'))
+		app_text_box_add_line(t, total);
+	app_text_box_add_line(t, total);
+	return 0;
+}
+
+/*
+ *  Recompute the starting byte locations for the entire text.
+ */
+static void app_recompute_text_lines(TextBox *t)
+{
+	int total = t->text_length;
+
+	/* forget the old lines */
+	t->line_gap = 0;
+	t->line_gap_size = t->max_lines;
+	t->num_lines = -1;
+
+	if (t->caret > total)
+		t->caret = total;
 
-	/* resize to smallest array size */
-	t->num_lines = i;
-	t->lines = app_realloc(t->lines, (i+2) * sizeof(t->lines[0]));
+	app_text_box_add_line(t, 0);
+	app_text_box_wrap_lines(t, 0, total);
 
 	/* fix previous selection */
 	if (total > t->prev_start)
 		t->prev_start = total;
 	if (total > t->prev_end)
 		t->prev_end = total;
-
-	if (first_resync < 0)
-		first_resync = t->num_lines;
-	return first_resync;
 }
 
 /*
@@ -282,7 +427,10 @@ static void app_text_box_update(Control *c)
 	TextBox *t;
 
 	t = c->extra;
-	length = c->text ? (int) strlen(c->text) : 0;
+	if (c->text)	/* new text, else text is unchanged */
+		if (! app_text_box_load_text(t))
+			return; /* error */
+	length = t->text_length;
 
 	if (t->caret < 0)
 		t->caret = 0;
@@ -293,7 +441,6 @@ static void app_text_box_update(Control *c)
 	if (t->caret + t->selected > length)
 		t->selected = length - t->caret;
 
-	t->text_length = length;
 	t->caret = length;
 	t->caret = 0;
 	t->selected = 0;
@@ -308,6 +455,7 @@ static Region * app_text_box_selection_region(Control *c,
 			int sel_start, int sel_end)
 {
 	int i, y, x1, x2, h, h2, temp;
+	long line, next;
 	Font *f;
 	Rect r, textbox;
 	Region *reg;
@@ -336,7 +484,10 @@ static Region * app_text_box_selection_region(Control *c,
 		(i < t->num_lines) && (y < textbox.height);
 		y+=h, i++)
 	{
-		if ((sel_start == t->lines[i+1]) &&
+		line = app_text_box_line(t, i);
+		next = app_text_box_line(t, i+1);
+
+		if ((sel_start == next) &&
 			(sel_end == sel_start) &&
 			(i < t->num_lines-1))
 		{
@@ -344,11 +495,11 @@ static Region * app_text_box_selection_region(Control *c,
 			/* belongs at start of the next line */
 			continue;
 		}
-		else if (sel_start > t->lines[i+1]) {
+		else if (sel_start > next) {
 			/* start of selection on later line */
 			continue;
 		}
-		else if (sel_start < t->lines[i]) {
+		else if (sel_start < line) {
 			/* start of selection on prior line */
 			/* so select from start of this line */
 			x1 = textbox.x;
@@ -358,12 +509,12 @@ static Region * app_text_box_selection_region(Control *c,
 			/* so select only from that point */
 			x1 = textbox.x;
 			x1 += app_text_width(f, textbox.width,
-				c->text + t->lines[i],
-				sel_start - t->lines[i]);
+				app_text_box_bytes(t, line, next - line),
+				sel_start - line);
 		}
 
-		if (sel_end < t->lines[i]) {
-			/* sel_start <= sel_end < t->lines[i] */
+		if (sel_end < line) {
+			/* sel_start <= sel_end < line */
 			/* so the selection is on a prior line */
 			continue;
 		}
@@ -372,21 +523,21 @@ static Region * app_text_box_selection_region(Control *c,
 			/* so use a thin insertion bar */
 			x2 = x1 + 1;
 		}
-		else if (sel_end >= t->lines[i+1]) {
+		else if (sel_end >= next) {
 			/* end of selection on later line */
 			/* so select up to end of this line */
 			x2 = textbox.x;
 			x2 += app_text_width(f, textbox.width,
-				c->text + t->lines[i],
-				t->lines[i+1] - t->lines[i]);
+				app_text_box_bytes(t, line, next - line),
+				next - line);
 		}
 		else {
 			/* end of selection on this line */
 			/* so select only up to that point */
 			x2 = textbox.x;
 			x2 += app_text_width(f, textbox.width,
-				c->text + t->lines[i],
-				sel_end - t->lines[i]);
+				app_text_box_bytes(t, line, next - line),
+				sel_end - line);
 		}
 
 		h2 = h;
@@ -436,6 +587,7 @@ static void app_text_box_redraw(Control *c, Graphics *g, int do_clip)
 	Rect r;
 	Rect textbox;
 	int h, i, y, lb;
+	long line;
 	int sel_start, sel_end;
 	Font *f;
 	TextBox *t;
@@ -472,12 +624,13 @@ static void app_text_box_redraw(Control *c, Graphics *g, int do_clip)
 	for (i=t->start, y=0;
 		(i < t->num_lines) && (y < textbox.height); y+=h, i++)
 	{
-		lb = t->lines[i+1] - t->lines[i];
+		line = app_text_box_line(t, i);
+		lb = app_text_box_line(t, i+1) - line;
 
 		app_draw_text(g,
 			rect(textbox.x, textbox.y+y, textbox.width, h),
 			ALIGN_LEFT+VALIGN_TOP,
-			c->text + t->lines[i], lb);
+			app_text_box_bytes(t, line, lb), lb);
 	}
 	if (do_clip)
 		app_set_clip_rect(g, r);
@@ -610,12 +763,10 @@ static void app_text_box_scroll_to_caret(TextBox *t, int redraw)
 	if (start + num > t->num_lines)
 		num = t->num_lines - start;
 
-	if (t->lines[start] > caret)
-		while (t->lines[start] > caret)
-			start--;
-	else if (t->lines[start + num] < caret)
-		while (t->lines[start + num] < caret)
-			start++;
+	if (app_text_box_line(t, start) > caret)
+		start = app_text_box_find_line(t, caret);
+	else if (app_text_box_line(t, start + num) < caret)
+		start = app_text_box_find_line(t, caret - 1) + 1 - num;
 
 	max = t->num_lines - page + 1;
 	if (max < 0)
@@ -666,6 +817,7 @@ static void app_text_box_scroll_to_caret(TextBox *t, int redraw)
 static int app_text_box_caret_from_click(TextBox *t, Point p)
 {
 	int i, h, w1, w2, line;
+	long start, length;
 	Font *f;
 	char *text;
 	Rect textbox;
@@ -690,20 +842,22 @@ static int app_text_box_caret_from_click(TextBox *t, Point p)
 		/* Clicked below text box. */
 		line = t->start + textbox.height / h + 1;
 		if (line >= t->num_lines)
-			return t->lines[t->num_lines];	/* end of text */
+			return t->text_length;	/* end of text */
 	}
 	else {
 		/* Clicked inside text box. */
 		line = t->start + (p.y-textbox.y) / h;
 		if (line >= t->num_lines)
-			return t->lines[t->num_lines];	/* end of text */
+			return t->text_length;	/* end of text */
 	}
 
 	/* Now find the character offset within that line. */
 
-	text = t->parent->text + t->lines[line];
+	start = app_text_box_line(t, line);
+	length = app_text_box_line(t, line+1) - start;
+	text = app_text_box_bytes(t, start, length);
 	p.x -= textbox.x;
-	for (i=w1=0; i < t->lines[line+1] - t->lines[line]; i++)
+	for (i=w1=0; i < length; i++)
 	{
 		if (text[i] == '\n')
 			break;
@@ -723,29 +877,28 @@ static int app_text_box_caret_from_click(TextBox *t, Point p)
 				i++; /* include UTF-8 continuation bytes */
 	}
 /*
-	if ((i > 0) && (i == t->lines[line+1]))
+	if ((i > 0) && (i == length))
 		if ((text[i-1] == '\n') ||
 			(text[i-1] == '\t') ||
 			(text[i-1] == ' '))
 			i--;
 */
-	return t->lines[line] + i;
+	return start + i;
 }
 
 /*
- *  Recompute all text lines and update (redraw) only those lines
- *  which have changed. This may involve scrolling some lines up or down
- *  to handle text insertion or deletion, and redrawing certain
- *  rectangular regions. The selection is emptied as a result.
+ *  Replace some bytes of the text, re-wrap only the lines which
+ *  changed, and update (redraw) only those lines. If the number of
+ *  lines changed, every line below the change is redrawn as well.
+ *  The selection is emptied as a result.
  */
-static void app_recompute_and_update(TextBox *t, int inserted, int new_caret)
+static void app_text_box_replace_text(TextBox *t, long pos, long removed,
+		const char *newtext, long added, int new_caret)
 {
-	int i, h, final_line;
-	int old_num_lines;
-	long *old_lines;
-	int first, last;
-	int old_first_line, first_line;
-	int x, y;
+	int i, h, final_line, old_num_lines, resynced;
+	int first_line, last_line, edit_line, wrap_line;
+	long old_next, line, length;
+	int x, y, h2;
 	Font *f;
 	Rect textbox;
 	Region *update, *extra;
@@ -759,65 +912,96 @@ static void app_recompute_and_update(TextBox *t, int inserted, int new_caret)
 	textbox = app_get_control_area(t->box);
 	textbox = app_inset_rect(textbox, 4);
 
-	/* Determine updated text slice. */
-	first = t->caret;
-	last = t->caret;
+	if (! app_text_box_grow_gap(t, added))
+		return; /* error */
 
 	/*
-	 * Check what selection was removed, if any.
-	 * All lines where the selection was valid
-	 * must be redrawn in full or in part
+	 * Find the line on which the change begins. Deleting from
+	 * a line's first word might let it wrap back onto the line
+	 * before, so start wrapping lines from that one.
 	 */
-	if (t->selected < 0)
-		first += t->selected;
-	else if (t->selected > 0)
-		last += t->selected;
-
-	/* Add inserted to current caret to expand update region. */
-	if (inserted < 0) {
-		if (first > t->caret + inserted)
-			first = t->caret + inserted;
-	}
-	else if (inserted > 0) {
-		if (last < t->caret + inserted)
-			last = t->caret + inserted;
-	}
-
-	/* Save old lines array. */
+	edit_line = app_text_box_find_line(t, pos);
+	wrap_line = (edit_line > 0) ? edit_line - 1 : 0;
+	old_next = app_text_box_line(t, wrap_line + 1);
 	old_num_lines = t->num_lines;
-	old_lines = t->lines;
-	t->num_lines = 0;
-	t->lines = NULL;
-
-	/* Find line on which first change occurred. */
-	old_first_line = 0;
-	for (i=0; i < old_num_lines; i++) {
-		if (first < old_lines[i])
-			break;
-		old_first_line = i;
+	app_text_box_move_line_gap(t, wrap_line + 1);
+
+	/* Replace the bytes, by widening the gap over those removed. */
+	app_text_box_move_gap(t, pos);
+	t->num_chars -= app_text_box_count_chars(t->buf + pos + t->gap_size,
+			removed);
+	t->num_chars += app_text_box_count_chars(newtext, added);
+	t->gap_size += removed;
+	if (added > 0)
+		memcpy(t->buf + pos, newtext, added);
+	t->gap_start += added;
+	t->gap_size -= added;
+	t->text_length += added - removed;
+
+	/* The control's text string is now out of date. */
+	if (t->parent->text) {
+		app_del_string(t->parent->text);
+		t->parent->text = NULL;
 	}
 
+	/* Re-wrap lines until they start where old lines did. */
+	resynced = app_text_box_wrap_lines(t,
+			app_text_box_line(t, wrap_line), pos + added);
+
 	/* Update caret and selection. */
 	t->caret = new_caret;
 	t->selected = 0;
 
-	/* Recompute where each line begins. */
-	app_recompute_text_lines_and_resync(t, old_first_line,
-			old_lines, old_num_lines, inserted);
-
-	/* Find line on which first change will be seen. */
-	first_line = 0;
-	for (i=0; i < t->num_lines; i++) {
-		if (first < t->lines[i])
-			break;
+	/* fix previous selection */
+	if (t->text_length > t->prev_start)
+		t->prev_start = t->text_length;
+	if (t->text_length > t->prev_end)
+		t->prev_end = t->text_length;
+
+	/* Find the first changed line, and where on it to redraw from. */
+	i = app_text_box_find_line(t, pos);
+	x = 0;
+	if ((wrap_line < edit_line)
+	 && (app_text_box_line(t, wrap_line + 1) != old_next))
+	{
+		/* A word wrapped back onto the earlier line. */
+		first_line = wrap_line;
+	}
+	else if (i > edit_line) {
+		/* A word wrapped onto a later line, so redraw
+		 * from the new end of the line where it was. */
+		first_line = edit_line;
+		line = app_text_box_line(t, first_line);
+		length = app_text_box_line(t, first_line + 1) - line;
+		x = app_text_width(f, textbox.width,
+			app_text_box_bytes(t, line, length), length);
+	}
+	else if (i < edit_line) {
+		first_line = i;
+	}
+	else {
+		/* Perhaps we just typed one character. */
 		first_line = i;
+		line = app_text_box_line(t, first_line);
+		length = pos - line;
+		x = app_text_width(f, textbox.width,
+			app_text_box_bytes(t, line, length), length);
+	}
+
+	/* Find the last changed line, if the lines after it didn't move. */
+	if (resynced && (t->num_lines == old_num_lines)) {
+		last_line = t->line_gap - 1;
+		i = app_text_box_find_line(t, pos + added);
+		if (last_line < i)
+			last_line = i;	/* the caret's line */
 	}
+	else
+		last_line = -1;
 
 	/* Redraw everything if it's too difficult to work out. */
 	final_line = t->start + textbox.height / h;
 	if ((first_line < t->start) || (first_line > final_line))
 	{
-		app_free(old_lines);
 		app_text_box_scroll_to_caret(t, 1);
 		return;
 	}
@@ -825,168 +1009,29 @@ static void app_recompute_and_update(TextBox *t, int inserted, int new_caret)
 	/* Accumulate the lines to update in a region. */
 	update = app_new_region();
 
-	/* Scroll text if possible. */
-	#ifdef DO_NOT_COMPILE
-	for (i=t->start; i < t->num_lines; i++)
-	{
-		int j;
-		int found = 0;
-
-		if (t->lines[i] < last)
-			continue;
-
-		for (j=i; j < old_num_lines; j++) {
-			if (t->lines[i] == old_lines[j] + inserted) {
-				found = 1;
-				break;
-			}
-		}
-		if (! found)
-			continue;
-
-		/* Else, found a resync spot. */
-		if (i < j)
-		{
-			/* scrolled up */
-		}
-		else if (i > j)
-		{
-			/* scrolled down */
-		}
-		break;
-	}
-	#endif
-
-	/* Redraw whatever changed from old to new lines array. */
-	if (first_line > old_first_line)
-	{
-		/* Perhaps a word wrapped onto a later line; if so
-		 * redraw the end of old_first_line and every
-		 * visible line thereafter.
-		 */
-		i = old_first_line;
-
-		if ((i >= t->start) && (i <= final_line) && (i < t->num_lines))
-		{
-			x = app_font_width(f,
-					t->parent->text + t->lines[i],
-					t->lines[i+1] - t->lines[i]);
-			y = (i - t->start) * h;
-			extra = app_new_rect_region(rect(textbox.x + x,
-					textbox.y + y, textbox.width - x, h));
-			app_union_region(update, extra, update);
-			app_del_region(extra);
-		}
-
-		i = old_first_line + 1;
-
-		if ((i >= t->start) && (i <= final_line))
-		{
-			y = (i - t->start) * h;
-			extra = app_new_rect_region(rect(textbox.x,
-					textbox.y + y, textbox.width,
-					textbox.height - y));
-			app_union_region(update, extra, update);
-			app_del_region(extra);
-		}
-	}
-	else if (first_line < old_first_line)
-	{
-		/* Perhaps a word wrapped onto an earlier line
-		 * due to hitting the backspace or delete key; if so
-		 * redraw the new first_line and every line thereafter.
-		 */
-		i = first_line;
-
-		if ((i >= t->start) && (i <= final_line))
-		{
-			y = (i - t->start) * h;
-			extra = app_new_rect_region(rect(textbox.x,
-					textbox.y + y, textbox.width,
-					textbox.height - y));
-			app_union_region(update, extra, update);
-			app_del_region(extra);
-		}
-	}
-	else {
-		/* First changed line is the same in both old and new
-		 * lines lists. Perhaps we just typed one character.
-		 * So, redraw from the first change onwards.
-		 */
-		i = first_line;
-
-		if ((i >= t->start) && (i <= final_line) && (i < t->num_lines))
-		{
-			x = app_font_width(f,
-					t->parent->text + t->lines[i],
-					first - t->lines[i]);
-			y = (i - t->start) * h;
-			extra = app_new_rect_region(rect(textbox.x + x,
-					textbox.y + y, textbox.width - x, h));
-			app_union_region(update, extra, update);
-			app_del_region(extra);
-		}
-
-		/* If the last change was also on that first_line, stop. */
-
-		i = first_line + 1;
-
-		if (i > final_line) {
-			/* After last visible line; redraw nothing extra. */
-		}
-		else if ((i < t->num_lines) && (i < old_num_lines)
-			&& (t->lines[i] == old_lines[i] + inserted))
-		{
-			/* Changes on one line only; redraw nothing extra. */
-		}
-		else if (i >= t->start)
-		{
-			y = (i - t->start) * h;
-			extra = app_new_rect_region(rect(textbox.x,
-					textbox.y + y, textbox.width,
-					textbox.height - y));
-			app_union_region(update, extra, update);
-			app_del_region(extra);
-		}
-	}
-	/* Redraw changed lines. */
-	#ifdef DO_NOT_COMPILE
-	for (i=t->start; i < t->num_lines; i++)
+	/* Lines may be partly visible, so clip to the text area. */
+	y = (first_line - t->start) * h;
+	h2 = h;
+	if (y + h2 > textbox.height)
+		h2 = textbox.height - y;
+	extra = app_new_rect_region(rect(textbox.x + x,
+			textbox.y + y, textbox.width - x, h2));
+	app_union_region(update, extra, update);
+	app_del_region(extra);
+
+	y += h;
+	if ((last_line < 0) || (last_line > final_line))
+		last_line = final_line;
+	if ((last_line > first_line) && (y < textbox.height))
 	{
-		/* If first changed text is after this line, keep looking. */
-		if (i < first_line)
-			continue;
-
-		/* If found a resync spot, stop here. */
-		if (t->lines[i] >= last) {
-			if (i < old_num_lines)
-				if (t->lines[i] == old_lines[i] + inserted)
-					break;
-		}
-
-		/* If first bit of changed text is on this line, */
-		/* just redraw the line from the change onwards. */
-		if (i == first_line)
-		{
-			x = app_font_width(f,
-					t->parent->text + t->lines[i],
-					first - t->lines[i]);
-			extra = app_new_rect_region(rect(textbox.x+x,
-					textbox.y+(i-t->start)*h,
-					textbox.width-x, h));
-			app_union_region(update, extra, update);
-			app_del_region(extra);
-		}
-		/* Else if after the first change, redraw this line */
-		else if (i > first_line) {
-			extra = app_new_rect_region(rect(textbox.x,
-					textbox.y+(i-t->start)*h,
-					textbox.width, h));
-			app_union_region(update, extra, update);
-			app_del_region(extra);
-		}
+		h2 = (last_line - first_line) * h;
+		if (y + h2 > textbox.height)
+			h2 = textbox.height - y;
+		extra = app_new_rect_region(rect(textbox.x,
+				textbox.y + y, textbox.width, h2));
+		app_union_region(update, extra, update);
+		app_del_region(extra);
 	}
-	#endif
 
 	if (update) {
 		Graphics *g = app_get_control_graphics(t->box);
@@ -998,7 +1043,6 @@ static void app_recompute_and_update(TextBox *t, int inserted, int new_caret)
 		app_del_graphics(g);
 		app_del_region(update);
 	}
-	app_free(old_lines);
 }
 
 /*
@@ -1007,8 +1051,8 @@ static void app_recompute_and_update(TextBox *t, int inserted, int new_caret)
 static Point app_text_box_caret_point(TextBox *t)
 {
 	int i, h;
+	long line;
 	Font *f;
-	char *text;
 	Rect textbox;
 
 	textbox = app_inset_rect(app_get_control_area(t->box), 4);
@@ -1016,16 +1060,15 @@ static Point app_text_box_caret_point(TextBox *t)
 	if (f == NULL)
 		return pt(textbox.x, textbox.y);
 	h = app_font_height(f);
-	text = t->parent->text;
-
-	for (i=0; i < t->num_lines; i++) {
-		if ((i == t->num_lines - 1) ||
-			((t->lines[i] <= t->caret) && (t->caret < t->lines[i+1])))
-			return pt(textbox.x +
-				app_text_width(f, textbox.width,
-					text + t->lines[i],
-					t->caret - t->lines[i]),
-				textbox.y + h * (i - t->start) + h/2);
+
+	if (t->num_lines > 0) {
+		i = app_text_box_find_line(t, t->caret);
+		line = app_text_box_line(t, i);
+		return pt(textbox.x +
+			app_text_width(f, textbox.width,
+				app_text_box_bytes(t, line, t->caret - line),
+				t->caret - line),
+			textbox.y + h * (i - t->start) + h/2);
 	}
 	return pt(textbox.x + textbox.width,
 		textbox.y + h * (t->num_lines-1) + h/2);
@@ -1113,59 +1156,19 @@ static void app_text_box_mouse_up(Control *c, int buttons, Point p)
  */
 static void app_text_box_insert_text(Control *c, const char *newtext, int len2)
 {
-	int len, caret, selected;
-	char *text;
+	int pos, removed;
 	TextBox *t = c->extra;
 
-	/* find current size of text */
-	text = c->text;
-	len = t->text_length;
-	caret = t->caret;
-	selected = t->selected;
-
-	/* delete any current selection first */
-	if (selected > 0) {
-		/* selection runs from caret to caret+selected */
-		/* 0 <= caret < caret+selected < len */
-		/* number of bytes following selection is len-(caret+selected) */
-		memmove(text+caret, text+caret+selected, len-caret-selected+1);
-		len -= selected;
-		t->text_length -= selected;
-		if (caret >= len)
-			caret = len;
-	}
-	else if (selected < 0) {
+	/* delete any current selection too */
+	pos = t->caret;
+	removed = t->selected;
+	if (removed < 0) {
 		/* selection runs from caret+selected to caret */
-		/* 0 <= caret+selected < caret < len */
-		/* number of bytes following selection is len-caret */
-		memmove(text+caret+selected, text+caret, len-caret+1);
-		len += selected;
-		caret += selected;
-		t->text_length += selected;
-		if (caret >= len)
-			caret = len;
+		pos += removed;
+		removed = 0 - removed;
 	}
 
-	/* if nothing is being inserted, just update */
-	if (len2 == 0) {
-		app_recompute_and_update(t, len2, caret);
-		return;
-	}
-
-	/* adjust size of stored string */
-	text = app_realloc(text, len+len2+1);
-	if (text == NULL)
-		return; /* error */
-
-	/* copy new text into resized string */
-	c->text = text;
-	memmove(text+caret+len2, text+caret, len-caret+1);
-	memcpy(text+caret, newtext, len2);
-	t->text_length += len2;
-
-	/* fix caret and start offset */
-	caret += len2;
-	app_recompute_and_update(t, len2, caret);
+	app_text_box_replace_text(t, pos, removed, newtext, len2, pos + len2);
 }
 
 /*
@@ -1174,7 +1177,6 @@ static void app_text_box_insert_text(Control *c, const char *newtext, int len2)
 static void app_text_box_key_down(Control *c, unsigned long ch)
 {
 	int i, len;
-	char *text;
 	char *s;
 	char buffer[8];
 	Window *w;
@@ -1204,16 +1206,12 @@ static void app_text_box_key_down(Control *c, unsigned long ch)
 			app_text_box_insert_text(c, NULL, 0);
 			return;
 		}
-		text = c->text;
-		len = t->text_length;
 		i = t->caret;
-		while ((i > 0) && IS_UTF8_EXTRA_BYTE(text[i-1]))
+		while ((i > 0) && IS_UTF8_EXTRA_BYTE(app_text_box_char(t, i-1)))
 			i--; /* remove UTF-8 continuation bytes */
 		if (i > 0)
 			i--; /* remove first UTF-8 byte */
-		memmove(text+i, text+t->caret, len-t->caret+1);
-		t->text_length -= (t->caret - i);
-		app_recompute_and_update(t, i - t->caret, i);
+		app_text_box_replace_text(t, i, t->caret - i, NULL, 0, i);
 	}
 	else if (ch == DEL)	/* delete next character, if any */
 	{
@@ -1225,16 +1223,14 @@ static void app_text_box_key_down(Control *c, unsigned long ch)
 			app_text_box_insert_text(c, NULL, 0);
 			return;
 		}
-		text = c->text;
 		len = t->text_length;
 		i = t->caret;
 		if (i < len)
 			i++; /* remove first UTF-8 byte */
-		while ((i < len) && IS_UTF8_EXTRA_BYTE(text[i]))
+		while ((i < len) && IS_UTF8_EXTRA_BYTE(app_text_box_char(t, i)))
 			i++; /* remove UTF-8 continuation bytes */
-		memmove(text+t->caret, text+i, len-i+1);
-		t->text_length -= (i - t->caret);
-		app_recompute_and_update(t, t->caret - i, t->caret);
+		app_text_box_replace_text(t, t->caret, i - t->caret,
+				NULL, 0, t->caret);
 	}
 	else if ((ch == (CONTROL + 'X')) ||	/* Ctrl-X is Cut */
 		 (ch == (CONTROL + 'C')))	/* Ctrl-C is Copy */
@@ -1244,7 +1240,7 @@ static void app_text_box_key_down(Control *c, unsigned long ch)
 			s = app_alloc(len+1);
 			if (! s)
 				return;
-			memmove(s, c->text+t->caret, len);
+			app_text_box_copy_bytes(t, s, t->caret, len);
 			s[len] = '\0';
 			w = app_parent_window(c);
 			app_set_clipboard_text(w->app, s);
@@ -1255,7 +1251,7 @@ static void app_text_box_key_down(Control *c, unsigned long ch)
 			s = app_alloc(len+1);
 			if (! s)
 				return;
-			memmove(s, c->text+t->caret-len, len);
+			app_text_box_copy_bytes(t, s, t->caret-len, len);
 			s[len] = '\0';
 			w = app_parent_window(c);
 			app_set_clipboard_text(w->app, s);
@@ -1294,7 +1290,7 @@ static void app_text_box_key_down(Control *c, unsigned long ch)
 			return;
 		}
 		if ((t->maxwidth > 0) && (t->selected == 0)) {
-			if (app_utf8_length(c->text) >= t->maxwidth) {
+			if (t->num_chars >= t->maxwidth) {
 				app_pass_event(c);
 				return;
 			}
@@ -1313,6 +1309,7 @@ static void app_text_box_key_down(Control *c, unsigned long ch)
 static void app_text_box_key_action(Control *c, unsigned long ch)
 {
 	int i, len, start, caret, sel;
+	char last;
 	Rect textbox;
 	Point p;
 	Font *f;
@@ -1329,45 +1326,27 @@ static void app_text_box_key_action(Control *c, unsigned long ch)
 
 	switch (ch & ~(CONTROL | SHIFT)) {
 		case HOME:
-			for (i=0; i < t->num_lines; i++) {
-				if (caret < t->lines[i])
-					break;	/* gone past the line */
-				if (caret == t->lines[i])
-					break;	/* already at start */
-				/* last line, no newline, special */
-				if (i == t->num_lines-1)
-					if (caret <= t->lines[i+1]) {
-						caret = t->lines[i];
-						break;
-					}
-				if (caret < t->lines[i+1]) {
-					caret = t->lines[i];
-					break;
-				}
-			}
+			i = app_text_box_find_line(t, caret);
+			caret = app_text_box_line(t, i);
 			sel = 0;
 			break;
 		case END:
-			for (i=0; i < t->num_lines; i++) {
-				if (caret < t->lines[i])
-					break;	/* gone past the line */
-				if (caret < t->lines[i+1]) {
-					caret = t->lines[i+1];
-					if (caret == 0)
-						break;
-					if ((c->text[caret-1] == '\n') ||
-						(c->text[caret-1] == '\t') ||
-						(c->text[caret-1] == ' '))
-						caret--;
+			i = app_text_box_find_line(t, caret);
+			if (caret < app_text_box_line(t, i+1)) {
+				caret = app_text_box_line(t, i+1);
+				if (caret == 0)
 					break;
-				}
+				last = app_text_box_char(t, caret-1);
+				if ((last == '\n') || (last == '\t')
+				 || (last == ' '))
+					caret--;
 			}
 			sel = 0;
 			break;
 		case LEFT:
 			caret -= 1;
 			while ((caret > 0) &&
-				IS_UTF8_EXTRA_BYTE(c->text[caret]))
+				IS_UTF8_EXTRA_BYTE(app_text_box_char(t, caret)))
 					caret -= 1;
 			if (caret < 0)
 				caret = 0;
@@ -1382,7 +1361,7 @@ static void app_text_box_key_action(Control *c, unsigned long ch)
 			len = t->text_length;
 			caret += 1;
 			while ((caret < len) &&
-				IS_UTF8_EXTRA_BYTE(c->text[caret]))
+				IS_UTF8_EXTRA_BYTE(app_text_box_char(t, caret)))
 					caret += 1;
 			if (caret > len)
 				caret = len;
@@ -1547,6 +1526,8 @@ static void app_text_box_del(Control *c)
 
 	if (t->lines)
 		app_free(t->lines);
+	if (t->buf)
+		app_free(t->buf);
 	app_free(c->extra);
 }
 
@@ -1586,9 +1567,13 @@ static Control *app_create_text_box(Control *c, Rect r, const char *text) //!!
 	else
 		app_set_control_text(c, "");
 	t->start = 0;
-	t->text_length = (int) strlen(c->text);
-	t->caret = t->text_length;
 	t->parent = c;
+	if (! app_text_box_load_text(t)) {
+		app_free(t);
+		app_del_control(c);
+		return NULL;
+	}
+	t->caret = t->text_length;
 	t->vert = vert;
 	t->horz = NULL;
 	t->box = box;
@@ -1605,6 +1590,7 @@ static Control *app_create_text_box(Control *c, Rect r, const char *text) //!!
 	app_on_control_update(c, app_text_box_update);
 	app_on_control_refocus(c, app_text_box_refocus);
 	app_on_control_deletion(c, app_text_box_del);
+	app_on_control_get_text(c, app_text_box_get_text);
 	app_show_control(c);
 
 	app_recompute_text_lines(t);
@@ -1684,7 +1670,8 @@ void app_select_text(Control *c, long start, long end)
 	TextBox *t = c->extra;
 	long length;
 
-	if (((start == 0) && (end == 0)) || (c->text == NULL))
+	if (((start == 0) && (end == 0))
+	 || ((c->text == NULL) && (t->buf == NULL)))
 		t->start = t->caret = t->selected = 0;
 	else {
 		length = t->text_length;
@@ -1708,7 +1695,7 @@ void app_select_text(Control *c, long start, long end)
 		t->start = (start < end) ? start : end;
 	}
 	if (c->key_down && (c->key_down[0] == app_text_box_key_down)) {
-		app_recompute_text_lines(t);
+		/* lines are up to date, since edits re-wrap them */
 		app_text_box_scroll_page(t, 0);
 		app_redraw_control(c);
 	}
@@ -4,6 +4,7 @@
  *  Platform: Neutral
  *
  *  Version: 3.50  2004/01/01  First release.
+ *  Version: 3.74  2026/10/17  Text boxes keep their text in a gap buffer.
  */
 
 /* Copyright (c) L. Patrick
@@ -30,7 +31,15 @@ struct TextBox {
 	/* used only by text boxes: (could use subclassing if C++!) */
 
 	int num_lines;		/* number of lines in entire text */
+	int num_chars;		/* running count of Chars in text */
 	long *lines;		/* indices to start of each line */
+	int max_lines;		/* allocated size of lines array */
+	int line_gap;		/* lines array index of unused gap */
+	int line_gap_size;	/* unused entries; those after are */
+				/* counted back from end of text */
+	char *buf;		/* text, with a gap at the last edit */
+	int gap_start;		/* byte-position of the gap */
+	int gap_size;		/* number of bytes in the gap */
 	Control *parent;	/* enclosing region */
 	Control *vert;		/* vertical scroll bar */
 	Control *horz;		/* horizontal scroll bar */
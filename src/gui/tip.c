@@ -108,7 +108,7 @@ static void app_show_tip(TipsControl *tc, Point p)
 	/* get the text of tip */
 	i = app_find_tip_index(tc, tc->c);
 	if (i == -1)
-		text = tc->c->text;
+		text = app_get_control_text(tc->c);
 	else {
 		void *p = tc->tips[i];
 		if (tc->c->state & TIP_HANDLER)
@@ -7,6 +7,7 @@
  *  Version: 3.10  2001/12/01  Fixed some bugs; added app_read_image_file.
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
  *  Version: 3.56  2005/08/09  Silenced some size_t conversion warnings.
+ *  Version: 3.73  2026/10/17  Shrinks images to fit max_width, max_height.
  */
 
 /* Copyright (c) L. Patrick
@@ -20,7 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "app.h" 
+#include "apputils.h"
 #include "readgif.h"
 #include "readjpg.h"
 #include "readpng.h"
@@ -97,6 +98,86 @@ Image *app_read_image_memory(const byte *memsrc, int memsize, int required_depth
 	return img;
 }
 
+/*
+ *  Find the size an image must shrink to, keeping its shape,
+ *  to fit within the reader's max_width and max_height.
+ *  A limit of zero or less means no limit. Images which fit
+ *  already keep their size.
+ */
+APP_PRIVATE
+void app_fit_image_size(ImageReader *reader, int width, int height,
+			int *fit_width, int *fit_height)
+{
+	double scale = 1.0;
+
+	if ((reader->max_width > 0) && (width > reader->max_width))
+		scale = (double) reader->max_width / width;
+	if ((reader->max_height > 0) && (height * scale > reader->max_height))
+		scale = (double) reader->max_height / height;
+
+	*fit_width = width;
+	*fit_height = height;
+	if (scale < 1.0) {
+		*fit_width = (int) (width * scale + 0.5);
+		*fit_height = (int) (height * scale + 0.5);
+		if (*fit_width < 1)
+			*fit_width = 1;
+		if (*fit_height < 1)
+			*fit_height = 1;
+	}
+}
+
+/*
+ *  Shrink an image which is still too large for the reader's
+ *  max_width and max_height, using a Lanczos filter. An 8-bit
+ *  image is dithered back to its own palette afterwards.
+ *  Returns the image to keep; img is deleted if it is replaced.
+ */
+static Image * shrink_to_fit(ImageReader *reader, Image *img)
+{
+	Image *small, *dest;
+	Palette *pal;
+	Ditherer *d;
+	int width, height, y;
+
+	app_fit_image_size(reader, img->width, img->height,
+				&width, &height);
+	if ((width == img->width) && (height == img->height))
+		return img;
+
+	small = app_scale_image_ex(img, rect(0,0,width,height),
+			rect(0,0,img->width,img->height), LANCZOS_FILTER);
+	if (! small)
+		return img;
+
+	if (img->depth == 8) {
+		dest = app_new_image(width, height, 8);
+		pal = app_new_palette(img->cmap_size, img->cmap);
+		d = (dest && pal) ? app_new_ditherer(pal, width,
+					DIFFUSION_DITHER) : NULL;
+		if (d) {
+			app_set_image_cmap(dest, img->cmap_size, img->cmap);
+			for (y=0; y < height; y++)
+				app_dither_row(d, y, small->data32[y],
+						dest->data8[y]);
+			app_del_ditherer(d);
+		}
+		else if (dest) {
+			app_del_image(dest);
+			dest = NULL;
+		}
+		if (pal)
+			app_del_palette(pal);
+		app_del_image(small);
+		if (! dest)
+			return img;
+		small = dest;
+	}
+
+	app_del_image(img);
+	return small;
+}
+
 Image *app_read_image_progressively(ImageReader *reader)
 {
 	int depth;
@@ -137,7 +218,8 @@ Image *app_read_image_progressively(ImageReader *reader)
 		break;
 	  case GA_H_FORMAT:
 		/* cannot read this format interactively yet */
-		img = app_read_header_image_file(reader->file);
+		if (reader->file)
+			img = app_read_header_image_file(reader->file);
 		break;
 	  default:
 		break;
@@ -171,6 +253,9 @@ Image *app_read_image_progressively(ImageReader *reader)
 		reader->pal = NULL;
 	}
 
+	if (img)
+		img = shrink_to_fit(reader, img);
+
 	return img;
 }
 
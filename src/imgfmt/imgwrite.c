@@ -8,6 +8,7 @@
  *  Version: 3.56  2005/08/09  Silenced a size_t conversion warning.
  *  Version: 3.57  2002/08/09  Added saving of PNG file format.
  *  Version: 3.60  2007/06/06  Added app_write_image_at function.
+ *  Version: 3.72  2026/10/17  Added app_write_image_memory function.
  */
 
 /* Copyright (c) L. Patrick
@@ -67,3 +68,23 @@ int app_write_image_at(Image *img, const char *filename, int dpi, int interlace)
 
 	return 0;
 }
+
+/*
+ *  Write an image into a newly allocated block of memory,
+ *  in the given format (GIF_FORMAT or PNG_FORMAT), setting
+ *  *size to its length in bytes. The caller must free the
+ *  memory using app_free. Returns NULL on failure.
+ */
+byte * app_write_image_memory(Image *img, int format, int *size)
+{
+	*size = 0;
+
+	switch (format) {
+	  case GIF_FORMAT:
+		return app_save_gif_memory(img, 0, size);
+	  case PNG_FORMAT:
+		return app_save_png_memory(img, 0, 0, size);
+	  default:
+		return NULL;
+	}
+}
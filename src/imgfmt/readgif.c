@@ -5,6 +5,7 @@
  *
  *  Version: 3.00  2001/05/05  First release.
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
+ *  Version: 3.71  2026/10/17  Reads GIF data held in memory.
  */
 
 /* Copyright (c) L. Patrick
@@ -21,14 +22,6 @@
 #include "readgif.h"
 #include <gif.h>
 
-static unsigned char read_byte(FILE *file)
-{
-	int ch = getc(file);
-	if (ch == EOF)
-		ch = 0;
-	return ch;
-}
-
 static Image * gif_to_image(GifPicture *pic, GifExtension *ext, GifScreen *screen)
 {
 	Image * img = NULL;
@@ -160,7 +153,7 @@ static int read_gif_error(ImageReader *reader, Gif *gif, char *msg)
 int app_read_gif (ImageReader *reader)
 {
 	int i;
-	FILE *file;
+	GifStream stream, *file = &stream;
 	Gif *gif;
 	GifBlock *block;
 	GifExtension *ext;
@@ -177,11 +170,14 @@ int app_read_gif (ImageReader *reader)
 	int interlace_height[] = {8, 4, 2, 1};
 	int scan_pass, row;
 
-	/* The file should already be open. */
+	/* The file should already be open, or the GIF in memory. */
 
 	reader->state = STARTING;
-	file = reader->file;
-	if (file == NULL)
+	if (reader->file)
+		init_gif_file_stream(file, reader->file);
+	else if (reader->memsrc)
+		init_gif_memory_stream(file, reader->memsrc, reader->memsize);
+	else
 		return read_gif_error(reader, NULL, "The file is not open.");
 
 	/* Initialize GIF object, check header. */
@@ -192,7 +188,7 @@ int app_read_gif (ImageReader *reader)
 	if ((reader->bytes_read > 0) && (reader->bytes_read <= 6))
 		strncpy(gif->header, "GIF89a", reader->bytes_read);
 	for (i=reader->bytes_read; i<6; i++)
-		gif->header[i] = read_byte(file);
+		gif->header[i] = read_gif_char(file);
 	if (strncmp(gif->header, "GIF", 3) != 0)
 		return read_gif_error(reader, gif, "The file is not GIF.");
 
@@ -204,7 +200,7 @@ int app_read_gif (ImageReader *reader)
 
 	while (1)
 	{
-		block->intro = read_byte(file);
+		block->intro = read_gif_char(file);
 
 		if (block->intro == 0x2C) {	/* image */
 			/* Don't read the image just yet: */
@@ -260,7 +256,7 @@ int app_read_gif (ImageReader *reader)
 	pic->width  = read_gif_int(file);
 	pic->height = read_gif_int(file);
 
-	info = read_byte(file);
+	info = read_gif_char(file);
 	pic->has_cmap    = (info & 0x80) >> 7;
 	pic->interlace   = (info & 0x40) >> 6;
 	pic->sorted      = (info & 0x20) >> 5;
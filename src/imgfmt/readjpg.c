@@ -4,6 +4,9 @@
  *  Platform: Neutral
  *
  *  Version: 3.00  2001/07/25  First release.
+ *  Version: 3.71  2026/10/17  Quantizes with the shared median cut.
+ *  Version: 3.72  2026/10/17  Reads JPEG data held in memory.
+ *  Version: 3.73  2026/10/17  Uses DCT scaling to fit max_width, max_height.
  */
 
 /* Copyright (c) L. Patrick
@@ -17,9 +20,10 @@
 #include <string.h>
 #include <setjmp.h>
 
-#include "app.h"
+#include "apputils.h"
 #include "readjpg.h"
 #include <jpeglib.h>
+#include <jerror.h>
 
 /*
  * IMAGE DATA FORMATS:
@@ -153,78 +157,113 @@ static void start_progress_monitor (j_common_ptr cinfo,
 
 
 /*
- *  Create a palette based on the JPEG file's quantized palette.
+ *  Memory source manager:
+ *  The decompressor reads straight from the reader's memsrc,
+ *  so the data is never copied into a buffer of its own.
  */
 
-#define EXTRAS 2
+static const JOCTET fake_eoi[2] = { 0xFF, JPEG_EOI };
 
-static Palette *create_cmap(struct jpeg_decompress_struct * cinfo)
+METHODDEF(void)
+init_memory_source (j_decompress_ptr cinfo)
 {
-	int i, size;
-	Colour elem[256];
-	Colour additional[EXTRAS];
-	JSAMPARRAY cmap;
-
-	additional[0] = rgb(255, 255, 255);
-	additional[1] = rgb(0, 0, 0);
+}
 
-	size = cinfo->actual_number_of_colors;
-	cmap = cinfo->colormap;
+METHODDEF(boolean)
+fill_memory_input_buffer (j_decompress_ptr cinfo)
+{
+	/* The whole image was already there, so the data was
+	 * truncated. Insert a fake EOI marker, as the stdio
+	 * source manager does at the end of a file. */
+
+	WARNMS(cinfo, JWRN_JPEG_EOF);
+	cinfo->src->next_input_byte = fake_eoi;
+	cinfo->src->bytes_in_buffer = 2;
+	return TRUE;
+}
 
-	if (cinfo->out_color_components == 3) {
-		/* RGB data */
-		for (i=0; i < size; i++) {
-			/* copy palette from JPEG colormap */
-			elem[i] = rgb(cmap[0][i], cmap[1][i], cmap[2][i]);
-		}
-	}
-	else if (cinfo->out_color_components == 1) {
-		/* Greyscale */
-		for (i=0; i < size; i++) {
-			/* copy palette from JPEG colormap */
-			elem[i] = rgb(cmap[0][i], cmap[0][i], cmap[0][i]);
-		}
+METHODDEF(void)
+skip_memory_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+	struct jpeg_source_mgr *src = cinfo->src;
+
+	if (num_bytes <= 0)
+		return;
+	if ((size_t) num_bytes > src->bytes_in_buffer)
+		fill_memory_input_buffer(cinfo);
+	else {
+		src->next_input_byte += (size_t) num_bytes;
+		src->bytes_in_buffer -= (size_t) num_bytes;
 	}
+}
 
-	/* add some additional colours to the palette */
-	for (i = 0; (i < EXTRAS) && (i + size < 256); i++) {
-		elem[i + size] = additional[i];
-	}
+METHODDEF(void)
+term_memory_source (j_decompress_ptr cinfo)
+{
+}
 
-	return app_new_palette(size + EXTRAS, elem);
+static void jpeg_memory_src(j_decompress_ptr cinfo,
+		struct jpeg_source_mgr *src, byte *memsrc, int memsize)
+{
+	src->init_source = init_memory_source;
+	src->fill_input_buffer = fill_memory_input_buffer;
+	src->skip_input_data = skip_memory_input_data;
+	src->resync_to_restart = jpeg_resync_to_restart;
+	src->term_source = term_memory_source;
+	src->next_input_byte = (const JOCTET *) memsrc;
+	src->bytes_in_buffer = (size_t) memsize;
+	cinfo->src = src;
 }
 
 /*
- *  Create a colormap based on a palette, and add it to the JPEG structure.
- *  Sets the actual_number_of_colors field, and the colormap field.
- *  Flags quantize_colors as true to yield colormapped output.
+ *  Copy a row of JPEG samples into a row of Colours.
  */
-static void create_colormap(struct jpeg_decompress_struct * cinfo,
-		Palette *pal)
+static void copy_row(struct jpeg_decompress_struct * cinfo,
+		JSAMPROW src, Colour *dest)
 {
-	int i;
-	JSAMPARRAY cmap;
-
-	cmap = (*cinfo->mem->alloc_sarray)
-		((j_common_ptr) cinfo, JPOOL_IMAGE, pal->size, 3);
-
-	/* RGB data */
-	for (i=0; i < pal->size; i++) {
-		/* copy palette into JPEG colormap */
-		cmap[0][i] = pal->element[i].red;
-		cmap[1][i] = pal->element[i].green;
-		cmap[2][i] = pal->element[i].blue;
+	int i, r, g, b;
+	int width = cinfo->output_width;
+
+	if (cinfo->output_components == 1) {
+		/* Greyscale */
+		for (i=0; i < width; i++) {
+			g = src[i];
+			dest[i] = rgb(g,g,g);
+		}
+	}
+	else {
+		/* RGB data */
+		for (i=0; i < width; i++) {
+			r = src[i*3];
+			g = src[i*3+1];
+			b = src[i*3+2];
+			dest[i] = rgb(r,g,b);
+		}
 	}
+}
 
-	cinfo->quantize_colors = 1;
-	cinfo->desired_number_of_colors = pal->size;
-	cinfo->actual_number_of_colors = pal->size;
-	cinfo->colormap = cmap;
+/*
+ *  Free the temporary data used for 8-bit output.
+ */
+static void free_temporaries(Image *whole, Ditherer *ditherer,
+		Colour *rgb_row)
+{
+	if (whole)
+		app_del_image(whole);
+	if (ditherer)
+		app_del_ditherer(ditherer);
+	app_free(rgb_row);
 }
 
 /*
- *  Read a JPEG image from an open file.
+ *  Read a JPEG image from an open file, or from the reader's
+ *  memsrc if no file is open.
  *  Return IMAGE_ERROR is there is any error.
+ *
+ *  For 8-bit output, a palette given by the user is dithered to
+ *  as each row arrives. Otherwise the whole image is decoded
+ *  first, so a palette can be chosen from all of its colours,
+ *  and then dithered to.
  */
 
 int app_read_jpeg (ImageReader *reader)
@@ -236,14 +275,21 @@ int app_read_jpeg (ImageReader *reader)
 	 */
 	struct my_error_mgr	jerr;
 	struct my_progress_mgr	progress;
+	struct jpeg_source_mgr	memory;	/* used if reading memory */
 	JSAMPARRAY buffer;	/* Output row buffer */
 	int rowbytes;		/* byte row width in output buffer */
 	int row;
+	int denom, fit_width, fit_height;
+	Colour *src;
+	/* These are volatile so they can be freed after an error: */
+	Image * volatile whole = NULL;	/* whole image, to quantize */
+	Colour * volatile rgb_row = NULL;	/* row to dither */
+	Ditherer * volatile ditherer = NULL;
 
 	/* The file should already be open. */
 
 	reader->state = STARTING;
-	if (reader->file == NULL) {
+	if ((reader->file == NULL) && (reader->memsrc == NULL)) {
 		return IMAGE_ERROR;
 	}
 
@@ -266,6 +312,7 @@ int app_read_jpeg (ImageReader *reader)
 		 */
 
 		jpeg_destroy_decompress(&cinfo);
+		free_temporaries(whole, ditherer, rgb_row);
 		if (reader->error_func)
 			reader->error_func(reader);
 		return IMAGE_ERROR;
@@ -279,7 +326,11 @@ int app_read_jpeg (ImageReader *reader)
 
 	/* Step 2: specify data source (eg, a file). */
 
-	jpeg_stdio_src(&cinfo, reader->file);
+	if (reader->file)
+		jpeg_stdio_src(&cinfo, reader->file);
+	else
+		jpeg_memory_src(&cinfo, &memory, reader->memsrc,
+				reader->memsize);
 
 	/* Step 3: read file parameters with jpeg_read_header() */
 
@@ -292,26 +343,32 @@ int app_read_jpeg (ImageReader *reader)
 
 	/* Step 4: set parameters for decompression */
 
-	cinfo.scale_denom = 1; /* scale = 1:1 */
+	/* If the image must fit within max_width and max_height,
+	 * let the IDCT shrink it by 1/2, 1/4 or 1/8, as far as
+	 * it can without becoming smaller than the size it must
+	 * fit. The image reader resamples it the rest of the way. */
+
+	app_fit_image_size(reader, cinfo.image_width, cinfo.image_height,
+				&fit_width, &fit_height);
+	for (denom = 8; denom > 1; denom /= 2) {
+		if (((int) (cinfo.image_width + denom-1) / denom >= fit_width)
+		 && ((int) (cinfo.image_height + denom-1) / denom >= fit_height))
+			break;
+	}
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = denom; /* scale = 1:denom */
 	/* cinfo.dct_method = JDCT_FLOAT; */
 
 	/* Determine final width and height. */
-	reader->width = cinfo.image_width;
-	reader->height = cinfo.image_height;
+	jpeg_calc_output_dimensions(&cinfo);
+	reader->width = cinfo.output_width;
+	reader->height = cinfo.output_height;
 
 	reader->max_stages = 1;
 	reader->row = 0;
 	reader->rows_done = 0;
 	reader->row_height = 1;
 
-	if (reader->src_pal) {
-		create_colormap(&cinfo, reader->src_pal);
-	}
-	else if (reader->required_depth == 8) {
-		cinfo.quantize_colors = 1;
-		cinfo.desired_number_of_colors = reader->max_cmap_size;
-	}
-
 	/* Call startup function. */
 
 	if (reader->startup_func)
@@ -329,15 +386,6 @@ int app_read_jpeg (ImageReader *reader)
 	 * not possible with the stdio data source.
 	 */
 
-	if (reader->required_depth == 8)
-		reader->pal = create_cmap(&cinfo);
-
-	if (reader->after_dither_func)
-		if (! reader->after_dither_func(reader)) {
-			jpeg_destroy_decompress(&cinfo);
-			return IMAGE_ERROR;
-	}
- 
 	/* JSAMPLEs per row in output buffer */
 	rowbytes = cinfo.output_width * cinfo.output_components;
 
@@ -346,13 +394,44 @@ int app_read_jpeg (ImageReader *reader)
 	buffer = (*cinfo.mem->alloc_sarray)
 		((j_common_ptr) &cinfo, JPOOL_IMAGE, rowbytes, 1);
 
+	/* Choose the palette to dither to. */
+
+	if (reader->required_depth == 8)
+	{
+		if (reader->src_pal) {
+			reader->pal = app_new_palette(reader->src_pal->size,
+						reader->src_pal->element);
+			rgb_row = app_alloc(reader->width * sizeof(Colour));
+		}
+		else {
+			whole = app_new_image(reader->width, reader->height, 32);
+			while (cinfo.output_scanline < cinfo.output_height) {
+				row = reader->row = cinfo.output_scanline;
+				jpeg_read_scanlines(&cinfo, buffer, 1);
+				copy_row(&cinfo, buffer[0], whole->data32[row]);
+			}
+			reader->pal = app_quantize_rows(whole->data32,
+				reader->width, reader->height,
+				reader->max_cmap_size);
+		}
+		ditherer = app_new_ditherer(reader->pal, reader->width,
+					DIFFUSION_DITHER);
+	}
+
+	if (reader->after_dither_func)
+		if (! reader->after_dither_func(reader)) {
+			jpeg_destroy_decompress(&cinfo);
+			free_temporaries(whole, ditherer, rgb_row);
+			return IMAGE_ERROR;
+	}
+
 	/* Allocate the ImageReader data pointers. */
 
 	if (reader->required_depth == 8)
 	{
 		reader->data8 = app_alloc(reader->height * sizeof(void *));
 		for (row = 0; row < reader->height; row++)
-			reader->data8[row] = app_alloc(rowbytes);
+			reader->data8[row] = app_alloc(reader->width);
 	}
 	else if (reader->required_depth == 32)
 	{
@@ -364,55 +443,52 @@ int app_read_jpeg (ImageReader *reader)
 	/* Step 6: while (scan lines remain to be read) */
 	/*           jpeg_read_scanlines(...); */
 
-	/* Here we use the library's state variable cinfo.output_scanline
-	 * as the loop counter, so we don't have to keep track ourselves.
+	/* Rows already decoded into the whole image are taken from
+	 * there; otherwise each row is decoded as it is needed.
 	 */
 
 	reader->state = RENDERING;
 	reader->rows_done = 0;
 	reader->row_height = 1;
-	while (cinfo.output_scanline < cinfo.output_height) {
-		/* jpeg_read_scanlines expects an array of pointers
-		 * to scanlines. Here the array is only one element long,
-		 * but you could ask for more than one scanline at a
-		 * time if that's more convenient.
-		 */
-		row = reader->row = cinfo.output_scanline;
-		jpeg_read_scanlines(&cinfo, buffer, 1);
-
-		if (reader->required_depth == 8)
-			memcpy(reader->data8[row], buffer[0], rowbytes);
-		else if (cinfo.output_components == 1) {
-			int i,g;
-			for (i=0; i < reader->width; i++) {
-				g = buffer[0][i];
-				reader->data32[row][i] = rgb(g,g,g);
-			}
-		}
+	for (row = 0; row < (int) cinfo.output_height; row++) {
+		reader->row = row;
+		if (whole)
+			src = whole->data32[row];
 		else {
-			int i,r,g,b;
-			for (i=0; i < reader->width; i++) {
-				r = buffer[0][i*3];
-				g = buffer[0][i*3+1];
-				b = buffer[0][i*3+2];
-				reader->data32[row][i] = rgb(r,g,b);
-			}
+			/* jpeg_read_scanlines expects an array of pointers
+			 * to scanlines. Here the array is only one element
+			 * long, but you could ask for more than one scanline
+			 * at a time if that's more convenient.
+			 */
+			jpeg_read_scanlines(&cinfo, buffer, 1);
+			src = (rgb_row) ? rgb_row : reader->data32[row];
+			copy_row(&cinfo, buffer[0], src);
 		}
+
+		if (reader->required_depth == 8)
+			app_dither_row(ditherer, row, src, reader->data8[row]);
 		reader->rows_done++;
 
 		if (reader->progress_func)
 			if (! reader->progress_func(reader)) {
 				jpeg_destroy_decompress(&cinfo);
+				free_temporaries(whole, ditherer, rgb_row);
 				return IMAGE_ERROR;
 			}
 
 		if (reader->rendering_func)
 			if (! reader->rendering_func(reader)) {
 				jpeg_destroy_decompress(&cinfo);
+				free_temporaries(whole, ditherer, rgb_row);
 				return IMAGE_ERROR;
 			}
 	}
 
+	free_temporaries(whole, ditherer, rgb_row);
+	whole = NULL;
+	ditherer = NULL;
+	rgb_row = NULL;
+
 	/* Step 7: Finish decompression */
 
 	/* Release JPEG decompressor. */
@@ -5,6 +5,8 @@
  *
  *  Version: 3.00  2001/05/05  First release.
  *  Version: 3.56  2005/08/09  Silenced a size_t conversion warning.
+ *  Version: 3.71  2026/10/17  Dithering uses the shared ditherer.
+ *  Version: 3.72  2026/10/17  Reads PNG data held in memory.
  */
 
 /* Copyright (c) L. Patrick
@@ -17,7 +19,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-#include "app.h"
+#include "apputils.h"
 #include <png.h>
 
 /*
@@ -69,19 +71,19 @@
  *
  *  if (user_wants_8_bits)
  *    if (user_given_palette)
- *      png_set_dither(user_given_palette)
+ *      dither to user_given_palette
  *      if (tRNS)
  *        transparent pixels map to a single bgcolor
  *    else (no user_given_palette)
  *      if (PLTE) # indexed color or otherwise
- *         png_set_dither(PLTE)
+ *         dither to PLTE, or a median cut of it if too large
  *         if (tRNS)
  *           transparent pixels map to a single bgcolor
  *      else (no PLTE)
  *         if (greyscale)
  *           generate_greyscale_palette(depth, tRNS=None, bgcolor=None)
  *         else (must be RGB or RGBA)
- *           quantize_image_to_palette(image)
+ *           ordered dither to a colour cube
  *  else (user_wants_32_bits)
  *    expand all to ARGB format
  *
@@ -107,12 +109,26 @@ typedef struct Transformation
 	/* For indexed colour: */
 	Palette * pal;
 
+	/* For dithering: */
+	Ditherer *ditherer;
+	Colour *  rgb_row;
+	int       row;
+
 	/* For PLTE files: */
 	Palette * file_pal;
 } Transform;
 
 typedef void (*TransformFunc)(Transform *, byte *, byte *);
 
+static void free_transform(Transform *transform)
+{
+	if (transform->ditherer)
+		app_del_ditherer(transform->ditherer);
+	app_free(transform->rgb_row);
+	transform->ditherer = NULL;
+	transform->rgb_row = NULL;
+}
+
 static int palette_size(int bit_depth)
 {
 	switch (bit_depth) {
@@ -283,90 +299,6 @@ void transform_ga_to_ramp(Transform *transform, byte *row, byte *dest)
 	}
 }
 
-void transform_rgb_to_cube(Transform *transform, byte *row, byte *dest)
-{
-	/* RGB data, 8-bit samples. */
-	/* Transform to a colour cube + greyscale ramp. */
-	long i;
-	long width = transform->width;
-	int r, g, b, value;
-	int side = transform->side;
-	int greys = transform->greys;
-	int grey_start = transform->grey_start;
-	int grey_end = grey_start + greys;
-	int black_index = transform->black_index;
-	int white_index = transform->white_index;
-	long max_side = side - 1;
-	long max_grey = greys - 1;
-
-	for (i=0; i < width; i++) {
-		r = *row++;
-		g = *row++;
-		b = *row++;
-		if ((r == g) && (g == b) && (greys > 0)) {
-			value = grey_start - 1 + ((g * max_grey) / 255);
-			if (value < grey_start)
-				value = black_index;
-			else if (value >= grey_end)
-				value = white_index;
-			*dest++ = value;
-		}
-		else {
-			value = (r * max_side) / 255;
-			value *= side;
-			value += (g * max_side) / 255;
-			value *= side;
-			value += (b * max_side) / 255;
-			*dest++ = value;
-		}
-	}
-}
-
-void transform_rgba_to_cube(Transform *transform, byte *row, byte *dest)
-{
-	/* RGBA data, 8-bit samples. */
-	/* Transform to a colour cube + greyscale ramp + transparent entry. */
-	long i;
-	long width = transform->width;
-	int r, g, b, a, value;
-	int side = transform->side;
-	int greys = transform->greys;
-	int grey_start = transform->grey_start;
-	int grey_end = grey_start + greys;
-	int black_index = transform->black_index;
-	int white_index = transform->white_index;
-	int transparent = transform->transparent;
-	int transparent_index = transform->transparent_index;
-	long max_side = side - 1;
-	long max_grey = greys - 1;
-
-	for (i=0; i < width; i++) {
-		r = *row++;
-		g = *row++;
-		b = *row++;
-		a = *row++;
-		if ((a > 0x7F) && (transparent)) {
-			*dest++ = transparent_index;
-		}
-		else if ((r == g) && (g == b) && (greys > 0)) {
-			value = grey_start - 1 + (g * max_grey / 255);
-			if (value < grey_start)
-				value = black_index;
-			else if (value >= grey_end)
-				value = white_index;
-			*dest++ = value;
-		}
-		else {
-			value = (r * max_side) / 255;
-			value *= side;
-			value += (g * max_side) / 255;
-			value *= side;
-			value += (b * max_side) / 255;
-			*dest++ = value;
-		}
-	}
-}
-
 void dither_g(Transform *transform, byte *row, byte *dest)
 {
 	/* Greyscale data, 8-bit samples, significant bits highest. */
@@ -374,15 +306,13 @@ void dither_g(Transform *transform, byte *row, byte *dest)
 	long i;
 	long width = transform->width;
 	int g;
-	Colour *rgb_row;
+	Colour *rgb_row = transform->rgb_row;
 
-	rgb_row = app_alloc(width * sizeof(Colour));
 	for (i=0; i < width; i++) {
 		g = (*row++);
 		rgb_row[i] = rgb(g,g,g);
 	}
-	app_palette_translation(transform->pal, dest, width, rgb_row);
-	app_free(rgb_row);
+	app_dither_row(transform->ditherer, transform->row, rgb_row, dest);
 }
 
 void dither_ga(Transform *transform, byte *row, byte *dest)
@@ -392,17 +322,15 @@ void dither_ga(Transform *transform, byte *row, byte *dest)
 	long i;
 	long width = transform->width;
 	int g, a;
-	Colour *rgb_row;
+	Colour *rgb_row = transform->rgb_row;
 
-	rgb_row = app_alloc(width * sizeof(Colour));
 	for (i=0; i < width; i++) {
 		g = (*row++);
 		a = (*row++);
 		rgb_row[i] = rgb(g,g,g);
 		rgb_row[i].alpha = a;
 	}
-	app_palette_translation(transform->pal, dest, width, rgb_row);
-	app_free(rgb_row);
+	app_dither_row(transform->ditherer, transform->row, rgb_row, dest);
 }
 
 void dither_rgb(Transform *transform, byte *row, byte *dest)
@@ -412,17 +340,15 @@ void dither_rgb(Transform *transform, byte *row, byte *dest)
 	long i;
 	long width = transform->width;
 	int r, g, b;
-	Colour *rgb_row;
+	Colour *rgb_row = transform->rgb_row;
 
-	rgb_row = app_alloc(width * sizeof(Colour));
 	for (i=0; i < width; i++) {
 		r = (*row++);
 		g = (*row++);
 		b = (*row++);
 		rgb_row[i] = rgb(r,g,b);
 	}
-	app_palette_translation(transform->pal, dest, width, rgb_row);
-	app_free(rgb_row);
+	app_dither_row(transform->ditherer, transform->row, rgb_row, dest);
 }
 
 void dither_rgba(Transform *transform, byte *row, byte *dest)
@@ -432,9 +358,8 @@ void dither_rgba(Transform *transform, byte *row, byte *dest)
 	long i;
 	long width = transform->width;
 	int r, g, b, a;
-	Colour *rgb_row;
+	Colour *rgb_row = transform->rgb_row;
 
-	rgb_row = app_alloc(width * sizeof(Colour));
 	for (i=0; i < width; i++) {
 		r = (*row++);
 		g = (*row++);
@@ -443,13 +368,35 @@ void dither_rgba(Transform *transform, byte *row, byte *dest)
 		rgb_row[i] = rgb(r,g,b);
 		rgb_row[i].alpha = a;
 	}
-	app_palette_translation(transform->pal, dest, width, rgb_row);
-	app_free(rgb_row);
+	app_dither_row(transform->ditherer, transform->row, rgb_row, dest);
+}
+
+/*
+ * Read PNG data held in memory, where it lies:
+ */
+
+typedef struct MemorySource
+{
+	const byte * bytes;
+	long         length;
+	long         position;
+} MemorySource;
+
+static void read_png_memory(png_structp png_ptr, png_bytep data,
+	png_size_t length)
+{
+	MemorySource *src = (MemorySource *) png_get_io_ptr(png_ptr);
+
+	if ((long) length > src->length - src->position)
+		png_error(png_ptr, "Read past the end of the PNG data.");
+	memcpy(data, src->bytes + src->position, length);
+	src->position += (long) length;
 }
 
 /*
  * Read a PNG file.
- * Assume the file has been opened and is known to be a PNG file.
+ * Assume the file has been opened (or the reader's memsrc holds
+ * the PNG data) and is known to be a PNG file.
  */
 
 int app_read_png(ImageReader *reader)
@@ -471,9 +418,11 @@ int app_read_png(ImageReader *reader)
 	unsigned int y;
 	Transform transform;
 	TransformFunc transform_data;
+	int dither;
+	MemorySource memory;
 
 	reader->state = STOPPED;
-	if (reader->file == NULL)
+	if ((reader->file == NULL) && (reader->memsrc == NULL))
 		return IMAGE_ERROR;
 
 	/* Set starting state, call startup function. */
@@ -504,6 +453,9 @@ int app_read_png(ImageReader *reader)
 		return IMAGE_ERROR;
 	}
 
+	transform.ditherer = NULL;
+	transform.rgb_row = NULL;
+
 	/* Set error handling using the setjmp/longjmp method (this is the
 	 * normal method of doing things with libpng).  REQUIRED unless you set
 	 * up your own error handlers in the png_create_read_struct() earlier.
@@ -512,6 +464,7 @@ int app_read_png(ImageReader *reader)
 	{
 		/* Free all memory associated with the png_ptr and info_ptr */
 		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		free_transform(&transform);
 		/* If we get here, we had a problem reading the file */
 		reader->state = IMAGE_ERROR;
 		if (reader->error_func)
@@ -522,9 +475,18 @@ int app_read_png(ImageReader *reader)
 	/* Initialise some variables to stop spurious complaints */
 	data_ptr = NULL;
 	transform_data = transform_copy;
+	dither = -1;
 
 	/* Set up the input control if you are using standard C streams */
-	png_init_io(png_ptr, reader->file);
+	if (reader->file)
+		png_init_io(png_ptr, reader->file);
+	/* or read straight from memory */
+	else {
+		memory.bytes = reader->memsrc + sig_read;
+		memory.length = reader->memsize - sig_read;
+		memory.position = 0;
+		png_set_read_fn(png_ptr, &memory, read_png_memory);
+	}
 
 	/* If we have already read some of the signature */
 	png_set_sig_bytes(png_ptr, sig_read);
@@ -655,6 +617,22 @@ int app_read_png(ImageReader *reader)
 			png_set_gamma(png_ptr, screen_gamma, 0.45455);
 	}
 
+	/* Turn on interlace handling.  REQUIRED if you are not using
+	 * png_read_image().  To see how to handle interlacing passes,
+	 * see the png_read_row() method below:
+	 */
+	number_passes = png_set_interlace_handling(png_ptr);
+
+	/* Optional call to gamma correct and add the background to the palette
+	 * and update info structure.  REQUIRED if you are expecting libpng to
+	 * update the palette for you (ie you selected such a transform above).
+	 */
+	png_read_update_info(png_ptr, info_ptr);
+
+	/* Now the PLTE has been gamma corrected, so it matches the
+	 * expanded rows which will be dithered to it.
+	 */
+
 	/* Dither RGB files down to 8 bit palette or reduce palettes
 	 * to the number of colors available on your screen, if required.
 	 */
@@ -662,44 +640,23 @@ int app_read_png(ImageReader *reader)
 
 	if (reader->required_depth == 8)
 	{
-		int i, max, num_palette;
+		int i, max, num_palette, transparent;
 		Colour col;
 		png_colorp palette;
-		png_uint_16p histogram;
+		Histogram *h;
+
+		/* Diffuse errors, unless rows arrive out of order */
+		if (interlace_type == PNG_INTERLACE_NONE)
+			dither = DIFFUSION_DITHER;
+		else
+			dither = ORDERED_DITHER;
 
 		/* This reduces the image to the application supplied palette */
 		if (reader->src_pal) /* we have our own palette */
 		{
 			max = reader->src_pal->size;
-			/*
-			palette = app_alloc(sizeof(png_color) * max);
-
-			for (i=0; i < max; i++) {
-				col = reader->src_pal->element[i];
-				palette[i].red   = col.red;
-				palette[i].green = col.green;
-				palette[i].blue  = col.blue;
-			}
-
-			if (! png_get_hIST(png_ptr, info_ptr, &histogram))
-				histogram = NULL;
-
-			png_set_dither(png_ptr, palette, max, max, histogram, 0);
-
-			app_free(palette);
-			*/
 			reader->pal = app_new_palette(max, reader->src_pal->element);
 			transform.pal = reader->pal;
-			if (color_type == PNG_COLOR_TYPE_RGB)
-				transform_data = dither_rgb;
-			else if (color_type == PNG_COLOR_TYPE_RGB_ALPHA)
-				transform_data = dither_rgba;
-			else if (color_type == PNG_COLOR_TYPE_PALETTE)
-				transform_data = dither_rgba;
-			else if (color_type == PNG_COLOR_TYPE_GRAY)
-				transform_data = dither_g;
-			else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
-				transform_data = dither_ga;
 		}
 		/* This reduces the image to the palette supplied in the file */
 		else if (png_get_PLTE(png_ptr, info_ptr, &palette, &num_palette))
@@ -707,65 +664,56 @@ int app_read_png(ImageReader *reader)
 			max = reader->max_cmap_size;
 			if (max <= 0)
 				max = 256;
-			if (max > num_palette)
-				max = num_palette;
-
-			if (! png_get_hIST(png_ptr, info_ptr, &histogram))
-				histogram = NULL;
-
-			png_set_dither(png_ptr, palette, num_palette, max, histogram, 0);
-
-			reader->pal = app_new_palette(max, NULL);
-			for (i=0; i < max; i++) {
-				col = rgb(palette[i].red, palette[i].green, palette[i].blue);
-				reader->pal->element[i] = col;
+			transparent = (color_type & PNG_COLOR_MASK_ALPHA)
+				|| png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS);
+
+			if (num_palette + transparent <= max) {
+				/* copy the file's palette */
+				reader->pal = app_new_palette(num_palette
+						+ transparent, NULL);
+				for (i=0; i < num_palette; i++) {
+					col = rgb(palette[i].red,
+						palette[i].green,
+						palette[i].blue);
+					reader->pal->element[i] = col;
+				}
+				if (transparent)
+					reader->pal->element[i] =
+						argb(255,255,255,255);
+			}
+			else {
+				/* choose the best few of its colours */
+				h = app_new_histogram();
+				for (i=0; i < num_palette; i++) {
+					col = rgb(palette[i].red,
+						palette[i].green,
+						palette[i].blue);
+					app_add_to_histogram(h, &col, 1);
+				}
+				if (transparent) {
+					col = argb(255,255,255,255);
+					app_add_to_histogram(h, &col, 1);
+				}
+				reader->pal = app_histogram_palette(h, max);
+				app_del_histogram(h);
 			}
 			transform.pal = reader->pal;
-			if (color_type == PNG_COLOR_TYPE_RGB)
-				transform_data = dither_rgb;
-			else if (color_type == PNG_COLOR_TYPE_RGB_ALPHA)
-				transform_data = dither_rgba;
-			else if (color_type == PNG_COLOR_TYPE_PALETTE)
-				transform_data = dither_rgba;
-			else if (color_type == PNG_COLOR_TYPE_GRAY)
-				transform_data = dither_g;
-			else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
-				transform_data = dither_ga;
-		}
-		/* Quantize, or use a colour cube */
-		else if (color_type == PNG_COLOR_TYPE_RGB)
-		{
-			/* Because we're reading the image progresively,
-			 * quantization is not feasible (we'd have to read
-			 * the entire image first, then quantize to produce
-			 * a valid palette to use). So, we find the largest
-			 * colour cube we can, and use that approximation.
-			 */
-			max = reader->max_cmap_size;
-			if (max <= 0)
-				max = 256;
-
-			reader->pal = generate_colour_cube(max, 1, &transform);
-			transform_data = transform_rgb_to_cube;
 		}
-		/* Quantize, or use a colour cube, with transparency */
-		else if (color_type == PNG_COLOR_TYPE_RGB_ALPHA)
+		/* Progressive reading means the whole image is not
+		 * available to choose a palette from, so the largest
+		 * colour cube which fits is used instead, with an
+		 * ordered dither so each row can be done on its own.
+		 */
+		else if ((color_type == PNG_COLOR_TYPE_RGB)
+		      || (color_type == PNG_COLOR_TYPE_RGB_ALPHA)
+		      || (color_type == PNG_COLOR_TYPE_PALETTE))
 		{
 			max = reader->max_cmap_size;
 			if (max <= 0)
 				max = 256;
 
 			reader->pal = generate_colour_cube(max, 1, &transform);
-			transform_data = transform_rgba_to_cube;
-		}
-		/* Handle paletted images as RGBA, map to colour cube */
-		else if (color_type == PNG_COLOR_TYPE_PALETTE) {
-			max = reader->max_cmap_size;
-			if (max <= 0)
-				max = 256;
-
-			reader->pal = generate_colour_cube(max, 1, &transform);
-			transform_data = transform_rgba_to_cube;
+			dither = ORDERED_DITHER;
 		}
 		/* Generate a greyscale palette to use */
 		else if (color_type == PNG_COLOR_TYPE_GRAY)
@@ -777,6 +725,7 @@ int app_read_png(ImageReader *reader)
 
 			reader->pal = generate_greyscale_palette(max, 0, &transform);
 			transform_data = transform_g_to_ramp;
+			dither = -1;
 		}
 		/* Generate a greyscale palette with one transparent entry */
 		else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
@@ -788,6 +737,25 @@ int app_read_png(ImageReader *reader)
 
 			reader->pal = generate_greyscale_palette(max, 1, &transform);
 			transform_data = transform_ga_to_ramp;
+			dither = -1;
+		}
+
+		/* Set up the ditherer for the chosen palette */
+		if (dither >= 0)
+		{
+			if ((color_type == PNG_COLOR_TYPE_RGB_ALPHA)
+			 || (color_type == PNG_COLOR_TYPE_PALETTE))
+				transform_data = dither_rgba;
+			else if (color_type == PNG_COLOR_TYPE_RGB)
+				transform_data = dither_rgb;
+			else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+				transform_data = dither_ga;
+			else
+				transform_data = dither_g;
+
+			transform.ditherer = app_new_ditherer(transform.pal,
+						width, dither);
+			transform.rgb_row = app_alloc(width * sizeof(Colour));
 		}
 	}
 
@@ -795,21 +763,10 @@ int app_read_png(ImageReader *reader)
 	if (reader->after_dither_func)
 		if (! reader->after_dither_func(reader)) {
 			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+			free_transform(&transform);
 			return IMAGE_ERROR;
 		}
 
-	/* Turn on interlace handling.  REQUIRED if you are not using
-	 * png_read_image().  To see how to handle interlacing passes,
-	 * see the png_read_row() method below:
-	 */
-	number_passes = png_set_interlace_handling(png_ptr);
-
-	/* Optional call to gamma correct and add the background to the palette
-	 * and update info structure.  REQUIRED if you are expecting libpng to
-	 * update the palette for you (ie you selected such a transform above).
-	 */
-	png_read_update_info(png_ptr, info_ptr);
-
 	/* Allocate the memory to hold the image using the fields of info_ptr. */
 
 	rowbytes = png_get_rowbytes(png_ptr, info_ptr);
@@ -848,6 +805,7 @@ int app_read_png(ImageReader *reader)
 		for (y = 0; y < height; y++)
 		{
 			reader->row = y;
+			transform.row = y;
 
 			if (reader->required_depth == 8) {
 				png_read_rows(png_ptr, NULL, data_ptr, 1);
@@ -863,11 +821,13 @@ int app_read_png(ImageReader *reader)
 			if (reader->progress_func)
 				if (! reader->progress_func(reader)) {
 					png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+					free_transform(&transform);
 					return IMAGE_ERROR;
 				}
 			if (reader->rendering_func)
 				if (! reader->rendering_func(reader)) {
 					png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+					free_transform(&transform);
 					return IMAGE_ERROR;
 				}
 		}
@@ -876,6 +836,7 @@ int app_read_png(ImageReader *reader)
 	/* Free temporary array of data */
 	if (reader->required_depth == 8)
 		app_free(temp_data);
+	free_transform(&transform);
 
 	/* read rest of file, and get additional chunks in info_ptr - REQUIRED */
 	png_read_end(png_ptr, info_ptr);
@@ -7,6 +7,7 @@
  *  Version: 3.10  2001/12/01  Changed transparency bitfield from 1 to 5.
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
  *  Version: 3.57  2005/08/16  Now returns a success indicator.
+ *  Version: 3.71  2026/10/17  Added app_save_gif_memory.
  */
 
 /* Copyright (c) L. Patrick
@@ -32,7 +33,12 @@ static int bitsize(int cmap_length)
 	return depth;
 }
 
-int app_save_gif(Image *img, const char *filename, int interlace)
+/*
+ *  Write an image to the named file, or if filename is NULL,
+ *  into memory, setting *bytes and *nbytes.
+ */
+static int save_gif(Image *img, const char *filename, int interlace,
+	byte **bytes, int *nbytes)
 {
 	Gif *gif;
 	GifPalette *cmap;
@@ -41,6 +47,7 @@ int app_save_gif(Image *img, const char *filename, int interlace)
 	unsigned char *data;
 	GifBlock *block;
 	int i, depth, size;
+	long length;
 	Image *img8 = NULL;
 
 	/* Create a blank Gif: */
@@ -125,8 +132,13 @@ int app_save_gif(Image *img, const char *filename, int interlace)
 	gif->blocks = app_realloc(gif->blocks, size * sizeof(GifBlock *));
 	gif->blocks[size-1] = block;
 
-	/* Write the Gif file: */
-	write_gif_file(filename, gif);
+	/* Write the Gif file, or into memory: */
+	if (filename)
+		write_gif_file(filename, gif);
+	else {
+		*bytes = write_gif_memory(gif, &length);
+		*nbytes = (int) length;
+	}
 
 	/* Unlink the pixel data and clean up: */
 	pic->data = NULL;
@@ -137,3 +149,23 @@ int app_save_gif(Image *img, const char *filename, int interlace)
 
 	return 1;
 }
+
+int app_save_gif(Image *img, const char *filename, int interlace)
+{
+	return save_gif(img, filename, interlace, NULL, NULL);
+}
+
+/*
+ *  Write an image in GIF format into memory, returning the
+ *  bytes (which the caller must app_free) and setting *size.
+ *  Returns NULL on failure.
+ */
+byte * app_save_gif_memory(Image *img, int interlace, int *size)
+{
+	byte *bytes = NULL;
+
+	*size = 0;
+	if (! save_gif(img, NULL, interlace, &bytes, size))
+		return NULL;
+	return bytes;
+}
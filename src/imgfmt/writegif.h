@@ -3,3 +3,4 @@
  */
 
 int app_save_gif(Image *img, const char *filename, int interlace);
+byte * app_save_gif_memory(Image *img, int interlace, int *size);
@@ -5,6 +5,7 @@
  *
  *  Version: 3.57  2002/08/09  Added saving of PNG file format.
  *  Version: 3.60  2007/06/06  Can now save DPI.
+ *  Version: 3.71  2026/10/17  Added app_save_png_memory.
  */
 
 /* Copyright (c) L. Patrick and the LibPNG group.
@@ -16,15 +17,52 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include <png.h>
 #include "app.h"
 
+/*
+ *  A growable buffer for writing PNG data into memory:
+ */
+typedef struct PngBuffer {
+	byte *	bytes;
+	long	length;
+	long	capacity;
+} PngBuffer;
+
+static void write_png_memory(png_structp png_ptr, png_bytep data,
+	png_size_t length)
+{
+	PngBuffer *buf = (PngBuffer *) png_get_io_ptr(png_ptr);
+	byte *bytes;
+	long capacity;
+
+	if (buf->length + (long) length > buf->capacity) {
+		capacity = buf->capacity * 2;
+		if (capacity < buf->length + (long) length)
+			capacity = buf->length + (long) length + 4096;
+		bytes = app_realloc(buf->bytes, capacity);
+		if (bytes == NULL)
+			png_error(png_ptr, "Ran out of memory.");
+		buf->bytes = bytes;
+		buf->capacity = capacity;
+	}
+	memcpy(buf->bytes + buf->length, data, length);
+	buf->length += (long) length;
+}
+
+static void flush_png_memory(png_structp png_ptr)
+{
+}
+
 /*
  *  Write a PNG file, either as an 8bpp paletted image, or a 32bpp image.
+ *  If filename is NULL, the PNG data is written into buf instead.
  */
-int app_save_png(Image *img, const char *filename, int dpi, int interlace)
+static int save_png(Image *img, const char *filename, PngBuffer *buf,
+	int dpi, int interlace)
 {
-	FILE *fp;
+	FILE *fp = NULL;
 	png_structp png_ptr;
 	png_infop info_ptr;
 	png_colorp palette;
@@ -32,9 +70,11 @@ int app_save_png(Image *img, const char *filename, int dpi, int interlace)
 	int pass, number_passes;
 
 	/* open the file */
-	fp = fopen(filename, "wb");
-	if (fp == NULL)
-		return 0;
+	if (filename) {
+		fp = fopen(filename, "wb");
+		if (fp == NULL)
+			return 0;
+	}
 
 	/* Create and initialize the png_struct with the desired error
 	 * handler functions.
@@ -49,7 +89,8 @@ int app_save_png(Image *img, const char *filename, int dpi, int interlace)
 
 	if (png_ptr == NULL)
 	{
-		fclose(fp);
+		if (fp)
+			fclose(fp);
 		return 0;
 	}
 
@@ -57,7 +98,8 @@ int app_save_png(Image *img, const char *filename, int dpi, int interlace)
 	info_ptr = png_create_info_struct(png_ptr);
 	if (info_ptr == NULL)
 	{
-		fclose(fp);
+		if (fp)
+			fclose(fp);
 		png_destroy_write_struct(&png_ptr,  (png_infopp)NULL);
 		return 0;
 	}
@@ -68,14 +110,20 @@ int app_save_png(Image *img, const char *filename, int dpi, int interlace)
 	if (setjmp(png_ptr->jmpbuf))
 	{
 		/* If we get here, we had a problem reading the file */
-		fclose(fp);
+		if (fp)
+			fclose(fp);
 		png_destroy_write_struct(&png_ptr,  (png_infopp)NULL);
 		return 0;
 	}
 
 	/* One of the following I/O initialization functions is REQUIRED */
 	/* set up the output control if you are using standard C streams */
-	png_init_io(png_ptr, fp);
+	if (fp)
+		png_init_io(png_ptr, fp);
+	/* or write into a memory buffer */
+	else
+		png_set_write_fn(png_ptr, buf, write_png_memory,
+			flush_png_memory);
 
 	/* Set the image information here.  Width and height are up to 2^31,
 	 * bit_depth is one of 1, 2, 4, 8, or 16, but valid values also
@@ -260,9 +308,36 @@ int app_save_png(Image *img, const char *filename, int dpi, int interlace)
 	png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
 
 	/* close the file */
-	fclose(fp);
+	if (fp)
+		fclose(fp);
 
 	/* that's it */
 	return 1;
 }
 
+int app_save_png(Image *img, const char *filename, int dpi, int interlace)
+{
+	return save_png(img, filename, NULL, dpi, interlace);
+}
+
+/*
+ *  Write an image in PNG format into memory, returning the
+ *  bytes (which the caller must app_free) and setting *size.
+ *  Returns NULL on failure.
+ */
+byte * app_save_png_memory(Image *img, int dpi, int interlace, int *size)
+{
+	PngBuffer buf;
+
+	buf.bytes = NULL;
+	buf.length = 0;
+	buf.capacity = 0;
+	*size = 0;
+	if (! save_png(img, NULL, &buf, dpi, interlace)) {
+		app_free(buf.bytes);
+		return NULL;
+	}
+	*size = (int) buf.length;
+	return buf.bytes;
+}
+
@@ -3,3 +3,4 @@
  */
 
 int app_save_png(Image *img, const char *filename, int dpi, int interlace);
+byte * app_save_png_memory(Image *img, int dpi, int interlace, int *size);
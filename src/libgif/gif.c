@@ -10,6 +10,7 @@
  *  Version: 3.34  2002/12/18  Debugging code is now better encapsulated.
  *  Version: 3.56  2005/08/09  Silenced a size_t conversion warning.
  *  Version: 3.60  2007/06/06  Fixed a memory leak in del_gif.
+ *  Version: 3.71  2026/10/17  Reads and writes memory via GifStream.
  */
 
 /* Copyright (c) L. Patrick
@@ -76,50 +77,126 @@ void * gif_alloc(long bytes)
 
 /*
  *  GIF file input/output functions.
+ *
+ *  A GifStream is either a stdio file or a block of memory.
+ *  Memory is read where it lies, so a GIF held in memory is
+ *  never copied first. Memory being written is grown with
+ *  app_realloc as needed, and belongs to the caller afterwards.
  */
 
-static unsigned char read_byte(FILE *file)
+void init_gif_file_stream(GifStream *file, FILE *f)
 {
-	int ch = getc(file);
-	if (ch == EOF)
-		ch = 0;
-	return ch;
+	memset(file, 0, sizeof(GifStream));
+	file->file = f;
+}
+
+void init_gif_memory_stream(GifStream *file, const unsigned char *bytes,
+	long length)
+{
+	memset(file, 0, sizeof(GifStream));
+	file->bytes = (unsigned char *) bytes;
+	file->length = length;
+}
+
+static unsigned char read_byte(GifStream *file)
+{
+	int ch;
+
+	if (file->file) {
+		ch = getc(file->file);
+		if (ch == EOF)
+			ch = 0;
+		return ch;
+	}
+	if (file->position >= file->length)
+		return 0;
+	return file->bytes[file->position++];
 }
 
-static int write_byte(FILE *file, int ch)
+static int grow_stream(GifStream *file, long extra)
 {
-	return putc(ch, file);
+	unsigned char *bytes;
+	long capacity;
+
+	if (file->position + extra <= file->capacity)
+		return 1;
+	capacity = file->capacity * 2;
+	if (capacity < file->position + extra)
+		capacity = file->position + extra + 4096;
+	bytes = app_realloc(file->bytes, capacity);
+	if (bytes == NULL)
+		return 0;
+	file->bytes = bytes;
+	file->capacity = capacity;
+	return 1;
 }
 
-static int read_stream(FILE *file, unsigned char buffer[], int length)
+static int write_byte(GifStream *file, int ch)
 {
-	int count = (int) fread(buffer, 1, length, file);
-	int i = count;
+	if (file->file)
+		return putc(ch, file->file);
+	if (! grow_stream(file, 1))
+		return EOF;
+	file->bytes[file->position++] = ch;
+	if (file->length < file->position)
+		file->length = file->position;
+	return ch;
+}
+
+static int read_stream(GifStream *file, unsigned char buffer[], int length)
+{
+	int count, i;
+
+	if (file->file)
+		count = (int) fread(buffer, 1, length, file->file);
+	else {
+		count = length;
+		if (count > file->length - file->position)
+			count = (int) (file->length - file->position);
+		if (count < 0)
+			count = 0;
+		memcpy(buffer, file->bytes + file->position, count);
+		file->position += count;
+	}
+	i = count;
 	while (i < length)
 		buffer[i++] = '\0';
 	return count;
 }
 
-static int write_stream(FILE *file, unsigned char buffer[], int length)
+static int write_stream(GifStream *file, unsigned char buffer[], int length)
+{
+	if (file->file)
+		return (int) fwrite(buffer, 1, length, file->file);
+	if (! grow_stream(file, length))
+		return 0;
+	memcpy(file->bytes + file->position, buffer, length);
+	file->position += length;
+	if (file->length < file->position)
+		file->length = file->position;
+	return length;
+}
+
+unsigned char read_gif_char(GifStream *file)
 {
-	return (int) fwrite(buffer, 1, length, file);
+	return read_byte(file);
 }
 
-int read_gif_int(FILE *file)
+int read_gif_int(GifStream *file)
 {
 	int output;
 	unsigned char buf[2];
 
-	if (fread(buf, 1, 2, file) != 2)
+	if (read_stream(file, buf, 2) != 2)
 		return 0;
 	output = (((unsigned int) buf[1]) << 8) | buf[0];
 	return output;
 }
 
-void write_gif_int(FILE *file, int output)
+void write_gif_int(GifStream *file, int output)
 {
-	putc ( (output & 0xff), file);
-	putc ( (((unsigned int) output) >> 8) & 0xff, file);
+	write_byte(file, (output & 0xff));
+	write_byte(file, (((unsigned int) output) >> 8) & 0xff);
 }
 
 /*
@@ -147,7 +224,7 @@ void del_gif_data(GifData *data)
  *  This routine should be called until NULL is returned.
  *  Use app_free() to free the returned array of bytes.
  */
-GifData * read_gif_data(FILE *file)
+GifData * read_gif_data(GifStream *file)
 {
 	GifData *data;
 	int size;
@@ -169,7 +246,7 @@ GifData * read_gif_data(FILE *file)
  *  A Gif data block is a size-byte followed by that many
  *  bytes of data (0 to 255 of them).
  */
-void write_gif_data(FILE *file, GifData *data)
+void write_gif_data(GifStream *file, GifData *data)
 {
 	if (data) {
 		write_byte(file, data->byte_count);
@@ -218,7 +295,7 @@ void print_gif_data(FILE *file, GifData *data)
  *  and will automatically skip to the next block to find
  *  a new byte to read, or return 0 if there is no next block.
  */
-static unsigned char read_gif_byte(FILE *file, GifDecoder *decoder)
+static unsigned char read_gif_byte(GifStream *file, GifDecoder *decoder)
 {
 	unsigned char *buf = decoder->buf;
 	unsigned char next;
@@ -248,7 +325,7 @@ static unsigned char read_gif_byte(FILE *file, GifDecoder *decoder)
 /*
  *  Read to end of an image, including the zero block.
  */
-static void finish_gif_picture(FILE *file, GifDecoder *decoder)
+static void finish_gif_picture(GifStream *file, GifDecoder *decoder)
 {
 	unsigned char *buf = decoder->buf;
 
@@ -270,7 +347,7 @@ static void finish_gif_picture(FILE *file, GifDecoder *decoder)
  *  If FLUSH_OUTPUT is the char to be written, the buffer is
  *  written and an empty block appended.
  */
-static void write_gif_byte(FILE *file, GifEncoder *encoder, int ch)
+static void write_gif_byte(GifStream *file, GifEncoder *encoder, int ch)
 {
 	unsigned char *buf = encoder->buf;
 
@@ -314,7 +391,7 @@ void del_gif_palette(GifPalette *cmap)
 	app_free(cmap);
 }
 
-void read_gif_palette(FILE *file, GifPalette *cmap)
+void read_gif_palette(GifStream *file, GifPalette *cmap)
 {
 	int i;
 	unsigned char r, g, b;
@@ -329,7 +406,7 @@ void read_gif_palette(FILE *file, GifPalette *cmap)
 	}
 }
 
-void write_gif_palette(FILE *file, GifPalette *cmap)
+void write_gif_palette(GifStream *file, GifPalette *cmap)
 {
 	int i;
 	Colour c;
@@ -375,7 +452,7 @@ void del_gif_screen(GifScreen *screen)
 	app_free(screen);
 }
 
-void read_gif_screen(FILE *file, GifScreen *screen)
+void read_gif_screen(GifStream *file, GifScreen *screen)
 {
 	unsigned char info;
 
@@ -397,7 +474,7 @@ void read_gif_screen(FILE *file, GifScreen *screen)
 	}
 }
 
-void write_gif_screen(FILE *file, GifScreen *screen)
+void write_gif_screen(GifStream *file, GifScreen *screen)
 {
 	unsigned char info;
 
@@ -460,7 +537,7 @@ void del_gif_extension(GifExtension *ext)
 	app_free(ext);
 }
 
-void read_gif_extension(FILE *file, GifExtension *ext)
+void read_gif_extension(GifStream *file, GifExtension *ext)
 {
 	GifData *data;
 	int i;
@@ -477,7 +554,7 @@ void read_gif_extension(FILE *file, GifExtension *ext)
 	}
 }
 
-void write_gif_extension(FILE *file, GifExtension *ext)
+void write_gif_extension(GifStream *file, GifExtension *ext)
 {
 	int i;
 
@@ -516,7 +593,7 @@ void del_gif_decoder(GifDecoder *decoder)
 	app_free(decoder);
 }
 
-void init_gif_decoder(FILE *file, GifDecoder *decoder)
+void init_gif_decoder(GifStream *file, GifDecoder *decoder)
 {
 	int i, depth;
 	int lzw_min;
@@ -552,7 +629,7 @@ void init_gif_decoder(FILE *file, GifDecoder *decoder)
  *  bits to read, and uses a buffer in the decoder to remember
  *  bits from the last byte input.
  */
-int read_gif_code(FILE *file, GifDecoder *decoder)
+int read_gif_code(GifStream *file, GifDecoder *decoder)
 {
 	int code;
 	unsigned char next_byte;
@@ -611,7 +688,7 @@ static int trace_prefix(unsigned int *prefix, int code, int clear_code)
  *  The LZ decompression routine:
  *  Call this function once per scanline to fill in a picture.
  */
-void read_gif_line(FILE *file, GifDecoder *decoder,
+void read_gif_line(GifStream *file, GifDecoder *decoder,
 			unsigned char *line, int length)
 {
     int i = 0, j;
@@ -832,7 +909,7 @@ void del_gif_encoder(GifEncoder *encoder)
  *  before writing them. It uses the encoder to store
  *  codes until enough can be packaged into a whole byte.
  */
-void write_gif_code(FILE *file, GifEncoder *encoder, int code)
+void write_gif_code(GifStream *file, GifEncoder *encoder, int code)
 {
 	if (code == FLUSH_OUTPUT) {
 		/* write all remaining data */
@@ -873,7 +950,7 @@ void write_gif_code(FILE *file, GifEncoder *encoder, int code)
 /*
  *   Initialise the encoder, given a GifPalette depth.
  */
-void init_gif_encoder(FILE *file, GifEncoder *encoder, int depth)
+void init_gif_encoder(GifStream *file, GifEncoder *encoder, int depth)
 {
 	int lzw_min = depth = (depth < 2 ? 2 : depth);
 
@@ -903,7 +980,7 @@ void init_gif_encoder(FILE *file, GifEncoder *encoder, int depth)
  *  Write one scanline of pixels out to the Gif file,
  *  compressing that line using LZW into a series of codes.
  */
-void write_gif_line(FILE *file, GifEncoder *encoder, unsigned char *line, int length)
+void write_gif_line(GifStream *file, GifEncoder *encoder, unsigned char *line, int length)
 {
     int i = 0, current_code, new_code;
     unsigned long new_key;
@@ -956,7 +1033,7 @@ void write_gif_line(FILE *file, GifEncoder *encoder, unsigned char *line, int le
     encoder->current_code = current_code;
 }
 
-void flush_gif_encoder(FILE *file, GifEncoder *encoder)
+void flush_gif_encoder(GifStream *file, GifEncoder *encoder)
 {
 	write_gif_code(file, encoder, encoder->current_code);
 	write_gif_code(file, encoder, encoder->eof_code);
@@ -990,7 +1067,7 @@ void del_gif_picture(GifPicture *pic)
 	app_free(pic);
 }
 
-static void read_gif_picture_data(FILE *file, GifPicture *pic)
+static void read_gif_picture_data(GifStream *file, GifPicture *pic)
 {
 	GifDecoder *decoder;
 	long w, h;
@@ -1030,7 +1107,7 @@ static void read_gif_picture_data(FILE *file, GifPicture *pic)
 	del_gif_decoder(decoder);
 }
 
-void read_gif_picture(FILE *file, GifPicture *pic)
+void read_gif_picture(GifStream *file, GifPicture *pic)
 {
 	unsigned char info;
 
@@ -1054,7 +1131,7 @@ void read_gif_picture(FILE *file, GifPicture *pic)
 	read_gif_picture_data(file, pic);
 }
 
-static void write_gif_picture_data(FILE *file, GifPicture *pic)
+static void write_gif_picture_data(GifStream *file, GifPicture *pic)
 {
 	GifEncoder *encoder;
 	long w, h;
@@ -1089,7 +1166,7 @@ static void write_gif_picture_data(FILE *file, GifPicture *pic)
 	del_gif_encoder(encoder);
 }
 
-void write_gif_picture(FILE *file, GifPicture *pic)
+void write_gif_picture(GifStream *file, GifPicture *pic)
 {
 	unsigned char info;
 
@@ -1173,7 +1250,7 @@ void del_gif_block(GifBlock *block)
 	app_free(block);
 }
 
-void read_gif_block(FILE *file, GifBlock *block)
+void read_gif_block(GifStream *file, GifBlock *block)
 {
 	block->intro = read_byte(file);
 	if (block->intro == 0x2C) {
@@ -1186,7 +1263,7 @@ void read_gif_block(FILE *file, GifBlock *block)
 	}
 }
 
-void write_gif_block(FILE *file, GifBlock *block)
+void write_gif_block(GifStream *file, GifBlock *block)
 {
 	write_byte(file, block->intro);
 	if (block->pic)
@@ -1232,7 +1309,7 @@ void del_gif(Gif *gif)
 	app_free(gif);
 }
 
-void read_gif(FILE *file, Gif *gif)
+void read_gif(GifStream *file, Gif *gif)
 {
 	int i;
 	GifBlock *block;
@@ -1271,7 +1348,7 @@ void read_gif(FILE *file, Gif *gif)
 	}
 }
 
-void read_one_gif_picture(FILE *file, Gif *gif)
+void read_one_gif_picture(GifStream *file, Gif *gif)
 {
 	int i;
 	GifBlock *block;
@@ -1312,11 +1389,12 @@ void read_one_gif_picture(FILE *file, Gif *gif)
 	}
 }
 
-void write_gif(FILE *file, Gif *gif)
+void write_gif(GifStream *file, Gif *gif)
 {
 	int i;
 
-	fprintf(file, "%s", gif->header);
+	write_stream(file, (unsigned char *) gif->header,
+		(int) strlen(gif->header));
 	write_gif_screen(file, gif->screen);
 	for (i=0; i < gif->block_count; i++)
 		write_gif_block(file, gif->blocks[i]);
@@ -1343,18 +1421,20 @@ void print_gif(FILE *file, Gif *gif)
 Gif * read_gif_file(const char *filename)
 {
 	Gif *gif;
-	FILE *file;
+	FILE *f;
+	GifStream file;
 
-	file = app_open_file(filename, "rb");
-	if (file == NULL)
+	f = app_open_file(filename, "rb");
+	if (f == NULL)
 		return NULL;
 	gif = new_gif();
 	if (gif == NULL) {
-		app_close_file(file);
+		app_close_file(f);
 		return NULL;
 	}
-	read_gif(file, gif);
-	app_close_file(file);
+	init_gif_file_stream(&file, f);
+	read_gif(&file, gif);
+	app_close_file(f);
 	if (strncmp(gif->header, "GIF", 3) != 0) {
 		del_gif(gif);
 		gif = NULL;
@@ -1364,15 +1444,34 @@ Gif * read_gif_file(const char *filename)
 
 void write_gif_file(const char *filename, Gif *gif)
 {
-	FILE *file;
+	FILE *f;
+	GifStream file;
 
-	file = app_open_file(filename, "wb");
-	if (file == NULL)
+	f = app_open_file(filename, "wb");
+	if (f == NULL)
 		return;
 	if (gif == NULL) {
-		app_close_file(file);
+		app_close_file(f);
 		return;
 	}
-	write_gif(file, gif);
-	app_close_file(file);
+	init_gif_file_stream(&file, f);
+	write_gif(&file, gif);
+	app_close_file(f);
+}
+
+/*
+ *  Write a Gif into memory, returning the bytes, which the
+ *  caller must app_free, and setting their length.
+ */
+unsigned char * write_gif_memory(Gif *gif, long *length)
+{
+	GifStream file;
+
+	*length = 0;
+	if (gif == NULL)
+		return NULL;
+	init_gif_memory_stream(&file, NULL, 0);
+	write_gif(&file, gif);
+	*length = file.length;
+	return file.bytes;
 }
@@ -56,6 +56,20 @@ typedef struct {
   } Gif;
 
 
+/*
+ *  Gif files are read and written through a GifStream,
+ *  which is either a stdio file or a block of memory:
+ */
+
+typedef struct {
+    FILE *          file;       /* stdio file, or NULL for memory */
+    unsigned char * bytes;      /* memory to read or write */
+    long            length;     /* bytes of data in memory */
+    long            position;   /* next byte to read or write */
+    long            capacity;   /* bytes allocated, when writing */
+  } GifStream;
+
+
 /*
  *  Gif internal definitions:
  */
@@ -111,65 +125,70 @@ typedef struct {
 
 void * gif_alloc(long bytes);
 
-int 	read_gif_int(FILE *file);
-void	write_gif_int(FILE *file, int output);
+void	init_gif_file_stream(GifStream *file, FILE *f);
+void	init_gif_memory_stream(GifStream *file, const unsigned char *bytes, long length);
+
+unsigned char read_gif_char(GifStream *file);
+int 	read_gif_int(GifStream *file);
+void	write_gif_int(GifStream *file, int output);
 
 GifData * new_gif_data(int size);
-GifData * read_gif_data(FILE *file);
+GifData * read_gif_data(GifStream *file);
 void	del_gif_data(GifData *data);
-void	write_gif_data(FILE *file, GifData *data);
+void	write_gif_data(GifStream *file, GifData *data);
 void	print_gif_data(FILE *file, GifData *data);
 
 GifPalette * new_gif_palette(void);
 void	del_gif_palette(GifPalette *cmap);
-void	read_gif_palette(FILE *file, GifPalette *cmap);
-void	write_gif_palette(FILE *file, GifPalette *cmap);
+void	read_gif_palette(GifStream *file, GifPalette *cmap);
+void	write_gif_palette(GifStream *file, GifPalette *cmap);
 void	print_gif_palette(FILE *file, GifPalette *cmap);
 
 GifScreen * new_gif_screen(void);
 void	del_gif_screen(GifScreen *screen);
-void	read_gif_screen(FILE *file, GifScreen *screen);
-void	write_gif_screen(FILE *file, GifScreen *screen);
+void	read_gif_screen(GifStream *file, GifScreen *screen);
+void	write_gif_screen(GifStream *file, GifScreen *screen);
 void	print_gif_screen(FILE *file, GifScreen *screen);
 
 GifExtension *new_gif_extension(void);
 void	del_gif_extension(GifExtension *ext);
-void	read_gif_extension(FILE *file, GifExtension *ext);
-void	write_gif_extension(FILE *file, GifExtension *ext);
+void	read_gif_extension(GifStream *file, GifExtension *ext);
+void	write_gif_extension(GifStream *file, GifExtension *ext);
 void	print_gif_extension(FILE *file, GifExtension *ext);
 
 GifDecoder * new_gif_decoder(void);
 void	del_gif_decoder(GifDecoder *decoder);
-void	init_gif_decoder(FILE *file, GifDecoder *decoder);
+void	init_gif_decoder(GifStream *file, GifDecoder *decoder);
 
-int	read_gif_code(FILE *file, GifDecoder *decoder);
-void	read_gif_line(FILE *file, GifDecoder *decoder, unsigned char *line, int length);
+int	read_gif_code(GifStream *file, GifDecoder *decoder);
+void	read_gif_line(GifStream *file, GifDecoder *decoder, unsigned char *line, int length);
 
 GifEncoder * new_gif_encoder(void);
 void	del_gif_encoder(GifEncoder *encoder);
-void	write_gif_code(FILE *file, GifEncoder *encoder, int code);
-void	init_gif_encoder(FILE *file, GifEncoder *encoder, int depth);
-void	write_gif_line(FILE *file, GifEncoder *encoder, unsigned char *line, int length);
-void	flush_gif_encoder(FILE *file, GifEncoder *encoder);
+void	write_gif_code(GifStream *file, GifEncoder *encoder, int code);
+void	init_gif_encoder(GifStream *file, GifEncoder *encoder, int depth);
+void	write_gif_line(GifStream *file, GifEncoder *encoder, unsigned char *line, int length);
+void	flush_gif_encoder(GifStream *file, GifEncoder *encoder);
 
 GifPicture * new_gif_picture(void);
 void	del_gif_picture(GifPicture *pic);
-void	read_gif_picture(FILE *file, GifPicture *pic);
-void	write_gif_picture(FILE *file, GifPicture *pic);
+void	read_gif_picture(GifStream *file, GifPicture *pic);
+void	write_gif_picture(GifStream *file, GifPicture *pic);
 void	print_gif_picture(FILE *file, GifPicture *pic);
 
 GifBlock *new_gif_block(void);
 void	del_gif_block(GifBlock *block);
-void	read_gif_block(FILE *file, GifBlock *block);
-void	write_gif_block(FILE *file, GifBlock *block);
+void	read_gif_block(GifStream *file, GifBlock *block);
+void	write_gif_block(GifStream *file, GifBlock *block);
 void	print_gif_block(FILE *file, GifBlock *block);
 
 Gif *	new_gif(void);
 void	del_gif(Gif *gif);
-void	read_gif(FILE *file, Gif *gif);
-void	read_one_gif_picture(FILE *file, Gif *gif);
-void	write_gif(FILE *file, Gif *gif);
+void	read_gif(GifStream *file, Gif *gif);
+void	read_one_gif_picture(GifStream *file, Gif *gif);
+void	write_gif(GifStream *file, Gif *gif);
 void	print_gif(FILE *file, Gif *gif);
 
 Gif *	read_gif_file(const char *filename);
 void	write_gif_file(const char *filename, Gif *gif);
+unsigned char * write_gif_memory(Gif *gif, long *length);
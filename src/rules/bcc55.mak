@@ -40,7 +40,7 @@ APP_OBJECTS   = utility/apputil.obj  utility/array.obj    utility/border.obj   \
                 win32/cursor.obj     win32/drawbmap.obj   win32/drawwin.obj  \
                 win32/event.obj      win32/folder.obj     win32/font.obj     \
                 win32/graphics.obj   win32/init.obj       win32/timer.obj    \
-                win32/win.obj
+                win32/thread.obj     win32/win.obj
 
 GIF_OBJECTS   = libgif\gif.obj
 
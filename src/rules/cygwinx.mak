@@ -17,7 +17,7 @@ X11_INC_DIR      = /usr/X11R6/include
 CFLAGS        = -O2 -Wall -I. -Ix11 -Iutility -Igui -Ilibz -Ilibpng -Ilibjpeg -Ilibgif -I$(X11_INC_DIR)
 RM            = rm -f
 
-XLIBS         = -L$(X11_LIB_DIR) -lX11 -lc -lm
+XLIBS         = -L$(X11_LIB_DIR) -lX11 -lXext -lXrender -lpthread -lc -lm
 
 APP_OBJECTS   = utility/apputil.o  utility/array.o    utility/border.o   \
 		utility/clipline.o utility/compose.o  \
@@ -46,7 +46,8 @@ APP_OBJECTS   = utility/apputil.o  utility/array.o    utility/border.o   \
 		x11/clut.o         x11/cursor.o       x11/drawbmap.o  \
 		x11/drawwin.o      x11/event.o        x11/folder.o    \
 		x11/font.o         x11/graphics.o     x11/init.o      \
-		x11/keys2ucs.o     x11/timer.o        x11/win.o
+		x11/keys2ucs.o     x11/thread.o       x11/timer.o     \
+		x11/win.o
 
 GIF_OBJECTS   = libgif/gif.o
 
@@ -46,7 +46,7 @@ APP_OBJECTS   = utility/apputil.o  utility/array.o    utility/border.o   \
 		win32/cursor.o     win32/drawbmap.o   win32/drawwin.o  \
 		win32/event.o      win32/folder.o     win32/font.o     \
 		win32/graphics.o   win32/init.o       win32/timer.o    \
-		win32/win.o
+		win32/thread.o     win32/win.o
 
 GIF_OBJECTS   = libgif/gif.o
 
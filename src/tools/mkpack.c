@@ -0,0 +1,170 @@
+/*
+ *  MkPack
+ *  ------
+ *  This program compiles a portable font into font packs.
+ *
+ *  A portable font is normally a folder holding an information
+ *  file for each height and style (such as 16.txt or 12b.txt)
+ *  and a folder of sub-font images for each (16/ or 12b/).
+ *  Loading a sub-font from these means searching for the image,
+ *  decoding it, and parsing the information file for its widths.
+ *
+ *  A font pack holds all of the sub-fonts of one height and
+ *  style, with their widths and their images already converted,
+ *  in one file which the App library maps into memory. It is
+ *  named like the information file, but with a .gfp suffix
+ *  (16.gfp, 12b.gfp), and is placed beside it in the font's
+ *  folder. The library tries font packs before the loose files.
+ */
+
+/*
+ *  Usage:
+ *
+ *     mkpack font_folder [size ...]
+ *
+ *  Each size is a pixel height followed by the style letters
+ *  used in the font's file names: b for bold, i for italic and
+ *  a for anti-aliased. If no sizes are given, a pack is made for
+ *  every information file in the folder.
+ *
+ *  Examples:
+ *
+ *     mkpack fonts/unifont
+ *     mkpack fonts/serif 12 12b 16
+ *
+ *  Font packs can also be added to a program as resources,
+ *  using AddRes, instead of the information files and images:
+ *
+ *     addres prog -o prog2 fonts/unifont/16.gfp
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include <app.h>
+
+char *this_prog = "mkpack";
+
+void error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", this_prog, msg);
+}
+
+void usage(void)
+{
+	fprintf(stderr, "usage: %s font_folder [size ...]\n", this_prog);
+}
+
+void skipped(char *name, char *reason)
+{
+	fprintf(stderr, "%s: skipped %s (%s)\n", this_prog, name, reason);
+}
+
+/*
+ *  Work out the height and style from a name such as "12bi".
+ *  Returns 1 if the name makes sense, 0 if not.
+ */
+
+int parse_size(char *name, int *height, int *style)
+{
+	char *s;
+
+	if (! isdigit((unsigned char) name[0]))
+		return 0;
+	*height = (int) strtol(name, &s, 10);
+	*style = PLAIN;
+	for ( ; *s != '\0'; s++) {
+		if (*s == 'b')
+			*style |= BOLD;
+		else if (*s == 'i')
+			*style |= ITALIC;
+		else if (*s == 'a')
+			*style |= ANTI_ALIAS;
+		else
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ *  Make the pack for one size.
+ */
+
+int make_pack(char *folder, char *size)
+{
+	int height, style;
+	char *filename;
+
+	if (! parse_size(size, &height, &style)) {
+		skipped(size, "not a font size");
+		return -1;
+	}
+
+	filename = app_alloc(strlen(folder) + strlen(size) + 10);
+	if (! filename) {
+		error("out of memory");
+		return -1;
+	}
+	sprintf(filename, "%s/%s.gfp", folder, size);
+
+	if (! app_write_font_pack(folder, height, style, filename)) {
+		skipped(filename, "no information file or sub-fonts");
+		app_free(filename);
+		return -1;
+	}
+	fprintf(stdout, "    +   %-48s %10ld bytes\n", filename,
+		app_file_size(filename));
+	app_free(filename);
+	return 0;
+}
+
+/*
+ *  Make packs for every information file in a folder.
+ */
+
+int make_all_packs(char *folder)
+{
+	Folder *f;
+	char *name;
+	char size[64];
+	int length, height, style, result = 0;
+
+	f = app_open_folder(folder);
+	if (f == NULL) {
+		error("the font folder could not be opened");
+		return -1;
+	}
+	while ((name = app_read_folder(f)) != NULL) {
+		length = strlen(name);
+		if ((length < 5) || (length >= sizeof(size))
+		 || (strcmp(name+length-4, ".txt") != 0))
+			continue;
+		strcpy(size, name);
+		size[length-4] = '\0';
+		if (! parse_size(size, &height, &style))
+			continue;	/* not an information file */
+		if (make_pack(folder, size) != 0)
+			result = -1;
+	}
+	app_close_folder(f);
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, result = 0;
+
+	if (argc < 2) {
+		usage();
+		return 2;
+	}
+	if (argc == 2)
+		result = make_all_packs(argv[1]);
+	for (i=2; i < argc; i++) {
+		if (make_pack(argv[1], argv[i]) != 0)
+			result = -1;
+	}
+	return (result == 0) ? 0 : 1;
+}
@@ -9,6 +9,7 @@
  *  Version: 3.43  2003/04/25  Now deletes all cursors when deinitialised.
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
  *  Version: 3.56  2005/08/09  Silenced some size_t conversion warnings.
+ *  Version: 3.70  2026/10/17  Frees the App's cached subfonts.
  */
 
 /* Copyright (c) L. Patrick
@@ -68,6 +69,7 @@ void app_app_deinitialise(App *app)
 		app_del_cursor(app->cursors[i]);
 	for (i = app->num_fonts - 1; i >= 0; i--)
 		app_del_font(app->fonts[i]);
+	app_forget_font_cache(app);
 	while (app->num_timers)
 		app_del_timer(app->timers[0]);
 	app_free(app->program_name);
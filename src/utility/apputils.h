@@ -59,11 +59,17 @@ int 	app_window_draw_line(Graphics *g, Point p1, Point p2);
 
 int     app_load_native_font(Font *f, const char *name, int size, int height, int style);
 void    app_release_native_font(Font *f);
-void    app_release_native_subfont(Font *f, Subfont *sub);
+void    app_release_native_subfont(App *app, Subfont *sub);
 int     app_native_font_height(Font *f);
 int     app_native_font_width(Font *f);
 int     app_native_font_string_width(Font *f, const char *s, int nbytes);
 
+/* Subfonts (see utility/fontutil.c): */
+
+int     app_subfont_char_width(Subfont *sub, unsigned long ch);
+void    app_trim_font_cache(void);
+void    app_forget_font_cache(App *app);
+
 /* Composing Unicode characters: */
 
 long	app_compose_unicode(int accent, int letter);
@@ -80,6 +86,10 @@ int     app_forget_window(App *app, Window *win);
 int     app_remember_modal(App *app, Window *win);
 int     app_forget_modal(App *app, Window *win);
 
+/* Bitmaps cached by app_draw_image (see utility/image.c): */
+
+void    app_forget_image_caches(Window *win);
+
 /* Delayed-deletion functions: */
 
 int     app_remember_deleted_window(App *app, Window *win);
@@ -92,6 +102,38 @@ int     app_do_key_down(Window *win, unsigned long ch);
 int     app_send_key_value(Window *win, unsigned long ch, int pass_to);
 int     app_do_alt_key_down(Window *win, unsigned long ch, int alt);
 
+/* Worker threads (see x11/thread.c): */
+
+typedef void (*BandFunc)(void *data, int thread, int y1, int y2);
+
+int     app_worker_threads(void);
+void    app_run_bands(BandFunc func, void *data, int rows, int threads);
+
+/* Colour quantization and dithering (see utility/palette.c): */
+
+typedef struct Histogram Histogram;
+typedef struct Ditherer  Ditherer;
+
+Histogram * app_new_histogram(void);
+void        app_del_histogram(Histogram *h);
+void        app_add_to_histogram(Histogram *h, const Colour *row, int width);
+Palette *   app_histogram_palette(Histogram *h, int max_colours);
+Palette *   app_quantize_rows(Colour **rows, int width, int height, int max_colours);
+
+Ditherer *  app_new_ditherer(Palette *pal, int width, int method);
+void        app_del_ditherer(Ditherer *d);
+void        app_dither_row(Ditherer *d, int y, const Colour *src, byte *dest);
+
+/* Mapping files into memory (see x11/folder.c): */
+
+void *  app_map_file(const char *filepath, long *length);
+void    app_unmap_file(void *data, long length);
+
+/* Image readers (see imgfmt/imgread.c): */
+
+void    app_fit_image_size(ImageReader *reader, int width, int height,
+			int *fit_width, int *fit_height);
+
 /* Arrays: */
 
 void ** app_add_array_element(void **array, void *insertion);
@@ -15,6 +15,8 @@
  *  Version: 3.57  2005/08/16  Added layout options DOCK, FLOW, AUTOSIZE.
  *  Version: 3.58  2005/08/28  Silenced a size_t conversion warning.
  *  Version: 3.60  2007/06/06  Fixed some bugs. Added tooltip support!
+ *  Version: 3.70  2026/10/17  Redraws skip controls outside the damage.
+ *  Version: 3.74  2026/10/17  Added get_text handler for lazily made text.
  */
 
 /* Copyright (c) L. Patrick
@@ -522,11 +524,20 @@ Control *app_locate_control(Window *w, Point p)
  *  and destroy many Graphics objects for each redraw event, plus
  *  we inherit whatever clipping has already been set on the
  *  Window due to the redraw event itself.
+ *
+ *  While a window is redrawing damaged areas, a control lying
+ *  wholly outside the damage is skipped along with its children,
+ *  which lie within it. A control whose visible part misses the
+ *  damage is not drawn, though its children may still be.
  */
 void app_do_draw_controls(Graphics *g, int num, Control **list, int clear)
 {
 	int n, i;
 	Control *c;
+	Region *damage;
+	Rect r;
+
+	damage = g->win ? g->win->redraw_rgn : NULL;
 
 	for (n=num-1; n >= 0; n--) {
 		c = list[n];
@@ -534,19 +545,26 @@ void app_do_draw_controls(Graphics *g, int num, Control **list, int clear)
 		if ((c->state & VISIBLE) == 0)
 			continue;	/* skip invisible controls */
 
+		r = rect(c->offset.x, c->offset.y,
+			c->area.width, c->area.height);
+		if (damage && (! app_rect_intersects_region(r, damage)))
+			continue;	/* skip undamaged controls */
+
 		/* draw this control */
 		g->ctrl = c;
 		g->offset = c->offset;
 		app_set_clip_region(g, NULL);
-		if ((clear) && (c->bg.alpha <= 0x7F)) {
-			app_set_rgb(g, c->bg);
-			app_fill_rect(g, app_get_control_area(c));
+		if ((! damage) || (! app_region_is_empty(g->clip))) {
+			if ((clear) && (c->bg.alpha <= 0x7F)) {
+				app_set_rgb(g, c->bg);
+				app_fill_rect(g, app_get_control_area(c));
+			}
+			app_set_rgb(g, BLACK);
+			app_set_line_width(g, 1);
+			if (c->redraw)
+				for (i=0; c->redraw[i]; i++)
+					c->redraw[i](c, g);
 		}
-		app_set_rgb(g, BLACK);
-		app_set_line_width(g, 1);
-		if (c->redraw)
-			for (i=0; c->redraw[i]; i++)
-				c->redraw[i](c, g);
 
 		/* draw children of this control */
 		if (c->children)
@@ -1006,6 +1024,7 @@ static void app_del_control_tree(Control *c)
 	app_free(c->update);
 	app_free(c->refocus);
 	app_free(c->del);
+	app_free(c->get_text);
 	/* Discard this control. */
 	app_free(c);
 }
@@ -1037,7 +1056,7 @@ void app_del_control(Control *c)
  */
 static int app_set_control_natural(Control *c)
 {
-	if ((c->text != NULL) || (c->img != NULL)) {
+	if ((app_get_control_text(c) != NULL) || (c->img != NULL)) {
 		int w, h;
 		Window *win;
 
@@ -1180,6 +1199,12 @@ void app_on_control_deletion(Control *c, ControlFunc del)
 		app_add_array_element((void **) c->del, del);
 }
 
+void app_on_control_get_text(Control *c, ControlFunc get_text)
+{
+	c->get_text = (ControlFunc *)
+		app_add_array_element((void **) c->get_text, get_text);
+}
+
 void app_set_control_layout(Control *c, long flags)
 {
 	Rect *area;
@@ -1271,11 +1296,17 @@ Colour app_get_control_foreground(Control *c)
 
 /*
  *  Set or get a '\0' terminated text pointer associated with the control.
+ *  A control which keeps its text elsewhere, such as a text box,
+ *  can use a get_text handler to make the string when it's asked for.
+ *  Such a control leaves its text NULL until then, so setting its
+ *  text to NULL stores "" instead, which it can tell apart.
  */
 void app_set_control_text(Control *c, const char *text)
 {
 	if (c->text)
 		app_del_string(c->text);
+	if ((text == NULL) && c->get_text)
+		text = "";
 	c->text = app_copy_string(text);
 
 	app_update_control(c);
@@ -1283,6 +1314,12 @@ void app_set_control_text(Control *c, const char *text)
 
 char * app_get_control_text(Control *c)
 {
+	if (c->get_text) {
+		int i;
+
+		for (i=0; c->get_text[i]; i++)
+			c->get_text[i](c);
+	}
 	return c->text;
 }
 
@@ -11,6 +11,10 @@
  *  Version: 3.58  2002/08/28  Now allows greyscale text blending.
  *  Version: 3.59  2005/10/10  Supports over-sized glyphs.
  *  Version: 3.62  2010/02/24  Non-black drawing of glyphs with alpha.
+ *  Version: 3.64  2026/10/17  SSE2/AVX2 alpha blending kernels.
+ *  Version: 3.65  2026/10/17  Opaque runs copied, transparent runs skipped.
+ *  Version: 3.66  2026/10/17  Drawing moves on the image's generation.
+ *  Version: 3.67  2026/10/17  Trims the glyph cache before drawing text.
  */
 
 /* Copyright (c) L. Patrick
@@ -33,21 +37,6 @@
  */
 
 
-/*
- *  app_image_fill_rect:
- *
- *  Fill a rectangle with colour, in an image.
- *
- *  We assume the correct colour and pixel value (pixval) are
- *  already set. If the image is 32-bit, we just fill with the
- *  colour, performing 'alpha' colour blending (unless it's
- *  transparent, if which case nothing needs to be done at all).
- *  If the image is 8-bit, we fill using the pixval, but we don't
- *  do alpha blending, since that would be too difficult
- *  (we'd have to find the best blended colour from the palette
- *  for each pixel - very slow).
- */
-
 /*
  *  How to do alpha blending:
  *
@@ -98,6 +87,515 @@
  *	Dg = Sg + (Dg-Sg).Sa/256
  *	Db = Sb + (Db-Sb).Sa/256
  */
+
+/*
+ *  Alpha blending kernels:
+ *
+ *  The blending formulas above are applied to whole runs of
+ *  pixels by the functions below. There is a plain C version,
+ *  and, where the compiler supports them, SSE2 (4 pixels at a
+ *  time) and AVX2 (8 pixels at a time) versions. The fastest
+ *  version the CPU supports is chosen the first time a kernel
+ *  is used. Define APP_NO_SIMD to build only the C version.
+ *
+ *  The vector versions give exactly the same results as the C
+ *  version. C division truncates towards zero, so (D-S).Sa/256
+ *  is computed as ((D-S).Sa >> 8) when D >= S, and as
+ *  -((S-D).Sa >> 8) when D < S. Each product is at most
+ *  255*255, which fits in an unsigned 16-bit lane. Zeroing the
+ *  source alpha lane makes the same calculation produce
+ *  Da = (Da.Sa)/256 for the alpha channel.
+ *
+ *  A source alpha of 255 leaves the destination pixel alone.
+ *  (Using the formulas with Sa/256 = 255/256 would otherwise
+ *  darken it very slightly.) This means runs of transparent
+ *  pixels can simply be skipped, and runs of opaque pixels can
+ *  simply be copied, without changing the result.
+ */
+
+#ifndef APP_NO_SIMD
+  #if defined(__GNUC__) && (defined(__x86_64__) || defined(__SSE2__))
+    #define APP_BLEND_SSE2 1
+    #if defined(__clang__) || (__GNUC__ > 4) \
+	|| ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+      #define APP_BLEND_AVX2 1
+      #define APP_AVX2_FUNC __attribute__((target("avx2")))
+    #endif
+  #elif defined(_MSC_VER) && (defined(_M_X64) \
+	|| (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+    #define APP_BLEND_SSE2 1
+    #if (_MSC_VER >= 1800)
+      #define APP_BLEND_AVX2 1
+      #define APP_AVX2_FUNC
+    #endif
+  #endif
+#endif
+
+#ifdef APP_BLEND_SSE2
+  #include <emmintrin.h>
+#endif
+#ifdef APP_BLEND_AVX2
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#endif
+
+typedef void (*BlendRowFunc)(Colour *dst, const Colour *src, int n);
+typedef void (*BlendFillFunc)(Colour *dst, Colour col, int n);
+
+/*
+ *  Blend n source pixels onto n destination pixels,
+ *  working from left to right.
+ */
+static
+void app_blend_row_c(Colour *dst, const Colour *src, int n)
+{
+	int a, r, g, b;
+
+	while (n-- > 0)
+	{
+		a = src->alpha;
+		r = src->red;
+		g = src->green;
+		b = src->blue;
+		src++;
+
+		if (a != 0xFF) {
+			dst->alpha = ((dst->alpha*a)/256);
+			dst->red   = r+(((dst->red  -r)*a)/256);
+			dst->green = g+(((dst->green-g)*a)/256);
+			dst->blue  = b+(((dst->blue -b)*a)/256);
+		}
+		dst++;
+	}
+}
+
+/*
+ *  Blend n source pixels onto n destination pixels,
+ *  working from right to left (for overlapping rows).
+ */
+static
+void app_blend_row_backwards_c(Colour *dst, const Colour *src, int n)
+{
+	int a, r, g, b;
+
+	src += n - 1;
+	dst += n - 1;
+
+	while (n-- > 0)
+	{
+		a = src->alpha;
+		r = src->red;
+		g = src->green;
+		b = src->blue;
+		src--;
+
+		if (a != 0xFF) {
+			dst->alpha = ((dst->alpha*a)/256);
+			dst->red   = r+(((dst->red  -r)*a)/256);
+			dst->green = g+(((dst->green-g)*a)/256);
+			dst->blue  = b+(((dst->blue -b)*a)/256);
+		}
+		dst--;
+	}
+}
+
+/*
+ *  Blend one colour onto n destination pixels.
+ */
+static
+void app_blend_fill_c(Colour *dst, Colour col, int n)
+{
+	int a, r, g, b;
+
+	a = col.alpha;
+	r = col.red;
+	g = col.green;
+	b = col.blue;
+
+	while (n-- > 0)
+	{
+		dst->alpha = ((dst->alpha*a)/256);
+		dst->red   = r+(((dst->red  -r)*a)/256);
+		dst->green = g+(((dst->green-g)*a)/256);
+		dst->blue  = b+(((dst->blue -b)*a)/256);
+		dst++;
+	}
+}
+
+#ifdef APP_BLEND_SSE2
+
+/*
+ *  Blend two pixels held as eight 16-bit lanes (alpha,red,green,blue).
+ *  The source alpha lanes must already be zero.
+ */
+static
+__m128i app_blend_lanes_sse2(__m128i s, __m128i d, __m128i a)
+{
+	__m128i pos, neg, keep;
+
+	pos = _mm_srli_epi16(_mm_mullo_epi16(_mm_subs_epu16(d, s), a), 8);
+	neg = _mm_srli_epi16(_mm_mullo_epi16(_mm_subs_epu16(s, d), a), 8);
+	s = _mm_sub_epi16(_mm_add_epi16(s, pos), neg);
+
+	/* transparent source pixels leave the destination alone */
+	keep = _mm_cmpeq_epi16(a, _mm_set1_epi16(0xFF));
+
+	return _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s));
+}
+
+static
+void app_blend_row_sse2(Colour *dst, const Colour *src, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i mask = _mm_set_epi16(-1,-1,-1,0,-1,-1,-1,0);
+	__m128i s, d, s16, d16, a16, lo, hi;
+	int i;
+
+	for (i=0; i + 4 <= n; i += 4)
+	{
+		s = _mm_loadu_si128((const __m128i *) (src + i));
+		d = _mm_loadu_si128((const __m128i *) (dst + i));
+
+		s16 = _mm_unpacklo_epi8(s, zero);
+		d16 = _mm_unpacklo_epi8(d, zero);
+		a16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, 0), 0);
+		lo  = app_blend_lanes_sse2(_mm_and_si128(s16, mask), d16, a16);
+
+		s16 = _mm_unpackhi_epi8(s, zero);
+		d16 = _mm_unpackhi_epi8(d, zero);
+		a16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, 0), 0);
+		hi  = app_blend_lanes_sse2(_mm_and_si128(s16, mask), d16, a16);
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+	}
+
+	app_blend_row_c(dst + i, src + i, n - i);
+}
+
+static
+void app_blend_fill_sse2(Colour *dst, Colour col, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i s16, a16, d, lo, hi;
+	int i;
+
+	s16 = _mm_set_epi16(col.blue, col.green, col.red, 0,
+				col.blue, col.green, col.red, 0);
+	a16 = _mm_set1_epi16(col.alpha);
+
+	for (i=0; i + 4 <= n; i += 4)
+	{
+		d  = _mm_loadu_si128((const __m128i *) (dst + i));
+		lo = app_blend_lanes_sse2(s16, _mm_unpacklo_epi8(d, zero), a16);
+		hi = app_blend_lanes_sse2(s16, _mm_unpackhi_epi8(d, zero), a16);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+	}
+
+	app_blend_fill_c(dst + i, col, n - i);
+}
+
+#endif /* APP_BLEND_SSE2 */
+
+#ifdef APP_BLEND_AVX2
+
+/*
+ *  The AVX2 versions work the same way on 8 pixels at a time.
+ *  The unpack, shuffle and pack instructions all work within
+ *  each 128-bit half, so the pixel order is preserved.
+ */
+static APP_AVX2_FUNC
+__m256i app_blend_lanes_avx2(__m256i s, __m256i d, __m256i a)
+{
+	__m256i pos, neg, keep;
+
+	pos = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_subs_epu16(d, s), a), 8);
+	neg = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_subs_epu16(s, d), a), 8);
+	s = _mm256_sub_epi16(_mm256_add_epi16(s, pos), neg);
+
+	keep = _mm256_cmpeq_epi16(a, _mm256_set1_epi16(0xFF));
+
+	return _mm256_blendv_epi8(s, d, keep);
+}
+
+static APP_AVX2_FUNC
+void app_blend_row_avx2(Colour *dst, const Colour *src, int n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i mask = _mm256_set_epi16(-1,-1,-1,0,-1,-1,-1,0,
+						-1,-1,-1,0,-1,-1,-1,0);
+	__m256i s, d, s16, d16, a16, lo, hi;
+	int i;
+
+	for (i=0; i + 8 <= n; i += 8)
+	{
+		s = _mm256_loadu_si256((const __m256i *) (src + i));
+		d = _mm256_loadu_si256((const __m256i *) (dst + i));
+
+		s16 = _mm256_unpacklo_epi8(s, zero);
+		d16 = _mm256_unpacklo_epi8(d, zero);
+		a16 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, 0), 0);
+		lo  = app_blend_lanes_avx2(_mm256_and_si256(s16, mask), d16, a16);
+
+		s16 = _mm256_unpackhi_epi8(s, zero);
+		d16 = _mm256_unpackhi_epi8(d, zero);
+		a16 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, 0), 0);
+		hi  = app_blend_lanes_avx2(_mm256_and_si256(s16, mask), d16, a16);
+
+		_mm256_storeu_si256((__m256i *) (dst + i),
+					_mm256_packus_epi16(lo, hi));
+	}
+
+	app_blend_row_sse2(dst + i, src + i, n - i);
+}
+
+static APP_AVX2_FUNC
+void app_blend_fill_avx2(Colour *dst, Colour col, int n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i s16, a16, d, lo, hi;
+	int i;
+
+	s16 = _mm256_set_epi16(col.blue, col.green, col.red, 0,
+				col.blue, col.green, col.red, 0,
+				col.blue, col.green, col.red, 0,
+				col.blue, col.green, col.red, 0);
+	a16 = _mm256_set1_epi16(col.alpha);
+
+	for (i=0; i + 8 <= n; i += 8)
+	{
+		d  = _mm256_loadu_si256((const __m256i *) (dst + i));
+		lo = app_blend_lanes_avx2(s16, _mm256_unpacklo_epi8(d, zero), a16);
+		hi = app_blend_lanes_avx2(s16, _mm256_unpackhi_epi8(d, zero), a16);
+		_mm256_storeu_si256((__m256i *) (dst + i),
+					_mm256_packus_epi16(lo, hi));
+	}
+
+	app_blend_fill_sse2(dst + i, col, n - i);
+}
+
+/*
+ *  Ask the CPU (and operating system) whether AVX2 can be used.
+ */
+static
+int app_cpu_has_avx2(void)
+{
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return 0;
+	__cpuid(info, 1);
+	if ((info[2] & (3 << 27)) != (3 << 27))	/* OSXSAVE and AVX */
+		return 0;
+	if ((_xgetbv(0) & 6) != 6)	/* OS saves the YMM registers */
+		return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;	/* AVX2 */
+#endif
+}
+
+#endif /* APP_BLEND_AVX2 */
+
+/*
+ *  The kernels in use start out pointing at functions which
+ *  choose the best kernels, then pass the call on to them.
+ */
+static void app_blend_row_first(Colour *dst, const Colour *src, int n);
+static void app_blend_fill_first(Colour *dst, Colour col, int n);
+
+static BlendRowFunc  app_blend_row  = app_blend_row_first;
+static BlendFillFunc app_blend_fill = app_blend_fill_first;
+
+static
+void app_choose_blend_kernels(void)
+{
+	BlendRowFunc  row  = app_blend_row_c;
+	BlendFillFunc fill = app_blend_fill_c;
+
+#ifdef APP_BLEND_SSE2
+	row  = app_blend_row_sse2;
+	fill = app_blend_fill_sse2;
+#endif
+#ifdef APP_BLEND_AVX2
+	if (app_cpu_has_avx2()) {
+		row  = app_blend_row_avx2;
+		fill = app_blend_fill_avx2;
+	}
+#endif
+
+	app_blend_row  = row;
+	app_blend_fill = fill;
+}
+
+static
+void app_blend_row_first(Colour *dst, const Colour *src, int n)
+{
+	app_choose_blend_kernels();
+	app_blend_row(dst, src, n);
+}
+
+static
+void app_blend_fill_first(Colour *dst, Colour col, int n)
+{
+	app_choose_blend_kernels();
+	app_blend_fill(dst, col, n);
+}
+
+/*
+ *  Copying rows of pixels with alpha blending:
+ *
+ *  Many images are mostly opaque (backgrounds, photos) or have
+ *  large transparent areas (icons, sprites, overlays). Rather
+ *  than blending every pixel, the functions below look for runs
+ *  of opaque pixels, which are copied using memmove, and runs of
+ *  transparent pixels, which are skipped. Only the pixels in
+ *  between are blended. Short opaque or transparent runs are
+ *  left inside the blended run, which gives the same result, so
+ *  that anti-aliased edges still blend many pixels at once.
+ */
+
+#define APP_MIN_ALPHA_RUN 8
+
+/*
+ *  Find the end of a run of pixels, starting at src, which all
+ *  have the same alpha as the first one (which is 0 or 255).
+ */
+static
+const Colour * app_alpha_run_end(const Colour *src, const Colour *end)
+{
+	byte alpha = src->alpha;
+#ifdef APP_BLEND_SSE2
+	const __m128i want = _mm_set1_epi8((char) alpha);
+	__m128i same;
+
+	/* compare the alpha bytes of four pixels at a time */
+	while (end - src >= 4)
+	{
+		same = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) src), want);
+		if ((_mm_movemask_epi8(same) & 0x1111) != 0x1111)
+			break;
+		src += 4;
+	}
+#endif
+
+	while ((src < end) && (src->alpha == alpha))
+		src++;
+	return src;
+}
+
+/*
+ *  Find the end of a run of pixels which should be blended.
+ *  The run stops before the next long opaque or transparent run.
+ */
+static
+const Colour * app_blend_run_end(const Colour *src, const Colour *end)
+{
+	const Colour *run_end;
+
+	while (src < end)
+	{
+		if ((src->alpha != 0x00) && (src->alpha != 0xFF)) {
+			src++;
+			continue;
+		}
+		run_end = app_alpha_run_end(src, end);
+		if (run_end - src >= APP_MIN_ALPHA_RUN)
+			break;
+		src = run_end;
+	}
+	return src;
+}
+
+/*
+ *  Copy n pixels from src onto dst, from left to right.
+ */
+static
+void app_copy_blend_row(Colour *dst, const Colour *src, int n)
+{
+	const Colour *end = src + n;
+	const Colour *start;
+
+	while (src < end)
+	{
+		start = src;
+
+		if (src->alpha == 0x00) {
+			/* opaque: just copy the pixels */
+			src = app_alpha_run_end(src, end);
+			memmove(dst, start, (src - start) * sizeof(Colour));
+		}
+		else if (src->alpha == 0xFF) {
+			/* transparent: nothing to draw */
+			src = app_alpha_run_end(src, end);
+		}
+		else {
+			src = app_blend_run_end(src, end);
+			app_blend_row(dst, start, (int) (src - start));
+		}
+		dst += src - start;
+	}
+}
+
+/*
+ *  Copy n pixels from src onto dst, from right to left.
+ *  This is used when dst is to the right of src in the same row,
+ *  so the runs are found and copied starting from the right.
+ */
+static
+void app_copy_blend_row_backwards(Colour *dst, const Colour *src, int n)
+{
+	const Colour *begin = src;
+	const Colour *end;
+	byte alpha;
+
+	src += n;
+	dst += n;
+
+	while (src > begin)
+	{
+		end = src;
+		alpha = src[-1].alpha;
+
+		if ((alpha == 0x00) || (alpha == 0xFF)) {
+			while ((src > begin) && (src[-1].alpha == alpha))
+				src--;
+		}
+		else {
+			while ((src > begin) && (src[-1].alpha != 0x00)
+					&& (src[-1].alpha != 0xFF))
+				src--;
+		}
+		dst -= end - src;
+
+		if (alpha == 0x00)
+			memmove(dst, src, (end - src) * sizeof(Colour));
+		else if (alpha != 0xFF)
+			app_blend_row_backwards_c(dst, src, (int) (end - src));
+	}
+}
+
+
+/*
+ *  app_image_fill_rect:
+ *
+ *  Fill a rectangle with colour, in an image.
+ *
+ *  We assume the correct colour and pixel value (pixval) are
+ *  already set. If the image is 32-bit, we just fill with the
+ *  colour, performing 'alpha' colour blending (unless it's
+ *  transparent, if which case nothing needs to be done at all).
+ *  If the image is 8-bit, we fill using the pixval, but we don't
+ *  do alpha blending, since that would be too difficult
+ *  (we'd have to find the best blended colour from the palette
+ *  for each pixel - very slow).
+ */
+
 int app_image_fill_rect(Graphics *dst, Rect dr)
 {
 	int i, num_rects;
@@ -106,11 +604,12 @@ int app_image_fill_rect(Graphics *dst, Rect dr)
 	int x, y, end_y, pixval;
 	byte *dst8;
 	Colour *dst32, colour;
-	int a, r, g, b;
 
 	if (dst->colour.alpha == 0xFF)
 		return 1; /* nothing to draw if colour is transparent */
 
+	app_image_changed(dst->img);
+
 	/* correct drawing displacement */
 	dr.x += dst->offset.x;
 	dr.y += dst->offset.y;
@@ -172,11 +671,6 @@ int app_image_fill_rect(Graphics *dst, Rect dr)
 	{
 		/* blend with the partially transparent colour */
 
-		a = colour.alpha;
-		r = colour.red;
-		g = colour.green;
-		b = colour.blue;
-
 		for (i=0; i < num_rects; i++) {
 			clipped = app_clip_rect(dr, rects[i]);
 			if (clipped.width == 0)
@@ -190,14 +684,7 @@ int app_image_fill_rect(Graphics *dst, Rect dr)
 			for (y=clipped.y; y < end_y; y++)
 			{
 			  dst32 = & dst->img->data32[y][clipped.x];
-			  for (x=0; x < clipped.width; x++)
-			  {
-			    dst32->alpha = ((dst32->alpha*a)/256);
-			    dst32->red   = r+(((dst32->red  -r)*a)/256);
-			    dst32->green = g+(((dst32->green-g)*a)/256);
-			    dst32->blue  = b+(((dst32->blue -b)*a)/256);
-			    dst32++;
-			  }
+			  app_blend_fill(dst32, colour, clipped.width);
 			}
 		}
 	}
@@ -264,6 +751,8 @@ int app_image_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 	int a, r, g, b;
 	Palette p;
 
+	app_image_changed(dst->img);
+
 	/* correct drawing displacement */
 	dp.x += dst->offset.x;
 	dp.y += dst->offset.y;
@@ -306,7 +795,8 @@ int app_image_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 	if ((src->img->depth == 32) && (dst->img->depth == 32))
 	{
-	  /* perform full alpha blending for each 32-bit pixel */
+	  /* alpha blend 32-bit pixels, copying opaque runs and */
+	  /* skipping transparent runs */
 
 	  for (i=0; i < num_rects; i++) {
 		clipped = app_clip_rect(dr, rects[i]);
@@ -319,97 +809,32 @@ int app_image_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 		end_y = clipped.y + clipped.height;
 
-		if (ydiff >= 0) {	/* upwards: copy top to bottom */
-		  if (xdiff >= 0) {	/* leftwards: copy left to right */
+		/* within one row of the same image, pixels moving */
+		/* rightwards must be blended from right to left */
+
+		if ((src->img == dst->img) && (ydiff == 0) && (xdiff < 0)) {
 		    for (y=clipped.y; y < end_y; y++)
 		    {
 		      src32 = & src->img->data32[y+ydiff][clipped.x+xdiff];
 		      dst32 = & dst->img->data32[y][clipped.x];
-		      for (x=0; x < clipped.width; x++)
-		      {
-			a = src32->alpha;
-			r = src32->red;
-			g = src32->green;
-			b = src32->blue;
-			src32++; /* move right */
-
-			dst32->alpha = ((dst32->alpha*a)/256);
-			dst32->red   = r+(((dst32->red  -r)*a)/256);
-			dst32->green = g+(((dst32->green-g)*a)/256);
-			dst32->blue  = b+(((dst32->blue -b)*a)/256);
-			dst32++; /* move right */
-		      }
+		      app_copy_blend_row_backwards(dst32, src32, clipped.width);
 		    }
-		  }
-		  else {		/* rightwards: copy right to left */
+		}
+		else if (ydiff >= 0) {	/* upwards: copy top to bottom */
 		    for (y=clipped.y; y < end_y; y++)
 		    {
 		      src32 = & src->img->data32[y+ydiff][clipped.x+xdiff];
 		      dst32 = & dst->img->data32[y][clipped.x];
-		      src32 += clipped.width - 1; /* start on right */
-		      dst32 += clipped.width - 1; /* start on right */
-		      for (x=0; x < clipped.width; x++)
-		      {
-			a = src32->alpha;
-			r = src32->red;
-			g = src32->green;
-			b = src32->blue;
-			src32--; /* move left */
-
-			dst32->alpha = ((dst32->alpha*a)/256);
-			dst32->red   = r+(((dst32->red  -r)*a)/256);
-			dst32->green = g+(((dst32->green-g)*a)/256);
-			dst32->blue  = b+(((dst32->blue -b)*a)/256);
-			dst32--; /* move left */
-		      }
+		      app_copy_blend_row(dst32, src32, clipped.width);
 		    }
-		  }
 		}
 		else {			/* downwards: copy bottom to top */
-		  if (xdiff >= 0) {	/* leftwards: copy left to right */
 		    for (y=end_y-1; y >= clipped.y; y--)
 		    {
 		      src32 = & src->img->data32[y+ydiff][clipped.x+xdiff];
 		      dst32 = & dst->img->data32[y][clipped.x];
-		      for (x=0; x < clipped.width; x++)
-		      {
-			a = src32->alpha;
-			r = src32->red;
-			g = src32->green;
-			b = src32->blue;
-			src32++; /* move right */
-
-			dst32->alpha = ((dst32->alpha*a)/256);
-			dst32->red   = r+(((dst32->red  -r)*a)/256);
-			dst32->green = g+(((dst32->green-g)*a)/256);
-			dst32->blue  = b+(((dst32->blue -b)*a)/256);
-			dst32++; /* move right */
-		      }
+		      app_copy_blend_row(dst32, src32, clipped.width);
 		    }
-		  }
-		  else {		/* rightwards: copy right to left */
-		    for (y=end_y-1; y >= clipped.y; y--)
-		    {
-		      src32 = & src->img->data32[y+ydiff][clipped.x+xdiff];
-		      dst32 = & dst->img->data32[y][clipped.x];
-		      src32 += clipped.width - 1; /* start on right */
-		      dst32 += clipped.width - 1; /* start on right */
-		      for (x=0; x < clipped.width; x++)
-		      {
-			a = src32->alpha;
-			r = src32->red;
-			g = src32->green;
-			b = src32->blue;
-			src32--; /* move left */
-
-			dst32->alpha = ((dst32->alpha*a)/256);
-			dst32->red   = r+(((dst32->red  -r)*a)/256);
-			dst32->green = g+(((dst32->green-g)*a)/256);
-			dst32->blue  = b+(((dst32->blue -b)*a)/256);
-			dst32--; /* move left */
-		      }
-		    }
-		  }
 		}
 	  }
 	}
@@ -655,6 +1080,8 @@ int app_image_draw_glyph(Graphics *dst, Point dp, Image *img, Rect sr)
 	int a, r, g, b;
 	Palette p;
 
+	app_image_changed(dst->img);
+
 	/* correct drawing displacement */
 
 	dp.x += dst->offset.x;
@@ -932,6 +1359,9 @@ int app_image_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 	if (f == NULL)
 		return 0;
 
+	/* make room in the glyph cache for this string's subfonts */
+	app_trim_font_cache();
+
 	/* correct drawing direction */
 	if (dst->text_direction & RL_TB)
 		right_to_left = 1;
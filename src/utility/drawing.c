@@ -10,6 +10,7 @@
  *  Version: 3.45  2003/05/05  Included stdlib for abs() definition.
  *  Version: 3.47  2003/05/28  Fixed round-off error in boundary_point.
  *  Version: 3.56  2005/08/09  Silenced some double to int conversions.
+ *  Version: 3.70  2026/10/17  Added app_get_clip_rect.
  */
 
 /* Copyright (c) L. Patrick
@@ -201,6 +202,28 @@ int app_fill_region(Graphics *g, Region *reg)
 	return result;
 }
 
+/*
+ *  Return the smallest rectangle enclosing everything that drawing
+ *  through g can change, in the target's own co-ordinates. During
+ *  a redraw this is the part of the window or control which was
+ *  damaged, so a redraw function can skip drawing anything outside
+ *  it. The rectangle is empty if nothing can be drawn.
+ */
+Rect app_get_clip_rect(Graphics *g)
+{
+	Rect r = g->area;
+	Rect extents;
+
+	if (g->clip) {
+		/* the clipping region is in window co-ordinates */
+		extents = g->clip->extents;
+		extents.x -= g->offset.x;
+		extents.y -= g->offset.y;
+		r = app_clip_rect(r, extents);
+	}
+	return r;
+}
+
 /*
  *  Run-length slice line drawing:
  *
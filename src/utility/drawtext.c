@@ -11,6 +11,7 @@
  *  Version: 3.56  2005/08/09  Silenced some pointer subtraction warnings.
  *  Version: 3.58  2005/09/28  Fixed possible bug in justified text.
  *  Version: 3.60  2007/06/06  app_text_width now examines entire text.
+ *  Version: 3.73  2026/10/17  Added TextLayout for re-drawing wrapped text.
  */
 
 /* Copyright (c) L. Patrick
@@ -253,111 +254,8 @@ int app_text_height(Font *f, int pixel_width, const char *utf8, int nb)
 }
 
 /*
- *  Drawing text functions, for various text alignments.
+ *  Find the width of each word in a line, for justification.
  */
-static const char *app_draw_text_left(Graphics *g, Rect r, int line_height,
-	const char *utf8, int nb)
-{
-	int nl;
-	int right_to_left;
-	char *line;
-	Point p;
-	Font *f;
-
-	p.x = r.x;
-	p.y = r.y;
-	f = g->font;
-	line = NULL;
-
-	if (g->text_direction & RL_TB)
-		right_to_left = 1;
-	else
-		right_to_left = 0;
-
-	for (nl=0; (p.y <= r.y+r.height) && (nb > 0); p.y += line_height)
-	{
-		app_get_next_line(f, r.width, &line, &nl, &utf8, &nb);
-		p.x = r.x;
-		if (right_to_left)
-			p.x += app_font_width(f, line, nl);
-		app_draw_utf8(g, p, line, nl);
-	}
-
-	app_free(line);
-	if (nb == 0)
-		return NULL;
-	return utf8;
-}
-
-static const char *app_draw_text_right(Graphics *g, Rect r, int line_height,
-	const char *utf8, int nb)
-{
-	int nl;
-	int right_to_left;
-	char *line;
-	Point p;
-	Font *f;
-
-	p.x = r.x;
-	p.y = r.y;
-	f = g->font;
-	line = NULL;
-
-	if (g->text_direction & RL_TB)
-		right_to_left = 1;
-	else
-		right_to_left = 0;
-
-	for (nl=0; (p.y <= r.y+r.height) && (nb > 0); p.y += line_height)
-	{
-		app_get_next_line(f, r.width, &line, &nl, &utf8, &nb);
-		p.x = r.x + r.width;
-		if (! right_to_left)
-			p.x -= app_font_width(f, line, nl);
-		app_draw_utf8(g, p, line, nl);
-	}
-
-	app_free(line);
-	if (nb == 0)
-		return NULL;
-	return utf8;
-}
-
-static const char *app_draw_text_centered(Graphics *g, Rect r, int line_height,
-	const char *utf8, int nb)
-{
-	int nl, w;
-	int right_to_left;
-	char *line;
-	Point p;
-	Font *f;
-
-	p.x = r.x;
-	p.y = r.y;
-	f = g->font;
-	line = NULL;
-
-	if (g->text_direction & RL_TB)
-		right_to_left = 1;
-	else
-		right_to_left = 0;
-
-	for (nl=0; (p.y <= r.y+r.height) && (nb > 0); p.y += line_height)
-	{
-		app_get_next_line(f, r.width, &line, &nl, &utf8, &nb);
-		w = app_font_width(f, line, nl);
-		p.x = r.x + (r.width - w) / 2;
-		if (right_to_left)
-			p.x += w;
-		app_draw_utf8(g, p, line, nl);
-	}
-
-	app_free(line);
-	if (nb == 0)
-		return NULL;
-	return utf8;
-}
-
 static int app_find_word_size(const char *utf8, int nbytes)
 {
 	int i;
@@ -373,128 +271,147 @@ static int app_find_word_size(const char *utf8, int nbytes)
 	return i;
 }
 
-static const char *app_draw_text_justified(Graphics *g, Rect r, int line_height,
-	const char *utf8, int nb)
+/*
+ *  Draw one line of text at height y within the rectangle,
+ *  using the given alignment. The width of the line in pixels
+ *  is w, or -1 if it has not been measured yet. The final
+ *  line of the text is never justified.
+ */
+static void app_draw_text_line(Graphics *g, Rect r, int y, int align,
+	const char *line, int nl, int w, int final)
 {
-	int nl, w, ns, sw, xw;
+	int ns, sw, xw;
 	int width, spaces, last;
 	int right_to_left;
-	char *line, *s, *start, *end;
+	const char *s, *start, *end;
 	Point p;
 	Font *f;
 
 	p.x = r.x;
-	p.y = r.y;
+	p.y = y;
 	f = g->font;
-	line = NULL;
 
 	if (g->text_direction & RL_TB)
 		right_to_left = 1;
 	else
 		right_to_left = 0;
 
-	for (nl=0; (p.y <= r.y+r.height) && (nb > 0); p.y += line_height)
+	if ((align & ALIGN_CENTER) == ALIGN_CENTER)
 	{
-		app_get_next_line(f, r.width, &line, &nl, &utf8, &nb);
-
-		p.x = r.x;
-		width = r.width;
+		if (w < 0)
+			w = app_font_width(f, line, nl);
+		p.x = r.x + (r.width - w) / 2;
+		if (right_to_left)
+			p.x += w;
+		app_draw_utf8(g, p, line, nl);
+		return;
+	}
+	else if ((align & ALIGN_JUSTIFY) != ALIGN_JUSTIFY)
+	{
+		if ((align & ALIGN_RIGHT) == ALIGN_RIGHT) {
+			p.x = r.x + r.width;
+			if (! right_to_left) {
+				if (w < 0)
+					w = app_font_width(f, line, nl);
+				p.x -= w;
+			}
+		}
+		else if (right_to_left) {
+			if (w < 0)
+				w = app_font_width(f, line, nl);
+			p.x += w;
+		}
+		app_draw_utf8(g, p, line, nl);
+		return;
+	}
 
-		/* if we have reached a newline line, don't justify it */
-		if (line[nl] == '\n')	/* yes, line[nl] looks wrong */
-			last = 1;	/* but it's correct */
-		else
-			last = 0;
+	/* justified text */
+	width = r.width;
 
-		/* discard spaces at start of line */
-		end = line+nl;
-		for (s=line; (s < end) && (*s == ' '); s++)
-			continue;
-		start = s;
+	/* if we have reached a newline line, don't justify it */
+	if (line[nl] == '\n')	/* yes, line[nl] looks wrong */
+		last = 1;	/* but it's correct */
+	else
+		last = 0;
 
-		/* discard spaces at the end of the line */
-		for (s=line+nl-1; (s >= start) && (*s == ' '); s--)
-			continue;
-		end = s+1;
+	/* discard spaces at start of line */
+	end = line+nl;
+	for (s=line; (s < end) && (*s == ' '); s++)
+		continue;
+	start = s;
 
-		/* count the number of scalable spaces */
-		for (spaces=0, s=start; s < end; s++)
-			if (*s == ' ')
-				spaces++;
+	/* discard spaces at the end of the line */
+	for (s=line+nl-1; (s >= start) && (*s == ' '); s--)
+		continue;
+	end = s+1;
 
-		if ((spaces == 0) || last || (nb == 0))
-		{
-			/* align this line normally, don't justify it */
-			if (right_to_left)
-				p.x += r.width;
-			app_draw_utf8(g, p, line, nl);
-			continue; /* go to next line */
-		}
+	/* count the number of scalable spaces */
+	for (spaces=0, s=start; s < end; s++)
+		if (*s == ' ')
+			spaces++;
 
-		/* otherwise, each word must be drawn individually */
+	if ((spaces == 0) || last || final)
+	{
+		/* align this line normally, don't justify it */
+		if (right_to_left)
+			p.x += r.width;
+		app_draw_utf8(g, p, line, nl);
+		return;
+	}
 
-		w = app_font_width(f, start, (int)(end-start));
-		sw = (width-w) / spaces;
-		xw = (width-w) % spaces;
+	/* otherwise, each word must be drawn individually */
 
-		if (right_to_left) {
-			p.x += r.width; /* draw from right-most point */
-			while (start < end)
-			{
-				ns = app_find_word_size(start, (int)(end-start));
-				w = app_font_width(f, start, ns);
+	w = app_font_width(f, start, (int)(end-start));
+	sw = (width-w) / spaces;
+	xw = (width-w) % spaces;
 
-				app_draw_utf8(g, p, start, ns);
-				p.x -= w;
-				if (*start == ' ')
-					p.x -= sw;
-				if (xw) {
-					p.x--;
-					xw--;
-				}
-				start += ns;
+	if (right_to_left) {
+		p.x += r.width; /* draw from right-most point */
+		while (start < end)
+		{
+			ns = app_find_word_size(start, (int)(end-start));
+			w = app_font_width(f, start, ns);
+
+			app_draw_utf8(g, p, start, ns);
+			p.x -= w;
+			if (*start == ' ')
+				p.x -= sw;
+			if (xw) {
+				p.x--;
+				xw--;
 			}
+			start += ns;
 		}
-		else { /* draw left to right */
-			while (start < end)
-			{
-				ns = app_find_word_size(start, (int)(end-start));
-				w = app_font_width(f, start, ns);
-
-				app_draw_utf8(g, p, start, ns);
-				p.x += w;
-				if (*start == ' ')
-					p.x += sw;
-				if (xw) {
-					p.x++;
-					xw--;
-				}
-				start += ns;
+	}
+	else { /* draw left to right */
+		while (start < end)
+		{
+			ns = app_find_word_size(start, (int)(end-start));
+			w = app_font_width(f, start, ns);
+
+			app_draw_utf8(g, p, start, ns);
+			p.x += w;
+			if (*start == ' ')
+				p.x += sw;
+			if (xw) {
+				p.x++;
+				xw--;
 			}
+			start += ns;
 		}
 	}
-
-	app_free(line);
-	if (nb == 0)
-		return NULL;
-	return utf8;
 }
 
 /*
- *  The function which calls the above alignment-specific functions.
+ *  Clip drawing to the rectangle and set the text direction
+ *  from the alignment, before drawing text. Returns the old
+ *  clipping region, which app_end_draw_text puts back.
  */
-char *app_draw_text(Graphics *g, Rect r, int align,
-	const char *utf8, int nbytes)
+static Region * app_begin_draw_text(Graphics *g, Rect r, int align,
+	int *td)
 {
-	int h, lh, nlines, td;
-	const char *remains;
 	Region *old, *clip;
 
-	if (g->font == NULL)
-		app_set_default_font(g);
-	if (g->font == NULL)
-		return NULL; /* error */
-
 	old = g->clip;
 	if (old != NULL) {	//!!
 	g->clip = NULL;
@@ -506,49 +423,362 @@ char *app_draw_text(Graphics *g, Rect r, int align,
 	} else
 		app_set_clip_rect(g, r);
 
-	lh = app_font_height(g->font);
+	*td = g->text_direction;
+	if (align & LR_TB) {
+		g->text_direction &= ~RL_TB;
+		g->text_direction |= LR_TB;
+	}
+	else if (align & RL_TB) {
+		g->text_direction &= ~LR_TB;
+		g->text_direction |= RL_TB;
+	}
+
+	return old;
+}
+
+static void app_end_draw_text(Graphics *g, Region *old, int td)
+{
+	app_del_region(g->clip);
+	g->clip = old;
+	g->text_direction = td;
+}
+
+/*
+ *  Move the rectangle or spread out the lines, for text which
+ *  is h pixels high, according to the vertical alignment.
+ *  The text height is only needed for these alignments.
+ */
+#define NEEDS_TEXT_HEIGHT(align) ((align) & (VALIGN_BOTTOM | VALIGN_CENTER))
+
+static void app_align_text_vertically(int align, int h, Rect *r, int *lh)
+{
+	int nlines;
 
 	if ((align & VALIGN_CENTER) == VALIGN_CENTER) {
-		h = app_text_height(g->font, r.width, utf8, nbytes);
-		if (h < r.height)
-			r.y += (r.height-h)/2;
+		if (h < r->height)
+			r->y += (r->height-h)/2;
 	}
 	else if ((align & VALIGN_JUSTIFY) == VALIGN_JUSTIFY) {
-		h = app_text_height(g->font, r.width, utf8, nbytes);
-		if (h < r.height) {
-			nlines = h / lh;
+		if (h < r->height) {
+			nlines = h / *lh;
 			if (nlines > 1)
-				lh += ((r.height-h) / (nlines-1));
+				*lh += ((r->height-h) / (nlines-1));
 		}
 	}
 	else if ((align & VALIGN_BOTTOM) == VALIGN_BOTTOM) {
+		if (h < r->height)
+			r->y += (r->height-h);
+	}
+}
+
+/*
+ *  The function which wraps and draws text, line by line.
+ */
+char *app_draw_text(Graphics *g, Rect r, int align,
+	const char *utf8, int nbytes)
+{
+	int h, lh, nl, td, y;
+	char *line;
+	Region *old;
+
+	if (g->font == NULL)
+		app_set_default_font(g);
+	if (g->font == NULL)
+		return NULL; /* error */
+
+	old = app_begin_draw_text(g, r, align, &td);
+
+	lh = app_font_height(g->font);
+	if (NEEDS_TEXT_HEIGHT(align)) {
 		h = app_text_height(g->font, r.width, utf8, nbytes);
-		if (h < r.height)
-			r.y += (r.height-h);
+		app_align_text_vertically(align, h, &r, &lh);
 	}
 
-	td = g->text_direction;
-	if (align & LR_TB) {
-		g->text_direction &= ~RL_TB;
-		g->text_direction |= LR_TB;
+	line = NULL;
+	for (y=r.y; (y <= r.y+r.height) && (nbytes > 0); y += lh)
+	{
+		app_get_next_line(g->font, r.width, &line, &nl,
+				&utf8, &nbytes);
+		app_draw_text_line(g, r, y, align, line, nl, -1,
+				nbytes == 0);
 	}
-	else if (align & RL_TB) {
-		g->text_direction &= ~LR_TB;
-		g->text_direction |= RL_TB;
+	app_free(line);
+
+	app_end_draw_text(g, old, td);
+
+	if (nbytes == 0)
+		return NULL;
+	return (char *) utf8; /* cast away const */
+}
+
+/*
+ *  Text layouts
+ *  ------------
+ *  A TextLayout keeps a copy of some text together with the
+ *  lines it wraps into for a font and a pixel width, so it can
+ *  be drawn again without finding the lines again. The lines
+ *  are found by app_get_next_line, so they are the same lines
+ *  app_draw_text would draw, with tabs already expanded.
+ *
+ *  When the width changes, each paragraph (the text up to and
+ *  including a newline) is wrapped again only if it has to be:
+ *  a paragraph which was one line, no wider than the new width,
+ *  keeps that line without being measured again.
+ *
+ *  Drawing a layout draws only the lines which cross the
+ *  clipping region, so redrawing a small part of a long text
+ *  costs little.
+ *
+ *  Each line's pixel width is kept once measured, which is all
+ *  that left, right and centred lines need. The advances of
+ *  single glyphs are not kept: only justified lines measure
+ *  their words, and the font's width tables make that cheap.
+ */
+
+static int app_add_text_layout_line(TextLayout *t, int start, int nbytes,
+	const char *line, int nl)
+{
+	TextLine *lines;
+	char *buf;
+	int size;
+
+	if (t->num_lines == t->max_lines) {
+		size = t->max_lines ? t->max_lines * 2 : 16;
+		lines = app_realloc(t->lines, size * sizeof(TextLine));
+		if (! lines)
+			return 0;
+		t->lines = lines;
+		t->max_lines = size;
+	}
+	if (t->buf_used + nl + 1 > t->buf_size) {
+		size = t->buf_size ? t->buf_size * 2 : MIN_BUF;
+		while (t->buf_used + nl + 1 > size)
+			size *= 2;
+		buf = app_realloc(t->buf, size);
+		if (! buf)
+			return 0;
+		t->buf = buf;
+		t->buf_size = size;
 	}
 
-	if ((align & ALIGN_CENTER) == ALIGN_CENTER)
-		remains = app_draw_text_centered(g, r, lh, utf8, nbytes);
-	else if ((align & ALIGN_JUSTIFY) == ALIGN_JUSTIFY)
-		remains = app_draw_text_justified(g, r, lh, utf8, nbytes);
-	else if ((align & ALIGN_RIGHT) == ALIGN_RIGHT)
-		remains = app_draw_text_right(g, r, lh, utf8, nbytes);
-	else
-		remains = app_draw_text_left(g, r, lh, utf8, nbytes);
+	t->lines[t->num_lines].start  = start;
+	t->lines[t->num_lines].nbytes = nbytes;
+	t->lines[t->num_lines].offset = t->buf_used;
+	t->lines[t->num_lines].length = nl;
+	t->lines[t->num_lines].width  = -1;
+	t->num_lines++;
 
-	app_del_region(g->clip);
-	g->clip = old;
-	g->text_direction = td;
+	memcpy(t->buf + t->buf_used, line, nl);
+	t->buf[t->buf_used + nl] = '\0';
+	t->buf_used += nl + 1;
+
+	return 1;
+}
+
+/*
+ *  Wrap a text layout's lines to a new pixel width.
+ */
+static void app_wrap_text_layout(TextLayout *t, int pixel_width)
+{
+	TextLayout old;
+	TextLine *ln;
+	const char *src;
+	char *line;
+	int i, p, first, count, start, end, nb, nl, w, widest;
+
+	if (t->wrapped && (t->width == pixel_width))
+		return;
+
+	/* the old lines are kept while the new ones are made */
+	old = *t;
+	t->num_lines = t->max_lines = 0;
+	t->lines = NULL;
+	t->buf_used = t->buf_size = 0;
+	t->buf = NULL;
+	line = NULL;
+
+	for (p=0; p < t->num_paras; p++)
+	{
+		start = t->para_start[p];
+		end = t->para_start[p+1];
+		first = t->para_line[p];
+		count = t->para_line[p+1] - first;
+		t->para_line[p] = t->num_lines;
+
+		if (old.wrapped && (count == 1)
+		 && (t->para_width[p] <= pixel_width))
+		{
+			/* it still fits on one line */
+			ln = &old.lines[first];
+			if (app_add_text_layout_line(t, ln->start, ln->nbytes,
+					old.buf + ln->offset, ln->length))
+				t->lines[t->num_lines-1].width = ln->width;
+			continue;
+		}
+
+		/* wrap the paragraph again */
+		src = t->text + start;
+		nb = t->nbytes - start;
+		widest = 0;
+		while (src < t->text + end) {
+			i = (int) (src - t->text);
+			w = app_get_next_line(t->font, pixel_width,
+					&line, &nl, &src, &nb);
+			if (src == t->text + i)
+				break;	/* out of memory */
+			if (! app_add_text_layout_line(t, i,
+					(int) (src - t->text) - i, line, nl))
+				break;
+			if (widest < w)
+				widest = w;
+		}
+		t->para_width[p] = widest;
+	}
+	t->para_line[t->num_paras] = t->num_lines;
+
+	app_free(line);
+	app_free(old.lines);
+	app_free(old.buf);
+
+	t->width = pixel_width;
+	t->wrapped = 1;
+}
+
+/*
+ *  Create a text layout holding a copy of the given text,
+ *  to be drawn in the given font.
+ */
+TextLayout * app_new_text_layout(Font *f, const char *utf8, int nbytes)
+{
+	TextLayout *t;
+	int i, p;
 
-	return (char *) remains; /* cast away const */
+	t = app_zero_alloc(sizeof(TextLayout));
+	if (! t)
+		return NULL;
+	t->font = f;
+	t->text = app_alloc(nbytes + 1);
+	if (! t->text) {
+		app_free(t);
+		return NULL;
+	}
+	memcpy(t->text, utf8, nbytes);
+	t->text[nbytes] = '\0';
+	t->nbytes = nbytes;
+
+	/* split the text into paragraphs */
+	for (i=0; i < nbytes; i++)
+		if (utf8[i] == '\n')
+			t->num_paras++;
+	if ((nbytes > 0) && (utf8[nbytes-1] != '\n'))
+		t->num_paras++;
+	t->para_start = app_alloc((t->num_paras+1) * sizeof(int));
+	t->para_line  = app_zero_alloc((t->num_paras+1) * sizeof(int));
+	t->para_width = app_zero_alloc((t->num_paras+1) * sizeof(int));
+	if ((! t->para_start) || (! t->para_line) || (! t->para_width)) {
+		app_del_text_layout(t);
+		return NULL;
+	}
+	t->para_start[0] = 0;
+	for (i=0, p=1; i < nbytes; i++)
+		if ((utf8[i] == '\n') && (p < t->num_paras))
+			t->para_start[p++] = i+1;
+	t->para_start[t->num_paras] = nbytes;
+
+	return t;
+}
+
+void app_del_text_layout(TextLayout *t)
+{
+	if (! t)
+		return;
+	app_free(t->text);
+	app_free(t->para_start);
+	app_free(t->para_line);
+	app_free(t->para_width);
+	app_free(t->lines);
+	app_free(t->buf);
+	app_free(t);
+}
+
+/*
+ *  Measure a text layout's height in pixels when wrapped
+ *  to the given width.
+ */
+int app_text_layout_height(TextLayout *t, int pixel_width)
+{
+	app_wrap_text_layout(t, pixel_width);
+	return t->num_lines * app_font_height(t->font);
+}
+
+/*
+ *  Draw a text layout as app_draw_text would draw its text,
+ *  using the layout's font. Only lines which cross the
+ *  clipping region are drawn. Returns a pointer into the
+ *  layout's text where drawing stopped, or NULL if it all fit.
+ */
+char *app_draw_text_layout(Graphics *g, Rect r, int align, TextLayout *t)
+{
+	int i, h, lh, td, y, top, bottom, fit, justify;
+	TextLine *ln;
+	Region *old;
+	Font *saved;
+
+	/* the caller's font is put back afterwards */
+	saved = g->font;
+	app_set_font(g, t->font);
+	app_wrap_text_layout(t, r.width);
+
+	old = app_begin_draw_text(g, r, align, &td);
+
+	lh = app_font_height(t->font);
+	if (NEEDS_TEXT_HEIGHT(align)) {
+		h = t->num_lines * lh;
+		app_align_text_vertically(align, h, &r, &lh);
+	}
+
+	/* only lines within the clip region need to be drawn, */
+	/* but an over-sized glyph can reach into the next line */
+	top = r.y;
+	bottom = r.y + r.height;
+	if (g->clip) {
+		top = g->clip->extents.y - g->offset.y;
+		bottom = top + g->clip->extents.height;
+	}
+	i = 0;
+	if ((lh > 0) && (top > r.y))
+		i = (top - r.y) / lh - 1;
+	if (i < 0)
+		i = 0;
+
+	justify = ((align & ALIGN_CENTER) != ALIGN_CENTER)
+		&& ((align & ALIGN_JUSTIFY) == ALIGN_JUSTIFY);
+
+	for ( ; i < t->num_lines; i++)
+	{
+		y = r.y + i * lh;
+		if ((y > r.y+r.height) || (y >= bottom + lh))
+			break;
+		ln = &t->lines[i];
+		if ((ln->width < 0) && (! justify))
+			ln->width = app_font_width(t->font,
+					t->buf + ln->offset, ln->length);
+		app_draw_text_line(g, r, y, align, t->buf + ln->offset,
+				ln->length, ln->width, i == t->num_lines-1);
+	}
+
+	app_end_draw_text(g, old, td);
+
+	if (saved)
+		app_set_font(g, saved);
+	else
+		g->font = NULL;
+
+	/* find the first line which didn't fit in the rectangle */
+	fit = t->num_lines;
+	if (lh > 0)
+		fit = (r.height / lh) + 1;
+	if (fit >= t->num_lines)
+		return NULL;
+	return t->text + t->lines[fit].start;
 }
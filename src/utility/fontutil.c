@@ -15,6 +15,10 @@
  *  Version: 3.58  2005/09/25  Finds .png then .gif. Anti-aliased fonts.
  *  Version: 3.59  2005/10/10  Supports over-sized glyphs.
  *  Version: 3.60  2005/12/29  Better italics synthesis. New search order.
+ *  Version: 3.70  2026/10/17  Subfont character widths are shared.
+ *  Version: 3.71  2026/10/17  Subfonts are kept in a shared glyph cache.
+ *  Version: 3.72  2026/10/17  Subfonts can be loaded from font packs.
+ *  Version: 3.73  2026/10/17  Faster string measuring, batch measuring.
  */
 
 /* Copyright (c) L. Patrick
@@ -31,9 +35,16 @@
  */
 
 enum {
-	APP_FONT_MAX_SUBFONTS = 15
+	APP_FONT_PLANES = 17,	/* Unicode planes 0 to 16 */
+	APP_FONT_PLANE_PAGES = 256,	/* subfonts per plane */
+	APP_FONT_PACK_STYLES = 16,	/* BOLD | ITALIC | ANTI_ALIAS */
+	APP_FONT_PACK_VERSION = 1,
+	APP_FONT_PACK_HEADER = 32,	/* bytes */
+	APP_FONT_PACK_ENTRY = 32	/* bytes per page in index */
 };
 
+#define APP_FONT_CACHE_LIMIT  (8L * 1024 * 1024)	/* bytes */
+
 static const char * app_font_search_var      = "APP_FONT_PATH";
 static const char * app_font_home_var        = "HOME";
 static const char * app_font_install_dir     = "/graphappfonts/";
@@ -41,6 +52,8 @@ static const char * app_font_resource_hdr    = "*fonts/";
 static const char * app_font_info_suffix     = ".txt";
 static const char * app_font_file_suffix     = ".png"; /* tried first */
 static const char * app_font_file_suffix_alt = ".gif"; /* tried second */
+static const char * app_font_pack_suffix     = ".gfp";
+static const char * app_font_pack_magic      = "GAFP";
 static const char * app_font_default         = "unifont";
 static int          app_font_default_style   = PLAIN;
 static int          app_font_default_size    = 16;
@@ -436,10 +449,9 @@ static Image * app_get_subfont_image(App *app, const char *name,
 }
 
 /*
- *  This ugly parser function loads the font information file
- *  and skips through it until it finds an entry for the
- *  required subfont. It then proceeds to load just the
- *  information for that subfont.
+ *  This ugly parser function skips through the font information
+ *  file until it finds an entry for the required subfont. It
+ *  then proceeds to load just the information for that subfont.
  *
  *  This means that loading each subfont may parse the whole file.
  *  This may seem wasteful, but consider the alternative.
@@ -451,23 +463,18 @@ static Image * app_get_subfont_image(App *app, const char *name,
  *  So, we slightly wastefully read the file for each subfont.
  *  This reduces the memory needed, and allows us to control
  *  how many subfonts we wish to have in memory at the one time
- *  in a fairly straightforward manner: it's just a list of
- *  subfonts up to a certain maximum number.
+ *  in a fairly straightforward manner. Fonts which must load
+ *  quickly can be compiled into font packs instead (see below),
+ *  which need no parsing at all.
  */
-static int app_load_subfont_info(App *app, Font *fnt, Subfont *sub,
-	const char *name, int height, int style)
+static void app_read_subfont_info(FILE *f, Subfont *sub,
+	int *maximum_width)
 {
-	FILE *f;
 	int i, r, ch, width, start, finish;
 	char buf[10];
 	unsigned long base;
 	FontWidth *fw;
 
-	/* load the font information file */
-	f = app_open_font_info(app, name, height, style);
-	if (! f)
-		return 0;
-
 	/* create the subfont glyph width array, if necessary */
 	if (sub->width == NULL) {
 		sub->width = app_alloc(sizeof(sub->width[0]) * 256);
@@ -522,8 +529,8 @@ static int app_load_subfont_info(App *app, Font *fnt, Subfont *sub,
 		}
 		buf[i] = '\0';
 		width = strtol(buf, NULL, 10); /* decimal integer */
-		if (width > fnt->maximum_width)
-			fnt->maximum_width = width;
+		if (width > *maximum_width)
+			*maximum_width = width;
 		start = -1;
 		finish = -2;
 
@@ -617,6 +624,22 @@ static int app_load_subfont_info(App *app, Font *fnt, Subfont *sub,
 			if (sub->width[i] == -2)
 				sub->width[i] = -1;
 	}
+}
+
+/*
+ *  Load the information for one subfont from the font's
+ *  information file. Returns 0 if the file can't be found.
+ */
+static int app_load_subfont_info(App *app, Font *fnt, Subfont *sub,
+	const char *name, int height, int style)
+{
+	FILE *f;
+
+	f = app_open_font_info(app, name, height, style);
+	if (! f)
+		return 0;
+
+	app_read_subfont_info(f, sub, &fnt->maximum_width);
 
 	app_close_file(f);
 	return 1;
@@ -658,9 +681,9 @@ void app_print_subfont(Subfont *sub)
 }
 
 /*
- *  Delete a subfont and its character width ranges.
+ *  Free a subfont's character widths and width ranges.
  */
-void app_del_subfont(Font *f, Subfont *sub)
+static void app_free_subfont_widths(Subfont *sub)
 {
 	int i;
 
@@ -671,7 +694,18 @@ void app_del_subfont(Font *f, Subfont *sub)
 		app_free(sub->widths[i]);
 	}
 	app_free(sub->widths);
-	app_release_native_subfont(f, sub);
+	sub->width = NULL;
+	sub->widths = NULL;
+	sub->num_widths = 0;
+}
+
+/*
+ *  Delete a subfont and its character width ranges.
+ */
+void app_del_subfont(App *app, Subfont *sub)
+{
+	app_free_subfont_widths(sub);
+	app_release_native_subfont(app, sub);
 	if (sub->img)
 		app_del_image(sub->img);
 	app_free(subfont_extra(sub));
@@ -789,8 +823,6 @@ static void app_make_subfont_info_bold(Font *fnt, Subfont *sub)
 	}
 }
 
-static int app_subfont_char_width(Subfont *sub, unsigned long ch);
-
 /*
  *  Create an "italic" version of a subfont image.
  *  Assume the image is in 8-bit indexed format.
@@ -989,38 +1021,17 @@ static void app_make_subfont_info_italic_old(Font *fnt, Subfont *sub)
 }
 
 /*
- *  Load a subfont into the given font.
- *  If there isn't much space, evict a subfont from the bottom
- *  of the list.
+ *  Make a subfont image ready to draw with: it becomes an indexed
+ *  image whose white entries are transparent. If the palette is
+ *  all greyscale the greys become degrees of transparent black,
+ *  and *anti_alias is set to 1.
  */
-static Subfont * app_load_subfont(Font *f, unsigned long base)
+static Image * app_prepare_subfont_image(Image *img, int *anti_alias)
 {
-	int i, style_found;
+	int i;
 	int all_greyscale;
 	Colour c;
-	Image *img, *img2;
-	Subfont *sub;
-	Subfont **list;
-
-	/* check if we already have this subfont loaded */
-	for (i=0; i < f->num_subfonts; i++)
-		if (f->subfonts[i]->base == base) {
-			/* found it, move it to the top by swapping */
-			if (i > 0) {
-				sub = f->subfonts[i];
-				f->subfonts[i] = f->subfonts[0];
-				f->subfonts[0] = sub;
-			} else
-				sub = f->subfonts[0];
-			return sub;
-
-		}
-
-	/* load subfont image */
-	img = app_get_subfont_image(f->app, f->name, f->height, base,
-			f->style, &style_found);
-	if (! img)
-		return NULL;
+	Image *img2;
 
 	/* ensure the subfont is an indexed image */
 	if (img->depth == 32) {
@@ -1059,30 +1070,668 @@ static Subfont * app_load_subfont(Font *f, unsigned long base)
 		}
 	}
 
-	/* create the subfont structure */
+	*anti_alias = all_greyscale;
+	return img;
+}
+
+/*
+ *  Create a subfont structure around a prepared image.
+ */
+static Subfont * app_new_subfont(Image *img, unsigned long base,
+		int anti_alias)
+{
+	Subfont *sub;
+
 	sub = app_zero_alloc(sizeof(Subfont));
-	if (sub == NULL) {
-		app_del_image(img);
+	if (sub == NULL)
 		return NULL;
-	}
 	sub->extra = app_zero_alloc(sizeof(struct SubfontExtra));
 	if (sub->extra == NULL) {
 		app_free(sub);
-		app_del_image(img);
 		return NULL;
 	}
 
 	sub->img = img;
 	sub->base = base;
-	sub->anti_alias = all_greyscale;
+	sub->anti_alias = anti_alias;
+
+	return sub;
+}
+
+/*
+ *  Read a subfont of the given font from its image and info files.
+ */
+static Subfont * app_read_subfont_files(Font *f, unsigned long base,
+		int *style_found)
+{
+	int anti_alias;
+	Image *img;
+	Subfont *sub;
+
+	/* load subfont image */
+	img = app_get_subfont_image(f->app, f->name, f->height, base,
+			f->style, style_found);
+	if (! img)
+		return NULL;
+
+	img = app_prepare_subfont_image(img, &anti_alias);
+
+	/* create the subfont structure */
+	sub = app_new_subfont(img, base, anti_alias);
+	if (sub == NULL) {
+		app_del_image(img);
+		return NULL;
+	}
 
 	/* load the glyph width information */
-	if (! app_load_subfont_info(f->app, f, sub, f->name, f->height, style_found))
+	if (! app_load_subfont_info(f->app, f, sub, f->name, f->height,
+			*style_found))
+	{
+		app_del_subfont(f->app, sub);
+		return NULL;
+	}
+
+	return sub;
+}
+
+/*
+ *  Font packs
+ *  ----------
+ *  A font pack holds every subfont of one font height and style,
+ *  already prepared for drawing, in a single file which is mapped
+ *  into memory. Fetching a subfont from a pack is a binary search
+ *  of its index; there is no image decoding and no parsing of the
+ *  information file. The pack for "unifont" 16 bold is called
+ *  16b.gfp and lives beside 16b.txt, so it is found along the same
+ *  search path as the loose files, and is tried before them.
+ *  Packs are made by app_write_font_pack (see tools/mkpack.c).
+ *
+ *  All numbers are 32-bit little-endian words, except for widths,
+ *  which are 16-bit little-endian signed numbers. The layout is:
+ *
+ *    header:  "GAFP", version, height, style, maximum width,
+ *             number of pages, 2 words spare (32 bytes)
+ *    index:   for each page, in increasing order of base:
+ *             base, offset of page data, image width, height,
+ *             bytes per row, palette size, anti-alias flag,
+ *             1 word spare (32 bytes)
+ *    pages:   256 glyph widths (-1 for no glyph),
+ *             palette as alpha, red, green, blue bytes,
+ *             rows of 8-bit pixels, each padded to 4 bytes
+ */
+
+typedef struct FontPack   FontPack;
+
+struct FontPack
+{
+	byte *		data;
+	long		length;
+	int		mapped;		/* else read into memory */
+	int		num_pages;
+};
+
+static FontPack app_missing_pack;	/* marks packs not found */
+
+static unsigned long app_get_pack_word(const byte *p)
+{
+	return (unsigned long) p[0] | ((unsigned long) p[1] << 8)
+		| ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+static void app_put_pack_word(byte *p, unsigned long w)
+{
+	p[0] = (byte) (w & 0xFF);
+	p[1] = (byte) ((w >> 8) & 0xFF);
+	p[2] = (byte) ((w >> 16) & 0xFF);
+	p[3] = (byte) ((w >> 24) & 0xFF);
+}
+
+/*
+ *  Check the header of a pack's bytes. The FontPack returned
+ *  owns the bytes; if they are not a pack, they are released.
+ */
+static FontPack * app_new_font_pack(byte *data, long length, int mapped)
+{
+	FontPack *pack;
+	unsigned long num_pages;
+
+	num_pages = 0;
+	if ((length >= APP_FONT_PACK_HEADER)
+	 && (memcmp(data, app_font_pack_magic, 4) == 0)
+	 && (app_get_pack_word(data+4) == APP_FONT_PACK_VERSION))
+		num_pages = app_get_pack_word(data+20);
+	if ((num_pages == 0) || (num_pages > APP_FONT_PLANES * 256)
+	 || (APP_FONT_PACK_HEADER + num_pages * APP_FONT_PACK_ENTRY
+			> (unsigned long) length))
+	{
+		if (mapped)
+			app_unmap_file(data, length);
+		else
+			app_free(data);
+		return NULL;
+	}
+
+	pack = app_zero_alloc(sizeof(FontPack));
+	if (! pack) {
+		if (mapped)
+			app_unmap_file(data, length);
+		else
+			app_free(data);
+		return NULL;
+	}
+	pack->data = data;
+	pack->length = length;
+	pack->mapped = mapped;
+	pack->num_pages = (int) num_pages;
+	return pack;
+}
+
+static void app_del_font_pack(FontPack *pack)
+{
+	if ((! pack) || (pack == &app_missing_pack))
+		return;
+	if (pack->mapped)
+		app_unmap_file(pack->data, pack->length);
+	else
+		app_free(pack->data);
+	app_free(pack);
+}
+
+/*
+ *  Map a font pack found within path + dir.
+ */
+static FontPack * app_open_font_pack_by_path(const char *path,
+		const char *dir, const char *name, int height,
+		const char *short_name)
+{
+	char *filepath;
+	byte *data;
+	long length;
+
+	if ((! path) || (! dir))
+		return NULL;
+	if ((path[0] == '\0') && (dir[0] == '\0'))
+		return NULL;
+
+	filepath = app_zero_alloc((long) strlen(path) + (long) strlen(dir) +
+				(long) strlen(name) + 40);
+	if (filepath == NULL)
+		return NULL;
+
+	sprintf(filepath, "%s%s%s/%d%s%s", path, dir, name,
+			height, short_name, app_font_pack_suffix);
+	data = app_map_file(filepath, &length);
+	app_free(filepath);
+
+	if (! data)
+		return NULL;
+	return app_new_font_pack(data, length, 1);
+}
+
+/*
+ *  Read a font pack from the application's resources.
+ *  Resources can't be mapped, so the pack is read into memory.
+ */
+static FontPack * app_open_font_pack_from_resources(App *app,
+		const char *name, int height, const char *short_name)
+{
+	char *filepath;
+	FILE *f;
+	byte *data;
+	long length;
+
+	if ((app == NULL) || (app->has_resources == 0))
+		return NULL; /* no resources, no point looking */
+
+	filepath = app_zero_alloc((long) strlen(app_font_resource_hdr) +
+				(long) strlen(name) + 40);
+	if (! filepath)
+		return NULL;
+	sprintf(filepath, "%s%s/%d%s%s", app_font_resource_hdr, name,
+			height, short_name, app_font_pack_suffix);
+	f = app_open_resource(app->program_name, filepath, &length);
+	app_free(filepath);
+	if (! f)
+		return NULL;
+
+	data = NULL;
+	if (length > 0)
+		data = app_alloc(length);
+	if (data && (fread(data, 1, length, f) != (size_t) length)) {
+		app_free(data);
+		data = NULL;
+	}
+	app_close_file(f);
+
+	if (! data)
+		return NULL;
+	return app_new_font_pack(data, length, 0);
+}
+
+/*
+ *  Find a font pack, searching in the same places and order
+ *  as app_open_font_info. Returns NULL if there isn't one.
+ */
+static FontPack * app_open_font_pack(App *app, const char *name,
+		int height, const char *short_name)
+{
+	FontPack *pack;
+
+	pack = app_open_font_pack_by_path(getenv(app_font_search_var), "/",
+					name, height, short_name);
+	if (pack != NULL)
+		return pack;
+
+	pack = app_open_font_pack_by_path(getenv(app_font_home_var),
+					app_font_install_dir,
+					name, height, short_name);
+	if (pack != NULL)
+		return pack;
+
+	pack = app_open_font_pack_by_path(getenv(app_font_search_var),
+					app_font_install_dir,
+					name, height, short_name);
+	if (pack != NULL)
+		return pack;
+
+	pack = app_open_font_pack_by_path("", app_font_install_dir,
+					name, height, short_name);
+	if (pack != NULL)
+		return pack;
+
+	return app_open_font_pack_from_resources(app, name, height,
+					short_name);
+}
+
+/*
+ *  Report whether there is a font pack for any of the search
+ *  cases which apply to the given style.
+ */
+static int app_font_pack_exists(App *app, const char *name,
+		int height, int style)
+{
+	int i, flags;
+	FontPack *pack;
+
+	for (i=0; i < NELEM(app_font_search); i++)
 	{
-		app_del_subfont(f, sub);
+		flags = app_font_search[i].flags;
+		if ((style & flags) != flags)
+			continue;
+		pack = app_open_font_pack(app, name, height,
+				app_font_search[i].short_name);
+		if (pack) {
+			app_del_font_pack(pack);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ *  Make a subfont from a page of a font pack. The image uses
+ *  the pack's pixels where they lie. Returns NULL if the pack
+ *  does not have the page.
+ */
+static Subfont * app_unpack_subfont(FontPack *pack, unsigned long base,
+		int *maximum_width)
+{
+	int lo, hi, mid, i;
+	unsigned long b, offset, width, height, stride, cmap_size;
+	const byte *entry, *p;
+	Colour cmap[256];
+	Image *img;
+	Subfont *sub;
+
+	/* binary search of the index */
+	entry = NULL;
+	lo = 0;
+	hi = pack->num_pages - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		p = pack->data + APP_FONT_PACK_HEADER
+			+ (long) mid * APP_FONT_PACK_ENTRY;
+		b = app_get_pack_word(p);
+		if (b == base) {
+			entry = p;
+			break;
+		}
+		if (b < base)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	if (! entry)
+		return NULL;
+
+	offset    = app_get_pack_word(entry+4);
+	width     = app_get_pack_word(entry+8);
+	height    = app_get_pack_word(entry+12);
+	stride    = app_get_pack_word(entry+16);
+	cmap_size = app_get_pack_word(entry+20);
+
+	/* don't trust the entry until it's known to fit; with
+	 * these limits the size below can't overflow 32 bits */
+	if ((cmap_size == 0) || (cmap_size > 256) || (stride < width)
+	 || (width > 0xFFFF) || (height > 0xFFFF)
+	 || (stride > ((width + 3) & ~3UL))
+	 || (offset > (unsigned long) pack->length)
+	 || (512 + cmap_size*4 + stride*height
+			> (unsigned long) pack->length - offset))
+		return NULL;
+
+	p = pack->data + offset + 512;
+	for (i=0; i < (int) cmap_size; i++, p+=4) {
+		cmap[i].alpha = p[0];
+		cmap[i].red   = p[1];
+		cmap[i].green = p[2];
+		cmap[i].blue  = p[3];
+	}
+
+	img = app_wrap_image((int) width, (int) height, 8, (int) stride,
+			(void *) p, NULL);
+	if (! img)
+		return NULL;
+	app_set_image_cmap(img, (int) cmap_size, cmap);
+
+	sub = app_new_subfont(img, base, (int) app_get_pack_word(entry+24));
+	if (! sub) {
+		app_del_image(img);
+		return NULL;
+	}
+	sub->width = app_alloc(sizeof(sub->width[0]) * 256);
+	if (! sub->width) {
+		app_del_subfont(NULL, sub);
 		return NULL;
 	}
 
+	p = pack->data + offset;
+	for (i=0; i < 256; i++, p+=2) {
+		sub->width[i] = (short) (p[0] | (p[1] << 8));
+		if (*maximum_width < sub->width[i])
+			*maximum_width = sub->width[i];
+	}
+
+	return sub;
+}
+
+/*
+ *  Look for a subfont in the font packs which apply to a Font's
+ *  style, opening the packs when first needed. The packs array
+ *  is indexed by the styles a pack's glyphs were drawn in.
+ */
+static Subfont * app_read_packed_subfont(Font *f, FontPack **packs,
+		unsigned long base, int *style_found)
+{
+	int i, flags, found;
+	Subfont *sub;
+
+	for (i=0; i < NELEM(app_font_search); i++)
+	{
+		flags = app_font_search[i].flags;
+		found = app_font_search[i].found_flags;
+
+		/* only use the part of the search table which applies */
+		if ((f->style & flags) != flags)
+			continue;
+
+		if (! packs[found]) {
+			packs[found] = app_open_font_pack(f->app, f->name,
+				f->height, app_font_search[i].short_name);
+			if (! packs[found])
+				packs[found] = &app_missing_pack;
+		}
+		if (packs[found] == &app_missing_pack)
+			continue;
+
+		sub = app_unpack_subfont(packs[found], base,
+				&f->maximum_width);
+		if (sub) {
+			*style_found = found;
+			return sub;
+		}
+	}
+	return NULL;
+}
+
+/*
+ *  Where each subfont is described in an info file.
+ */
+typedef struct FontPackPage FontPackPage;
+
+struct FontPackPage {
+	unsigned long  base;	/* subfont base number */
+	long           offset;	/* its line in the info file */
+};
+
+/*
+ *  Compare subfont base numbers, for sorting a pack's index.
+ */
+static int app_cmp_font_base(const void *a, const void *b)
+{
+	unsigned long base_a = ((const FontPackPage *) a)->base;
+	unsigned long base_b = ((const FontPackPage *) b)->base;
+
+	if (base_a < base_b)        return (-1);
+	else if (base_a > base_b)   return (+1);
+	else                        return 0;
+}
+
+/*
+ *  Write a font pack holding every subfont of one height and
+ *  style of the font in the given folder, such as "fonts/serif".
+ *  The style must be PLAIN or a mix of BOLD, ITALIC and ANTI_ALIAS
+ *  for which the font has its own images, e.g. 16b.txt and 16b/.
+ *  Returns 1 on success, 0 on failure.
+ */
+int app_write_font_pack(const char *folder, int height, int style,
+		const char *filename)
+{
+	int i, num, max, anti_alias, maximum_width, y;
+	char *short_name, *filepath;
+	char line[20];
+	unsigned long base, offset;
+	FontPackPage *pages, *new_pages;
+	long line_offset;
+	int line_start;
+	FILE *fi, *fo;
+	Image *img;
+	Subfont sub;
+	byte *index, *entry;
+	byte header[APP_FONT_PACK_HEADER];
+	byte word[4];
+	long stride;
+	int ok = 1;
+
+	/* find the file names used for this style */
+	style &= (BOLD | ITALIC | ANTI_ALIAS);
+	short_name = NULL;
+	for (i=0; i < NELEM(app_font_search); i++) {
+		if (app_font_search[i].found_flags == style) {
+			short_name = app_font_search[i].short_name;
+			break;
+		}
+	}
+	if (! short_name)
+		return 0;
+
+	filepath = app_zero_alloc((long) strlen(folder) + 40);
+	if (! filepath)
+		return 0;
+	sprintf(filepath, "%s/%d%s%s", folder, height, short_name,
+			app_font_info_suffix);
+	fi = app_open_file(filepath, "rb");
+	if (! fi) {
+		app_free(filepath);
+		return 0;
+	}
+
+	/* list the subfont base numbers in the info file */
+	num = max = 0;
+	pages = NULL;
+	line_start = 1;
+	line_offset = 0;
+	while (fgets(line, sizeof(line), fi) != NULL) {
+		/* long width lines are read in several pieces */
+		if (! line_start)
+			goto next_line;
+		if ((line[0] == '\t') || (line[0] == ' ')
+		 || (line[0] == '\r') || (line[0] == '\n'))
+			goto next_line;
+		if (num == max) {
+			max = max ? max * 2 : 64;
+			new_pages = app_realloc(pages,
+					max * sizeof(FontPackPage));
+			if (! new_pages) {
+				app_free(pages);
+				pages = NULL;
+				break;
+			}
+			pages = new_pages;
+		}
+		pages[num].base = strtoul(line, NULL, 16);
+		pages[num].offset = line_offset;
+		num++;
+	next_line:
+		line_start = (strchr(line, '\n') != NULL);
+		line_offset = ftell(fi);
+	}
+	if ((! pages) || (num == 0)) {
+		app_free(pages);
+		app_close_file(fi);
+		app_free(filepath);
+		return 0;
+	}
+
+	/* the index must be sorted, whatever order the file uses */
+	qsort(pages, num, sizeof(FontPackPage), app_cmp_font_base);
+
+	index = app_zero_alloc((long) num * APP_FONT_PACK_ENTRY);
+	fo = app_open_file(filename, "wb");
+	if ((! index) || (! fo)) {
+		app_close_file(fo);
+		app_free(index);
+		app_free(pages);
+		app_close_file(fi);
+		app_free(filepath);
+		return 0;
+	}
+
+	/* leave room for the header and index, then write pages */
+	memset(header, 0, sizeof(header));
+	fwrite(header, 1, sizeof(header), fo);
+	fwrite(index, 1, (long) num * APP_FONT_PACK_ENTRY, fo);
+	offset = APP_FONT_PACK_HEADER + (long) num * APP_FONT_PACK_ENTRY;
+	maximum_width = 0;
+	entry = index;
+
+	for (i=0; i < num; i++)
+	{
+		base = pages[i].base;
+		if ((i > 0) && (base == pages[i-1].base))
+			continue;	/* listed twice */
+
+		sprintf(filepath, "%s/%d%s/%08lx%s", folder, height,
+			short_name, base, app_font_file_suffix);
+		img = app_read_image(filepath, 8);
+		if (! img) {
+			sprintf(filepath, "%s/%d%s/%08lx%s", folder, height,
+				short_name, base, app_font_file_suffix_alt);
+			img = app_read_image(filepath, 8);
+		}
+		if (! img)
+			continue;	/* no glyphs for this page */
+		img = app_prepare_subfont_image(img, &anti_alias);
+
+		memset(&sub, 0, sizeof(sub));
+		sub.base = base;
+		/* start at the page's own line, in case the file is not sorted */
+		fseek(fi, pages[i].offset, SEEK_SET);
+		app_read_subfont_info(fi, &sub, &maximum_width);
+
+		/* glyph widths */
+		for (y=0; y < 256; y++) {
+			word[0] = (byte) (sub.width ? sub.width[y] : -1);
+			word[1] = (byte) ((sub.width ? sub.width[y] : -1) >> 8);
+			fwrite(word, 1, 2, fo);
+		}
+		app_free_subfont_widths(&sub);
+
+		/* palette, then pixel rows */
+		for (y=0; y < img->cmap_size; y++) {
+			word[0] = img->cmap[y].alpha;
+			word[1] = img->cmap[y].red;
+			word[2] = img->cmap[y].green;
+			word[3] = img->cmap[y].blue;
+			fwrite(word, 1, 4, fo);
+		}
+		stride = (img->width + 3) & ~3;
+		memset(word, 0, 4);
+		for (y=0; y < img->height; y++) {
+			fwrite(img->data8[y], 1, img->width, fo);
+			fwrite(word, 1, stride - img->width, fo);
+		}
+
+		app_put_pack_word(entry, base);
+		app_put_pack_word(entry+4, offset);
+		app_put_pack_word(entry+8, img->width);
+		app_put_pack_word(entry+12, img->height);
+		app_put_pack_word(entry+16, stride);
+		app_put_pack_word(entry+20, img->cmap_size);
+		app_put_pack_word(entry+24, anti_alias);
+		entry += APP_FONT_PACK_ENTRY;
+		offset += 512 + img->cmap_size * 4 + stride * img->height;
+
+		app_del_image(img);
+	}
+
+	/* now the header and index can be filled in */
+	num = (int) ((entry - index) / APP_FONT_PACK_ENTRY);
+	memcpy(header, app_font_pack_magic, 4);
+	app_put_pack_word(header+4, APP_FONT_PACK_VERSION);
+	app_put_pack_word(header+8, height);
+	app_put_pack_word(header+12, style);
+	app_put_pack_word(header+16, maximum_width);
+	app_put_pack_word(header+20, num);
+	fseek(fo, 0, SEEK_SET);
+	fwrite(header, 1, sizeof(header), fo);
+	if (fwrite(index, 1, (long) num * APP_FONT_PACK_ENTRY, fo)
+			!= (size_t) num * APP_FONT_PACK_ENTRY)
+		ok = 0;
+	if (ferror(fo) || (num == 0))
+		ok = 0;
+
+	if (! app_close_file(fo))
+		ok = 0;
+	app_free(index);
+	app_free(pages);
+	app_close_file(fi);
+	app_free(filepath);
+
+	if (! ok)
+		app_remove_file(filename);
+	return ok;
+}
+
+/*
+ *  Read a subfont of the given font, from one of its font packs
+ *  if it has any, otherwise from its image and info files, and
+ *  synthesise any bold or italic style the glyphs don't have.
+ */
+static Subfont * app_read_subfont(Font *f, FontPack **packs,
+		unsigned long base)
+{
+	int style_found;
+	Image *img, *img2;
+	Subfont *sub;
+
+	sub = app_read_packed_subfont(f, packs, base, &style_found);
+	if (! sub)
+		sub = app_read_subfont_files(f, base, &style_found);
+	if (! sub)
+		return NULL;
+	img = sub->img;
+
 	/* if the font is bold, create a new bold subfont image */
 	if ((f->style & BOLD) && (! (style_found & BOLD))) {
 		img2 = app_subfont_image_to_bold(f, sub, img);
@@ -1103,37 +1752,329 @@ static Subfont * app_load_subfont(Font *f, unsigned long base)
 	if (f->app) {
 		subfont_extra(sub)->clipmask = app_image_to_clipmask(f->app, img);
 		if (! subfont_extra(sub)->clipmask) {
-			/*app_del_subfont(f, sub);
+			/*app_del_subfont(f->app, sub);
 			return NULL;*/
 		}
 	}
 
-	/* add the subfont to the subfont list, evict one if needed */
-	i = f->num_subfonts;
-	list = NULL;
+	return sub;
+}
 
-	if (i == 0) {
-		list = app_alloc(sizeof(Subfont*));
-		if (list == NULL) {
-			app_del_subfont(f, sub);
-			return NULL;	/* failed: no memory */
+/*
+ *  Glyph cache
+ *  -----------
+ *  Subfonts are not owned by Fonts but by a process-wide cache.
+ *  The cache holds one face for each font name, pixel height
+ *  and style which has been used, and every Font with the same
+ *  name, height and style on the same App shares that face, so
+ *  a Font which is deleted and made again finds its subfonts
+ *  still loaded. Faces are per App because the clipmasks and
+ *  glyph sets made from subfonts belong to its display.
+ *
+ *  A face finds its subfonts through a table of 256-glyph pages
+ *  for each Unicode plane, so looking up a character costs two
+ *  array indexes; the character's width is then found in the
+ *  subfont's width array. Pages the font does not have are
+ *  remembered too, so they are not searched for on disk again.
+ *  A face also keeps open the font packs its subfonts came from,
+ *  since their images use the pixels in the packs.
+ *
+ *  Instead of a limit on the number of subfonts per Font, the
+ *  whole cache has a limit on the memory its subfonts use. The
+ *  least recently used subfonts are deleted when it is over
+ *  the limit, but only by app_trim_font_cache, which is called
+ *  before a string is measured or drawn. Subfonts used within
+ *  one string are thus never deleted while it is being drawn.
+ */
+
+typedef struct FontFace   FontFace;
+typedef struct GlyphPage  GlyphPage;
+
+struct FontFace
+{
+	App *		app;
+	char *		name;
+	int		height;
+	int		style;		/* BOLD, ITALIC, ANTI_ALIAS */
+	int		refcount;	/* Fonts using this face */
+	int		num_pages;	/* subfonts loaded */
+	int		maximum_width;	/* widest char loaded so far */
+	GlyphPage **	plane[APP_FONT_PLANES];
+	short **	widths[APP_FONT_PLANES];	/* measured pages */
+	FontPack *	packs[APP_FONT_PACK_STYLES];
+	FontFace *	next;
+};
+
+struct GlyphPage
+{
+	Subfont *	sub;
+	FontFace *	face;
+	long		bytes;		/* memory counted for it */
+	GlyphPage *	newer;		/* least recently used list */
+	GlyphPage *	older;
+};
+
+#define font_face(f) ((FontFace *) (f)->cache)
+
+static GlyphPage   app_missing_page;	/* marks pages not in a font */
+static FontFace *  app_font_faces = NULL;
+static GlyphPage * app_newest_page = NULL;
+static GlyphPage * app_oldest_page = NULL;
+static long        app_font_cache_bytes = 0;
+static long        app_font_cache_limit = APP_FONT_CACHE_LIMIT;
+
+/*
+ *  Estimate the memory used by a subfont: its image, plus as
+ *  much again for the clipmask or glyph set made from it.
+ */
+static long app_subfont_bytes(Subfont *sub)
+{
+	long pixels, bytes;
+
+	bytes = sizeof(Subfont) + 256 * sizeof(short);
+	if (sub->img) {
+		pixels = (long) sub->img->width * sub->img->height;
+		bytes += pixels * (sub->img->depth / 8) + pixels;
+		bytes += sub->img->cmap_size * sizeof(Colour);
+	}
+	return bytes;
+}
+
+/*
+ *  Find the face a Font uses, creating it if need be.
+ */
+static FontFace * app_find_font_face(Font *f)
+{
+	FontFace *face;
+	int style = f->style & (BOLD | ITALIC | ANTI_ALIAS);
+
+	for (face = app_font_faces; face; face = face->next) {
+		if ((face->app == f->app) && (face->height == f->height)
+		 && (face->style == style)
+		 && (strcmp(face->name, f->name) == 0))
+			break;
+	}
+	if (! face) {
+		face = app_zero_alloc(sizeof(FontFace));
+		if (! face)
+			return NULL;
+		face->name = app_alloc((int) strlen(f->name)+1);
+		if (! face->name) {
+			app_free(face);
+			return NULL;
 		}
+		strcpy(face->name, f->name);
+		face->app = f->app;
+		face->height = f->height;
+		face->style = style;
+		face->next = app_font_faces;
+		app_font_faces = face;
 	}
-	else if (i < APP_FONT_MAX_SUBFONTS)
-		list = app_realloc(f->subfonts, (i+1) * sizeof(Subfont*));
+	face->refcount++;
+	f->cache = face;
+	return face;
+}
 
-	if (list) {
-		i++;
-		f->num_subfonts++;
-		f->subfonts = list;
-	} else {
-		list = f->subfonts;
-		app_del_subfont(f, f->subfonts[i-1]);
+/*
+ *  Free a face's tables of measured widths.
+ */
+static void app_forget_font_widths(FontFace *face)
+{
+	int i, j;
+
+	for (i=0; i < APP_FONT_PLANES; i++) {
+		if (! face->widths[i])
+			continue;
+		for (j=0; j < APP_FONT_PLANE_PAGES; j++)
+			app_free(face->widths[i][j]);
+		app_free(face->widths[i]);
+		face->widths[i] = NULL;
+	}
+}
+
+/*
+ *  Unlink and free a face which is no longer used.
+ */
+static void app_del_font_face(FontFace *face)
+{
+	FontFace **fp;
+	int i;
+
+	for (fp = &app_font_faces; *fp; fp = &(*fp)->next) {
+		if (*fp == face) {
+			*fp = face->next;
+			break;
+		}
+	}
+	for (i=0; i < APP_FONT_PLANES; i++)
+		app_free(face->plane[i]);
+	app_forget_font_widths(face);
+	for (i=0; i < APP_FONT_PACK_STYLES; i++)
+		app_del_font_pack(face->packs[i]);
+	app_free(face->name);
+	app_free(face);
+}
+
+/*
+ *  Delete a cached subfont, leaving its page empty again.
+ */
+static void app_evict_glyph_page(GlyphPage *page)
+{
+	FontFace *face = page->face;
+	unsigned long base = page->sub->base;
+
+	face->plane[base >> 16][(base >> 8) & 0xFF] = NULL;
+	face->num_pages--;
+
+	if (page->newer)
+		page->newer->older = page->older;
+	else
+		app_newest_page = page->older;
+	if (page->older)
+		page->older->newer = page->newer;
+	else
+		app_oldest_page = page->newer;
+	app_font_cache_bytes -= page->bytes;
+
+	app_del_subfont(face->app, page->sub);
+	app_free(page);
+
+	if ((face->num_pages == 0) && (face->refcount == 0))
+		app_del_font_face(face);
+}
+
+/*
+ *  Move a page to the most recently used end of the list.
+ */
+static void app_touch_glyph_page(GlyphPage *page)
+{
+	if (page == app_newest_page)
+		return;
+	page->newer->older = page->older;
+	if (page->older)
+		page->older->newer = page->newer;
+	else
+		app_oldest_page = page->newer;
+	page->older = app_newest_page;
+	page->newer = NULL;
+	app_newest_page->newer = page;
+	app_newest_page = page;
+}
+
+/*
+ *  Delete the least recently used subfonts until the cache
+ *  is within its memory limit. Not to be called while a
+ *  string is being drawn, since its subfonts might go.
+ */
+APP_PRIVATE
+void app_trim_font_cache(void)
+{
+	while ((app_font_cache_bytes > app_font_cache_limit)
+	    && app_oldest_page)
+		app_evict_glyph_page(app_oldest_page);
+}
+
+/*
+ *  Set the most memory the subfonts of all fonts may use.
+ */
+void app_set_font_cache_size(long bytes)
+{
+	if (bytes < 0)
+		bytes = APP_FONT_CACHE_LIMIT;
+	app_font_cache_limit = bytes;
+	app_trim_font_cache();
+}
+
+/*
+ *  Delete the cached subfonts which belong to an App's display,
+ *  before the display is closed.
+ */
+APP_PRIVATE
+void app_forget_font_cache(App *app)
+{
+	GlyphPage *page, *older;
+	FontFace *face, *next;
+
+	for (page = app_newest_page; page; page = older) {
+		older = page->older;
+		if (page->face->app == app)
+			app_evict_glyph_page(page);
+	}
+	for (face = app_font_faces; face; face = next) {
+		next = face->next;
+		if ((face->app == app) && (face->refcount == 0))
+			app_del_font_face(face);
+	}
+}
+
+/*
+ *  Find the subfont which holds the given page of a font,
+ *  loading it into the cache if it is not there yet.
+ */
+static Subfont * app_load_subfont(Font *f, unsigned long base)
+{
+	FontFace *face;
+	GlyphPage **slot;
+	GlyphPage *page;
+	Subfont *sub;
+	int p;
+
+	face = font_face(f);
+	if (! face) {
+		face = app_find_font_face(f);
+		if (! face)
+			return NULL;
+	}
+
+	p = (int) (base >> 16);
+	if (p >= APP_FONT_PLANES)
+		return NULL;	/* beyond Unicode */
+	if (! face->plane[p]) {
+		face->plane[p] = app_zero_alloc(
+				APP_FONT_PLANE_PAGES * sizeof(GlyphPage *));
+		if (! face->plane[p])
+			return NULL;
+	}
+	slot = & face->plane[p][(base >> 8) & 0xFF];
+
+	page = *slot;
+	if (page == &app_missing_page)
+		return NULL;
+	if (page) {
+		app_touch_glyph_page(page);
+		if (f->maximum_width < face->maximum_width)
+			f->maximum_width = face->maximum_width;
+		return page->sub;
 	}
 
-	if (i > 1)
-		memmove(&list[1], list, (i-1)*sizeof(Subfont*));
-	f->subfonts[0] = sub;
+	/* not loaded yet */
+	sub = app_read_subfont(f, face->packs, base);
+	if (! sub) {
+		*slot = &app_missing_page;
+		return NULL;
+	}
+	page = app_zero_alloc(sizeof(GlyphPage));
+	if (! page) {
+		app_del_subfont(f->app, sub);
+		return NULL;
+	}
+	page->sub = sub;
+	page->face = face;
+	page->bytes = app_subfont_bytes(sub);
+	page->older = app_newest_page;
+	if (app_newest_page)
+		app_newest_page->newer = page;
+	else
+		app_oldest_page = page;
+	app_newest_page = page;
+	app_font_cache_bytes += page->bytes;
+
+	*slot = page;
+	face->num_pages++;
+	if (face->maximum_width < f->maximum_width)
+		face->maximum_width = f->maximum_width;
+	if (f->maximum_width < face->maximum_width)
+		f->maximum_width = face->maximum_width;
 
 	return sub;
 }
@@ -1204,7 +2145,9 @@ Font * app_new_font(App *app, const char *name, int style, int size)
 		if (fi) {
 			style &= ~NATIVE_FONT;
 			app_close_file(fi);
-		} else
+		} else if (app_font_pack_exists(app, name, height, style))
+			style &= ~NATIVE_FONT;
+		else
 			style &= ~PORTABLE_FONT;
 	}
 
@@ -1280,10 +2223,15 @@ void app_del_font(Font *f)
 		app_release_native_font(f);
 	}
 
+	/* Release its subfonts to the glyph cache. */
+	if (font_face(f)) {
+		font_face(f)->refcount--;
+		if ((font_face(f)->num_pages == 0)
+		 && (font_face(f)->refcount == 0))
+			app_del_font_face(font_face(f));
+	}
+
 	/* Destroy the font structure. */
-	for (i=f->num_subfonts-1; i >= 0; i--)
-		app_del_subfont(f, f->subfonts[i]);
-	app_free(f->subfonts);
 	app_free(f->name);
 	app_free(f->extra);
 	app_free(f);
@@ -1311,7 +2259,8 @@ Font *app_find_default_font(App *app)
  *  The subfont containing this character must already have
  *  been loaded.
  */
-static int app_subfont_char_width(Subfont *sub, unsigned long ch)
+APP_PRIVATE
+int app_subfont_char_width(Subfont *sub, unsigned long ch)
 {
 	int i, r;
 	byte c;
@@ -1377,42 +2326,193 @@ int app_font_height(Font *f)
 }
 
 /*
- *  Return the width of a UTF-8 string, in pixels.
+ *  String measurement
+ *  ------------------
+ *  Strings are measured with flat tables of widths, one for
+ *  each page of 256 characters which has been measured, kept
+ *  by the face. A table holds the widths app_font_width uses:
+ *  the font's own, or else the default font's, or else 6 for
+ *  a character neither has. Measuring a character thus costs
+ *  one table lookup, and ASCII text needs no UTF-8 decoding.
+ *  The tables are small and stay when the subfonts they were
+ *  made from leave the cache.
  */
-int app_font_width(Font *f, const char *s, int nbytes)
+
+/*
+ *  Return the table of widths for a page of a font, making
+ *  it if need be. Returns NULL if there is no memory.
+ */
+static const short * app_font_page_widths(Font *f, unsigned long page)
 {
-	int w, total;
-	const char *sp;
-	const char *src_end;
-	unsigned long ch;
-	unsigned long *cp;
-	Subfont *sub;
+	FontFace *face;
+	short **slot;
+	short *table;
+	int c, w, p;
+
+	face = font_face(f);
+	if (! face) {
+		face = app_find_font_face(f);
+		if (! face)
+			return NULL;
+	}
 
-	if (f->style & NATIVE_FONT)
-		return app_native_font_string_width(f, s, nbytes);
+	p = (int) (page >> 16);
+	if (p >= APP_FONT_PLANES)
+		return NULL;	/* beyond Unicode */
+	if (! face->widths[p]) {
+		face->widths[p] = app_zero_alloc(
+				APP_FONT_PLANE_PAGES * sizeof(short *));
+		if (! face->widths[p])
+			return NULL;
+	}
+	slot = & face->widths[p][(page >> 8) & 0xFF];
+
+	if (! *slot) {
+		table = app_alloc(256 * sizeof(short));
+		if (! table)
+			return NULL;
+		for (c=0; c < 256; c++) {
+			app_font_char_info(f, page + c, &w);
+			table[c] = (w < 0) ? 6 : w;
+		}
+		*slot = table;
+	}
+	return *slot;
+}
+
+/*
+ *  Measure a UTF-8 string in a portable font. If x is not NULL,
+ *  x[i] is set to the offset in pixels of byte i, for every byte
+ *  and the end of the string, so x must have nbytes+1 elements.
+ *  The bytes of a character all have the character's offset.
+ */
+static int app_measure_utf8(Font *f, const char *s, int nbytes, int *x)
+{
+	int i, k, n, w, total;
+	const short *ascii;
+	const short *page_width;
+	unsigned long page, ch;
+	unsigned long *cp;
+	const char *sp;
+	byte c;
 
+	ascii = app_font_page_widths(f, 0);
+	page = ~0UL;
+	page_width = NULL;
 	total = 0;
-	sp = s;
-	src_end = s + nbytes;
 
-	while (nbytes > 0) {
+	for (i=0; i < nbytes; i += n)
+	{
+		c = (byte) s[i];
+		if ((c < 0x80) && ascii) {
+			/* fast path for ASCII */
+			if (x)
+				x[i] = total;
+			total += ascii[c];
+			n = 1;
+			continue;
+		}
+
+		sp = s + i;
 		cp = &ch;
-		if (app_utf8_to_unicode(&sp, src_end, &cp, cp+1)
+		if (app_utf8_to_unicode(&sp, s + nbytes, &cp, cp+1)
 		    & SourceExhausted)
 			break;
-		nbytes -= (int) (sp - s);
-		s = sp;
+		n = (int) (sp - (s + i));
 
-		sub = app_font_char_info(f, ch, &w);
+		if ((ch & 0xFFFFFF00UL) != page) {
+			page = ch & 0xFFFFFF00UL;
+			page_width = app_font_page_widths(f, page);
+		}
+		if (page_width)
+			w = page_width[ch & 0xFF];
+		else {
+			app_font_char_info(f, ch, &w);
+			if (w < 0)
+				w = 6;	/* no glyph, reserve 6 pixels */
+		}
 
-		if (w < 0) {
-			/* character glyph not found, reserve 6 pixels */
-			total += 6;
-			continue; /* go to next character */
+		if (x) {
+			for (k=0; k < n; k++)
+				x[i+k] = total;
 		}
-		/* else, character glyph exists */
 		total += w;
 	}
+
+	if (x) {
+		for ( ; i <= nbytes; i++)
+			x[i] = total;
+	}
+	return total;
+}
+
+/*
+ *  Return the width of a UTF-8 string, in pixels.
+ */
+int app_font_width(Font *f, const char *s, int nbytes)
+{
+	if (f->style & NATIVE_FONT)
+		return app_native_font_string_width(f, s, nbytes);
+
+	app_trim_font_cache();
+	return app_measure_utf8(f, s, nbytes, NULL);
+}
+
+/*
+ *  Measure many UTF-8 strings at once, putting the width of
+ *  each into the widths array. If nbytes is NULL the strings
+ *  must be nul-terminated. Returns the widest width.
+ */
+int app_font_widths(Font *f, int count, const char **utf8,
+		const int *nbytes, int *widths)
+{
+	int i, n, w, widest;
+
+	if (! (f->style & NATIVE_FONT))
+		app_trim_font_cache();
+
+	widest = 0;
+	for (i=0; i < count; i++) {
+		n = nbytes ? nbytes[i] : (int) strlen(utf8[i]);
+		if (f->style & NATIVE_FONT)
+			w = app_native_font_string_width(f, utf8[i], n);
+		else
+			w = app_measure_utf8(f, utf8[i], n, NULL);
+		if (widths)
+			widths[i] = w;
+		if (widest < w)
+			widest = w;
+	}
+	return widest;
+}
+
+/*
+ *  Find the offset in pixels of every byte of a UTF-8 string,
+ *  for placing a caret or finding which character was clicked.
+ *  The x array must have nbytes+1 elements; x[i] is the width
+ *  of the text before byte i, and x[nbytes] the whole width,
+ *  which is also returned. The bytes of a character all have
+ *  the character's offset.
+ */
+int app_font_prefix_widths(Font *f, const char *utf8, int nbytes, int *x)
+{
+	int i, k, n, total;
+
+	if (! (f->style & NATIVE_FONT)) {
+		app_trim_font_cache();
+		return app_measure_utf8(f, utf8, nbytes, x);
+	}
+
+	total = 0;
+	for (i=0; i < nbytes; i += n) {
+		n = 1;
+		while ((i+n < nbytes) && ((utf8[i+n] & 0xC0) == 0x80))
+			n++;
+		for (k=0; k < n; k++)
+			x[i+k] = total;
+		total += app_native_font_string_width(f, utf8+i, n);
+	}
+	x[nbytes] = total;
 	return total;
 }
 
@@ -1430,6 +2530,12 @@ void app_set_default_font(Graphics *g)
  */
 void app_change_default_font(const char *name)
 {
+	FontFace *face;
+
         if (name != NULL)
 		app_font_default = name;
+
+	/* measured widths may have come from the old default font */
+	for (face = app_font_faces; face; face = face->next)
+		app_forget_font_widths(face);
 }
@@ -12,6 +12,14 @@
  *  Version: 3.61  2010/01/28 halftone_32_bit now handles alpha.
  *  Version: 3.62  2010/02/21 Fixed a bug in app_draw_image.
  *  Version: 3.63  2010/11/21 consts, app_get_image_rect, static to APP_PRIVATE.
+ *  Version: 3.64  2026/10/17 Pixels now stored in one contiguous buffer.
+ *  Version: 3.65  2026/10/17 Added app_wrap_image for caller-owned pixels.
+ *  Version: 3.66  2026/10/17 Separable resampler replaces scale_down, halftone.
+ *  Version: 3.67  2026/10/17 Row-independent operations run in worker threads.
+ *  Version: 3.68  2026/10/17 fast_find_cmap uses a hash table, one pass.
+ *  Version: 3.69  2026/10/17 Median-cut quantization in convert_32_to_8.
+ *  Version: 3.70  2026/10/17 app_draw_image keeps the Bitmap it makes.
+ *  Version: 3.71  2026/10/17 app_draw_image converts only the visible part.
  */
 
 /* Copyright (c) L. Patrick
@@ -43,16 +51,63 @@
  *  Any other depth is deliberately not supported.
  *  Transparency is handled in the alpha channel of each rgb value
  *  (either inside the cmap, or in the data32 array itself).
+ *
+ *  Images made by app_new_image keep all their pixels in one
+ *  contiguous buffer (pixels), with each row starting (stride)
+ *  bytes after the previous one. The data8 or data32 row arrays
+ *  point into that buffer, so data32[y][x] still works as before.
+ *  Images assembled by hand (e.g. by the image readers) may have
+ *  separately allocated rows; these have a NULL pixels field.
+ *  Images made by app_wrap_image use the caller's pixel buffer
+ *  directly, and hand it back through a release function.
  */
 
+#include <math.h>
 #include "apputils.h"
 
+/*
+ *  Operations which work out each row of their result on its
+ *  own describe the work with an ImageJob and hand it to
+ *  app_run_bands, which may share bands of rows out between
+ *  worker threads (see x11/thread.c). Band functions must not
+ *  allocate memory.
+ */
+typedef struct ImageJob ImageJob;
+
+struct ImageJob {
+	Image *		dest;
+	const Image *	src;
+	Rect		dr;
+	Rect		sr;
+	int		x0, x1;		/* columns of dr inside dest */
+	int		y0;		/* first row of dr inside dest */
+	Colour		(*change)(Colour c);
+};
+
+/*
+ *  Find the number of bytes between rows of a new image.
+ *  Rows are padded to a multiple of four bytes.
+ */
+APP_PRIVATE
+int app_image_stride(int width, int depth)
+{
+	int stride;
+
+	if (depth == 8)
+		stride = width;
+	else
+		stride = width * sizeof(Colour);
+
+	return (stride + 3) & ~3;
+}
+
 /*
  *  Create a new image:
  */
 Image * app_new_image(int width, int height, int depth)
 {
 	Image *img;
+	byte *row;
 	int i;
 
 	if ((depth != 8) && (depth != 32))
@@ -65,18 +120,85 @@ Image * app_new_image(int width, int height, int depth)
 
 	img->width  = width;
 	img->height = height;
+	img->depth  = depth;
+	img->stride = app_image_stride(width, depth);
+	img->pixels = app_alloc((long) height * img->stride);
+
+	row = img->pixels;
+
+	if (depth == 8) {
+		img->data8  = app_alloc(height * sizeof(byte *));
+		for (i=0; i < height; i++, row += img->stride)
+			img->data8[i] = row;
+	}
+	else {
+		img->data32 = app_alloc(height * sizeof(Colour *));
+		for (i=0; i < height; i++, row += img->stride)
+			img->data32[i] = (Colour *) row;
+	}
+
+	return img;
+}
+
+/*
+ *  Wrap an image around pixels which belong to the caller:
+ *  The pixels must already be laid out as image rows, either
+ *  bytes (8-bit) or Colour values (32-bit), with each row
+ *  starting stride bytes after the previous one. A stride of
+ *  zero means the rows are packed together with no padding.
+ *  The pixels are not copied. When the image is deleted the
+ *  release function is called with the pixels, so the caller
+ *  can free them; if it is NULL the pixels are left alone.
+ *  Returns NULL if the parameters make no sense.
+ */
+APP_PRIVATE
+void app_keep_image_pixels(void *pixels)
+{
+	/* the caller still owns these pixels */
+}
+
+Image * app_wrap_image(int width, int height, int depth, int stride,
+			void *pixels, ImageReleaseFunc release)
+{
+	Image *img;
+	byte *row;
+	int i;
+
+	if ((depth != 8) && (depth != 32))
+		return NULL;
+	if ((width < 0) || (height < 0) || (pixels == NULL))
+		return NULL;
+
+	if (stride == 0)
+		stride = width * (depth / 8);
+	if (stride < width * (depth / 8))
+		return NULL;
+	if ((depth == 32) && (stride % sizeof(Colour) != 0))
+		return NULL;
+
+	img = app_zero_alloc(sizeof(struct Image));
+
+	if (! img)
+		return img;
+
+	img->width   = width;
+	img->height  = height;
+	img->depth   = depth;
+	img->stride  = stride;
+	img->pixels  = pixels;
+	img->release = release ? release : app_keep_image_pixels;
+
+	row = img->pixels;
 
 	if (depth == 8) {
-		img->depth  = 8;
 		img->data8  = app_alloc(height * sizeof(byte *));
-		for (i=0; i < height; i++)
-			img->data8[i] = app_alloc(width);
+		for (i=0; i < height; i++, row += stride)
+			img->data8[i] = row;
 	}
 	else {
-		img->depth  = 32;
 		img->data32 = app_alloc(height * sizeof(Colour *));
-		for (i=0; i < height; i++)
-			img->data32[i] = app_alloc(width * sizeof(Colour));
+		for (i=0; i < height; i++, row += stride)
+			img->data32[i] = (Colour *) row;
 	}
 
 	return img;
@@ -88,35 +210,109 @@ Image * app_new_image(int width, int height, int depth)
 Image * app_copy_image(const Image *img)
 {
 	Image *new_img;
-	int x, y;
+	long row_bytes;
+	int y;
 
 	if (! img)
 		return NULL;
 
 	new_img = app_new_image(img->width, img->height, img->depth);
+	if (! new_img)
+		return NULL;
 
 	/* set the pixel values */
-	if (img->depth == 8) {
-		for (y=0; y < img->height; y++) {
-			for (x=0; x < img->width; x++) {
-				new_img->data8[y][x] = img->data8[y][x];
-			}
-		}
-		/* copy the palette */
-		if (img->cmap_size > 0)
-			app_set_image_cmap(new_img, img->cmap_size, img->cmap);
+	row_bytes = (long) img->width * (img->depth / 8);
+
+	if (img->pixels && (img->stride == new_img->stride)
+	    && (img->height > 0)) {
+		/* both images are contiguous: copy in one pass */
+		memcpy(new_img->pixels, img->pixels,
+			(long) (img->height - 1) * img->stride + row_bytes);
+	}
+	else if (img->depth == 8) {
+		for (y=0; y < img->height; y++)
+			memcpy(new_img->data8[y], img->data8[y], row_bytes);
 	}
 	else if (img->depth == 32) {
-		for (y=0; y < img->height; y++) {
-			for (x=0; x < img->width; x++) {
-				new_img->data32[y][x] = img->data32[y][x];
-			}
-		}
+		for (y=0; y < img->height; y++)
+			memcpy(new_img->data32[y], img->data32[y], row_bytes);
 	}
 
+	/* copy the palette */
+	if ((img->depth == 8) && (img->cmap_size > 0))
+		app_set_image_cmap(new_img, img->cmap_size, img->cmap);
+
 	return new_img;
 }
 
+/*
+ *  Cached Bitmaps
+ *  --------------
+ *  Drawing an image to a window or bitmap first converts it into
+ *  a Bitmap, which is slow. app_draw_image keeps the last Bitmap
+ *  it made with the image, and uses it again while the image's
+ *  generation stays the same, so redrawing an unchanged image
+ *  only copies pixels from one Bitmap to another.
+ *
+ *  Drawing into an image, or changing its colour map, moves on
+ *  its generation. A program which changes data8, data32 or cmap
+ *  directly should call app_image_changed afterwards.
+ *
+ *  The conversion only depends on the App and the palette of the
+ *  window the Bitmap is made for, so one Bitmap serves all windows
+ *  sharing those. Images holding a Bitmap are listed, so that the
+ *  Bitmap can be deleted along with the window it was made for.
+ */
+typedef struct ImageCache ImageCache;
+
+struct ImageCache {
+	long     generation;	/* image generation it was made from */
+	Rect     sr;		/* part of the image it shows */
+	int      width;		/* size that part was scaled to */
+	int      height;
+	Rect     part;		/* part of the scaled result it holds */
+	Bitmap * bmap;
+};
+
+static Image ** cached_images = NULL;
+
+void app_image_changed(Image *img)
+{
+	img->generation++;
+}
+
+static void app_del_image_cache(Image *img)
+{
+	ImageCache *c = (ImageCache *) img->cache;
+
+	if (! c)
+		return;
+	app_del_bitmap(c->bmap);
+	app_free(c);
+	img->cache = NULL;
+	cached_images = (Image **) app_del_array_element(
+				(void **) cached_images, img);
+}
+
+/*
+ *  Delete the cached Bitmaps which were made for a window,
+ *  before the window itself is deleted.
+ */
+APP_PRIVATE
+void app_forget_image_caches(Window *win)
+{
+	ImageCache *c;
+	int i = 0;
+
+	while (cached_images && cached_images[i]) {
+		c = (ImageCache *) cached_images[i]->cache;
+		if (c->bmap->win == win)
+			app_del_image_cache(cached_images[i]);
+		else
+			i++;
+	}
+}
+
 /*
  *  Delete an image:
  */
@@ -124,16 +320,29 @@ void app_del_image(Image *img)
 {
 	int row;
 
-	if (img->data8) {
-		for (row=0; row < img->height; row++)
-			app_free(img->data8[row]);
+	app_del_image_cache(img);
+
+	if (img->pixels) {
+		/* rows all point into the one buffer */
+		if (img->release)
+			img->release(img->pixels);
+		else
+			app_free(img->pixels);
 		app_free(img->data8);
+		app_free(img->data32);
 	}
+	else {
+		if (img->data8) {
+			for (row=0; row < img->height; row++)
+				app_free(img->data8[row]);
+			app_free(img->data8);
+		}
 
-	if (img->data32) {
-		for (row=0; row < img->height; row++)
-			app_free(img->data32[row]);
-		app_free(img->data32);
+		if (img->data32) {
+			for (row=0; row < img->height; row++)
+				app_free(img->data32[row]);
+			app_free(img->data32);
+		}
 	}
 
 	if (img->cmap)
@@ -186,6 +395,7 @@ void app_set_image_cmap(Image *img, int cmap_size, Colour *cmap)
 		img->cmap[i] = cmap[i];
 
 	app_free(prev_cmap);
+	app_image_changed(img);
 }
 
 /*
@@ -239,23 +449,39 @@ int app_image_has_transparent_pixels(const Image *img)
  *  image, this routine will return the corresponding
  *  indexed 8-bit image.
  *  Returns NULL if more than 256 colours are found.
+ *
+ *  Colours are found in one pass, using a small open-addressed
+ *  hash table of packed colours, and the cmap lists them in the
+ *  order they were first seen.
  */
+
+#define CMAP_HASH_SIZE  1024	/* a power of two, over 2 * 256 */
+
 APP_PRIVATE
 Image * app_fast_find_cmap (const Image *img)
 {
 	Image * new_img;
-	long    i, x, y;
-	int     cmap_size, low, high, mid;
-	Colour  col, col2;
+	long    x, y;
+	int     cmap_size, h, value;
+	unsigned long key, last_key;
+	Colour  col;
 	Colour  cmap[256];
+	unsigned long keys[CMAP_HASH_SIZE];
+	short   index[CMAP_HASH_SIZE];	/* -1 for an empty slot */
+	byte *  dest;
 
-	/* the first colour goes into the cmap automatically: */
-	cmap_size = 0;
-	mid = 0;
+	new_img = app_new_image(img->width, img->height, 8);
+	if (! new_img)
+		return NULL;
 
-	/* create a sorted colour map for speed: */
+	for (h=0; h < CMAP_HASH_SIZE; h++)
+		index[h] = -1;
+	cmap_size = 0;
+	last_key = 0;
+	value = -1;
 
 	for (y=0; y < img->height; y++) {
+	  dest = new_img->data8[y];
 	  for (x=0; x < img->width; x++) {
 		col = img->data32[y][x];
 		/* only allow one transparent colour in the cmap: */
@@ -264,90 +490,83 @@ Image * app_fast_find_cmap (const Image *img)
 		else
 			col.alpha = 0;	/* opaque */
 
-		/* binary search the cmap: */
-		low = 0;
-		high = cmap_size - 1;
-		while (low <= high) {
-			mid = (low+high)/2;
-			col2 = cmap[mid];
-			if ((col.alpha < col2.alpha) ||
-			    (col.red   < col2.red)   ||
-			    (col.green < col2.green) ||
-			    (col.blue  < col2.blue))
-				high = mid - 1;
-			else
-			if ((col.alpha > col2.alpha) ||
-			    (col.red   > col2.red)   ||
-			    (col.green > col2.green) ||
-			    (col.blue  > col2.blue))
-				low  = mid + 1;
-			else
-				break;
-		}
+		key = ((unsigned long) col.alpha << 24)
+			| ((unsigned long) col.red << 16)
+			| ((unsigned long) col.green << 8)
+			| (unsigned long) col.blue;
 
-		if (high < low) {
-			/* didn't find colour in cmap, insert it: */
-			if (cmap_size >= 256)
-				return NULL;
-			for (i=cmap_size; i > low; i--)
-				cmap[i] = cmap[i-1];
-			cmap[low] = col;
-			cmap_size ++;
+		/* runs of one colour are common, so check that first: */
+		if ((key != last_key) || (value < 0))
+		{
+			h = (int) (((key * 0x9E3779B1UL) & 0xFFFFFFFFUL) >> 22);
+			while ((index[h] >= 0) && (keys[h] != key))
+				h = (h + 1) & (CMAP_HASH_SIZE - 1);
+
+			if (index[h] < 0) {
+				/* a new colour, add it to the cmap: */
+				if (cmap_size >= 256) {
+					app_del_image(new_img);
+					return NULL;
+				}
+				keys[h] = key;
+				index[h] = cmap_size;
+				cmap[cmap_size++] = col;
+			}
+			value = index[h];
+			last_key = key;
 		}
+		dest[x] = value;
 	  }
 	}
 
-	/* create the 8-bit indexed image: */
-
-	new_img = app_new_image(img->width, img->height, 8);
-	if (! new_img)
-		return NULL;
 	app_set_image_cmap(new_img, cmap_size, cmap);
 
-	/* convert each 32-bit pixel into an 8-bit pixel: */
+	return new_img;
+}
 
-	for (y=0; y < img->height; y++) {
+/*
+ *  Map rows y1 to y2-1 of a 32-bit image onto the colour cube.
+ */
+static
+void app_generate_cmap_rows(void *data, int thread, int y1, int y2)
+{
+	ImageJob *job = data;
+	const Image *img = job->src;
+	long    x, y;
+	int     r, g, b, value;
+	Colour  col;
+
+	for (y=y1; y < y2; y++) {
 	  for (x=0; x < img->width; x++) {
 		col = img->data32[y][x];
+		r = col.red;
+		g = col.green;
+		b = col.blue;
 
-		/* only allow one transparent colour in the cmap: */
-		if (col.alpha > 0x7F)
-			col = argb(255,255,255,255);	/* transparent */
-		else
-			col.alpha = 0;	/* opaque */
+		if (col.alpha > 0x7F)  /* transparent */
+			value = 255;
 
-		/* binary search the cmap: */
-		low = 0;
-		high = cmap_size - 1;
-		while (low <= high) {
-			mid = (low+high)/2;
-			col2 = cmap[mid];
-			if ((col.alpha < col2.alpha) ||
-			    (col.red   < col2.red)   ||
-			    (col.green < col2.green) ||
-			    (col.blue  < col2.blue))
-				high = mid - 1;
-			else
-			if ((col.alpha > col2.alpha) ||
-			    (col.red   > col2.red)   ||
-			    (col.green > col2.green) ||
-			    (col.blue  > col2.blue))
-				low  = mid + 1;
+		else if ((r == g) && (r == b))	/* grey */
+		{
+			g = g * 38 / 255;
+			if (g == 0)
+				value = 0;	/* black */
 			else
-				break;
+				value = 216 + g;
 		}
 
-		if (high < low) {
-			/* impossible situation */
-			app_del_image(new_img);
-			return NULL;
+		else	/* map to 6x6x6 colour cube */
+		{
+			r = r * 5 / 255;
+			g = g * 5 / 255;
+			b = b * 5 / 255;
+
+			value = r*36 + g*6 + b;
 		}
 
-		new_img->data8[y][x] = mid;
+		job->dest->data8[y][x] = value;
 	  }
 	}
-
-	return new_img;
 }
 
 /*
@@ -360,17 +579,17 @@ APP_PRIVATE
 Image * app_fast_generate_cmap (const Image *img)
 {
 	Image * new_img;
-	long    i, x, y;
+	long    i;
 	int     r, g, b, value;
-	Colour  col;
 	Colour  cmap[256];
+	ImageJob job;
 
 	/* Generate the colour map: */
 
 	for (r=0; r<6; r++)		/* 6x6x6 colour cube */
 	  for (g=0; g<6; g++)
 	    for (b=0; b<6; b++)
-		cmap[r*36 + g*6 + b] = rgb(r,g,b);
+		cmap[r*36 + g*6 + b] = rgb(r*51, g*51, b*51);
 
 	for (i=0; i<39; i++)		/* greyscale ramp */
 	{
@@ -389,43 +608,77 @@ Image * app_fast_generate_cmap (const Image *img)
 
 	/* Translate the pixels from 32-bit to 8-bit: */
 
-	for (y=0; y < img->height; y++) {
-	  for (x=0; x < img->width; x++) {
-		col = img->data32[y][x];
-		r = col.red;
-		g = col.green;
-		b = col.blue;
+	job.dest = new_img;
+	job.src = img;
+	app_run_bands(app_generate_cmap_rows, &job, img->height,
+			app_worker_threads());
 
-		if (col.alpha > 0x7F)  /* transparent */
-			value = 255;
+	return new_img;
+}
 
-		else if ((r == g) && (r == b))	/* grey */
-		{
-			g = g * 38 / 255;
-			if (g == 0)
-				value = 0;	/* black */
-			else
-				value = 216 + g;
-		}
+/*
+ *  Reduce an image to at most max_colours colours, choosing
+ *  the palette by median cut and mapping the pixels onto it
+ *  using the given DitherMethod. An image which already has
+ *  few enough colours is converted exactly.
+ *  Returns an 8-bit image, or NULL on failure.
+ */
+Image * app_quantize_image(const Image *img, int max_colours, int dither)
+{
+	Image *new_img, *img32;
+	Palette *pal;
+	Ditherer *d;
+	int y;
 
-		else	/* map to 6x6x6 colour cube */
-		{
-			r = r * 5 / 255;
-			g = g * 5 / 255;
-			b = b * 5 / 255;
+	if ((max_colours <= 0) || (max_colours > 256))
+		max_colours = 256;
 
-			value = r*36 + g*6 + b;
-		}
+	if (img->depth == 8) {
+		if (img->cmap_size <= max_colours)
+			return app_copy_image(img);
+		img32 = app_image_convert_8_to_32(img);
+		if (! img32)
+			return NULL;
+		new_img = app_quantize_image(img32, max_colours, dither);
+		app_del_image(img32);
+		return new_img;
+	}
 
-		new_img->data8[y][x] = value;
-	  }
+	new_img = app_fast_find_cmap(img);
+	if (new_img) {
+		if (new_img->cmap_size <= max_colours)
+			return new_img;
+		app_del_image(new_img);
+	}
+
+	pal = app_quantize_rows(img->data32, img->width, img->height,
+				max_colours);
+	if (! pal)
+		return NULL;
+	new_img = app_new_image(img->width, img->height, 8);
+	d = app_new_ditherer(pal, img->width, dither);
+	if ((! new_img) || (! d)) {
+		if (new_img)
+			app_del_image(new_img);
+		if (d)
+			app_del_ditherer(d);
+		app_del_palette(pal);
+		return NULL;
 	}
+	app_set_image_cmap(new_img, pal->size, pal->element);
 
+	for (y=0; y < img->height; y++)
+		app_dither_row(d, y, img->data32[y], new_img->data8[y]);
+
+	app_del_ditherer(d);
+	app_del_palette(pal);
 	return new_img;
 }
 
 /*
  *  Try to generate an 8-bit version of a 32-bit image:
+ *  Images with more than 256 colours are quantized and
+ *  dithered, or mapped onto a colour cube if that fails.
  *  Return NULL on failure.
  */
 Image * app_image_convert_32_to_8 (const Image *img)
@@ -435,33 +688,46 @@ Image * app_image_convert_32_to_8 (const Image *img)
 	if (img->depth == 8)
 		return app_copy_image(img);
 
-	new_img = app_fast_find_cmap(img);
+	new_img = app_quantize_image(img, 256, DIFFUSION_DITHER);
 	if (! new_img)
 		new_img = app_fast_generate_cmap(img);
 
 	return new_img;
 }
 
+static
+void app_convert_8_to_32_rows(void *data, int thread, int y1, int y2)
+{
+	ImageJob *job = data;
+	const Image *img = job->src;
+	int x, y;
+	byte value;
+
+	for (y=y1; y < y2; y++) {
+	  for (x=0; x < img->width; x++) {
+		value = img->data8[y][x];
+		job->dest->data32[y][x] = img->cmap[value];
+	  }
+	}
+}
+
 /*
  *  Try to generate a 32-bit version of an 8-bit image:
  *  Return NULL if there is no memory left.
  */
 Image * app_image_convert_8_to_32 (const Image *img)
 {
-	int x, y;
 	Image *new_img;
-	byte value;
+	ImageJob job;
 
 	new_img = app_new_image(img->width, img->height, 32);
 	if (! new_img)
 		return new_img;
 
-	for (y=0; y < img->height; y++) {
-	  for (x=0; x < img->width; x++) {
-		value = img->data8[y][x];
-		new_img->data32[y][x] = img->cmap[value];
-	  }
-	}
+	job.dest = new_img;
+	job.src = img;
+	app_run_bands(app_convert_8_to_32_rows, &job, img->height,
+			app_worker_threads());
 
 	return new_img;
 }
@@ -564,6 +830,7 @@ void app_image_sort_palette(Image *img)
 	for (y=0; y < img->height; y++)
 		for (x=0; x < img->width; x++)
 			img->data8[y][x] = translate[img->data8[y][x]];
+	app_image_changed(img);
 
 	/* Clean up: */
 	app_free(translate);
@@ -686,19 +953,39 @@ Colour app_get_grey_pixel(const Image *img, int x, int y)
  *  it is no longer needed.
  */
 
-APP_PRIVATE
-void app_scale_8_bit_image(Image *dest, const Image *src, Rect dr, Rect sr)
+/*
+ *  Find which columns and rows of dr lie inside the destination
+ *  image, so that only those pixels are computed. Bands then
+ *  cover rows job->y0 up to *y1 of dr.
+ */
+static
+void app_clip_scaled_rows(ImageJob *job, int *y1)
 {
+	Rect dr = job->dr;
+	Image *dest = job->dest;
+
+	job->x0 = (dr.x < 0) ? -dr.x : 0;
+	job->x1 = (dr.x + dr.width > dest->width) ? dest->width - dr.x : dr.width;
+	job->y0 = (dr.y < 0) ? -dr.y : 0;
+	*y1 = (dr.y + dr.height > dest->height) ? dest->height - dr.y : dr.height;
+}
+
+static
+void app_scale_8_bit_rows(void *data, int thread, int y1, int y2)
+{
+	ImageJob *job = data;
+	Image *dest = job->dest;
+	const Image *src = job->src;
+	Rect dr = job->dr;
+	Rect sr = job->sr;
 	int value, t;
 	long x, y;
 	long dx, dy, sx, sy;
-	long dw, dh, sw, sh;
+	long sw, sh;
 	long hscale, vscale;
 	byte ** src_pixels = src->data8;
 	byte ** dest_pixels = dest->data8;
 
-	dw = dest->width;
-	dh = dest->height;
 	sw = src->width;
 	sh = src->height;
 
@@ -711,217 +998,511 @@ void app_scale_8_bit_image(Image *dest, const Image *src, Rect dr, Rect sr)
 	hscale = (dr.width > 1 ? dr.width-1 : 1);
 	vscale = (dr.height > 1 ? dr.height-1 : 1);
 
-	for (y=0; y < dr.height; y++) {
-	  for (x=0; x < dr.width; x++) {
-		sy = sr.y + y * (sr.height-1) / vscale;
+	for (y=job->y0+y1; y < job->y0+y2; y++) {
+	  sy = sr.y + y * (sr.height-1) / vscale;
+	  dy = dr.y + y;
+	  for (x=job->x0; x < job->x1; x++) {
 		sx = sr.x + x * (sr.width-1) / hscale;
 		if ((sx >= 0) && (sx < sw) && (sy >= 0) && (sy < sh))
 			value = src_pixels[sy][sx];
 		else
 			value = t;
-		dy = dr.y + y;
 		dx = dr.x + x;
-		if ((dx >= 0) && (dx < dw) && (dy >= 0) && (dy < dh))
-			dest_pixels[dy][dx] = value;
+		dest_pixels[dy][dx] = value;
 	  }
 	}
 }
 
 APP_PRIVATE
-void app_scale_32_bit_image(Image *dest, const Image *src, Rect dr, Rect sr)
+void app_scale_8_bit_image(Image *dest, const Image *src, Rect dr, Rect sr)
+{
+	ImageJob job;
+	int y1;
+
+	job.dest = dest;
+	job.src = src;
+	job.dr = dr;
+	job.sr = sr;
+	app_clip_scaled_rows(&job, &y1);
+	app_run_bands(app_scale_8_bit_rows, &job, y1 - job.y0,
+			app_worker_threads());
+}
+
+static
+void app_scale_32_bit_rows(void *data, int thread, int y1, int y2)
 {
+	ImageJob *job = data;
+	Image *dest = job->dest;
+	const Image *src = job->src;
+	Rect dr = job->dr;
+	Rect sr = job->sr;
 	Colour value;
 	long x, y;
 	long dx, dy, sx, sy;
-	long dw, dh, sw, sh;
+	long sw, sh;
 	long hscale, vscale;
 	Colour ** src_pixels = src->data32;
 	Colour ** dest_pixels = dest->data32;
 
-	dw = dest->width;
-	dh = dest->height;
 	sw = src->width;
 	sh = src->height;
 
 	hscale = (dr.width > 1 ? dr.width-1 : 1);
 	vscale = (dr.height > 1 ? dr.height-1 : 1);
 
-	for (y=0; y < dr.height; y++) {
-	  for (x=0; x < dr.width; x++) {
-		sy = sr.y + y * (sr.height-1) / vscale;
+	for (y=job->y0+y1; y < job->y0+y2; y++) {
+	  sy = sr.y + y * (sr.height-1) / vscale;
+	  dy = dr.y + y;
+	  for (x=job->x0; x < job->x1; x++) {
 		sx = sr.x + x * (sr.width-1) / hscale;
 		if ((sx >= 0) && (sx < sw) && (sy >= 0) && (sy < sh))
 			value = src_pixels[sy][sx];
 		else
 			value = argb(255,255,255,255);
-		dy = dr.y + y;
 		dx = dr.x + x;
-		if ((dx >= 0) && (dx < dw) && (dy >= 0) && (dy < dh))
-			dest_pixels[dy][dx] = value;
+		dest_pixels[dy][dx] = value;
 	  }
 	}
 }
 
 APP_PRIVATE
-void app_scale_down_32_bit_image(Image *dest, const Image *src, Rect dr, Rect sr)
+void app_scale_32_bit_image(Image *dest, const Image *src, Rect dr, Rect sr)
 {
-	Colour value, v;
-	long x, y;
-	long a, r, g, b, count, counta;
-	long x1, y1, x2, y2;
-	long dx, dy, sx, sy;
-	long dw, dh, sw, sh;
-	long hscale, vscale;
-	Colour ** src_pixels = src->data32;
-	Colour ** dest_pixels = dest->data32;
+	ImageJob job;
+	int y1;
+
+	job.dest = dest;
+	job.src = src;
+	job.dr = dr;
+	job.sr = sr;
+	app_clip_scaled_rows(&job, &y1);
+	app_run_bands(app_scale_32_bit_rows, &job, y1 - job.y0,
+			app_worker_threads());
+}
 
-	dw = dest->width;
-	dh = dest->height;
-	sw = src->width;
-	sh = src->height;
+/*
+ *  Separable resampling
+ *  --------------------
+ *  Filtered scaling is done in two passes: each source row is
+ *  first resampled horizontally into a row of the destination
+ *  width, then columns of those rows are resampled vertically.
+ *
+ *  The filter weights depend only on the destination column
+ *  (or row), so they are worked out once per axis before any
+ *  pixels are touched, and stored in fixed point. The inner
+ *  loops are then just multiply-adds with no divisions.
+ *
+ *  Colours are premultiplied by opacity (255 - alpha) as they
+ *  are filtered, so transparent pixels do not bleed their colour
+ *  into their neighbours. Only enough horizontally resampled
+ *  rows for one destination row are kept, in a ring buffer.
+ *
+ *  The edges of the source rectangle sr are extended outwards so
+ *  the filter has something to read there. Parts of sr which lie
+ *  outside the image count as transparent, by simply dropping
+ *  their weights.
+ */
 
-	hscale = (dr.width > 1 ? dr.width-1 : 1);
-	vscale = (dr.height > 1 ? dr.height-1 : 1);
+#define PI (3.14159265359)
 
-	for (y=0; y < dr.height; y++) {
-	  for (x=0; x < dr.width; x++) {
-		a = r = g = b = count = counta = 0;
+#define APP_FILTER_BITS  12
+#define APP_FILTER_ONE   (1 << APP_FILTER_BITS)
+#define APP_FILTER_HALF  (1 << (APP_FILTER_BITS - 1))
 
-		y1 = sr.y + y * (sr.height-1) / vscale;
-		x1 = sr.x + x * (sr.width-1) / hscale;
-		y2 = sr.y + (y + 1) * (sr.height-1) / vscale;
-		x2 = sr.x + (x + 1) * (sr.width-1) / hscale;
+typedef struct ImageFilterSpan ImageFilterSpan;
 
-		for (sy=y1; sy < y2; sy++) {
-		  for (sx=x1; sx < x2; sx++){
-			if ((sx >= 0) && (sx < sw) && (sy >= 0) && (sy < sh))
-				v = src_pixels[sy][sx];
-			else
-				v = argb(255,255,255,255);
-
-			a += v.alpha;
-			counta++;
-			if (v.alpha < 255)
-			{
-				r += v.red;
-				g += v.green;
-				b += v.blue;
-				count += 1;
-			}
-		  }
+struct ImageFilterSpan {
+	int	first;		/* first source pixel used */
+	int	count;		/* number of source pixels used */
+	int *	weight;		/* count weights, summing to APP_FILTER_ONE */
+};
+
+static
+double app_filter_support(int filter)
+{
+	switch (filter) {
+		case BOX_FILTER:	return 0.5;
+		case BILINEAR_FILTER:	return 1.0;
+		case BICUBIC_FILTER:	return 2.0;
+		case LANCZOS_FILTER:	return 3.0;
+	}
+	return 0.5;
+}
+
+static
+double app_filter_kernel(int filter, double t)
+{
+	if (t < 0)
+		t = -t;
+
+	switch (filter) {
+	  case BILINEAR_FILTER:
+		return (t < 1.0) ? 1.0 - t : 0.0;
+
+	  case BICUBIC_FILTER: /* Catmull-Rom, a = -0.5 */
+		if (t < 1.0)
+			return (1.5 * t - 2.5) * t * t + 1.0;
+		if (t < 2.0)
+			return ((-0.5 * t + 2.5) * t - 4.0) * t + 2.0;
+		return 0.0;
+
+	  case LANCZOS_FILTER: /* Lanczos-3 */
+		if (t < 1e-8)
+			return 1.0;
+		if (t < 3.0)
+			return 3.0 * sin(PI * t) * sin(PI * t / 3.0)
+				/ (PI * PI * t * t);
+		return 0.0;
+
+	  default: /* BOX_FILTER */
+		if (t < 0.5)
+			return 1.0;
+		if (t == 0.5)
+			return 0.5;
+		return 0.0;
+	}
+}
+
+/*
+ *  Work out which source pixels, and with what weights, make up
+ *  each of the dst_len destination pixels along one axis, when
+ *  the src_len pixels from src_start are scaled to fit. Pixels
+ *  outside 0 to limit-1 are left out.
+ *  The result is one allocation, freed with app_free.
+ */
+static
+ImageFilterSpan * app_new_filter_spans(int dst_len, int src_start,
+				int src_len, int limit, int filter)
+{
+	ImageFilterSpan *spans;
+	double *w;
+	int *weights;
+	double scale, fscale, support, center, total;
+	int i, j, k, left, right, first, last, max_count;
+	int sum, biggest;
+
+	scale = (double) src_len / dst_len;
+	fscale = (scale > 1.0) ? scale : 1.0;
+	support = app_filter_support(filter) * fscale;
+	max_count = (int) ceil(support * 2) + 2;
+
+	spans = app_alloc(dst_len * sizeof(ImageFilterSpan)
+			+ (long) dst_len * max_count * sizeof(int));
+	w = app_alloc(max_count * sizeof(double));
+	if ((! spans) || (! w)) {
+		app_free(spans);
+		app_free(w);
+		return NULL;
+	}
+	weights = (int *) (spans + dst_len);
+
+	for (i=0; i < dst_len; i++)
+	{
+		center = (i + 0.5) * scale;
+		left = (int) floor(center - support);
+		right = (int) ceil(center + support);
+
+		/* clamp to the source, folding edge weights inwards */
+		first = (left > 0) ? left : 0;
+		last = (right < src_len) ? right : src_len;
+		if (last <= first)
+			last = first + 1;
+		if (last > src_len) {
+			last = src_len;
+			first = last - 1;
 		}
-		if (count == 0) {
-			r = g = b = 255;
-			count = 1;
+
+		for (k=0; k < last - first; k++)
+			w[k] = 0.0;
+		total = 0.0;
+		for (j=left; j < right; j++) {
+			double v = app_filter_kernel(filter,
+					(j + 0.5 - center) / fscale);
+			k = j - first;
+			if (k < 0)
+				k = 0;
+			if (k >= last - first)
+				k = last - first - 1;
+			w[k] += v;
+			total += v;
 		}
-		if (counta == 0) {
-			a = 0;
-			counta = 1;
+		if (total == 0.0) {
+			/* degenerate; fall back to the nearest pixel */
+			k = (int) center - first;
+			if (k < 0)
+				k = 0;
+			if (k >= last - first)
+				k = last - first - 1;
+			w[k] = total = 1.0;
 		}
 
-		value.alpha = a / counta;
-		value.red   = r / count;
-		value.green = g / count;
-		value.blue  = b / count;
+		/* convert to fixed point, rounding into the biggest */
+		spans[i].weight = weights + (long) i * max_count;
+		sum = 0;
+		biggest = 0;
+		for (k=0; k < last - first; k++) {
+			spans[i].weight[k] = (int) floor(w[k] / total
+						* APP_FILTER_ONE + 0.5);
+			sum += spans[i].weight[k];
+			if (w[k] > w[biggest])
+				biggest = k;
+		}
+		spans[i].weight[biggest] += APP_FILTER_ONE - sum;
 
-		dy = dr.y + y;
-		dx = dr.x + x;
-		if ((dx >= 0) && (dx < dw) && (dy >= 0) && (dy < dh))
-			dest_pixels[dy][dx] = value;
-	  }
+		/* trim weights which rounded to zero off both ends */
+		while ((last - first > 1) && (spans[i].weight[0] == 0)) {
+			spans[i].weight++;
+			first++;
+		}
+		while ((last - first > 1)
+			&& (spans[i].weight[last - first - 1] == 0))
+			last--;
+
+		/* leave out pixels beyond the image */
+		first += src_start;
+		last += src_start;
+		if (first < 0) {
+			spans[i].weight -= first;
+			first = 0;
+		}
+		if (last > limit)
+			last = limit;
+		if (last < first)
+			last = first;
+
+		spans[i].first = first;
+		spans[i].count = last - first;
 	}
+
+	app_free(w);
+	return spans;
 }
 
-APP_PRIVATE
-void app_halftone_32_bit_image(Image *dest, const Image *src, Rect dr, Rect sr)
+/*
+ *  Resample one image row horizontally into width pixels, each
+ *  four ints: opacity, red, green, blue, premultiplied by the
+ *  opacity and so scaled to the range 0 to 255*255.
+ */
+static
+void app_filter_row(int *out, const Colour *in,
+			const ImageFilterSpan *spans, int width)
 {
-	Colour value, v1, v2, v3, v4;
-	long x, y;
-	long dx, dy, sx, sy;
-	long dw, dh, sw, sh;
-	long hscale, vscale;
-	Colour ** src_pixels = src->data32;
-	Colour ** dest_pixels = dest->data32;
-
-	dw = dest->width;
-	dh = dest->height;
-	sw = src->width;
-	sh = src->height;
+	int x, k, a, r, g, b, wo;
+	const Colour *c;
+	const int *w;
+
+	for (x=0; x < width; x++, out += 4) {
+		c = in + spans[x].first;
+		w = spans[x].weight;
+		a = 0;
+		r = g = b = APP_FILTER_HALF;
+		for (k=0; k < spans[x].count; k++, c++) {
+			wo = (255 - c->alpha) * w[k];
+			a += wo;
+			r += c->red   * wo;
+			g += c->green * wo;
+			b += c->blue  * wo;
+		}
+		out[0] = (a * 255 + APP_FILTER_HALF) >> APP_FILTER_BITS;
+		out[1] = r >> APP_FILTER_BITS;
+		out[2] = g >> APP_FILTER_BITS;
+		out[3] = b >> APP_FILTER_BITS;
+	}
+}
 
-	hscale = (dr.width > 1 ? dr.width-1 : 1);
-	vscale = (dr.height > 1 ? dr.height-1 : 1);
+/*
+ *  Undo the premultiplication, given the reciprocal of the
+ *  opacity a as (255 << 22) / a, so no division is needed.
+ */
+static
+int app_unpremultiply(int v, int a, unsigned long recip)
+{
+	if (v <= 0)
+		return 0;
+	if (v >= a)
+		return 255;
+	return (int) ((v * recip + (1UL << 21)) >> 22);
+}
 
-	for (y=0; y < dr.height; y++) {
-	  for (x=0; x < dr.width; x++) {
-		sy = sr.y + y * (sr.height-1) / vscale;
-		sx = sr.x + x * (sr.width-1) / hscale;
-		if ((sx >= 0) && (sx < sw) && (sy >= 0) && (sy < sh))
-			v1 = src_pixels[sy][sx];
-		else
-			v1 = argb(255,255,255,255);
+typedef struct ResampleJob ResampleJob;
+
+struct ResampleJob {
+	Image *		dest;
+	const Image *	src;
+	Rect		dr;
+	ImageFilterSpan * hspans;
+	ImageFilterSpan * vspans;
+	int		x0, x1;		/* columns of dr inside dest */
+	int		y0;		/* first row of dr inside dest */
+	int		window;		/* filtered rows kept in the ring */
+	int *		scratch;	/* per thread ring, slots and sums */
+	long		scratch_size;	/* ints of scratch per thread */
+};
 
-		//sy = sr.y + y * (sr.height-1) / vscale;
-		//sx = sr.x + x * (sr.width-1) / hscale +1;
-		sx += 1;
-		if ((sx >= 0) && (sx < sw) && (sy >= 0) && (sy < sh))
-			v2 = src_pixels[sy][sx];
-		else
-			v2 = argb(255,255,255,255);
+/*
+ *  Resample rows y0+y1 to y0+y2-1 of the destination rectangle.
+ *  Each band starts with an empty ring, so its output does not
+ *  depend on which rows were done before it.
+ */
+static
+void app_resample_rows(void *data, int thread, int y1, int y2)
+{
+	ResampleJob *job = data;
+	const ImageFilterSpan *vspans = job->vspans;
+	int window = job->window;
+	int width = job->dr.width;
+	int x0 = job->x0 * 4;
+	int x1 = job->x1 * 4;
+	int *rows, *slot_row, *sum;
+	int x, y, k, slot, sy, a, wk;
+	const int *p;
+	int *s;
+	unsigned long recip;
+	Colour *out;
+
+	rows = job->scratch + thread * job->scratch_size;
+	sum = rows + (long) window * width * 4;
+	slot_row = sum + width * 4;
+	for (k=0; k < window; k++)
+		slot_row[k] = -1;
+
+	for (y=job->y0+y1; y < job->y0+y2; y++)
+	{
+		for (x=x0; x < x1; x++)
+			sum[x] = APP_FILTER_HALF;
 
-		//sy = sr.y + y * (sr.height-1) / vscale +1;
-		//sx = sr.x + x * (sr.width-1) / hscale;
-		sy += 1;
-		sx -= 1;
-		if ((sx >= 0) && (sx < sw) && (sy >= 0) && (sy < sh))
-			v3 = src_pixels[sy][sx];
-		else
-			v3 = argb(255,255,255,255);
+		for (k=0; k < vspans[y].count; k++)
+		{
+			/* horizontally resample each source row once */
+			sy = vspans[y].first + k;
+			slot = sy % window;
+			p = rows + (long) slot * width * 4;
+			if (slot_row[slot] != sy) {
+				app_filter_row((int *) p + x0,
+						job->src->data32[sy],
+						job->hspans + job->x0,
+						job->x1 - job->x0);
+				slot_row[slot] = sy;
+			}
 
-		//sy = sr.y + y * (sr.height-1) / vscale +1;
-		//sx = sr.x + x * (sr.width-1) / hscale +1;
-		sx += 1;
-		if ((sx >= 0) && (sx < sw) && (sy >= 0) && (sy < sh))
-			v4 = src_pixels[sy][sx];
-		else
-			v4 = argb(255,255,255,255);
+			wk = vspans[y].weight[k];
+			for (x=x0; x < x1; x++)
+				sum[x] += p[x] * wk;
+		}
 
-		value.alpha = (v1.alpha*4L+v2.alpha*2L+v3.alpha*2L+v4.alpha*1L)/9;
-		value.red   = (v1.red  *4L+v2.red  *2L+v3.red  *2L+v4.red  *1L)/9;
-		value.green = (v1.green*4L+v2.green*2L+v3.green*2L+v4.green*1L)/9;
-		value.blue  = (v1.blue *4L+v2.blue *2L+v3.blue *2L+v4.blue *1L)/9;
+		out = job->dest->data32[job->dr.y + y] + job->dr.x;
+		for (x=job->x0, s=sum+x0; x < job->x1; x++, s += 4) {
+			a = s[0] >> APP_FILTER_BITS;
+			if (a < 128) {
+				/* rounds to fully transparent */
+				out[x] = argb(255,255,255,255);
+				continue;
+			}
+			if (a > 255 * 255)
+				a = 255 * 255;
+			recip = ((255UL << 22) + a / 2) / a;
+			out[x].alpha = 255 - (a + 127) / 255;
+			out[x].red   = app_unpremultiply(s[1] >> APP_FILTER_BITS, a, recip);
+			out[x].green = app_unpremultiply(s[2] >> APP_FILTER_BITS, a, recip);
+			out[x].blue  = app_unpremultiply(s[3] >> APP_FILTER_BITS, a, recip);
+		}
+	}
+}
 
-		dy = dr.y + y;
-		dx = dr.x + x;
-		if ((dx >= 0) && (dx < dw) && (dy >= 0) && (dy < dh))
-			dest_pixels[dy][dx] = value;
-	  }
+APP_PRIVATE
+int app_resample_32_bit_image(Image *dest, const Image *src,
+				Rect dr, Rect sr, int filter)
+{
+	ResampleJob job;
+	int threads, y, y1;
+	int done = 0;
+
+	if ((dr.width <= 0) || (dr.height <= 0)
+		|| (sr.width <= 0) || (sr.height <= 0))
+		return 1;
+
+	job.dest = dest;
+	job.src = src;
+	job.dr = dr;
+	job.scratch = NULL;
+	job.hspans = app_new_filter_spans(dr.width, sr.x, sr.width,
+					src->width, filter);
+	job.vspans = app_new_filter_spans(dr.height, sr.y, sr.height,
+					src->height, filter);
+	if ((! job.hspans) || (! job.vspans))
+		goto finish;
+
+	/* only destination pixels inside dest are computed */
+	job.x0 = (dr.x < 0) ? -dr.x : 0;
+	job.x1 = (dr.x + dr.width > dest->width) ? dest->width - dr.x : dr.width;
+	job.y0 = (dr.y < 0) ? -dr.y : 0;
+	y1 = (dr.y + dr.height > dest->height) ? dest->height - dr.y : dr.height;
+
+	job.window = 1;
+	for (y=job.y0; y < y1; y++)
+		if (job.vspans[y].count > job.window)
+			job.window = job.vspans[y].count;
+
+	/* ring of filtered rows, one row of sums, and the ring slots */
+	job.scratch_size = ((long) job.window + 1) * dr.width * 4
+				+ job.window;
+	/* app_run_bands is given the same count the scratch is sized for */
+	threads = app_worker_threads();
+	job.scratch = app_alloc(threads * job.scratch_size * sizeof(int));
+	if ((! job.scratch) && (threads > 1)) {
+		threads = 1;
+		job.scratch = app_alloc(job.scratch_size * sizeof(int));
 	}
+	if (! job.scratch)
+		goto finish;
+
+	app_run_bands(app_resample_rows, &job, y1 - job.y0, threads);
+	done = 1;
+
+finish:
+	app_free(job.scratch);
+	app_free(job.vspans);
+	app_free(job.hspans);
+	return done;
 }
 
-Image * app_scale_image(const Image *src, Rect dr, Rect sr)
+/*
+ *  Return just the part of the image app_scale_image_ex
+ *  would return, without computing any of the pixels outside it.
+ */
+static
+Image * app_scale_image_part(const Image *src, Rect dr, Rect sr,
+				int filter, Rect part)
 {
 	Image *dest;
+	Image *tmp;
 
-	dest = app_new_image(dr.width, dr.height, src->depth);
+	if ((src->depth == 8) && (filter != NEAREST_FILTER)) {
+		tmp = app_image_convert_8_to_32(src);
+		if (! tmp)
+			return NULL;
+		dest = app_scale_image_part(tmp, dr, sr, filter, part);
+		app_del_image(tmp);
+		return dest;
+	}
+
+	dest = app_new_image(part.width, part.height, src->depth);
 	if (! dest)
 		return NULL;
 
+	/* the part becomes the whole of dest */
+	dr.x -= part.x;
+	dr.y -= part.y;
+
 	if (src->depth == 8) {
 		app_set_image_cmap(dest, src->cmap_size, src->cmap);
 		app_scale_8_bit_image(dest, src, dr, sr);
 	}
-	else if ((src->depth == 32) &&
-		 ((dr.width < sr.width) && (dr.height < sr.height))) {
-		app_scale_down_32_bit_image(dest, src, dr, sr);
-	}
-	else if ((src->depth == 32) &&
-		 ((dr.width < sr.width) || (dr.height < sr.height))) {
-		app_halftone_32_bit_image(dest, src, dr, sr);
-	}
-	else if (src->depth == 32) {
+	else if ((src->depth == 32) && (filter == NEAREST_FILTER)) {
 		app_scale_32_bit_image(dest, src, dr, sr);
 	}
-	else {
+	else if ((src->depth != 32) ||
+		 (! app_resample_32_bit_image(dest, src, dr, sr, filter))) {
 		app_del_image(dest);
 		dest = NULL;
 	}
@@ -929,6 +1510,40 @@ Image * app_scale_image(const Image *src, Rect dr, Rect sr)
 	return dest;
 }
 
+/*
+ *  Return an image scaled using the given filter:
+ *    NEAREST_FILTER   pick the nearest pixel (fast, blocky)
+ *    BOX_FILTER       average the pixels covered (good for shrinking)
+ *    BILINEAR_FILTER  linear interpolation
+ *    BICUBIC_FILTER   cubic interpolation (Catmull-Rom)
+ *    LANCZOS_FILTER   Lanczos-3 windowed sinc (sharpest)
+ *  An 8-bit source image is returned as a 32-bit image unless
+ *  NEAREST_FILTER is used, since filtering makes new colours.
+ */
+Image * app_scale_image_ex(const Image *src, Rect dr, Rect sr, int filter)
+{
+	return app_scale_image_part(src, dr, sr, filter,
+			rect(0, 0, dr.width, dr.height));
+}
+
+/*
+ *  Shrinking a 32-bit image along either axis averages the pixels
+ *  covered; anything else picks the nearest pixel.
+ */
+static
+int app_scale_filter(const Image *src, Rect dr, Rect sr)
+{
+	if ((src->depth == 32) &&
+		 ((dr.width < sr.width) || (dr.height < sr.height)))
+		return BOX_FILTER;
+	return NEAREST_FILTER;
+}
+
+Image * app_scale_image(const Image *src, Rect dr, Rect sr)
+{
+	return app_scale_image_ex(src, dr, sr, app_scale_filter(src, dr, sr));
+}
+
 /*
  *  Functions for drawing an image:
  */
@@ -969,10 +1584,199 @@ int app_get_grey_pixval(Image *src, Image *dest, int x, int y)
 	return dest->cmap_size - 1;
 }
 
-int app_draw_image_monochrome(Graphics *g, Rect dr, Image *src, Rect sr)
+static
+void app_monochrome_rows(void *data, int thread, int y1, int y2)
+{
+	ImageJob *job = data;
+	int x, y;
+
+	for (y=y1; y < y2; y++)
+	  for (x=0; x < job->dest->width; x++)
+		job->dest->data8[y][x] = app_get_mono_pixval((Image *) job->src,
+						job->dest, x, y);
+}
+
+static
+void app_greyscale_rows(void *data, int thread, int y1, int y2)
+{
+	ImageJob *job = data;
+	int x, y;
+
+	for (y=y1; y < y2; y++)
+	  for (x=0; x < job->dest->width; x++)
+		job->dest->data8[y][x] = app_get_grey_pixval((Image *) job->src,
+						job->dest, x, y);
+}
+
+/*
+ *  Apply job->change (app_darker or app_brighter) to each pixel.
+ */
+static
+void app_change_colour_rows(void *data, int thread, int y1, int y2)
 {
+	ImageJob *job = data;
 	int x, y;
+
+	for (y=y1; y < y2; y++)
+	  for (x=0; x < job->dest->width; x++)
+		job->dest->data32[y][x]
+		  = job->change(app_get_image_pixel(job->src, x, y));
+}
+
+/*
+ *  Drawing part of an image
+ *  ------------------------
+ *  Drawing treats the source as the part sr of the image scaled to
+ *  the size of dr, or as the image itself when no scaling is needed.
+ *  Only the part of that which shows through the destination's area
+ *  and clipping region is scaled and converted, so drawing a small
+ *  piece of a large image costs in proportion to the piece.
+ */
+typedef struct ImagePart ImagePart;
+
+struct ImagePart {
+	Rect	sr;		/* part of the image being drawn */
+	int	width;		/* size it is scaled to */
+	int	height;
+	Point	origin;		/* where its top-left corner is drawn */
+	Rect	part;		/* the visible part, in its co-ordinates */
+};
+
+/*
+ *  Work out which part of the image drawing sr into dr would show.
+ *  Returns zero if none of it would.
+ */
+static int app_find_image_part(Graphics *g, const Image *img,
+				Rect dr, Rect sr, ImagePart *p)
+{
+	Rect vis;
+
+	vis = app_clip_rect(dr, app_get_clip_rect(g));
+
+	if ((dr.width == sr.width) && (dr.height == sr.height)) {
+		p->sr = app_get_image_area(img);
+		p->width = img->width;
+		p->height = img->height;
+		p->origin = pt(dr.x - sr.x, dr.y - sr.y);
+	}
+	else {
+		p->sr = sr;
+		p->width = dr.width;
+		p->height = dr.height;
+		p->origin = pt(dr.x, dr.y);
+	}
+
+	vis.x -= p->origin.x;
+	vis.y -= p->origin.y;
+	p->part = app_clip_rect(vis, rect(0, 0, p->width, p->height));
+	return (p->part.width > 0) && (p->part.height > 0);
+}
+
+/*
+ *  Make an image of the visible part. An unscaled part shares the
+ *  image's rows and colour map. Delete it with app_del_image_part.
+ */
+static Image * app_new_image_part(Image *img, ImagePart *p)
+{
+	Rect part = p->part;
+	Image *i;
+	int y;
+
+	if ((p->width != img->width) || (p->height != img->height)
+	    || (! app_rects_equal(p->sr, app_get_image_area(img))))
+		return app_scale_image_part(img,
+				rect(0, 0, p->width, p->height), p->sr,
+				app_scale_filter(img, rect(0, 0,
+					p->width, p->height), p->sr),
+				part);
+
+	if (app_rects_equal(part, app_get_image_area(img)))
+		return img;
+
+	i = app_zero_alloc(sizeof(Image));
+	if (! i)
+		return NULL;
+	i->depth = img->depth;
+	i->width = part.width;
+	i->height = part.height;
+	i->cmap_size = img->cmap_size;
+	i->cmap = img->cmap;
+	if (img->depth == 8) {
+		i->data8 = app_alloc(part.height * sizeof(byte *));
+		for (y=0; i->data8 && (y < part.height); y++)
+			i->data8[y] = img->data8[part.y + y] + part.x;
+	}
+	else {
+		i->data32 = app_alloc(part.height * sizeof(Colour *));
+		for (y=0; i->data32 && (y < part.height); y++)
+			i->data32[y] = img->data32[part.y + y] + part.x;
+	}
+	if ((! i->data8) && (! i->data32)) {
+		app_free(i);
+		return NULL;
+	}
+	return i;
+}
+
+static void app_del_image_part(Image *img, Image *i)
+{
+	if (i == img)
+		return;
+	if (i->pixels) {
+		/* a scaled part has pixels of its own */
+		app_del_image(i);
+		return;
+	}
+	app_free(i->data8);
+	app_free(i->data32);
+	app_free(i);
+}
+
+/*
+ *  Draw an image without keeping the Bitmap made from it.
+ *  Used for images which only exist to be drawn once.
+ */
+static int app_draw_image_once(Graphics *g, Rect dr, Image *img, Rect sr)
+{
+	Graphics *src;
+	Bitmap *b = NULL;
+	Window *win = NULL;
+	ImagePart p;
+	Image *i;
+	int result;
+
+	if (! app_find_image_part(g, img, dr, sr, &p))
+		return 1;
+	i = app_new_image_part(img, &p);
+	if (! i)
+		return 0;
+
+	if (g->win)
+		win = g->win;
+	else if (g->bmap)
+		win = g->bmap->win;
+
+	if (win) {
+		b = app_image_to_bitmap(win, i);
+		src = app_get_bitmap_graphics(b);
+	}
+	else
+		src = app_get_image_graphics(i);
+
+	result = app_copy_rect(g,
+			pt(p.origin.x + p.part.x, p.origin.y + p.part.y),
+			src, rect(0, 0, p.part.width, p.part.height));
+	app_del_graphics(src);
+	if (b)
+		app_del_bitmap(b);
+	app_del_image_part(img, i);
+	return result;
+}
+
+int app_draw_image_monochrome(Graphics *g, Rect dr, Image *src, Rect sr)
+{
 	int result;
+	ImageJob job;
 	Image *dest;
 	Colour cmap[3] = {
 		{  0,  0,  0,  0},	/* black */
@@ -983,18 +1787,19 @@ int app_draw_image_monochrome(Graphics *g, Rect dr, Image *src, Rect sr)
 	dest = app_new_image(src->width, src->height, 8);
 	app_set_image_cmap(dest, 3, cmap);
 
-	for (y=0; y < dest->height; y++)
-	  for (x=0; x < dest->width; x++)
-		dest->data8[y][x] = app_get_mono_pixval(src, dest, x, y);
-	result = app_draw_image(g, dr, dest, sr);
+	job.dest = dest;
+	job.src = src;
+	app_run_bands(app_monochrome_rows, &job, dest->height,
+			app_worker_threads());
+	result = app_draw_image_once(g, dr, dest, sr);
 	app_del_image(dest);
 	return result;
 }
 
 int app_draw_image_greyscale(Graphics *g, Rect dr, Image *src, Rect sr)
 {
-	int x, y;
 	int result;
+	ImageJob job;
 	Image *dest;
 	Colour cmap[6] = {
 		{  0,  0,  0,  0},	/* black */
@@ -1008,21 +1813,22 @@ int app_draw_image_greyscale(Graphics *g, Rect dr, Image *src, Rect sr)
 	dest = app_new_image(src->width, src->height, 8);
 	app_set_image_cmap(dest, 6, cmap);
 
-	for (y=0; y < dest->height; y++)
-	  for (x=0; x < dest->width; x++)
-		dest->data8[y][x] = app_get_grey_pixval(src, dest, x, y);
-	result = app_draw_image(g, dr, dest, sr);
+	job.dest = dest;
+	job.src = src;
+	app_run_bands(app_greyscale_rows, &job, dest->height,
+			app_worker_threads());
+	result = app_draw_image_once(g, dr, dest, sr);
 	app_del_image(dest);
 	return result;
 }
 
 int app_draw_image_darker(Graphics *g, Rect dr, Image *src, Rect sr)
 {
-	int i, x, y;
+	int i;
 	int result;
 	Image *dest = NULL;
 	Colour *newcmap = NULL, *oldcmap = NULL;
-	Colour **pixels;
+	ImageJob job;
 
 	if (src->depth == 8) {
 		newcmap = app_alloc(src->cmap_size * sizeof(Colour));
@@ -1035,16 +1841,16 @@ int app_draw_image_darker(Graphics *g, Rect dr, Image *src, Rect sr)
 	else if (src->depth == 32) {
 		dest = app_new_image(src->width, src->height, 32);
 		if (dest) {
-		  pixels = dest->data32;
-		  for (y=0; y < dest->height; y++)
-		    for (x=0; x < dest->width; x++)
-			pixels[y][x]
-			  = app_darker(app_get_image_pixel(src, x, y));
+			job.dest = dest;
+			job.src = src;
+			job.change = app_darker;
+			app_run_bands(app_change_colour_rows, &job,
+					dest->height, app_worker_threads());
 		} else {
 			dest = src;
 		}
 	}
-	result = app_draw_image(g, dr, dest, sr);
+	result = app_draw_image_once(g, dr, dest, sr);
 	if (dest != src)
 		app_del_image(dest);
 	if (src->cmap == newcmap)
@@ -1055,11 +1861,11 @@ int app_draw_image_darker(Graphics *g, Rect dr, Image *src, Rect sr)
 
 int app_draw_image_brighter(Graphics *g, Rect dr, Image *src, Rect sr)
 {
-	int i, x, y;
+	int i;
 	int result;
 	Image *dest = NULL;
 	Colour *newcmap = NULL, *oldcmap = NULL;
-	Colour **pixels;
+	ImageJob job;
 
 	if (src->depth == 8) {
 		newcmap = app_alloc(src->cmap_size * sizeof(Colour));
@@ -1072,16 +1878,16 @@ int app_draw_image_brighter(Graphics *g, Rect dr, Image *src, Rect sr)
 	else if (src->depth == 32) {
 		dest = app_new_image(src->width, src->height, 32);
 		if (dest) {
-		  pixels = dest->data32;
-		  for (y=0; y < dest->height; y++)
-		    for (x=0; x < dest->width; x++)
-			pixels[y][x]
-			  = app_brighter(app_get_image_pixel(src, x, y));
+			job.dest = dest;
+			job.src = src;
+			job.change = app_brighter;
+			app_run_bands(app_change_colour_rows, &job,
+					dest->height, app_worker_threads());
 		} else {
 			dest = src;
 		}
 	}
-	result = app_draw_image(g, dr, dest, sr);
+	result = app_draw_image_once(g, dr, dest, sr);
 	if (dest != src)
 		app_del_image(dest);
 	if (src->cmap == newcmap)
@@ -1091,39 +1897,103 @@ int app_draw_image_brighter(Graphics *g, Rect dr, Image *src, Rect sr)
 }
 
 /*
- *  Draw an image:
+ *  Find a Bitmap holding the visible part of an image, making one
+ *  if the image's cached Bitmap will not do. Sets *sr to the part
+ *  of the Bitmap to copy.
+ *
+ *  All of a small image is converted, in case more of it is drawn
+ *  later; a large one only has the visible part converted, so that
+ *  scrolling around it costs in proportion to the window.
  */
+#define CACHE_WHOLE_PIXELS  (512L * 512)
+
+static Bitmap * app_image_cache_bitmap(Window *win, Image *img,
+					ImagePart *p, Rect *sr)
+{
+	ImageCache *c = (ImageCache *) img->cache;
+	ImagePart want = *p;
+	long whole, visible;
+	Image *i;
+	Bitmap *b;
+
+	if (c && (c->generation == img->generation)
+	    && (c->bmap->win->app == win->app)
+	    && (c->bmap->win->pal == win->pal)
+	    && app_rects_equal(c->sr, p->sr)
+	    && (c->width == p->width) && (c->height == p->height)
+	    && app_rect_in_rect(p->part, c->part))
+	{
+		*sr = rect(p->part.x - c->part.x, p->part.y - c->part.y,
+				p->part.width, p->part.height);
+		return c->bmap;
+	}
+
+	whole = (long) p->width * p->height;
+	visible = (long) p->part.width * p->part.height;
+	if ((whole <= CACHE_WHOLE_PIXELS) || (whole <= 4 * visible))
+		want.part = rect(0, 0, p->width, p->height);
+
+	i = app_new_image_part(img, &want);
+	if (! i)
+		return NULL;
+	b = app_image_to_bitmap(win, i);
+	app_del_image_part(img, i);
+	if (! b)
+		return NULL;
 
+	if (! c) {
+		c = app_zero_alloc(sizeof(ImageCache));
+		if (! c) {
+			app_del_bitmap(b);
+			return NULL;
+		}
+		img->cache = c;
+		cached_images = (Image **) app_add_array_element(
+					(void **) cached_images, img);
+	}
+	else
+		app_del_bitmap(c->bmap);
+
+	c->generation = img->generation;
+	c->sr = p->sr;
+	c->width = p->width;
+	c->height = p->height;
+	c->part = want.part;
+	c->bmap = b;
+	*sr = rect(p->part.x - c->part.x, p->part.y - c->part.y,
+			p->part.width, p->part.height);
+	return b;
+}
+
+/*
+ *  Draw an image. Drawing to a window or bitmap uses the Bitmap
+ *  kept from the last time the image was drawn, if it will do.
+ */
 int app_draw_image(Graphics *g, Rect dr, Image *img, Rect sr)
 {
 	Graphics *src;
-	Bitmap *b = NULL;
 	Window *win = NULL;
-	Image *i = img;
+	ImagePart p;
+	Bitmap *b;
 	int result;
 
-	if ((dr.width != sr.width) || (dr.height != sr.height)) {
-		i = app_scale_image(img, rect(0,0,dr.width,dr.height), sr);
-		sr = rect(0, 0, dr.width, dr.height);
-	}
 	if (g->win)
 		win = g->win;
 	else if (g->bmap)
 		win = g->bmap->win;
+	if (! win)
+		return app_draw_image_once(g, dr, img, sr);
 
-	if (win) {
-		b = app_image_to_bitmap(win, i);
-		src = app_get_bitmap_graphics(b);
-	}
-	else
-		src = app_get_image_graphics(i);
-
-	result = app_copy_rect(g, pt(dr.x, dr.y), src, sr);
+	if (! app_find_image_part(g, img, dr, sr, &p))
+		return 1;
+	b = app_image_cache_bitmap(win, img, &p, &sr);
+	if (! b)
+		return 0;
+	src = app_get_bitmap_graphics(b);
+	result = app_copy_rect(g,
+			pt(p.origin.x + p.part.x, p.origin.y + p.part.y),
+			src, sr);
 	app_del_graphics(src);
-	if (b)
-		app_del_bitmap(b);
-	if (i != img)
-		app_del_image(i);
 	return result;
 }
 
@@ -1145,7 +2015,7 @@ int app_copy_bits(Graphics *g, Rect dr, Palette *pal, byte **rows)
 		img->cmap_size = pal->size;
 		img->cmap = pal->element;
 		img->data8 = rows;
-		result = app_draw_image(g, dr, img, rect(0,0,dr.width,dr.height));
+		result = app_draw_image_once(g, dr, img, rect(0,0,dr.width,dr.height));
 		app_free(img);
 	}
 	else for (y=0; y < dr.height; y++) {
@@ -1174,7 +2044,7 @@ int app_copy_rgbs(Graphics *g, Rect dr, Colour **rows)
 		img->width = dr.width;
 		img->height = dr.height;
 		img->data32 = rows;
-		result = app_draw_image(g, dr, img, rect(0,0,dr.width,dr.height));
+		result = app_draw_image_once(g, dr, img, rect(0,0,dr.width,dr.height));
 		app_free(img);
 	}
 	else for (y=0; y < dr.height; y++) {
@@ -4,6 +4,8 @@
  *  Platform: Neutral
  *
  *  Version: 3.00  2001/05/05  First release.
+ *  Version: 3.70  2026/10/17  Nearest colours found through a cell cache.
+ *  Version: 3.71  2026/10/17  Median-cut quantization and dithering.
  */
 
 /* Copyright (c) L. Patrick
@@ -39,66 +41,790 @@ void app_del_palette(Palette *pal)
 	app_free(pal);
 }
 
-/* 
- * Using the equation given in Poynton's ColorFAQ at
- * <http://www.inforamp.net/~poynton/>
+/*
+ *  Nearest-colour lookup
+ *  ---------------------
+ *  Finding the nearest palette colour means measuring the
+ *  distance to every palette entry. To avoid that, colour space
+ *  is divided into 32x32x32 cells, and for each cell we remember
+ *  which entries could possibly be nearest to a colour inside
+ *  it: those whose smallest distance to the cell is no more than
+ *  the largest distance from the cell to the entry which is
+ *  nearest at its worst. The candidates are kept in order of
+ *  their smallest distance, so the search can stop as soon as
+ *  no remaining candidate could be nearer. Ties go to the lower
+ *  palette index, so the answer is exactly what measuring every
+ *  entry in order would give.
+ *
+ *  A cell's candidate list is made when a colour first falls in
+ *  that cell. The lists for the last few palettes used are kept,
+ *  each with a copy of the palette's colours, so a palette is
+ *  recognised by its contents and changes to it are noticed.
+ */
+
+#define CELL_BITS        5
+#define CELL_SHIFT       (8 - CELL_BITS)
+#define CELL_WIDTH       (1 << CELL_SHIFT)
+#define CELLS_PER_SIDE   (1 << CELL_BITS)
+#define NUM_CELLS        (1L << (3 * CELL_BITS))
+#define MAX_COLOUR_MAPS  4
+
+typedef struct ColourMap ColourMap;
+
+struct ColourMap {
+	int		size;		/* number of palette colours */
+	Colour *	element;	/* copy of the palette colours */
+	unsigned short *range;		/* per channel, cell side, entry:
+					   smallest then largest distance */
+	int *		cell;		/* offset+1 of each cell's list, or 0 */
+	int *		list;		/* lists: count, then entry index
+					   and smallest distance pairs */
+	long		list_used;
+	long		list_max;
+	unsigned long	last_used;
+};
+
+static ColourMap      colour_maps[MAX_COLOUR_MAPS];
+static unsigned long  colour_map_clock = 0L;
+
+/*
+ *  The weighted colour distance, using the equation given in
+ *  Poynton's ColorFAQ at <http://www.inforamp.net/~poynton/>
+ */
+#define RED_WEIGHT(d)    (((long)(d) * 77)  >> 8)
+#define GREEN_WEIGHT(d)  (((long)(d) * 151) >> 8)
+#define BLUE_WEIGHT(d)   (((long)(d) * 28)  >> 8)
+
+static unsigned long app_colour_distance(Colour src, Colour tgt)
+{
+	long dr, dg, db;
+
+	/* RGB match in decimal:
+	dr = (((long)src.red  -(long)tgt.red)   *30) /100;
+	dg = (((long)src.green-(long)tgt.green) *59) /100;
+	db = (((long)src.blue -(long)tgt.blue)  *11) /100;
+	*/
+
+	/* RGB match in hex: */
+	dr = RED_WEIGHT((long)src.red   - (long)tgt.red);
+	dg = GREEN_WEIGHT((long)src.green - (long)tgt.green);
+	db = BLUE_WEIGHT((long)src.blue  - (long)tgt.blue);
+
+	/* RGB to greyscale:
+	dr = (((long)src.red  -(long)tgt.red)   *21) /100;
+	dg = (((long)src.green-(long)tgt.green) *72) /100;
+	db = (((long)src.blue -(long)tgt.blue)  * 7) /100;
+	*/
+
+	return dr * dr + dg * dg + db * db;
+}
+
+/*
+ *  Store the smallest and largest squared weighted differences
+ *  between channel value t and the values lo to lo+CELL_WIDTH-1.
+ *  The weighting only ever rounds downwards, so it keeps the
+ *  order of the differences, and the extremes are at the ends.
  */
+#define CHANNEL_RANGE(weight, lo, t, range)			\
+	{							\
+		long f1 = weight((long)(lo) - (long)(t));		\
+		long f2 = weight((long)(lo) + CELL_WIDTH-1 - (long)(t));	\
+		(range)[0] = (f1 > 0) ? f1*f1 : (f2 < 0) ? f2*f2 : 0;	\
+		(range)[1] = (f1*f1 > f2*f2) ? f1*f1 : f2*f2;	\
+	}
+
+/*
+ *  Work out the distance ranges for each entry, channel by
+ *  channel, since a cell's ranges are sums of these.
+ */
+static void app_make_channel_ranges(ColourMap *map)
+{
+	unsigned short *r = map->range;
+	int side, t, lo;
+
+	for (side=0; side < CELLS_PER_SIDE; side++) {
+		lo = side << CELL_SHIFT;
+		for (t=0; t < map->size; t++, r += 6) {
+			CHANNEL_RANGE(RED_WEIGHT,   lo, map->element[t].red,   r+0);
+			CHANNEL_RANGE(GREEN_WEIGHT, lo, map->element[t].green, r+2);
+			CHANNEL_RANGE(BLUE_WEIGHT,  lo, map->element[t].blue,  r+4);
+		}
+	}
+}
+
+/*
+ *  Make the candidate list for a cell, returning its offset+1.
+ */
+static int app_make_cell_list(ColourMap *map, long cell)
+{
+	const unsigned short *rr, *gr, *br;
+	unsigned long min, max, limit;
+	int t, i, count;
+	int *list;
+
+	rr = map->range + ((cell >> (2 * CELL_BITS)) & (CELLS_PER_SIDE-1))
+					* map->size * 6;
+	gr = map->range + ((cell >> CELL_BITS) & (CELLS_PER_SIDE-1))
+					* map->size * 6 + 2;
+	br = map->range + (cell & (CELLS_PER_SIDE-1)) * map->size * 6 + 4;
+
+	/* the worst case distance to the best entry: */
+	limit = ~(0UL);
+	for (t=0; t < map->size; t++) {
+		max = (unsigned long) rr[t*6+1] + gr[t*6+1] + br[t*6+1];
+		if (max < limit)
+			limit = max;
+	}
+
+	/* make room for the longest possible list: */
+	if (map->list_used + map->size * 2 + 1 > map->list_max) {
+		map->list_max = (map->list_used + map->size * 2 + 1) * 2;
+		map->list = app_realloc(map->list,
+				map->list_max * sizeof(int));
+		if (! map->list) {
+			map->list_used = map->list_max = 0;
+			memset(map->cell, 0, NUM_CELLS * sizeof(int));
+			return 0;
+		}
+	}
+
+	/* keep the candidates sorted by their smallest distance: */
+	list = map->list + map->list_used + 1;
+	count = 0;
+	for (t=0; t < map->size; t++) {
+		min = (unsigned long) rr[t*6] + gr[t*6] + br[t*6];
+		if (min > limit)
+			continue;
+		for (i=count; (i > 0) && ((unsigned long) list[i*2-1] > min); i--) {
+			list[i*2]   = list[i*2-2];
+			list[i*2+1] = list[i*2-1];
+		}
+		list[i*2]   = t;
+		list[i*2+1] = (int) min;
+		count++;
+	}
+	list[-1] = count;
+
+	map->cell[cell] = (int) (map->list_used + 1);
+	map->list_used += count * 2 + 1;
+	return map->cell[cell];
+}
+
+/*
+ *  Find (or make) the colour map for the given palette colours.
+ */
+static ColourMap * app_find_colour_map(int size, const Colour *element)
+{
+	ColourMap *map, *oldest;
+	int i;
+
+	colour_map_clock++;
+	oldest = &colour_maps[0];
+	for (i=0; i < MAX_COLOUR_MAPS; i++) {
+		map = &colour_maps[i];
+		if ((map->cell) && (map->size == size)
+		    && (memcmp(map->element, element,
+				size * sizeof(Colour)) == 0))
+		{
+			map->last_used = colour_map_clock;
+			return map;
+		}
+		if (map->last_used < oldest->last_used)
+			oldest = map;
+	}
+
+	/* reuse the least recently used map: */
+	map = oldest;
+	app_free(map->element);
+	app_free(map->range);
+	app_free(map->cell);
+	app_free(map->list);
+	memset(map, 0, sizeof(ColourMap));
+
+	map->element = app_alloc(size * sizeof(Colour));
+	map->range = app_alloc(CELLS_PER_SIDE * size * 6
+				* sizeof(unsigned short));
+	map->cell = app_zero_alloc(NUM_CELLS * sizeof(int));
+	if ((! map->element) || (! map->range) || (! map->cell)) {
+		app_free(map->element);
+		app_free(map->range);
+		app_free(map->cell);
+		memset(map, 0, sizeof(ColourMap));
+		return NULL;
+	}
+	memcpy(map->element, element, size * sizeof(Colour));
+	map->size = size;
+	map->last_used = colour_map_clock;
+	app_make_channel_ranges(map);
+	return map;
+}
+
+/*
+ *  Return the index of the nearest palette colour, or -1 if
+ *  the palette is empty. The first of equally near colours is
+ *  the one returned.
+ */
+static int app_nearest_colour(ColourMap *map, int size,
+		const Colour *element, Colour src)
+{
+	int i, t, bestmatch;
+	unsigned long min_dist, distance;
+	long cell;
+	const int *list;
+
+	min_dist = ~(0UL);
+	bestmatch = -1;	/* not-an-index */
+
+	cell = ((long) (src.red >> CELL_SHIFT) << (2 * CELL_BITS))
+		| ((src.green >> CELL_SHIFT) << CELL_BITS)
+		| (src.blue >> CELL_SHIFT);
+
+	if ((! map) || ((! map->cell[cell])
+			&& (! app_make_cell_list(map, cell))))
+	{
+		/* no cell lists, so measure every entry */
+		for (t=0; t < size; t++) {
+			distance = app_colour_distance(src, element[t]);
+			if (distance < min_dist) {
+				bestmatch = t;
+				min_dist = distance;
+				if (distance == 0)
+					break;
+			}
+		}
+		return bestmatch;
+	}
+
+	list = map->list + map->cell[cell] - 1;
+	for (i=list[0], list++; i > 0; i--, list += 2)
+	{
+		if ((unsigned long) list[1] > min_dist)
+			break;	/* the rest are all further away */
+		t = list[0];
+		distance = app_colour_distance(src, element[t]);
+		if ((distance < min_dist)
+		    || ((distance == min_dist) && (t < bestmatch))) {
+			bestmatch = t;
+			min_dist = distance;
+		}
+	}
+	return bestmatch;
+}
+
 byte * app_palette_translation(Palette *target, byte *dest,
 	int src_size, Colour *src_elem)
 {
 	/* Return a translation matrix which maps src colours to the
 	 * nearest target colours. Nearest in terms of human perception.
 	 */
-	int t, s, bestmatch;
-	unsigned long min_dist, distance;
-	long dr, dg, db;
-	Colour src, tgt;
+	ColourMap *map = NULL;
+	int s;
+
+	if (target->size > 0)
+		map = app_find_colour_map(target->size, target->element);
 
 	for (s=0; s < src_size; s++)
+		dest[s] = app_nearest_colour(map, target->size,
+				target->element, src_elem[s]);
+
+	return dest;
+}
+
+/*
+ *  Colour quantization
+ *  -------------------
+ *  A palette for a true-colour picture is chosen by median cut.
+ *  Pixels are counted in a histogram with 5 bits of red, 6 of
+ *  green and 5 of blue, and each bin also sums the exact colours
+ *  which fell into it. Starting with one box holding every bin,
+ *  the box whose pixels are most spread out is cut in two across
+ *  its longest side, at its median pixel, until there are enough
+ *  boxes. Each box then gives the average colour of its pixels,
+ *  so colours which were alone in their bin come out exactly.
+ *  If any pixel is transparent, the last entry is kept for a
+ *  transparent colour.
+ */
+
+#define HIST_INDEX(r,g,b) ((((long)(r) >> 3) << 11) \
+				| (((g) >> 2) << 5) | ((b) >> 3))
+#define HIST_BINS         (1L << 16)
+
+typedef struct HistogramBin HistogramBin;
+typedef struct ColourBox ColourBox;
+
+struct HistogramBin {
+	unsigned long	count;		/* pixels in this bin */
+	double		red, green, blue;	/* sums of their colours */
+};
+
+struct Histogram {
+	HistogramBin *	bin;
+	int		transparent;	/* any transparent pixels? */
+};
+
+struct ColourBox {
+	int		lo[3], hi[3];	/* inclusive ranges of bins */
+	unsigned long	count;		/* pixels inside */
+	double		score;		/* 0 if it cannot be cut */
+};
+
+static const int hist_mask[3]  = { 31, 63, 31 };
+static const int hist_scale[3] = { 8 * 77, 4 * 151, 8 * 28 };
+
+APP_PRIVATE
+Histogram * app_new_histogram(void)
+{
+	Histogram *h;
+
+	h = app_zero_alloc(sizeof(Histogram));
+	if (! h)
+		return NULL;
+	h->bin = app_zero_alloc(HIST_BINS * sizeof(HistogramBin));
+	if (! h->bin) {
+		app_free(h);
+		return NULL;
+	}
+	return h;
+}
+
+APP_PRIVATE
+void app_del_histogram(Histogram *h)
+{
+	app_free(h->bin);
+	app_free(h);
+}
+
+/*
+ *  Count a row of pixels. Runs of one colour are counted
+ *  together, since they are common in drawn pictures.
+ */
+APP_PRIVATE
+void app_add_to_histogram(Histogram *h, const Colour *row, int width)
+{
+	HistogramBin *bin;
+	Colour col;
+	int x, run;
+
+	for (x=0; x < width; x += run)
 	{
-		src = src_elem[s];
-		min_dist = ~(0UL);
-		bestmatch = -1;	/* not-an-index */
+		col = row[x];
+		for (run=1; x+run < width; run++) {
+			if ((row[x+run].red != col.red)
+			    || (row[x+run].green != col.green)
+			    || (row[x+run].blue != col.blue)
+			    || (row[x+run].alpha != col.alpha))
+				break;
+		}
+
+		if (col.alpha > 0x7F) {
+			h->transparent = 1;
+			continue;
+		}
+		bin = &h->bin[HIST_INDEX(col.red, col.green, col.blue)];
+		bin->count += run;
+		bin->red   += (double) col.red   * run;
+		bin->green += (double) col.green * run;
+		bin->blue  += (double) col.blue  * run;
+	}
+}
+
+/*
+ *  Shrink a box to fit the bins it holds which have pixels,
+ *  then count them and decide how much cutting it would help.
+ */
+static void app_shrink_colour_box(Histogram *h, ColourBox *box)
+{
+	int lo[3], hi[3], i, r, g, b;
+	unsigned long count;
+	long len, longest;
+	const HistogramBin *bin;
+
+	for (i=0; i < 3; i++) {
+		lo[i] = hist_mask[i] + 1;
+		hi[i] = -1;
+	}
+	count = 0;
 
-		for (t=0; t < target->size; t++)
+	for (r=box->lo[0]; r <= box->hi[0]; r++)
+	  for (g=box->lo[1]; g <= box->hi[1]; g++)
+	  {
+		bin = &h->bin[((long) r << 11) | (g << 5)];
+		for (b=box->lo[2]; b <= box->hi[2]; b++)
 		{
-			tgt = target->element[t];
+			if (bin[b].count == 0)
+				continue;
+			count += bin[b].count;
+			if (r < lo[0]) lo[0] = r;
+			if (r > hi[0]) hi[0] = r;
+			if (g < lo[1]) lo[1] = g;
+			if (g > hi[1]) hi[1] = g;
+			if (b < lo[2]) lo[2] = b;
+			if (b > hi[2]) hi[2] = b;
+		}
+	  }
 
-			/* RGB match in decimal:
-			dr = (((long)src.red  -(long)tgt.red)   *30) /100;
-			dg = (((long)src.green-(long)tgt.green) *59) /100;
-			db = (((long)src.blue -(long)tgt.blue)  *11) /100;
-			*/
+	box->count = count;
+	if (count == 0) {
+		box->score = 0;
+		return;
+	}
 
-			/* RGB match in hex: */
-			dr = (((long)src.red  -(long)tgt.red)   *77)  >>8;
-			dg = (((long)src.green-(long)tgt.green) *151) >>8;
-			db = (((long)src.blue -(long)tgt.blue)  *28)  >>8;
+	longest = 0;
+	for (i=0; i < 3; i++) {
+		box->lo[i] = lo[i];
+		box->hi[i] = hi[i];
+		len = (long) (hi[i] - lo[i]) * hist_scale[i];
+		if (len > longest)
+			longest = len;
+	}
+	box->score = (double) count * longest;
+}
 
-			/* RGB to greyscale:
-			dr = (((long)src.red  -(long)tgt.red)   *21) /100;
-			dg = (((long)src.green-(long)tgt.green) *72) /100;
-			db = (((long)src.blue -(long)tgt.blue)  * 7) /100;
-			*/
+/*
+ *  Cut a box across its longest side at the median pixel,
+ *  putting the upper part into the second box.
+ */
+static void app_cut_colour_box(Histogram *h, ColourBox *box,
+		ColourBox *upper)
+{
+	unsigned long slice[64];
+	unsigned long sum, half;
+	long len, longest;
+	int axis, i, k, r, g, b, at[3];
 
-			distance = dr * dr + dg * dg + db * db;
+	axis = 0;
+	longest = -1;
+	for (i=0; i < 3; i++) {
+		len = (long) (box->hi[i] - box->lo[i]) * hist_scale[i];
+		if (len > longest) {
+			longest = len;
+			axis = i;
+		}
+	}
 
-			if (distance == 0) {
-				bestmatch = t;
-				break;
-			}
-			else if (bestmatch < 0) {
-				bestmatch = t;
-				min_dist = distance;
+	/* count the pixels in each slice across that side: */
+	memset(slice, 0, sizeof(slice));
+	for (r=box->lo[0]; r <= box->hi[0]; r++)
+	  for (g=box->lo[1]; g <= box->hi[1]; g++)
+	    for (b=box->lo[2]; b <= box->hi[2]; b++)
+	    {
+		at[0] = r; at[1] = g; at[2] = b;
+		slice[at[axis]] += h->bin[((long) r << 11)
+					| (g << 5) | b].count;
+	    }
+
+	half = box->count / 2;
+	sum = 0;
+	for (k=box->lo[axis]; k < box->hi[axis] - 1; k++) {
+		sum += slice[k];
+		if (sum >= half)
+			break;
+	}
+
+	*upper = *box;
+	box->hi[axis] = k;
+	upper->lo[axis] = k + 1;
+	app_shrink_colour_box(h, box);
+	app_shrink_colour_box(h, upper);
+}
+
+/*
+ *  Choose a palette of at most max_colours colours for the
+ *  pixels counted so far.
+ */
+APP_PRIVATE
+Palette * app_histogram_palette(Histogram *h, int max_colours)
+{
+	ColourBox box[256];
+	Colour elem[256];
+	unsigned long count;
+	double red, green, blue;
+	const HistogramBin *bin;
+	int boxes, i, best, n, r, g, b;
+
+	if ((max_colours <= 0) || (max_colours > 256))
+		max_colours = 256;
+	if (h->transparent)
+		max_colours--;
+
+	boxes = 0;
+	if (max_colours > 0) {
+		for (i=0; i < 3; i++) {
+			box[0].lo[i] = 0;
+			box[0].hi[i] = hist_mask[i];
+		}
+		app_shrink_colour_box(h, &box[0]);
+		if (box[0].count > 0)
+			boxes = 1;
+	}
+
+	while (boxes < max_colours) {
+		best = -1;
+		for (i=0; i < boxes; i++)
+			if ((box[i].score > 0) && ((best < 0)
+				|| (box[i].score > box[best].score)))
+				best = i;
+		if (best < 0)
+			break;	/* every box is a single bin */
+		app_cut_colour_box(h, &box[best], &box[boxes++]);
+	}
+
+	/* each box gives the average colour of its pixels: */
+	n = 0;
+	for (i=0; i < boxes; i++) {
+		count = 0;
+		red = green = blue = 0;
+		for (r=box[i].lo[0]; r <= box[i].hi[0]; r++)
+		  for (g=box[i].lo[1]; g <= box[i].hi[1]; g++)
+		    for (b=box[i].lo[2]; b <= box[i].hi[2]; b++)
+		    {
+			bin = &h->bin[((long) r << 11) | (g << 5) | b];
+			count += bin->count;
+			red   += bin->red;
+			green += bin->green;
+			blue  += bin->blue;
+		    }
+		elem[n++] = rgb((int) (red / count + 0.5),
+				(int) (green / count + 0.5),
+				(int) (blue / count + 0.5));
+	}
+	if (h->transparent)
+		elem[n++] = argb(255,255,255,255);
+
+	return app_new_palette(n, elem);
+}
+
+/*
+ *  Choose a palette for some rows of 32-bit pixels.
+ *  Returns NULL if there is no memory left.
+ */
+APP_PRIVATE
+Palette * app_quantize_rows(Colour **rows, int width, int height,
+		int max_colours)
+{
+	Histogram *h;
+	Palette *pal;
+	int y;
+
+	h = app_new_histogram();
+	if (! h)
+		return NULL;
+	for (y=0; y < height; y++)
+		app_add_to_histogram(h, rows[y], width);
+	pal = app_histogram_palette(h, max_colours);
+	app_del_histogram(h);
+	return pal;
+}
+
+/*
+ *  Dithering
+ *  ---------
+ *  A Ditherer maps rows of 32-bit pixels onto a palette, one row
+ *  at a time, so image readers can use it as rows arrive.
+ *  Transparent pixels use the palette's first transparent entry
+ *  if it has one, and the other pixels use only its opaque
+ *  entries, found through the cell cache above.
+ *
+ *  Ordered dithering adds an 8x8 pattern to each pixel, sized to
+ *  the gaps between palette colours, so any row can be dithered
+ *  on its own. Error diffusion (Floyd-Steinberg, in alternating
+ *  directions) spreads each pixel's error onto its neighbours,
+ *  and carries it from one row to the next as long as the rows
+ *  come in order.
+ */
+
+#define ERROR_SHARE(e)  ((e) >= 0 ? ((e) + 8) >> 4 : -((8 - (e)) >> 4))
+#define CLAMP_BYTE(v)   ((v) < 0 ? 0 : (v) > 255 ? 255 : (v))
+
+struct Ditherer {
+	int		method;		/* a DitherMethod */
+	int		width;
+	int		size;		/* opaque palette entries */
+	Colour *	element;	/* the opaque entries, in order */
+	byte *		index;		/* their palette indexes */
+	int		transparent;	/* transparent entry, or -1 */
+	int		spread;		/* ordered dither strength */
+	int		last_row;	/* the row dithered last */
+	int *		error;		/* diffusion errors for two rows */
+};
+
+static const byte bayer_matrix[8][8] = {
+	{  0, 32,  8, 40,  2, 34, 10, 42 },
+	{ 48, 16, 56, 24, 50, 18, 58, 26 },
+	{ 12, 44,  4, 36, 14, 46,  6, 38 },
+	{ 60, 28, 52, 20, 62, 30, 54, 22 },
+	{  3, 35, 11, 43,  1, 33,  9, 41 },
+	{ 51, 19, 59, 27, 49, 17, 57, 25 },
+	{ 15, 47,  7, 39, 13, 45,  5, 37 },
+	{ 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+APP_PRIVATE
+Ditherer * app_new_ditherer(Palette *pal, int width, int method)
+{
+	Ditherer *d;
+	Colour a, b;
+	int i, j, gap, diff;
+	long total;
+
+	d = app_zero_alloc(sizeof(Ditherer));
+	if (! d)
+		return NULL;
+	d->method = method;
+	d->width = width;
+	d->transparent = -1;
+	d->last_row = -2;
+
+	d->element = app_alloc((pal->size + 1) * sizeof(Colour));
+	d->index = app_alloc(pal->size + 1);
+	if (method == DIFFUSION_DITHER)
+		d->error = app_zero_alloc((width + 2) * 6 * sizeof(int));
+	if ((! d->element) || (! d->index)
+	    || ((method == DIFFUSION_DITHER) && (! d->error)))
+	{
+		app_del_ditherer(d);
+		return NULL;
+	}
+
+	for (i=0; (i < pal->size) && (i < 256); i++) {
+		if (pal->element[i].alpha > 0x7F) {
+			if (d->transparent < 0)
+				d->transparent = i;
+			continue;
+		}
+		d->element[d->size] = pal->element[i];
+		d->element[d->size].alpha = 0;
+		d->index[d->size++] = i;
+	}
+
+	/* the pattern spans the typical gap between colours: */
+	total = 0;
+	for (i=0; i < d->size; i++) {
+		gap = 255;
+		for (j=0; j < d->size; j++) {
+			if (j == i)
+				continue;
+			a = d->element[i];
+			b = d->element[j];
+			diff = abs(a.red - b.red);
+			if (diff < abs(a.green - b.green))
+				diff = abs(a.green - b.green);
+			if (diff < abs(a.blue - b.blue))
+				diff = abs(a.blue - b.blue);
+			if (diff < gap)
+				gap = diff;
+		}
+		total += gap;
+	}
+	d->spread = (d->size > 0) ? (int) (total / d->size) : 255;
+	if (d->spread < 1)
+		d->spread = 1;
+
+	return d;
+}
+
+APP_PRIVATE
+void app_del_ditherer(Ditherer *d)
+{
+	app_free(d->element);
+	app_free(d->index);
+	app_free(d->error);
+	app_free(d);
+}
+
+/*
+ *  Dither row y of an image, writing palette indexes to dest.
+ */
+APP_PRIVATE
+void app_dither_row(Ditherer *d, int y, const Colour *src, byte *dest)
+{
+	ColourMap *map;
+	Colour col, near;
+	int x, i, dir, end, offset, r, g, b;
+	int *cur, *next, *e;
+
+	if (d->size == 0) {
+		/* nothing opaque to use */
+		memset(dest, (d->transparent < 0) ? 0 : d->transparent,
+			d->width);
+		return;
+	}
+	map = app_find_colour_map(d->size, d->element);
+
+	if (d->method != DIFFUSION_DITHER)
+	{
+		for (x=0; x < d->width; x++) {
+			col = src[x];
+			if ((col.alpha > 0x7F) && (d->transparent >= 0)) {
+				dest[x] = d->transparent;
+				continue;
 			}
-			else if (distance < min_dist) {
-				bestmatch = t;
-				min_dist = distance;
+			if (d->method == ORDERED_DITHER) {
+				offset = ((bayer_matrix[y & 7][x & 7] * 2 - 63)
+						* d->spread) / 128;
+				r = col.red + offset;
+				g = col.green + offset;
+				b = col.blue + offset;
+				col.red   = CLAMP_BYTE(r);
+				col.green = CLAMP_BYTE(g);
+				col.blue  = CLAMP_BYTE(b);
 			}
+			i = app_nearest_colour(map, d->size, d->element, col);
+			dest[x] = d->index[i];
 		}
-		dest[s] = bestmatch;
+		d->last_row = y;
+		return;
 	}
 
-	return dest;
-}
+	/* error diffusion only carries on from the row above: */
+	if (y != d->last_row + 1)
+		memset(d->error, 0, (d->width + 2) * 6 * sizeof(int));
+	d->last_row = y;
+
+	cur  = d->error + (y & 1) * (d->width + 2) * 3;
+	next = d->error + ((y + 1) & 1) * (d->width + 2) * 3;
+	memset(next, 0, (d->width + 2) * 3 * sizeof(int));
+
+	if (y & 1) {
+		x = d->width - 1;
+		end = -1;
+		dir = -1;
+	} else {
+		x = 0;
+		end = d->width;
+		dir = 1;
+	}
 
+	for (; x != end; x += dir)
+	{
+		col = src[x];
+		if ((col.alpha > 0x7F) && (d->transparent >= 0)) {
+			dest[x] = d->transparent;
+			continue;
+		}
+		e = cur + (x + 1) * 3;
+		r = col.red   + ERROR_SHARE(e[0]);
+		g = col.green + ERROR_SHARE(e[1]);
+		b = col.blue  + ERROR_SHARE(e[2]);
+		col.red   = CLAMP_BYTE(r);
+		col.green = CLAMP_BYTE(g);
+		col.blue  = CLAMP_BYTE(b);
+
+		i = app_nearest_colour(map, d->size, d->element, col);
+		dest[x] = d->index[i];
+
+		/* share the error out 7/16, 3/16, 5/16, 1/16: */
+		near = d->element[i];
+		r = (int) col.red   - near.red;
+		g = (int) col.green - near.green;
+		b = (int) col.blue  - near.blue;
+		e = cur + (x + 1 + dir) * 3;
+		e[0] += r * 7;  e[1] += g * 7;  e[2] += b * 7;
+		e = next + (x + 1 - dir) * 3;
+		e[0] += r * 3;  e[1] += g * 3;  e[2] += b * 3;
+		e = next + (x + 1) * 3;
+		e[0] += r * 5;  e[1] += g * 5;  e[2] += b * 5;
+		e = next + (x + 1 + dir) * 3;
+		e[0] += r;      e[1] += g;      e[2] += b;
+	}
+}
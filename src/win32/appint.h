@@ -50,6 +50,8 @@ struct AppExtra
 	Window *	timer_win;
 	int		timer_id;
 	int		window_number; /* unique increasing count */
+	Point		motion;		/* last mouse movement */
+	Point		motion_offset;	/* of the control being told */
 };
 
 #define app_extra(app) ((app)->extra)
@@ -13,6 +13,7 @@
  *  Version: 3.56  2005/08/09  Silenced some size_t conversion warnings.
  *  Version: 3.59  2005/10/10  Supports over-sized glyphs.
  *  Version: 3.62  2010/01/10  Native font drawing supports wider glyphs.
+ *  Version: 3.70  2026/10/17  Trims the glyph cache before drawing text.
  */
 
 /* Copyright (c) L. Patrick
@@ -825,6 +826,9 @@ int app_bitmap_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 	if (f == NULL)
 		return 0;
 
+	/* make room in the glyph cache for this string's subfonts */
+	app_trim_font_cache();
+
 	/* correct drawing displacement */
 	dp.x += dst->offset.x;
 	dp.y += dst->offset.y;
@@ -11,6 +11,7 @@
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
  *  Version: 3.56  2005/08/09  Silenced some size_t conversion warnings.
  *  Version: 3.59  2005/10/10  Supports over-sized glyphs.
+ *  Version: 3.70  2026/10/17  Trims the glyph cache before drawing text.
  */
 
 /* Copyright (c) L. Patrick
@@ -509,6 +510,9 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 	if (f == NULL)
 		return 0;
 
+	/* make room in the glyph cache for this string's subfonts */
+	app_trim_font_cache();
+
 	/* correct drawing direction */
 	if (dst->text_direction & RL_TB)
 		right_to_left = 1;
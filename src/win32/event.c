@@ -26,6 +26,8 @@
  *  Version: 3.56  2005/08/09  Silenced some WPARAM conversion warnings.
  *  Version: 3.57  2005/08/16  Added app_process_events, TEMP_CURSORs, VK_TAB.
  *  Version: 3.60  2007/06/06  Timers, tool-tips, temp cursors.
+ *  Version: 3.70  2026/10/17  Redraws are limited to the damaged area.
+ *  Version: 3.71  2026/10/17  Added mouse motion history.
  */
 
 /* Copyright (c) L. Patrick
@@ -141,6 +143,7 @@ static void app_do_mouse_move(Window *win, int buttons, int x, int y)
 
 	p.x = x;
 	p.y = y;
+	app_extra(win->app)->motion = p;
 
 	c = app_locate_control(win, p);
 
@@ -160,6 +163,7 @@ static void app_do_mouse_move(Window *win, int buttons, int x, int y)
 			if (c->mouse_drag) {
 				p.x = x - c->offset.x;
 				p.y = y - c->offset.y;
+				app_extra(win->app)->motion_offset = c->offset;
 				for (i=0; c->mouse_drag[i]; i++)
 					c->mouse_drag[i](c, buttons, p);
 				if (win->pass_event)
@@ -172,6 +176,7 @@ static void app_do_mouse_move(Window *win, int buttons, int x, int y)
 		if (win->mouse_drag) {
 			p.x = x;
 			p.y = y;
+			app_extra(win->app)->motion_offset = pt(0,0);
 			for (i=0; win->mouse_drag[i]; i++)
 				win->mouse_drag[i](win, buttons, p);
 		}
@@ -181,6 +186,7 @@ static void app_do_mouse_move(Window *win, int buttons, int x, int y)
 			if (c->mouse_move) {
 				p.x = x - c->offset.x;
 				p.y = y - c->offset.y;
+				app_extra(win->app)->motion_offset = c->offset;
 				for (i=0; c->mouse_move[i]; i++)
 					c->mouse_move[i](c, buttons, p);
 				if (win->pass_event)
@@ -193,12 +199,32 @@ static void app_do_mouse_move(Window *win, int buttons, int x, int y)
 		if (win->mouse_move) {
 			p.x = x;
 			p.y = y;
+			app_extra(win->app)->motion_offset = pt(0,0);
 			for (i=0; win->mouse_move[i]; i++)
 				win->mouse_move[i](win, buttons, p);
 		}
 	}
 }
 
+/*
+ *  Windows already merges mouse movements which are waiting,
+ *  keeping only the latest, so the history is just that one.
+ */
+void app_set_mouse_compression(App *app, int on)
+{
+}
+
+int app_get_mouse_history(App *app, Point *list, int max)
+{
+	if (max > 0) {
+		list[0].x = app_extra(app)->motion.x
+				- app_extra(app)->motion_offset.x;
+		list[0].y = app_extra(app)->motion.y
+				- app_extra(app)->motion_offset.y;
+	}
+	return 1;
+}
+
 /*
  *  Handle WM_KEYDOWN events, which occur prior to being
  *  translated into WM_CHAR events, and hence can contain
@@ -330,6 +356,7 @@ static void app_do_redraw_window(HWND hwnd, Window *win)
 	PAINTSTRUCT ps;
 	HPALETTE oldpal = 0;
 	Graphics *g;
+	Rect r;
 
 	if (win == NULL) {
 		dc = BeginPaint(hwnd, &ps);
@@ -349,12 +376,15 @@ static void app_do_redraw_window(HWND hwnd, Window *win)
 			ps.rcPaint.right - ps.rcPaint.left,
 			ps.rcPaint.bottom - ps.rcPaint.top));
 	g = app_get_window_redraw(dc, win);
-	app_set_rgb(g, win->bg);
-	app_fill_rect(g, rect(0, 0, win->area.width, win->area.height));
-	app_set_rgb(g, BLACK);
-	if (win->redraw)
-		for (i=0; win->redraw[i]; i++)
-			win->redraw[i](win, g);
+	r = app_get_clip_rect(g);
+	if ((r.width > 0) && (r.height > 0)) {
+		app_set_rgb(g, win->bg);
+		app_fill_rect(g, r);
+		app_set_rgb(g, BLACK);
+		if (win->redraw)
+			for (i=0; win->redraw[i]; i++)
+				win->redraw[i](win, g);
+	}
 	app_do_draw_controls(g, win->num_children, win->children, 1);
 	app_del_graphics(g);
 	app_del_region(win->redraw_rgn);
@@ -13,6 +13,7 @@
  *  Version: 3.50  2003/11/25  Both / and \ are now folder separators.
  *  Version: 3.53  2004/05/08  Better handling of root and drive letters.
  *  Version: 3.56  2005/08/09  Silenced some size_t conversion warnings.
+ *  Version: 3.71  2026/10/17  Files can be mapped into memory.
  */
 
 /* Copyright (c) L. Patrick
@@ -466,6 +467,54 @@ long app_file_size(const char *filepath)
 	return size;
 }
 
+/*
+ *  Map a whole file into memory, returning its bytes and setting
+ *  *length to its size. The pages are copy-on-write, so changes
+ *  to them never reach the file. Returns NULL if the file can't
+ *  be opened or mapped, or is empty.
+ */
+APP_PRIVATE
+void * app_map_file(const char *filepath, long *length)
+{
+	char *dos_path;
+	HANDLE hfile, hmap;
+	DWORD low, high;
+	void *data = NULL;
+
+	*length = 0;
+	dos_path = app_to_native_path(filepath);
+	hfile = CreateFile(dos_path, GENERIC_READ, FILE_SHARE_READ,
+			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	app_free(dos_path);
+	if (hfile == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	low = GetFileSize(hfile, &high);
+	if ((low != 0xFFFFFFFF) && (low > 0) && (high == 0)) {
+		hmap = CreateFileMapping(hfile, NULL, PAGE_WRITECOPY,
+				0, 0, NULL);
+		if (hmap) {
+			data = MapViewOfFile(hmap, FILE_MAP_COPY, 0, 0, 0);
+			if (data)
+				*length = (long) low;
+			CloseHandle(hmap);
+		}
+	}
+	CloseHandle(hfile);
+
+	return data;
+}
+
+/*
+ *  Release a file mapped by app_map_file.
+ */
+APP_PRIVATE
+void app_unmap_file(void *data, long length)
+{
+	if (data)
+		UnmapViewOfFile(data);
+}
+
 /*
  *  Return the file's last modifcation time in seconds.
  */
@@ -10,6 +10,7 @@
  *  Version: 3.21  2002/04/04  Fixed some memory leaks.
  *  Version: 3.35  2002/12/23  Moved portable code to fontutil.c
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
+ *  Version: 3.70  2026/10/17  Subfonts are released per App, not per Font.
  */
 
 /* Copyright (c) L. Patrick
@@ -24,7 +25,7 @@
 /*
  *  Release memory used by a native font's subfont.
  */
-void app_release_native_subfont(Font *f, Subfont *sub)
+void app_release_native_subfont(App *app, Subfont *sub)
 {
 	if (subfont_extra(sub)->clipmask) {
 		DeleteObject(subfont_extra(sub)->clipmask);
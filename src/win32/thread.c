@@ -0,0 +1,199 @@
+/*
+ *  Worker threads.
+ *
+ *  Platform: Windows.
+ *
+ *  Version: 3.70  2026/10/17  First release.
+ */
+
+/* Copyright (c) L. Patrick
+
+   This file is part of the App cross-platform programming package.
+   You may redistribute it and/or modify it under the terms of the
+   App Software License. See the file LICENSE.TXT for details.
+*/
+
+/*
+ *  Worker threads
+ *  --------------
+ *  This is the Windows version of x11/thread.c; see that file
+ *  for how jobs are split into bands of rows.
+ *
+ *  Workers sleep on a semaphore, which is released once per
+ *  worker for each job. The last band to finish sets an event
+ *  for the thread which started the job.
+ */
+
+#include "appint.h"
+
+#define MAX_WORKERS       63	/* threads besides the caller */
+#define BANDS_PER_THREAD  4	/* so uneven bands even out */
+#define MIN_BAND_ROWS     16	/* smaller bands are not worth it */
+
+static LONG              job_busy = 0;
+static int               pool_ready = 0;
+static CRITICAL_SECTION  pool_lock;
+static HANDLE            work_ready;	/* semaphore */
+static HANDLE            work_done;	/* auto-reset event */
+
+static HANDLE     workers[MAX_WORKERS];
+static int        num_workers = 0;
+static int        quitting = 0;
+
+/* The current job, guarded by pool_lock: */
+
+static BandFunc   job_func = NULL;
+static void *     job_data = NULL;
+static int        job_rows = 0;
+static int        job_threads = 0;
+static int        job_bands = 0;
+static int        next_band = 0;
+static int        bands_done = 0;
+
+/*
+ *  Take bands of the current job until there are none left.
+ *  Called with pool_lock held, which is released while each
+ *  band runs.
+ */
+static void app_take_bands(int thread)
+{
+	int band, y1, y2;
+
+	while (next_band < job_bands)
+	{
+		band = next_band++;
+		y1 = (int) ((long) job_rows * band / job_bands);
+		y2 = (int) ((long) job_rows * (band+1) / job_bands);
+
+		LeaveCriticalSection(&pool_lock);
+		job_func(job_data, thread, y1, y2);
+		EnterCriticalSection(&pool_lock);
+
+		if (++bands_done == job_bands)
+			SetEvent(work_done);
+	}
+}
+
+static DWORD WINAPI app_worker_main(LPVOID arg)
+{
+	int thread = (int) (INT_PTR) arg;
+
+	for (;;)
+	{
+		WaitForSingleObject(work_ready, INFINITE);
+		EnterCriticalSection(&pool_lock);
+		if (quitting) {
+			LeaveCriticalSection(&pool_lock);
+			break;
+		}
+		if (thread < job_threads)
+			app_take_bands(thread);
+		LeaveCriticalSection(&pool_lock);
+	}
+	return 0;
+}
+
+APP_PRIVATE
+int app_worker_threads(void)
+{
+	return num_workers + 1;
+}
+
+APP_PRIVATE
+void app_run_bands(BandFunc func, void *data, int rows, int threads)
+{
+	int bands;
+
+	if (rows <= 0)
+		return;
+	if ((threads < 2) || (rows < 2 * MIN_BAND_ROWS)
+		|| (InterlockedExchange(&job_busy, 1) != 0))
+	{
+		func(data, 0, 0, rows);
+		return;
+	}
+	if (num_workers == 0) {
+		InterlockedExchange(&job_busy, 0);
+		func(data, 0, 0, rows);
+		return;
+	}
+
+	if (threads > num_workers + 1)
+		threads = num_workers + 1;
+	bands = threads * BANDS_PER_THREAD;
+	if (bands > rows / MIN_BAND_ROWS)
+		bands = rows / MIN_BAND_ROWS;
+
+	EnterCriticalSection(&pool_lock);
+	job_func = func;
+	job_data = data;
+	job_rows = rows;
+	job_threads = threads;
+	job_bands = bands;
+	next_band = 0;
+	bands_done = 0;
+	ReleaseSemaphore(work_ready, threads - 1, NULL);
+
+	app_take_bands(0);
+	while (bands_done < job_bands) {
+		LeaveCriticalSection(&pool_lock);
+		WaitForSingleObject(work_done, INFINITE);
+		EnterCriticalSection(&pool_lock);
+	}
+	LeaveCriticalSection(&pool_lock);
+
+	InterlockedExchange(&job_busy, 0);
+}
+
+void app_set_worker_threads(int n)
+{
+	SYSTEM_INFO info;
+	int i;
+
+	if (n <= 0) {
+		GetSystemInfo(&info);
+		n = (int) info.dwNumberOfProcessors;
+		if (n <= 0)
+			n = 1;
+	}
+	if (n > MAX_WORKERS + 1)
+		n = MAX_WORKERS + 1;
+
+	while (InterlockedExchange(&job_busy, 1) != 0)
+		Sleep(1);
+
+	if (! pool_ready) {
+		InitializeCriticalSection(&pool_lock);
+		work_ready = CreateSemaphore(NULL, 0, MAX_WORKERS * 64, NULL);
+		work_done = CreateEvent(NULL, FALSE, FALSE, NULL);
+		pool_ready = (work_ready != NULL) && (work_done != NULL);
+	}
+
+	/* stop the old workers */
+	if (num_workers > 0) {
+		EnterCriticalSection(&pool_lock);
+		quitting = 1;
+		LeaveCriticalSection(&pool_lock);
+		ReleaseSemaphore(work_ready, num_workers, NULL);
+		for (i=0; i < num_workers; i++) {
+			WaitForSingleObject(workers[i], INFINITE);
+			CloseHandle(workers[i]);
+		}
+		num_workers = 0;
+		quitting = 0;
+		/* drain any wake-ups the old workers never took */
+		while (WaitForSingleObject(work_ready, 0) == WAIT_OBJECT_0)
+			;
+	}
+
+	/* start the new ones; thread 0 is always the caller */
+	for (i=0; pool_ready && (i < n-1); i++) {
+		workers[i] = CreateThread(NULL, 0, app_worker_main,
+					(LPVOID) (INT_PTR) (i+1), 0, NULL);
+		if (workers[i] == NULL)
+			break;
+		num_workers++;
+	}
+
+	InterlockedExchange(&job_busy, 0);
+}
@@ -16,6 +16,7 @@
  *  Version: 3.52  2004/03/29  Uses type-safe private extra data types.
  *  Version: 3.57  2004/03/29  Uses type-safe private extra data types.
  *  Version: 3.60  2007/06/06  Windows classes now shared. Added a function.
+ *  Version: 3.70  2026/10/17  Deletes image Bitmaps cached for the window.
  */
 
 /* Copyright (c) L. Patrick
@@ -238,6 +239,9 @@ void app_del_window(Window *win)
 	for (i = win->num_children - 1; i >= 0; i--)
 		app_del_control(win->children[i]);
 
+	/* Delete any image Bitmaps cached for this window. */
+	app_forget_image_caches(win);
+
 	/* Remove the window from the screen. */
 	if (win_extra(win)->hicon)
 		DestroyIcon(win_extra(win)->hicon);
@@ -13,6 +13,14 @@
 
 #undef USE_ALARM	//!!
 
+#ifndef NO_XSHM
+#define USE_XSHM	/* MIT-SHM image transfer, needs -lXext */
+#endif
+
+#ifndef NO_XRENDER
+#define USE_XRENDER	/* anti-aliased text, needs -lXrender */
+#endif
+
   typedef struct AppExtra       AppExtra;
   typedef struct WindowExtra    WindowExtra;
   typedef struct BitmapExtra    BitmapExtra;
@@ -31,6 +39,14 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/keysym.h>
+#ifdef USE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+#ifdef USE_XRENDER
+#include <X11/extensions/Xrender.h>
+#endif
 #undef   Cursor
 #undef   Font
 #undef   Region
@@ -56,6 +72,29 @@ typedef struct CLUT	/* Colour Look-Up Table */
 	byte   *        in_use;    /* which cells cannot be changed? */
 } CLUT;
 
+enum {
+	GRAPHICS_POOL = 8,	/* Graphics objects kept for reuse */
+	BATCH_SIZE = 256	/* shapes sent in one drawing request */
+};
+
+enum {
+	BATCH_NONE = 0,		/* kinds of batched shape */
+	BATCH_RECTS,
+	BATCH_SEGMENTS
+};
+
+#ifdef USE_XSHM
+enum {
+	SHM_SEGMENTS = 4	/* shared memory segments kept for reuse */
+};
+
+typedef struct ShmSegment
+{
+	XShmSegmentInfo info;	/* attached to the X server */
+	long		size;	/* in bytes, or zero if unused */
+	int		busy;	/* holding an image at the moment */
+} ShmSegment;
+#endif
 
 struct AppExtra
 {
@@ -70,6 +109,30 @@ struct AppExtra
 	Atom		xwmhint;	/* to handle window decorations */
 	Atom		xclip;		/* to own CLIPBOARD selection */
 	int 	timer_id;	/* If USE_ALARM */
+	int		compress_motion; /* merge queued MotionNotify events */
+	Point *		motion;		/* positions merged into this one */
+	int		num_motion;
+	int		max_motion;
+	Point		motion_offset;	/* of the control being told */
+	int		num_pooled;	/* Graphics kept for reuse */
+	Graphics *	pooled[GRAPHICS_POOL];
+	Graphics *	batch_owner;	/* whose drawing is batched */
+	XID		batch_xid;	/* drawable it is going to */
+	int		batch_kind;	/* BATCH_RECTS or BATCH_SEGMENTS */
+	int		batched;	/* number of shapes waiting */
+	union {
+		XRectangle	rects[BATCH_SIZE];
+		XSegment	segs[BATCH_SIZE];
+	} batch;
+#ifdef USE_XSHM
+	int		use_shm;	/* 1 if MIT-SHM works on this display */
+	ShmSegment	shm[SHM_SEGMENTS];
+#endif
+#ifdef USE_XRENDER
+	int		use_render;	/* 1 if XRender can draw text */
+	XRenderPictFormat * render_a8;	/* format of glyph alpha masks */
+	XRenderPictFormat * render_screen; /* format of windows */
+#endif
 };
 
 #define app_extra(app) ((app)->extra)
@@ -78,11 +141,20 @@ struct AppExtra
 struct WindowExtra
 {
 	int		exposed;	/* 1 if need No/GraphicsExpose */
+	int		expose_count;	/* Expose events still to come */
+	int		resize_queued;	/* 1 if ConfigureNotify is queued */
 	int		is_paletted;	/* 0 if TrueColor/DirectColor */
 	CLUT *		clut;		/* used if has private palette */
 	XID		xid;		/* ID of this window */
 	Atom		xdel;		/* deletion message ID */
 	Bitmap *	icon_bitmap;	/* bitmap used for window icon */
+	Pixmap		back_buffer;	/* used if window is BUFFERED */
+	int		back_width;	/* size of the back buffer */
+	int		back_height;
+#ifdef USE_XRENDER
+	Picture		picture;	/* for XRender drawing on window */
+	Picture		back_picture;	/* and on its back buffer */
+#endif
 };
 
 #define win_extra(win) ((win)->extra)
@@ -93,6 +165,7 @@ struct BitmapExtra
 	Pixmap		handle;
 	Pixmap		clipmask;
 	int		blitter;
+	int		depth;
 };
 
 #define bitmap_extra(bmap) ((bmap)->extra)
@@ -102,6 +175,15 @@ struct GraphicsExtra
 {
 	GC 		gc;
 	long		bgpixval;
+	XID		xid;		/* window or back buffer drawn on */
+	int		depth;		/* depth of drawables the GC suits */
+	unsigned long	fg;		/* foreground last sent to the GC */
+	int		function;	/* drawing function last sent */
+	int		clipped;	/* GC is clipped to the clip region */
+#ifdef USE_XRENDER
+	Picture		pen;		/* solid XRender source colour */
+	unsigned long	pen_pixel;	/* pixel value it was made from */
+#endif
 };
 
 #define graphics_extra(g) ((g)->extra)
@@ -110,6 +192,10 @@ struct GraphicsExtra
 struct SubfontExtra
 {
 	Pixmap		clipmask;
+#ifdef USE_XRENDER
+	GlyphSet	glyphs;		/* alpha masks held by XRender */
+	int		glyph_height;	/* font height they were placed for */
+#endif
 };
 
 #define subfont_extra(sub) ((sub)->extra)
@@ -149,12 +235,44 @@ XID 	app_new_clipmask(Display *disp, int width, int height);
 Bitmap *app_new_monochrome_bitmap(Window *win, int width, int height);
 XID 	app_image_to_clipmask(App *app, Image *img);
 Bitmap *app_image_to_monochrome_bitmap(Window *win, Image *img);
+void	app_init_shm(App *app);
+void	app_del_shm(App *app);
+
+/* Text drawn with XRender (see drawwin.c): */
+
+#ifdef USE_XRENDER
+void	app_init_render(App *app);
+void	app_del_glyph_set(App *app, Subfont *sub);
+#endif
 
 /* Clipboard events: */
 
 void	app_send_clipboard(App *app, XSelectionRequestEvent *e);
 char *	app_receive_clipboard(App *app, XSelectionEvent *e, long *nb);
 
+/* Timers (see timer.c): */
+
+long	app_next_timer_delay(App *app);
+int	app_run_timers(App *app);
+
+/* Graphics contexts: */
+
+void	app_set_gc_foreground(Graphics *g, unsigned long pixel);
+void	app_set_gc_function(Graphics *g, int function);
+void	app_clip_gc(Graphics *g);
+void	app_del_graphics_pool(App *app);
+
+/* Batched drawing: */
+
+void	app_batch_rect(Graphics *g, Rect r);
+void	app_batch_line(Graphics *g, Point p1, Point p2);
+void	app_flush_drawing(App *app);
+
+/* Back buffers (see win.c): */
+
+int	app_use_back_buffer(Graphics *g);
+void	app_show_back_buffer(Graphics *g);
+
 /* Colours and X CLUT features: */
 
 int 	app_is_true_colour_display(Display *disp);
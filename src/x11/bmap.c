@@ -7,6 +7,7 @@
  *  Version: 3.01  2001/07/07  New bitmaps are now transparent.
  *  Version: 3.11  2001/12/12  Now guards against zero-area bitmaps.
  *  Version: 3.42  2003/03/28  Added monochrome bitmap constructor.
+ *  Version: 3.70  2026/10/17  Bitmaps remember their depth.
  */
 
 /* Copyright (c) L. Patrick
@@ -60,6 +61,7 @@ Bitmap *app_new_bitmap(Window *win, int width, int height)
 
 	bitmap_extra(b)->handle = XCreatePixmap(disp,
 			win_extra(win)->xid, width, height, depth);
+	bitmap_extra(b)->depth = depth;
 
 	if (! app_bitmap_created(disp, bitmap_extra(b)->handle)) {
 		app_free(bitmap_extra(b));
@@ -97,6 +99,7 @@ Bitmap *app_new_white_bitmap(Window *win, int width, int height)
 
 	bitmap_extra(b)->handle = XCreatePixmap(disp,
 			win_extra(win)->xid, width, height, depth);
+	bitmap_extra(b)->depth = depth;
 
 	if (! app_bitmap_created(disp, bitmap_extra(b)->handle)) {
 		app_free(bitmap_extra(b));
@@ -144,6 +147,7 @@ Bitmap *app_new_monochrome_bitmap(Window *win, int width, int height)
 
 	bitmap_extra(b)->handle = XCreatePixmap(disp,
 			DefaultRootWindow(disp), width, height, depth);
+	bitmap_extra(b)->depth = depth;
 
 	if (! app_bitmap_created(disp, bitmap_extra(b)->handle)) {
 		app_free(bitmap_extra(b));
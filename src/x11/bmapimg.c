@@ -10,6 +10,7 @@
  *  Version: 3.43  2003/04/23  Added monochrome bitmap generation.
  *  Version: 3.45  2003/05/05  Added some conversions.
  *  Version: 3.58  2005/08/20  Fixed bugs. Added app_bitmap_to_image.
+ *  Version: 3.70  2026/10/17  Sends large images through MIT-SHM.
  */
 
 /* Copyright (c) L. Patrick
@@ -817,6 +818,192 @@ XID app_image_to_clipmask(App *app, Image *img)
 	return clipmask;
 }
 
+/*
+ *  Shared memory image transfer (MIT-SHM):
+ *
+ *  Large images are passed to and from the X server through
+ *  shared memory segments rather than down the socket. This only
+ *  works if the server runs on the same machine and permits it,
+ *  so app_init_shm attaches a first segment when the App starts,
+ *  and if that fails everything simply uses the socket instead.
+ *
+ *  Creating and attaching a segment costs more than sending a
+ *  small image, so a few segments are kept for reuse, and small
+ *  images still go down the socket. The server has finished with
+ *  a segment once XSync returns, so it can be used again at once.
+ */
+
+#ifdef USE_XSHM
+
+#define SHM_MIN_BYTES   (64L * 1024)	/* smaller images use the socket */
+
+static int shm_failed = 0;
+
+static int app_shm_error_handler(Display *disp, XErrorEvent *err)
+{
+	shm_failed = 1;
+	return 0;
+}
+
+static int app_new_shm_segment(Display *disp, ShmSegment *seg, long size)
+{
+	int (*handler)(Display *, XErrorEvent *);
+
+	size = (size + SHM_MIN_BYTES - 1) / SHM_MIN_BYTES * SHM_MIN_BYTES;
+
+	seg->info.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+	if (seg->info.shmid < 0)
+		return 0;
+	seg->info.shmaddr = shmat(seg->info.shmid, NULL, 0);
+	seg->info.readOnly = False;
+	if (seg->info.shmaddr == (char *) -1) {
+		shmctl(seg->info.shmid, IPC_RMID, NULL);
+		return 0;
+	}
+
+	/* a refused attachment is reported as an X error */
+	XSync(disp, False);
+	shm_failed = 0;
+	handler = XSetErrorHandler(app_shm_error_handler);
+	XShmAttach(disp, &seg->info);
+	XSync(disp, False);
+	XSetErrorHandler(handler);
+
+	/* the segment is removed once both sides detach */
+	shmctl(seg->info.shmid, IPC_RMID, NULL);
+
+	if (shm_failed) {
+		shmdt(seg->info.shmaddr);
+		return 0;
+	}
+	seg->size = size;
+	seg->busy = 0;
+	return 1;
+}
+
+static void app_free_shm_segment(Display *disp, ShmSegment *seg)
+{
+	XShmDetach(disp, &seg->info);
+	XSync(disp, False);
+	shmdt(seg->info.shmaddr);
+	seg->size = 0;
+	seg->busy = 0;
+}
+
+/*
+ *  Find an unused segment of at least size bytes, replacing
+ *  the smallest unused one if none is large enough. Returns
+ *  NULL if the image should go down the socket instead.
+ */
+static ShmSegment *app_get_shm_segment(App *app, long size)
+{
+	Display *disp = app_extra(app)->display;
+	ShmSegment *seg, *spare = NULL;
+	int i;
+
+	if ((! app_extra(app)->use_shm) || (size < SHM_MIN_BYTES))
+		return NULL;
+
+	for (i=0; i < SHM_SEGMENTS; i++) {
+		seg = &app_extra(app)->shm[i];
+		if (seg->busy)
+			continue;
+		if (seg->size >= size) {
+			seg->busy = 1;
+			return seg;
+		}
+		if ((! spare) || (seg->size < spare->size))
+			spare = seg;
+	}
+	if (! spare)
+		return NULL;
+
+	if (spare->size > 0)
+		app_free_shm_segment(disp, spare);
+	if (! app_new_shm_segment(disp, spare, size))
+		return NULL;
+	spare->busy = 1;
+	return spare;
+}
+
+/*
+ *  Create a ZPixmap XImage whose pixels are in shared memory.
+ *  Returns NULL if the image should go down the socket instead.
+ */
+static XImage *app_new_shm_image(App *app, int depth,
+	int width, int height, ShmSegment **segment)
+{
+	Display *disp = app_extra(app)->display;
+	XShmSegmentInfo probe;
+	ShmSegment *seg;
+	XImage *xi;
+
+	*segment = NULL;
+	if (! app_extra(app)->use_shm)
+		return NULL;
+
+	/* the XImage tells us how many bytes the pixels need */
+	xi = XShmCreateImage(disp, DefaultVisual(disp, DefaultScreen(disp)),
+		depth, ZPixmap, NULL, &probe, width, height);
+	if (! xi)
+		return NULL;
+
+	seg = app_get_shm_segment(app, (long) xi->bytes_per_line * height);
+	if (! seg) {
+		XDestroyImage(xi);
+		return NULL;
+	}
+	xi->obdata = (char *) &seg->info;
+	xi->data = seg->info.shmaddr;
+	*segment = seg;
+	return xi;
+}
+
+static void app_del_shm_image(XImage *xi, ShmSegment *seg)
+{
+	xi->data = NULL;
+	XDestroyImage(xi);
+	seg->busy = 0;
+}
+
+#endif /* USE_XSHM */
+
+/*
+ *  Check whether this display can use shared memory for images.
+ */
+APP_PRIVATE
+void app_init_shm(App *app)
+{
+#ifdef USE_XSHM
+	Display *disp = app_extra(app)->display;
+
+	app_extra(app)->use_shm = 0;
+	if (! XShmQueryExtension(disp))
+		return;
+	if (! app_new_shm_segment(disp, &app_extra(app)->shm[0],
+			SHM_MIN_BYTES))
+		return;
+	app_extra(app)->use_shm = 1;
+#endif
+}
+
+/*
+ *  Release the shared memory segments before closing the display.
+ */
+APP_PRIVATE
+void app_del_shm(App *app)
+{
+#ifdef USE_XSHM
+	int i;
+
+	for (i=0; i < SHM_SEGMENTS; i++)
+		if (app_extra(app)->shm[i].size > 0)
+			app_free_shm_segment(app_extra(app)->display,
+				&app_extra(app)->shm[i]);
+	app_extra(app)->use_shm = 0;
+#endif
+}
+
 /*
  *  Create a bitmap from an image.
  *  The bitmap will be a Pixmap with the bits of the image,
@@ -848,6 +1035,10 @@ Bitmap *app_image_to_bitmap(Window *win, Image *img)
 	byte *translation = NULL;
 	byte *byte_row = NULL;
 	Colour *rgb_row = NULL;
+#ifdef USE_XSHM
+	XImage *shm_xi = NULL;
+	ShmSegment *seg = NULL;
+#endif
 
 	technique = SlowRender;
 	disp = app_extra(win->app)->display;
@@ -908,7 +1099,19 @@ Bitmap *app_image_to_bitmap(Window *win, Image *img)
 			bitmap_extra(b)->blitter = blit;
 		}
 
-		if (blt_func) {
+#ifdef USE_XSHM
+		/* rows are laid out as before, but in shared memory */
+		if (blt_func)
+			shm_xi = app_new_shm_image(win->app, depth,
+					width, height, &seg);
+		if (shm_xi && (shm_xi->bytes_per_line != rowbytes)) {
+			app_del_shm_image(shm_xi, seg);
+			shm_xi = NULL;
+		}
+		if (shm_xi)
+			data = (byte *) shm_xi->data;
+#endif
+		if (blt_func && (! data)) {
 			data = app_alloc(height * rowbytes);
 			if (! data)
 				technique = SlowRender;
@@ -1068,10 +1271,23 @@ Bitmap *app_image_to_bitmap(Window *win, Image *img)
 
 	/* copy bits over, if we haven't already done it the slow way */
 
+#ifdef USE_XSHM
+	if (shm_xi) {
+		if (technique != SlowRender) {
+			XShmPutImage(disp, bitmap_extra(b)->handle,
+				graphics_extra(g)->gc, shm_xi,
+				0,0,0,0, width, height, False);
+			/* the server is done with the segment after this */
+			XSync(disp, False);
+		}
+		app_del_shm_image(shm_xi, seg);
+		data = NULL;
+	}
+#endif
 	if (xi) {
 		if (technique != SlowRender) {
 			if (data) {
-				xi->data = data;
+				xi->data = (char *) data;
 				XPutImage(disp, bitmap_extra(b)->handle,
 					graphics_extra(g)->gc, xi,
 					0,0,0,0, width, height);
@@ -1854,6 +2070,12 @@ Image *app_bitmap_to_image(Bitmap *bmp)
 	Bitmap *tmpb;
 	int blit = 0;
 	int failure = 0;
+#ifdef USE_XSHM
+	ShmSegment *seg = NULL;
+	XID root;
+	int px, py;
+	unsigned int pw, ph, pb, pdepth;
+#endif
 
 	win = bmp->win;
 	disp = app_extra(bmp->win->app)->display;
@@ -1862,7 +2084,25 @@ Image *app_bitmap_to_image(Bitmap *bmp)
 	width = bmp->area.width;
 	height = bmp->area.height;
 
-	xi = XGetImage(disp, src_id, 0, 0, width, height, ~0UL, ZPixmap);
+	xi = NULL;
+#ifdef USE_XSHM
+	if (app_extra(win->app)->use_shm
+	 && XGetGeometry(disp, src_id, &root, &px, &py,
+			&pw, &ph, &pb, &pdepth))
+	{
+		xi = app_new_shm_image(win->app, pdepth,
+				width, height, &seg);
+		if (xi && (! XShmGetImage(disp, src_id, xi, 0, 0, AllPlanes)))
+		{
+			app_del_shm_image(xi, seg);
+			xi = NULL;
+			seg = NULL;
+		}
+	}
+#endif
+	if (! xi)
+		xi = XGetImage(disp, src_id, 0, 0, width, height,
+					~0UL, ZPixmap);
 	if (! xi) {
 		return NULL; /* error */
 	}
@@ -1870,7 +2110,7 @@ Image *app_bitmap_to_image(Bitmap *bmp)
 	rowbytes = xi->bytes_per_line;
 	depth = xi->depth;
 	bits_per_pixel = xi->bits_per_pixel;
-	data = xi->data;
+	data = (byte *) xi->data;
 
 	if (depth <= 8)
 		order = ((xi->bitmap_bit_order==MSBFirst) ?1:0);
@@ -1986,6 +2226,11 @@ Image *app_bitmap_to_image(Bitmap *bmp)
 		}
 	}
 
+#ifdef USE_XSHM
+	if (seg)
+		app_del_shm_image(xi, seg);
+	else
+#endif
 	XDestroyImage(xi);
 
 	/* Now examine the bitmap's clipmask, if any, to set alpha. */
@@ -13,6 +13,10 @@
  *  Version: 3.48  2003/06/07  Fixed some memory leaks in draw_utf8.
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
  *  Version: 3.59  2005/10/10  Supports over-sized glyphs.
+ *  Version: 3.70  2026/10/17  Keeps track of when the GC is clipped.
+ *  Version: 3.71  2026/10/17  Copies from a window's back buffer if in use.
+ *  Version: 3.72  2026/10/17  Sends batched window drawing before copying.
+ *  Version: 3.73  2026/10/17  Trims the glyph cache before drawing text.
  */
 
 /* Copyright (c) L. Patrick
@@ -230,7 +234,8 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 	if (src->win) {
 		/* source is a window */
-		src_id = win_extra(src->win)->xid;
+		src_id = graphics_extra(src)->xid;
+		app_flush_drawing(src->app);
 
 		/* clip source rectangle to window's boundary */
 		clipped = app_clip_rect(app_get_window_area(src->win), sr);
@@ -296,7 +301,7 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 		/* handle XOR mode */
 		if (dst->xor_mode) {
 			/* copy image as BG^D^IMG to produce IMG where BG==D */
-			XSetForeground(disp, dst_gc,
+			app_set_gc_foreground(dst,
 				graphics_extra(dst)->bgpixval);
 		}
 
@@ -333,13 +338,14 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 		/* reset previous drawing colour */
 		if (dst->xor_mode) {
-			XSetForeground(disp, dst_gc,
+			app_set_gc_foreground(dst,
 				dst->pixval ^ graphics_extra(dst)->bgpixval);
 		}
 
 		/* tidy up */
 		XSetClipMask(disp, dst_gc, None);
 		XSetClipOrigin(disp, dst_gc, 0, 0);
+		graphics_extra(dst)->clipped = 0;
 		XFreeGC(disp, dst_mask_gc);
 	}
 	else if (dst_mask != None)
@@ -356,7 +362,7 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 		/* handle XOR mode */
 		if (dst->xor_mode) {
 			/* copy image as BG^D^IMG to produce IMG where BG==D */
-			XSetForeground(disp, dst_gc,
+			app_set_gc_foreground(dst,
 				graphics_extra(dst)->bgpixval);
 		}
 
@@ -391,7 +397,7 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 		/* reset previous drawing colour */
 		if (dst->xor_mode) {
-			XSetForeground(disp, dst_gc,
+			app_set_gc_foreground(dst,
 				dst->pixval ^ graphics_extra(dst)->bgpixval);
 		}
 
@@ -409,7 +415,7 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 		/* handle XOR mode */
 		if (dst->xor_mode) {
 			/* copy image as BG^D^IMG to produce IMG where BG==D */
-			XSetForeground(disp, dst_gc,
+			app_set_gc_foreground(dst,
 				graphics_extra(dst)->bgpixval);
 		}
 
@@ -438,13 +444,14 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 		/* reset previous drawing colour */
 		if (dst->xor_mode) {
-			XSetForeground(disp, dst_gc,
+			app_set_gc_foreground(dst,
 				dst->pixval ^ graphics_extra(dst)->bgpixval);
 		}
 
 		/* tidy up */
 		XSetClipMask(disp, dst_gc, None);
 		XSetClipOrigin(disp, dst_gc, 0, 0);
+		graphics_extra(dst)->clipped = 0;
 	}
 	else {
 		/* src and dst are both fully opaque: simple case */
@@ -452,7 +459,7 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 		/* handle XOR mode */
 		if (dst->xor_mode) {
 			/* copy image as BG^D^IMG to produce IMG where BG==D */
-			XSetForeground(disp, dst_gc,
+			app_set_gc_foreground(dst,
 				graphics_extra(dst)->bgpixval);
 		}
 
@@ -481,7 +488,7 @@ int app_bitmap_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 		/* reset previous drawing colour */
 		if (dst->xor_mode) {
-			XSetForeground(disp, dst_gc,
+			app_set_gc_foreground(dst,
 				dst->pixval ^ graphics_extra(dst)->bgpixval);
 		}
 	}
@@ -557,6 +564,9 @@ int app_bitmap_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 	if (f == NULL)
 		return 0;
 
+	/* make room in the glyph cache for this string's subfonts */
+	app_trim_font_cache();
+
 	/* correct drawing direction */
 	if (dst->text_direction & RL_TB)
 		right_to_left = 1;
@@ -673,6 +683,7 @@ int app_bitmap_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 
 		/* remove clipping */
 		XSetClipMask(disp, dst_gc, None);
+		graphics_extra(dst)->clipped = 0;
 
 		/* discard temporary mask GC */
 		if (dst_mask_gc)
@@ -713,11 +724,11 @@ int app_bitmap_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 		 */
 		if (dst->pixval == 0) {
 			XSetBackground(disp, dst_gc, ~0L);
-			XSetFunction(disp, dst_gc, GXand);
+			app_set_gc_function(dst, GXand);
 		}
 		else {
 			XSetBackground(disp, dst_gc, 0L);
-			XSetFunction(disp, dst_gc, GXor);
+			app_set_gc_function(dst, GXor);
 		}
 
 		while (nbytes > 0) {
@@ -800,7 +811,7 @@ int app_bitmap_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 		if (temp_font)
 			app_del_font(f);
 
-		XSetFunction(disp, dst_gc, GXcopy); /* restore mode */
+		app_set_gc_function(dst, GXcopy); /* restore mode */
 		return 1;
 	}
 
@@ -897,6 +908,7 @@ int app_bitmap_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 	}
 	XSetClipOrigin(disp, dst_gc, 0, 0);
 	XSetClipMask(disp, dst_gc, None);
+	graphics_extra(dst)->clipped = 0;
 	if (dst_mask_gc)
 		XFreeGC(disp, dst_mask_gc);
 	if (temp_font)
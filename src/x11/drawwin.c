@@ -13,6 +13,11 @@
  *  Version: 3.25  2002/07/07  Faster rendering of black/white text.
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
  *  Version: 3.59  2005/10/10  Supports over-sized glyphs.
+ *  Version: 3.70  2026/10/17  Native font text leaves the GC clipped.
+ *  Version: 3.71  2026/10/17  Draws on the window's back buffer if in use.
+ *  Version: 3.72  2026/10/17  Rectangles and thin lines are batched.
+ *  Version: 3.73  2026/10/17  Draws text with XRender where available.
+ *  Version: 3.74  2026/10/17  Trims the glyph cache before drawing text.
  */
 
 /* Copyright (c) L. Patrick
@@ -49,15 +54,14 @@
  *  In that situation we must rely on the server because there
  *  is no way for the program to know which portions of the
  *  window are currently obscured.
+ *
+ *  The rectangles are batched and sent later (see graphics.c).
  */
 int app_window_fill_rect(Graphics *dst, Rect r)
 {
 	int i, num_rects;
 	Rect clipped;
 	Rect *rects;
-	Display *disp;
-	XID dst_id;
-	GC dst_gc;
 
 	if (dst->colour.alpha > 0x7F)
 		return 1; /* nothing to draw if colour is transparent */
@@ -76,11 +80,6 @@ int app_window_fill_rect(Graphics *dst, Rect r)
 		r.height = 0 - r.height;
 	}
 
-	/* destination is a window */
-	disp = app_extra(dst->app)->display;
-	dst_id = win_extra(dst->win)->xid;
-	dst_gc = graphics_extra(dst)->gc;
-
 	/* set up clipping */
 
 	if (dst->clip) {
@@ -103,16 +102,53 @@ int app_window_fill_rect(Graphics *dst, Rect r)
 		if (clipped.height == 0)
 			continue; /* nothing visible here */
 
-		/* fill pixels with colour */
+		/* fill pixels with colour, batched */
 
-		XFillRectangle(disp, dst_id, dst_gc,
-				clipped.x, clipped.y,
-				clipped.width, clipped.height);
+		app_batch_rect(dst, clipped);
 	}
 
 	return 1;
 }
 
+/*
+ *  A window's back buffer only holds good pixels inside the area
+ *  being redrawn. Before copying from the back buffer, fill the
+ *  rest of the source rectangle from the window itself, which
+ *  still shows what it did before the redraw began there.
+ */
+static void app_seed_back_buffer(Graphics *src, Rect sr)
+{
+	Window *win = src->win;
+	Display *disp = app_extra(win->app)->display;
+	Region *outside;
+	XGCValues values;
+	GC gc;
+	Rect r;
+	int i;
+
+	if ((sr.width <= 0) || (sr.height <= 0))
+		return;
+	outside = app_new_rect_region(sr);
+	if (! outside)
+		return;
+	if (win->redraw_rgn)
+		app_subtract_region(outside, win->redraw_rgn, outside);
+
+	if (outside->num_rects > 0) {
+		values.graphics_exposures = False;
+		gc = XCreateGC(disp, win_extra(win)->xid,
+				GCGraphicsExposures, &values);
+		for (i=0; i < outside->num_rects; i++) {
+			r = outside->rects[i];
+			XCopyArea(disp, win_extra(win)->xid,
+				win_extra(win)->back_buffer, gc,
+				r.x, r.y, r.width, r.height, r.x, r.y);
+		}
+		XFreeGC(disp, gc);
+	}
+	app_del_region(outside);
+}
+
 /*
  *  app_window_copy_rect:
  *
@@ -158,18 +194,22 @@ int app_window_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 	/* destination is a window */
 	disp = app_extra(dst->app)->display;
-	dst_id = win_extra(dst->win)->xid;
+	dst_id = graphics_extra(dst)->xid;
 	dst_gc = graphics_extra(dst)->gc;
+	app_flush_drawing(dst->app);	/* draw in order */
 
 	if (src->win) {
 		/* source is a window */
-		src_id = win_extra(src->win)->xid;
+		src_id = graphics_extra(src)->xid;
 
 		/* clip source rectangle to window's boundary */
 		clipped = app_clip_rect(app_get_window_area(src->win), sr);
 		dp.x = dp.x + clipped.x - sr.x;
 		dp.y = dp.y + clipped.y - sr.y;
 		sr = clipped;
+
+		if (src_id == win_extra(src->win)->back_buffer)
+			app_seed_back_buffer(src, sr);
 	}
 	else if (src->bmap) {
 		/* source is a bitmap */
@@ -217,7 +257,7 @@ int app_window_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 		/* this makes the final image BG^D^IMG which should */
 		/* be just IMG if BG==D */
 
-		XSetForeground(disp, dst_gc, graphics_extra(dst)->bgpixval);
+		app_set_gc_foreground(dst, graphics_extra(dst)->bgpixval);
 	}
 	if (src_mask != None) {
 		/* src may have transparency, so use a clipmask */
@@ -256,11 +296,12 @@ int app_window_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 
 		XSetClipMask(disp, dst_gc, None);
 		XSetClipOrigin(disp, dst_gc, 0, 0);
+		graphics_extra(dst)->clipped = 0;
 	}
 	if (dst->xor_mode) {
 		/* reset previous drawing colour */
 
-		XSetForeground(disp, dst_gc,
+		app_set_gc_foreground(dst,
 			dst->pixval ^ graphics_extra(dst)->bgpixval);
 	}
 
@@ -269,12 +310,331 @@ int app_window_copy_rect(Graphics *dst, Point dp, Graphics *src, Rect sr)
 		app_del_bitmap(temp);
 
 	/* handle GraphicsExpose events before other events */
-	if (src->win)
+	/* (copies within a back buffer never cause them) */
+	if (src->win && (dst_id == win_extra(dst->win)->xid))
 		win_extra(dst->win)->exposed = 100;
 
 	return 1;
 }
 
+#ifdef USE_XRENDER
+/*
+ *  Text drawn with XRender
+ *  -----------------------
+ *  Where the X server has the XRender extension, each subfont's
+ *  glyphs are sent to it once, as 8-bit alpha masks in a GlyphSet,
+ *  and a whole string is then drawn with one request. Greyscale
+ *  subfonts keep their anti-aliasing this way, and text of any
+ *  colour costs no more than black or white text.
+ *
+ *  XOR mode, right-to-left text and paletted displays still use
+ *  the clipmask code below, as does any display without XRender.
+ */
+APP_PRIVATE
+void app_init_render(App *app)
+{
+	Display *disp = app_extra(app)->display;
+	int event_base, error_base;
+	int major = 0, minor = 0;
+
+	app_extra(app)->use_render = 0;
+
+	if (! XRenderQueryExtension(disp, &event_base, &error_base))
+		return;
+	if (! XRenderQueryVersion(disp, &major, &minor))
+		return;
+	if ((major == 0) && (minor < 10))
+		return;	/* too old for solid fill pictures */
+	if (! app_is_true_colour_display(disp))
+		return;
+
+	app_extra(app)->render_a8 =
+		XRenderFindStandardFormat(disp, PictStandardA8);
+	app_extra(app)->render_screen =
+		XRenderFindVisualFormat(disp,
+			DefaultVisual(disp, DefaultScreen(disp)));
+	if (app_extra(app)->render_a8 && app_extra(app)->render_screen)
+		app_extra(app)->use_render = 1;
+}
+
+/*
+ *  Free a subfont's glyphs in the X server.
+ */
+APP_PRIVATE
+void app_del_glyph_set(App *app, Subfont *sub)
+{
+	if (subfont_extra(sub)->glyphs) {
+		XRenderFreeGlyphSet(app_extra(app)->display,
+			subfont_extra(sub)->glyphs);
+		subfont_extra(sub)->glyphs = 0;
+	}
+}
+
+/*
+ *  Send a subfont's glyphs to the X server, one row of 32 cells
+ *  per request. Each glyph keeps the part of its cell which the
+ *  clipmask code would draw, and its origin is placed so that it
+ *  appears in the same place.
+ */
+static int app_load_glyph_set(Font *f, Subfont *sub)
+{
+	Display *disp = app_extra(f->app)->display;
+	Image *img = sub->img;
+	GlyphSet gs;
+	Glyph ids[32];
+	XGlyphInfo info[32];
+	Colour col;
+	byte *data, *row;
+	int cell_w, cell_h, max_stride, size;
+	int i, n, gw, w, x, y, px, py;
+
+	if (subfont_extra(sub)->glyphs)
+		return (subfont_extra(sub)->glyph_height == f->height);
+	if ((img->depth != 8) && (img->depth != 32))
+		return 0;
+
+	cell_w = img->width / 32;
+	cell_h = img->height / 8;
+	max_stride = (cell_w + 3) & ~3;
+	data = app_alloc(32 * max_stride * cell_h + 1);
+	if (! data)
+		return 0;
+
+	gs = XRenderCreateGlyphSet(disp, app_extra(f->app)->render_a8);
+
+	for (i=0; i < 256; i += 32)
+	{
+		n = 0;
+		size = 0;
+		for (py=i/32*cell_h, px=0; px < 32*cell_w; px += cell_w)
+		{
+			gw = app_subfont_char_width(sub, i + px/cell_w);
+			if (gw < 0)
+				continue;	/* no such character */
+
+			if (cell_h > f->height) {
+				/* glyphs are centered within each glyph box */
+				w = cell_w;
+				info[n].x = (cell_w - gw) / 2;
+				info[n].y = (cell_h - f->height) / 2;
+			}
+			else {
+				/* glyphs are in the top left of each glyph box */
+				w = (gw < cell_w) ? gw : cell_w;
+				info[n].x = 0;
+				info[n].y = 0;
+			}
+			info[n].width  = w;
+			info[n].height = (w > 0) ? cell_h : 0;
+			info[n].xOff = gw;
+			info[n].yOff = 0;
+			ids[n] = i + px/cell_w;
+
+			/* 8-bit alpha, rows padded to 4 bytes */
+			for (y=0; y < info[n].height; y++) {
+				row = data + size;
+				for (x=0; x < w; x++) {
+					if (img->depth == 8)
+						col = img->cmap[img->data8[py+y][px+x]];
+					else
+						col = img->data32[py+y][px+x];
+					if (sub->anti_alias)
+						row[x] = 255 - col.alpha;
+					else
+						row[x] = (col.alpha <= 0x7F) ? 255 : 0;
+				}
+				for (; x < ((w + 3) & ~3); x++)
+					row[x] = 0;
+				size += x;
+			}
+			n++;
+		}
+		if (n > 0)
+			XRenderAddGlyphs(disp, gs, ids, info, n,
+				(const char *) data, size);
+	}
+	app_free(data);
+
+	subfont_extra(sub)->glyphs = gs;
+	subfont_extra(sub)->glyph_height = f->height;
+	return 1;
+}
+
+/*
+ *  Return the XRender Picture for whatever a window Graphics
+ *  object draws on, creating it the first time.
+ */
+static Picture app_window_picture(Graphics *g)
+{
+	WindowExtra *extra = win_extra(g->win);
+	Picture *pict;
+
+	if (extra->is_paletted)
+		return None;
+	if (graphics_extra(g)->xid == extra->xid)
+		pict = & extra->picture;
+	else if (graphics_extra(g)->xid == extra->back_buffer)
+		pict = & extra->back_picture;
+	else
+		return None;
+
+	if (*pict == None)
+		*pict = XRenderCreatePicture(app_extra(g->app)->display,
+				graphics_extra(g)->xid,
+				app_extra(g->app)->render_screen, 0, NULL);
+	return *pict;
+}
+
+/*
+ *  Convert one channel of a TrueColor pixel value to 16 bits.
+ */
+static unsigned short app_pixel_channel(unsigned long pixel,
+					unsigned long mask)
+{
+	unsigned long max;
+
+	if (mask == 0)
+		return 0;
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		pixel >>= 1;
+	}
+	for (max = 1; max < mask; max = (max << 1) | 1)
+		continue;
+	return (unsigned short) ((pixel & mask) * 0xFFFFUL / max);
+}
+
+/*
+ *  Return a solid XRender source in the Graphics object's
+ *  current pixel value, making a new one if the colour changed.
+ */
+static Picture app_pen_picture(Graphics *g)
+{
+	Display *disp = app_extra(g->app)->display;
+	Visual *visual = DefaultVisual(disp, DefaultScreen(disp));
+	GraphicsExtra *extra = graphics_extra(g);
+	XRenderColor colour;
+
+	if (extra->pen && (extra->pen_pixel == (unsigned long) g->pixval))
+		return extra->pen;
+	if (extra->pen)
+		XRenderFreePicture(disp, extra->pen);
+
+	colour.red   = app_pixel_channel(g->pixval, visual->red_mask);
+	colour.green = app_pixel_channel(g->pixval, visual->green_mask);
+	colour.blue  = app_pixel_channel(g->pixval, visual->blue_mask);
+	colour.alpha = 0xFFFF;
+
+	extra->pen = XRenderCreateSolidFill(disp, &colour);
+	extra->pen_pixel = g->pixval;
+	return extra->pen;
+}
+
+/*
+ *  Draw a UTF-8 string with XRender, clipped to the given
+ *  rectangles. The point is in window co-ordinates.
+ *  Returns 0 if the string should be drawn the other way.
+ */
+static int app_render_utf8(Graphics *dst, Point dp, const char *s,
+			int nbytes, Font *f, int num_rects, Rect *rects)
+{
+	App *app = dst->app;
+	Display *disp = app_extra(app)->display;
+	Picture pict, pen;
+	XGlyphElt32 *elts, *elt = NULL;
+	unsigned int *ids;
+	XRectangle *x_rects;
+	Subfont *sub, *last = NULL;
+	unsigned long ch;
+	unsigned long *cp;
+	const char *sp = s;
+	const char *src_end = s + nbytes;
+	Point pen_at;
+	int i, gw, num_elts = 0, num_ids = 0;
+
+	if ((! app_extra(app)->use_render) || dst->xor_mode
+	    || (dst->text_direction & RL_TB))
+		return 0;
+	if ((pict = app_window_picture(dst)) == None)
+		return 0;
+
+	elts = app_alloc(nbytes * sizeof(XGlyphElt32));
+	ids = app_alloc(nbytes * sizeof(unsigned int));
+	x_rects = app_alloc(num_rects * sizeof(XRectangle));
+	if ((! elts) || (! ids) || (! x_rects)) {
+		app_free(elts);
+		app_free(ids);
+		app_free(x_rects);
+		return 0;
+	}
+
+	/* collect runs of glyphs from the same subfont */
+	pen_at = pt(0,0);
+	while (nbytes > 0) {
+		cp = &ch;
+		if (app_utf8_to_unicode(&sp, src_end, &cp, cp+1)
+		    & SourceExhausted)
+			break;
+		nbytes -= (sp - s);
+		s = sp;
+
+		sub = app_font_char_info(f, ch, &gw);
+
+		if ((sub == NULL) || (gw < 0)) {
+			/* character glyph not found, draw a box */
+			app_draw_rect(dst, rect(dp.x - dst->offset.x + 1,
+						dp.y - dst->offset.y + 1,
+						4, f->height-2));
+			dp.x += 6;
+			last = NULL;
+			continue;
+		}
+
+		if (sub != last) {
+			if (! app_load_glyph_set(f, sub)) {
+				num_elts = -1;
+				break;
+			}
+			/* element positions are relative to the pen */
+			elt = & elts[num_elts++];
+			elt->glyphset = subfont_extra(sub)->glyphs;
+			elt->chars = & ids[num_ids];
+			elt->nchars = 0;
+			elt->xOff = dp.x - pen_at.x;
+			elt->yOff = dp.y - pen_at.y;
+			pen_at = dp;
+			last = sub;
+		}
+		ids[num_ids++] = (unsigned int) (ch & 0xFF);
+		elt->nchars++;
+		dp.x += gw;
+		pen_at.x += gw;
+	}
+
+	if (num_elts > 0) {
+		pen = app_pen_picture(dst);
+
+		for (i=0; i < num_rects; i++) {
+			x_rects[i].x = rects[i].x;
+			x_rects[i].y = rects[i].y;
+			x_rects[i].width  = rects[i].width;
+			x_rects[i].height = rects[i].height;
+		}
+		app_flush_drawing(app);
+		XRenderSetPictureClipRectangles(disp, pict, 0, 0,
+			x_rects, num_rects);
+		XRenderCompositeText32(disp, PictOpOver, pen, pict,
+			app_extra(app)->render_a8, 0, 0, 0, 0,
+			elts, num_elts);
+	}
+
+	app_free(elts);
+	app_free(ids);
+	app_free(x_rects);
+	return (num_elts >= 0);
+}
+#endif
+
 /*
  *  app_window_draw_utf8:
  *
@@ -314,8 +674,9 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 
 	/* destination is a window */
 	disp = app_extra(dst->app)->display;
-	dst_id = win_extra(dst->win)->xid;
+	dst_id = graphics_extra(dst)->xid;
 	dst_gc = graphics_extra(dst)->gc;
+	app_flush_drawing(dst->app);	/* draw in order */
 
 	/* obtain font to use when drawing */
 	f = dst->font;
@@ -328,6 +689,9 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 	if (f == NULL)
 		return 0;
 
+	/* make room in the glyph cache for this string's subfonts */
+	app_trim_font_cache();
+
 	/* correct drawing direction */
 	if (dst->text_direction & RL_TB)
 		right_to_left = 1;
@@ -378,54 +742,19 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 
 	if (f->style & NATIVE_FONT) /* assume ISO Latin-1 for now */
 	{
-		Region *rgn;
-		XRectangle *x_rects;
-
 		/* convert UTF-8 to Latin-1 */
 		if (! app_utf8_is_ascii(s, nbytes))
 			s = temp_str = app_utf8_to_latin1(s, &nbytes);
 
-		/* calculate bounding rectangle of string */
-		gr.height = f->height;
-		gw = XTextWidth(font_extra(f)->fnt, s, nbytes);
-
-		dr = rect(dp.x - gw/2, dp.y - gr.height/2, gw * 2, gr.height * 2);
-
-		rgn = app_new_region();
-
-		/* for each clip rect, intersect with this rect */
-		for (i=0; i < num_rects; i++) {
-			/* clip to each rectangle separately and draw */
-			clipped = app_clip_rect(dr, rects[i]);
-			if (clipped.width == 0)
-				continue; /* nothing visible here */
-			if (clipped.height == 0)
-				continue; /* nothing visible here */
-
-			app_union_region_with_rect(rgn, clipped, rgn);
-		}
-
-		/* set the clipping region */
-		x_rects = app_alloc(sizeof(XRectangle) * rgn->num_rects);
-		for (i=0; i < rgn->num_rects; i++) {
-			x_rects[i].x = rgn->rects[i].x;
-			x_rects[i].y = rgn->rects[i].y;
-			x_rects[i].width  = rgn->rects[i].width;
-			x_rects[i].height = rgn->rects[i].height;
-		}
-		XSetClipRectangles(disp, dst_gc, 0, 0,
-				x_rects, rgn->num_rects, YXSorted);
-		app_free(x_rects);
-		app_del_region(rgn);
+		/* clip the GC to the whole clipping region, once;
+		 * it stays clipped for the next string */
+		app_clip_gc(dst);
 
 		/* draw the string, clipped */
 		XDrawString(disp, dst_id, dst_gc,
 				dp.x, dp.y + font_extra(f)->fnt->ascent,
 				s, nbytes);
 
-		/* remove clipping */
-		XSetClipMask(disp, dst_gc, None);
-
 		/* discard temporary info */
 		if (temp_str)
 			app_free(temp_str);
@@ -435,6 +764,15 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 		return 1;
 	}
 
+#ifdef USE_XRENDER
+	/* draw the whole string at once, if XRender can */
+	if (app_render_utf8(dst, dp, s, nbytes, f, num_rects, rects)) {
+		if (temp_font)
+			app_del_font(f);
+		return 1;
+	}
+#endif
+
 	/* Special case: if drawing black or white text
 	 *  (with no XOR mode), we may be able to avoid
 	 *  clipmasking by clever use of bitwise blitting modes.
@@ -461,11 +799,11 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 		 */
 		if (dst->pixval == 0) {
 			XSetBackground(disp, dst_gc, ~0L);
-			XSetFunction(disp, dst_gc, GXand);
+			app_set_gc_function(dst, GXand);
 		}
 		else {
 			XSetBackground(disp, dst_gc, 0L);
-			XSetFunction(disp, dst_gc, GXor);
+			app_set_gc_function(dst, GXor);
 		}
 
 		while (nbytes > 0) {
@@ -486,6 +824,7 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 				app_draw_rect(dst, rect(dp.x - dst->offset.x + 1,
 							dp.y - dst->offset.y + 1,
 							4, f->height-2));
+				app_flush_drawing(dst->app);
 
 				if (! right_to_left)
 					dp.x += 6;
@@ -546,7 +885,7 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 		if (temp_font)
 			app_del_font(f);
 
-		XSetFunction(disp, dst_gc, GXcopy); /* restore mode */
+		app_set_gc_function(dst, GXcopy); /* restore mode */
 		return 1;
 	}
 
@@ -571,6 +910,7 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 			app_draw_rect(dst, rect(dp.x - dst->offset.x + 1,
 						dp.y - dst->offset.y + 1,
 						4, f->height-2));
+			app_flush_drawing(dst->app);
 
 			if (! right_to_left)
 				dp.x += 6;
@@ -631,6 +971,7 @@ int app_window_draw_utf8(Graphics *dst, Point dp, const char *s, int nbytes)
 	}
 	XSetClipOrigin(disp, dst_gc, 0, 0);
 	XSetClipMask(disp, dst_gc, None);
+	graphics_extra(dst)->clipped = 0;
 	if (temp_font)
 		app_del_font(f);
 	return 1;
@@ -657,9 +998,6 @@ int app_window_draw_line(Graphics *dst, Point p1, Point p2)
 	Rect *rects;
 	int w, dx, dy;
 	Point p3, p4;
-	Display *disp;
-	XID dst_id;
-	GC dst_gc;
 
 	if (dst->colour.alpha > 0x7F)
 		return 1; /* nothing to draw if colour is transparent */
@@ -730,11 +1068,6 @@ int app_window_draw_line(Graphics *dst, Point p1, Point p2)
 	p2.x += dst->offset.x;
 	p2.y += dst->offset.y;
 
-	/* destination is a window */
-	disp = app_extra(dst->app)->display;
-	dst_id = win_extra(dst->win)->xid;
-	dst_gc = graphics_extra(dst)->gc;
-
 	/* draw the clipped lines */
 
 	/* special optimised case: if no clipping, draw and finish */
@@ -748,8 +1081,7 @@ int app_window_draw_line(Graphics *dst, Point p1, Point p2)
 		    (p2.x < rects[i].x+rects[i].width) &&
 		    (p1.y < rects[i].y+rects[i].height) &&
 		    (p2.y < rects[i].y+rects[i].height)) {
-			XDrawLine(disp, dst_id, dst_gc,
-					p1.x, p1.y, p2.x, p2.y);
+			app_batch_line(dst, p1, p2);
 			return 1;
 		}
 	    }
@@ -766,8 +1098,7 @@ int app_window_draw_line(Graphics *dst, Point p1, Point p2)
 			p4.y = p2.y +w;
 
 			if (app_clip_line_to_rect(rects[i], &p3, &p4))
-				XDrawLine(disp, dst_id, dst_gc,
-					p3.x, p3.y, p4.x, p4.y);
+				app_batch_line(dst, p3, p4);
 		}
 	  }
 	}
@@ -782,8 +1113,7 @@ int app_window_draw_line(Graphics *dst, Point p1, Point p2)
 			p4.y = p2.y;
 
 			if (app_clip_line_to_rect(rects[i], &p3, &p4))
-				XDrawLine(disp, dst_id, dst_gc,
-					p3.x, p3.y, p4.x, p4.y);
+				app_batch_line(dst, p3, p4);
 		}
 	  }
 	}
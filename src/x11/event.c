@@ -24,6 +24,11 @@
  *  Version: 3.51  2004/03/28  Supports delayed-deletion.
  *  Version: 3.57  2005/08/16  Added app_process_events.
  *  Version: 3.60  2007/06/06  Improved timer handling using poll.
+ *  Version: 3.70  2026/10/17  Redraws are limited to the damaged area.
+ *  Version: 3.71  2026/10/17  Redraws BUFFERED windows off-screen.
+ *  Version: 3.72  2026/10/17  Sends batched drawing before waiting.
+ *  Version: 3.73  2026/10/17  Sleeps in poll until an event or timer is due.
+ *  Version: 3.74  2026/10/17  Merges queued mouse motion and Expose events.
  */
 
 /* Copyright (c) L. Patrick
@@ -93,6 +98,7 @@ static void app_do_mouse_motion(Window *win, int state, int x, int y)
 			if (c->mouse_drag) {
 				p.x = x - c->offset.x;
 				p.y = y - c->offset.y;
+				app_extra(win->app)->motion_offset = c->offset;
 				for (i=0; c->mouse_drag[i]; i++)
 					c->mouse_drag[i](c, buttons, p);
 				if (win->pass_event)
@@ -105,6 +111,7 @@ static void app_do_mouse_motion(Window *win, int state, int x, int y)
 		if (win->mouse_drag) {
 			p.x = x;
 			p.y = y;
+			app_extra(win->app)->motion_offset = pt(0,0);
 			for (i=0; win->mouse_drag[i]; i++)
 				win->mouse_drag[i](win, buttons, p);
 		}
@@ -114,6 +121,7 @@ static void app_do_mouse_motion(Window *win, int state, int x, int y)
 			if (c->mouse_move) {
 				p.x = x - c->offset.x;
 				p.y = y - c->offset.y;
+				app_extra(win->app)->motion_offset = c->offset;
 				for (i=0; c->mouse_move[i]; i++)
 					c->mouse_move[i](c, buttons, p);
 				if (win->pass_event)
@@ -126,12 +134,89 @@ static void app_do_mouse_motion(Window *win, int state, int x, int y)
 		if (win->mouse_move) {
 			p.x = x;
 			p.y = y;
+			app_extra(win->app)->motion_offset = pt(0,0);
 			for (i=0; win->mouse_move[i]; i++)
 				win->mouse_move[i](win, buttons, p);
 		}
 	}
 }
 
+/*
+ *  Remember where the mouse has been since the last motion
+ *  call-back. When compression is on, later MotionNotify events
+ *  for the same window and button state which are already
+ *  queued are merged into this one, leaving it holding the
+ *  latest position; their positions stay in the history.
+ */
+static int app_add_motion(App *app, int x, int y)
+{
+	AppExtra *ae = app_extra(app);
+	Point *list;
+	int max;
+
+	if (ae->num_motion == ae->max_motion) {
+		max = ae->max_motion ? ae->max_motion * 2 : 16;
+		list = app_realloc(ae->motion, max * sizeof(Point));
+		if (! list)
+			return 0;
+		ae->motion = list;
+		ae->max_motion = max;
+	}
+	ae->motion[ae->num_motion].x = x;
+	ae->motion[ae->num_motion].y = y;
+	ae->num_motion++;
+	return 1;
+}
+
+static void app_merge_motion(App *app, XEvent *e)
+{
+	Display *disp = app_extra(app)->display;
+	XEvent next;
+
+	app_extra(app)->num_motion = 0;
+	app_add_motion(app, e->xmotion.x, e->xmotion.y);
+
+	if (! app_extra(app)->compress_motion)
+		return;
+
+	while (XEventsQueued(disp, QueuedAfterReading) > 0)
+	{
+		XPeekEvent(disp, &next);
+		if ((next.type != MotionNotify)
+		 || (next.xmotion.window != e->xmotion.window)
+		 || (next.xmotion.state != e->xmotion.state))
+			break;
+		XNextEvent(disp, e);
+		app_add_motion(app, e->xmotion.x, e->xmotion.y);
+	}
+}
+
+void app_set_mouse_compression(App *app, int on)
+{
+	app_extra(app)->compress_motion = on;
+}
+
+/*
+ *  Copy up to max of the positions given to the current motion
+ *  call-back into the list, oldest first, in the call-back's own
+ *  co-ordinates. The last is the position the call-back was given.
+ *  Returns how many positions there were.
+ */
+int app_get_mouse_history(App *app, Point *list, int max)
+{
+	AppExtra *ae = app_extra(app);
+	int i, n;
+
+	n = ae->num_motion;
+	if (max > n)
+		max = n;
+	for (i=0; i < max; i++) {
+		list[i].x = ae->motion[n-max+i].x - ae->motion_offset.x;
+		list[i].y = ae->motion[n-max+i].y - ae->motion_offset.y;
+	}
+	return n;
+}
+
 static int app_mouse_press_buttons(int state, int pressed)
 {
 	int buttons, prior;
@@ -530,24 +615,35 @@ static void app_do_resize_window(Window *win, int x, int y, int w, int h)
 /*
  *  Some part(s) of the window have been exposed and now need to
  *  be redrawn. Draw the window first, then all child controls,
- *  from back- to front-most.
+ *  from back- to front-most. The Graphics object is clipped to
+ *  the exposed area, and anything lying wholly outside it is
+ *  not drawn at all. A BUFFERED window is drawn off-screen and
+ *  then shown all at once.
  */
 static void app_do_redraw_window(Window *win)
 {
-	int i;
+	int i, buffered = 0;
 	Graphics *g;
+	Rect r;
 
 	g = app_get_window_graphics(win);
-
-	app_set_rgb(g, win->bg);
-	app_fill_rect(g, rect(0, 0, win->area.width, win->area.height));
-	app_set_rgb(g, BLACK);
-
-	if (win->redraw)
-		for (i=0; win->redraw[i]; i++)
-			win->redraw[i](win, g);
+	if (win->flags & BUFFERED)
+		buffered = app_use_back_buffer(g);
+
+	r = app_get_clip_rect(g);
+	if ((r.width > 0) && (r.height > 0)) {
+		app_set_rgb(g, win->bg);
+		app_fill_rect(g, r);
+		app_set_rgb(g, BLACK);
+
+		if (win->redraw)
+			for (i=0; win->redraw[i]; i++)
+				win->redraw[i](win, g);
+	}
 	app_do_draw_controls(g, win->num_children, win->children, 1);
 
+	if (buffered)
+		app_show_back_buffer(g);
 	app_del_graphics(g);
 }
 
@@ -584,37 +680,122 @@ void app_redraw_rect(Window *win, Rect r)
 	app_del_redraw_region(win);
 }
 
-static void app_do_portable_timers(App *app)	//!!
+/*
+ *  Find the window an X event is for, or NULL.
+ */
+static Window * app_find_event_window(App *app, XEvent *e)
 {
-	Timer *t;
-	unsigned long now;
 	int i;
+	Window *w;
 
-	now = app_current_time(app);
+	for (i=0; i < app->num_windows; i++) {
+		w = app->windows[i];
+		if (win_extra(w)->xid == e->xany.window)
+			return w;
+	}
+	return NULL;
+}
 
-	for (i=0; i < app->num_timers; i++) {
-		t = app->timers[i];
-		if (now - t->last_time >= (unsigned long) t->milliseconds) {
-			t->action(t);
-			t->last_time = now;
-		}
+/*
+ *  The queue is searched from the front, so a window's Expose
+ *  events are only taken up to its first queued ConfigureNotify.
+ *  Those behind it are for the new size and layout, and are
+ *  left until the ConfigureNotify has been handled.
+ */
+static Bool app_is_mergeable_expose(Display *disp, XEvent *e, XPointer arg)
+{
+	Window *win;
+
+	if ((e->type != Expose) && (e->type != ConfigureNotify))
+		return False;
+	win = app_find_event_window((App *) arg, e);
+	if (win == NULL)
+		return False;
+	if (e->type == ConfigureNotify) {
+		win_extra(win)->resize_queued = 1;
+		return False;
 	}
+	return (win_extra(win)->exposed == 0)
+		&& (win_extra(win)->resize_queued == 0);
 }
 
-static int app_do_timers(App *app)	//!!
+/*
+ *  Gather the damage from every Expose event already queued,
+ *  for any window, then redraw each damaged window once.
+ *  A window is only redrawn once the last Expose of a series
+ *  (with a count of zero) has arrived. Windows waiting for a
+ *  GraphicsExpose are left alone, since their events must be
+ *  handled in order.
+ */
+static void app_redraw_exposed_windows(App *app, XEvent *first)
 {
-	if (app->num_timers == 0)
-		return 0;
-	while (app_peek_event(app))
-		app_do_event(app);
-#ifdef USE_ALARM
-	if (app_extra(app)->timer_id)
-		return 0;
-#endif
-	app_delay(app, TIMER_INTERVAL);
-	app_do_portable_timers(app);
-	app_do_delayed_deletion(app);	//!!
-	return 1;
+	Display *disp = app_extra(app)->display;
+	XEvent e;
+	Window *win;
+	int i;
+
+	for (i=0; i < app->num_windows; i++)
+		win_extra(app->windows[i])->resize_queued = 0;
+
+	win = app_find_event_window(app, first);
+	win_extra(win)->expose_count = first->xexpose.count;
+
+	while (XCheckIfEvent(disp, &e, app_is_mergeable_expose,
+				(XPointer) app))
+	{
+		win = app_find_event_window(app, &e);
+		app_union_redraw_region(win,
+			e.xexpose.x, e.xexpose.y,
+			e.xexpose.width, e.xexpose.height);
+		win_extra(win)->expose_count = e.xexpose.count;
+	}
+
+	for (i=0; i < app->num_windows; i++) {
+		win = app->windows[i];
+		if ((win->redraw_rgn == NULL) || win_extra(win)->exposed
+		 || win_extra(win)->expose_count)
+			continue;
+		app_do_redraw_window(win);
+		app_del_redraw_region(win);
+	}
+}
+
+/*
+ *  Wait until an X event can be read or the next timer is due,
+ *  sleeping in poll on the X connection in the meantime.
+ *  Returns 1 if an event is ready, or 0 if a timer is due or
+ *  there is nothing left to wait for.
+ */
+static int app_wait_for_event(App *app)
+{
+	Display *disp = app_extra(app)->display;
+	struct pollfd fdinfo;
+	long delay;
+
+	app_flush_drawing(app);
+
+	for (;;) {
+		/* XPending also sends any requests still buffered */
+		if ((app->visible_windows > 0) && XPending(disp))
+			return 1;
+
+		delay = app_next_timer_delay(app);
+		if (delay == 0)
+			return 0;
+		if ((delay < 0) && (app->visible_windows == 0))
+			return 0;
+		if (delay > 86400000L)
+			delay = 86400000L;	/* a day at most */
+
+		fdinfo.fd = app->socket_fd;
+		fdinfo.events = POLLIN;
+		fdinfo.revents = 0;
+
+		/* an event, a signal or the timeout all lead back */
+		/* to the tests above */
+		poll(&fdinfo, (app->visible_windows > 0) ? 1 : 0,
+			(int) delay);
+	}
 }
 
 /*
@@ -623,19 +804,11 @@ static int app_do_timers(App *app)	//!!
  */
 static void app_winproc(App *app, XEvent *e)
 {
-	int i, modal_in_front;
-	Window *w;
+	int modal_in_front;
 	Window *win;
 
 	/* Find window to which this message is directed */
-	win = NULL;
-	for (i=0; i < app->num_windows; i++) {
-		w = app->windows[i];
-		if (win_extra(w)->xid == e->xany.window) {
-			win = w;
-			break;
-		}
-	}
+	win = app_find_event_window(app, e);
 	if (! win)
 		return; /* not found */
 
@@ -664,6 +837,7 @@ static void app_winproc(App *app, XEvent *e)
 	  case MotionNotify:
 		if (modal_in_front)
 			return;
+		app_merge_motion(app, e);
 		app_extra(app)->last_event_time = e->xmotion.time;
 		app_do_mouse_motion(win, e->xmotion.state,
 			e->xmotion.x, e->xmotion.y);
@@ -729,7 +903,9 @@ static void app_winproc(App *app, XEvent *e)
 		app_union_redraw_region(win,
 			e->xexpose.x, e->xexpose.y,
 			e->xexpose.width, e->xexpose.height);
-		if (e->xexpose.count == 0) {
+		if (e->type == Expose)
+			app_redraw_exposed_windows(app, e);
+		else if (e->xexpose.count == 0) {
 			app_do_redraw_window(win);
 			app_del_redraw_region(win);
 		}
@@ -861,6 +1037,7 @@ int app_get_mouse_event(App *app, int *buttons, Point *p)
 	int kind;
 
 	*buttons = 0;
+	app_flush_drawing(app);
 
 	while (app->visible_windows > 0) {
 		XPeekEvent(app_extra(app)->display, &event);
@@ -893,30 +1070,13 @@ int app_wait_event(App *app)
 	XEvent event;
 	int result = 0;
 
-	if (app_do_timers(app))
-			return 1;
-
-	if (app->visible_windows > 0) {
-#ifdef USE_ALARM	//!!
-		for (;;) {
-			struct pollfd fdinfo;
-
-			XFlush(app_extra(app)->display);
-			fdinfo.fd = app->socket_fd;
-			fdinfo.events = POLLIN;
-
-			result = poll(&fdinfo, 1, -1);
-
-			if ((result == -1) && (errno = EINTR))
-				app_do_portable_timers(app);
-			else
-				break;
-		}
-#endif
+	if (app_wait_for_event(app)) {
 		XNextEvent(app_extra(app)->display, &event);
 		result = 1;
 		app_winproc(app, &event);
 	}
+	else if (app_run_timers(app))
+		result = 1;
 
 	app_do_delayed_deletion(app);
 
@@ -928,9 +1088,9 @@ int app_process_events(App *app)
 	XEvent event;
 	int result = 0;
 
-	if (app->num_timers != 0)	//!!
-		app_do_portable_timers(app);
+	app_run_timers(app);
 
+	app_flush_drawing(app);
 	if (app->visible_windows > 0) {
 		Display *disp = app_extra(app)->display;
 		while (XPending(disp)) {
@@ -968,6 +1128,7 @@ int app_peek_event(App *app)
 		if (app->windows[i]->redraw_rgn != NULL)
 			return 1;
 	}
+	app_flush_drawing(app);
 	if (app->visible_windows > 0)
 		if (XPending(app_extra(app)->display))
 			return 1;
@@ -976,5 +1137,6 @@ int app_peek_event(App *app)
 
 void app_draw_all(App *app)
 {
+	app_flush_drawing(app);
 	XSync(app_extra(app)->display, 0);
 }
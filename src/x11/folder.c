@@ -9,6 +9,7 @@
  *  Version: 3.43  2003/04/25  Passing NULL to close_file/folder is legal.
  *  Version: 3.50  2003/11/25  Both / and \ are now folder separators.
  *  Version: 3.53  2004/05/08  Better handling of root folder.
+ *  Version: 3.71  2026/10/17  Files can be mapped into memory.
  */
 
 /* Copyright (c) L. Patrick
@@ -21,7 +22,9 @@
 #include "appint.h"
 
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 /*
@@ -403,6 +406,50 @@ long app_file_size(const char *filepath)
 	return size;
 }
 
+/*
+ *  Map a whole file into memory, returning its bytes and setting
+ *  *length to its size. The pages are copy-on-write, so changes
+ *  to them never reach the file. Returns NULL if the file can't
+ *  be opened or mapped, or is empty.
+ */
+APP_PRIVATE
+void * app_map_file(const char *filepath, long *length)
+{
+	char *path;
+	struct stat s;
+	void *data = NULL;
+	int fd;
+
+	*length = 0;
+	path = app_to_native_path(filepath);
+	fd = open(path, O_RDONLY);
+	app_free(path);
+	if (fd < 0)
+		return NULL;
+
+	if ((fstat(fd, &s) == 0) && (s.st_size > 0)) {
+		data = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+		else
+			*length = (long) s.st_size;
+	}
+	close(fd);
+
+	return data;
+}
+
+/*
+ *  Release a file mapped by app_map_file.
+ */
+APP_PRIVATE
+void app_unmap_file(void *data, long length)
+{
+	if (data)
+		munmap(data, length);
+}
+
 /*
  *  Return the file's last modifcation time in seconds.
  */
@@ -11,6 +11,8 @@
  *  Version: 3.35  2002/12/23  Moved portable code to fontutil.c
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
  *  Version: 3.58  2005/09/07  More font-selection fallback logic.
+ *  Version: 3.70  2026/10/17  Frees XRender glyph sets.
+ *  Version: 3.71  2026/10/17  Subfonts are released per App, not per Font.
  */
 
 /* Copyright (c) L. Patrick
@@ -25,13 +27,16 @@
 /*
  *  Release memory used by a native font's subfont.
  */
-void app_release_native_subfont(Font *f, Subfont *sub)
+void app_release_native_subfont(App *app, Subfont *sub)
 {
 	if (subfont_extra(sub)->clipmask) {
-		XFreePixmap(app_extra(f->app)->display,
+		XFreePixmap(app_extra(app)->display,
 			subfont_extra(sub)->clipmask);
 		subfont_extra(sub)->clipmask = 0;
 	}
+#ifdef USE_XRENDER
+	app_del_glyph_set(app, sub);
+#endif
 }
 
 /*
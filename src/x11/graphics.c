@@ -5,6 +5,10 @@
  *
  *  Version: 3.00  2001/05/05  First release.
  *  Version: 3.01  2001/09/09  Added XOR capability.
+ *  Version: 3.70  2026/10/17  Graphics objects and their GCs are reused.
+ *  Version: 3.71  2026/10/17  Remembers which drawable a window draws on.
+ *  Version: 3.72  2026/10/17  Batches rectangles and lines drawn in windows.
+ *  Version: 3.73  2026/10/17  Frees XRender pens.
  */
 
 /* Copyright (c) L. Patrick
@@ -16,10 +20,51 @@
 
 #include "appint.h"
 
-static Graphics *app_new_graphics(App *app, XID xid)
+/*
+ *  Reusing Graphics objects
+ *  ------------------------
+ *  Controls get a new Graphics object whenever they change state,
+ *  and creating and freeing a GC each time costs the server work
+ *  for nothing. So app_del_graphics keeps a few Graphics objects,
+ *  GCs and all, and app_new_graphics hands them out again.
+ *
+ *  A GC can draw on any drawable of the same depth, so the pool
+ *  belongs to the App rather than to any window or bitmap, and
+ *  each object remembers the depth its GC was made for. This
+ *  also means deleting a window never leaves a pooled GC behind.
+ *
+ *  Each GC's foreground, function and clipping are remembered
+ *  too, so that asking for the same state again sends nothing.
+ *  Drawing code which changes the GC directly must put it back
+ *  as it found it, or clear the clipped flag.
+ */
+static Graphics *app_new_graphics(App *app, XID xid, int depth)
 {
 	Graphics *g;
 	Display *disp;
+	GraphicsExtra *extra;
+	int i;
+
+	if (app) {
+		/* look for a kept GC of the right depth */
+		for (i=app_extra(app)->num_pooled-1; i >= 0; i--) {
+			g = app_extra(app)->pooled[i];
+			if (graphics_extra(g)->depth != depth)
+				continue;
+			app_extra(app)->pooled[i] =
+				app_extra(app)->pooled[--app_extra(app)->num_pooled];
+
+			extra = graphics_extra(g);
+			memset(g, 0, sizeof(struct Graphics));
+			g->extra = extra;
+			g->line_width = 1;
+			g->colour = CLEAR;
+			g->app = app;
+			extra->bgpixval = 0;
+			app_set_gc_function(g, GXcopy);
+			return g;
+		}
+	}
 
 	g = app_zero_alloc(sizeof(struct Graphics));
 	g->line_width = 1;
@@ -30,6 +75,9 @@ static Graphics *app_new_graphics(App *app, XID xid)
 		disp = app_extra(app)->display;
 		g->app = app;
 		graphics_extra(g)->gc = XCreateGC(disp, xid, 0, NULL);
+		graphics_extra(g)->depth = depth;
+		graphics_extra(g)->fg = 0;	/* X's defaults */
+		graphics_extra(g)->function = GXcopy;
 	}
 
 	return g;
@@ -38,8 +86,11 @@ static Graphics *app_new_graphics(App *app, XID xid)
 Graphics *app_get_window_graphics(Window *w)
 {
 	Graphics *g;
+	Display *disp = app_extra(w->app)->display;
 
-	g = app_new_graphics(w->app, win_extra(w)->xid);
+	g = app_new_graphics(w->app, win_extra(w)->xid,
+			DefaultDepth(disp, DefaultScreen(disp)));
+	graphics_extra(g)->xid = win_extra(w)->xid;
 	g->win = w;
 	g->area = app_get_window_area(w);
 	app_set_clip_region(g, NULL);
@@ -55,9 +106,13 @@ Graphics *app_get_control_graphics(Control *c)
 {
 	Graphics *g;
 	Window *w;
+	Display *disp;
 
 	w = app_parent_window(c);
-	g = app_new_graphics(w->app, win_extra(w)->xid);
+	disp = app_extra(w->app)->display;
+	g = app_new_graphics(w->app, win_extra(w)->xid,
+			DefaultDepth(disp, DefaultScreen(disp)));
+	graphics_extra(g)->xid = win_extra(w)->xid;
 	g->win = w;
 	g->ctrl = c;
 	g->area = app_get_control_area(c);
@@ -75,7 +130,8 @@ Graphics *app_get_bitmap_graphics(Bitmap *b)
 {
 	Graphics *g;
 
-	g = app_new_graphics(b->win->app, bitmap_extra(b)->handle);
+	g = app_new_graphics(b->win->app, bitmap_extra(b)->handle,
+			bitmap_extra(b)->depth);
 	g->bmap = b;
 	g->area = app_get_bitmap_area(b);
 	g->copy_rect = app_bitmap_copy_rect;
@@ -90,7 +146,7 @@ Graphics *app_get_image_graphics(Image *img)
 {
 	Graphics *g;
 
-	g = app_new_graphics(NULL, 0);
+	g = app_new_graphics(NULL, 0, 0);
 	g->img = img;
 	g->area = app_get_image_area(img);
 	g->copy_rect = app_image_copy_rect;
@@ -101,24 +157,216 @@ Graphics *app_get_image_graphics(Image *img)
 	return g;
 }
 
-void app_del_graphics(Graphics *g)
+static void app_free_graphics(App *app, Graphics *g)
 {
 	if (graphics_extra(g)->gc)
-		XFreeGC(app_extra(g->app)->display, graphics_extra(g)->gc);
-	if (g->clip)
-		app_del_region(g->clip);
+		XFreeGC(app_extra(app)->display, graphics_extra(g)->gc);
+#ifdef USE_XRENDER
+	if (graphics_extra(g)->pen)
+		XRenderFreePicture(app_extra(app)->display,
+			graphics_extra(g)->pen);
+#endif
 	app_free(graphics_extra(g));
 	app_free(g);
 }
 
+void app_del_graphics(Graphics *g)
+{
+	App *app = g->app;
+
+	if (app && (app_extra(app)->batch_owner == g))
+		app_flush_drawing(app);
+	if (g->clip)
+		app_del_region(g->clip);
+	g->clip = NULL;
+
+	if (graphics_extra(g)->gc
+	    && (app_extra(app)->num_pooled < GRAPHICS_POOL))
+	{
+		/* keep it, without the old clipping */
+		if (graphics_extra(g)->clipped) {
+			XSetClipMask(app_extra(app)->display,
+				graphics_extra(g)->gc, None);
+			graphics_extra(g)->clipped = 0;
+		}
+		app_extra(app)->pooled[app_extra(app)->num_pooled++] = g;
+		return;
+	}
+
+	app_free_graphics(app, g);
+}
+
+/*
+ *  Free the kept Graphics objects before closing the display.
+ */
+APP_PRIVATE
+void app_del_graphics_pool(App *app)
+{
+	Graphics *g;
+
+	while (app_extra(app)->num_pooled > 0) {
+		g = app_extra(app)->pooled[--app_extra(app)->num_pooled];
+		app_free_graphics(app, g);
+	}
+}
+
+/*
+ *  Change the GC's foreground or drawing function, unless it
+ *  already has that one.
+ */
+APP_PRIVATE
+void app_set_gc_foreground(Graphics *g, unsigned long pixel)
+{
+	if (graphics_extra(g)->fg == pixel)
+		return;
+	if (app_extra(g->app)->batch_owner == g)
+		app_flush_drawing(g->app);
+	XSetForeground(app_extra(g->app)->display,
+		graphics_extra(g)->gc, pixel);
+	graphics_extra(g)->fg = pixel;
+}
+
+APP_PRIVATE
+void app_set_gc_function(Graphics *g, int function)
+{
+	if (graphics_extra(g)->function == function)
+		return;
+	if (app_extra(g->app)->batch_owner == g)
+		app_flush_drawing(g->app);
+	XSetFunction(app_extra(g->app)->display,
+		graphics_extra(g)->gc, function);
+	graphics_extra(g)->function = function;
+}
+
+/*
+ *  Clip the GC to the Graphics object's clipping region, or to
+ *  its area if it has none, unless it is already. The server then
+ *  does the clipping, which suits drawing that cannot easily be
+ *  clipped here, such as text in native fonts.
+ */
+APP_PRIVATE
+void app_clip_gc(Graphics *g)
+{
+	XRectangle *x_rects;
+	Rect *rects;
+	int i, num_rects;
+
+	if (graphics_extra(g)->clipped)
+		return;
+	if (app_extra(g->app)->batch_owner == g)
+		app_flush_drawing(g->app);
+
+	if (g->clip) {
+		num_rects = g->clip->num_rects;
+		rects = g->clip->rects;
+	}
+	else {
+		num_rects = 1;
+		rects = & g->area;
+	}
+
+	x_rects = app_alloc(sizeof(XRectangle) * (num_rects + 1));
+	if (! x_rects)
+		return;
+	for (i=0; i < num_rects; i++) {
+		x_rects[i].x = rects[i].x;
+		x_rects[i].y = rects[i].y;
+		x_rects[i].width  = rects[i].width;
+		x_rects[i].height = rects[i].height;
+	}
+	XSetClipRectangles(app_extra(g->app)->display,
+		graphics_extra(g)->gc, 0, 0,
+		x_rects, num_rects, YXBanded);
+	app_free(x_rects);
+	graphics_extra(g)->clipped = 1;
+}
+
+/*
+ *  Batched drawing
+ *  ---------------
+ *  Filled rectangles and thin lines drawn in a window are not
+ *  sent one at a time, but collected and sent in one request
+ *  each time the batch fills up, so that a dense plot or a
+ *  polygon filled one span at a time costs a few requests
+ *  instead of thousands of library calls.
+ *
+ *  Only one batch is kept, for one Graphics object, since only
+ *  one can be drawing at a time. It is sent before the object's
+ *  GC changes, before anything else is drawn, before the object
+ *  is deleted, and before waiting for events, so the order in
+ *  which things appear on the screen is never affected.
+ */
+static void app_start_batch(Graphics *g, int kind)
+{
+	App *app = g->app;
+
+	if ((app_extra(app)->batch_owner != g)
+	    || (app_extra(app)->batch_xid != graphics_extra(g)->xid)
+	    || (app_extra(app)->batch_kind != kind)
+	    || (app_extra(app)->batched == BATCH_SIZE))
+	{
+		app_flush_drawing(app);
+		app_extra(app)->batch_owner = g;
+		app_extra(app)->batch_xid = graphics_extra(g)->xid;
+		app_extra(app)->batch_kind = kind;
+	}
+}
+
+APP_PRIVATE
+void app_batch_rect(Graphics *g, Rect r)
+{
+	XRectangle *xr;
+
+	app_start_batch(g, BATCH_RECTS);
+	xr = & app_extra(g->app)->batch.rects[app_extra(g->app)->batched++];
+	xr->x = r.x;
+	xr->y = r.y;
+	xr->width  = r.width;
+	xr->height = r.height;
+}
+
+APP_PRIVATE
+void app_batch_line(Graphics *g, Point p1, Point p2)
+{
+	XSegment *xs;
+
+	app_start_batch(g, BATCH_SEGMENTS);
+	xs = & app_extra(g->app)->batch.segs[app_extra(g->app)->batched++];
+	xs->x1 = p1.x;
+	xs->y1 = p1.y;
+	xs->x2 = p2.x;
+	xs->y2 = p2.y;
+}
+
+/*
+ *  Send any batched drawing to the X server.
+ */
+APP_PRIVATE
+void app_flush_drawing(App *app)
+{
+	AppExtra *extra = app_extra(app);
+
+	if (extra->batched > 0) {
+		if (extra->batch_kind == BATCH_RECTS)
+			XFillRectangles(extra->display, extra->batch_xid,
+				graphics_extra(extra->batch_owner)->gc,
+				extra->batch.rects, extra->batched);
+		else
+			XDrawSegments(extra->display, extra->batch_xid,
+				graphics_extra(extra->batch_owner)->gc,
+				extra->batch.segs, extra->batched);
+	}
+	extra->batch_owner = NULL;
+	extra->batch_kind = BATCH_NONE;
+	extra->batched = 0;
+}
+
 /*
  *  Set the drawing colour.
  */
 void app_set_rgb(Graphics *g, Colour col)
 {
-	Display *disp;
 	long bg;
-	GC gc;
 	Window *win = NULL;
 
 	if (col.alpha > 0x7F) {	/* transparent */
@@ -132,8 +380,6 @@ void app_set_rgb(Graphics *g, Colour col)
 		win = g->bmap->win;
 
 	if (win) {
-		disp = app_extra(win->app)->display;
-		gc = graphics_extra(g)->gc;
 		if (g->xor_mode) {
 			/* retrieve previous background pixval */
 			bg = graphics_extra(g)->bgpixval;
@@ -142,12 +388,12 @@ void app_set_rgb(Graphics *g, Colour col)
 			g->pixval = app_window_find_colour(g, win, col);
 
 			/* use the correct XOR drawing colour */
-			XSetForeground(disp, gc, g->pixval ^ bg);
+			app_set_gc_foreground(g, g->pixval ^ bg);
 		}
 		else {
 			/* find new foreground pixval and use it */
 			g->pixval = app_window_find_colour(g, win, col);
-			XSetForeground(disp, gc, g->pixval);
+			app_set_gc_foreground(g, g->pixval);
 		}
 	}
 	else if (g->img) {
@@ -160,9 +406,7 @@ void app_set_rgb(Graphics *g, Colour col)
 
 void app_set_rgbindex(Graphics *g, int index)
 {
-	Display *disp;
 	long bg;
-	GC gc;
 	Window *win = NULL;
 
 	if (g->win)
@@ -171,18 +415,16 @@ void app_set_rgbindex(Graphics *g, int index)
 		win = g->bmap->win;
 
 	if (win) {
-		disp = app_extra(win->app)->display;
-		gc = graphics_extra(g)->gc;
 		if (g->xor_mode) {
 			/* retrieve previous background pixval */
 			bg = graphics_extra(g)->bgpixval;
 
 			/* use the correct XOR drawing colour */
-			XSetForeground(disp, gc, index ^ bg);
+			app_set_gc_foreground(g, index ^ bg);
 		}
 		else {
 			/* use new foreground pixval */
-			XSetForeground(disp, gc, index);
+			app_set_gc_foreground(g, index);
 		}
 	}
 	else if (g->img) {
@@ -199,8 +441,6 @@ void app_set_rgbindex(Graphics *g, int index)
 void app_set_xor_mode(Graphics *g, Colour bgcol)
 {
 	long bg;
-	GC gc;
-	Display *disp;
 	Window *win = NULL;
 
 	if (g->win)
@@ -211,10 +451,8 @@ void app_set_xor_mode(Graphics *g, Colour bgcol)
 	if (win) {
 		bg = app_window_find_colour(g, win, bgcol);
 		graphics_extra(g)->bgpixval = bg;
-		disp = app_extra(win->app)->display;
-		gc = graphics_extra(g)->gc;
-		XSetForeground(disp, gc, g->pixval ^ bg);
-		XSetFunction(disp, gc, GXxor);
+		app_set_gc_foreground(g, g->pixval ^ bg);
+		app_set_gc_function(g, GXxor);
 	}
 
 	g->xor_mode = 1;
@@ -222,8 +460,6 @@ void app_set_xor_mode(Graphics *g, Colour bgcol)
 
 void app_set_paint_mode(Graphics *g)
 {
-	GC gc;
-	Display *disp;
 	Window *win = NULL;
 
 	if (g->win)
@@ -232,10 +468,8 @@ void app_set_paint_mode(Graphics *g)
 		win = g->bmap->win;
 
 	if (win) {
-		disp = app_extra(win->app)->display;
-		gc = graphics_extra(g)->gc;
-		XSetForeground(disp, gc, g->pixval);
-		XSetFunction(disp, gc, GXcopy);
+		app_set_gc_foreground(g, g->pixval);
+		app_set_gc_function(g, GXcopy);
 	}
 
 	g->xor_mode = 0;
@@ -312,6 +546,13 @@ void app_set_clip_region(Graphics *g, Region *rgn)
 	/* remove any existing clipping region */
 	if (g->clip)
 		app_del_region(g->clip);
+	if (graphics_extra(g)->clipped) {
+		if (app_extra(g->app)->batch_owner == g)
+			app_flush_drawing(g->app);
+		XSetClipMask(app_extra(g->app)->display,
+			graphics_extra(g)->gc, None);
+		graphics_extra(g)->clipped = 0;
+	}
 
 	/* take a copy of the given region, if one was given */
 	if (rgn)
@@ -12,6 +12,11 @@
  *  Version: 3.48  2003/06/05  Better support for non-graphical Apps.
  *  Version: 3.50  2004/01/11  Uses const keyword for some param strings.
  *  Version: 3.57  2005/08/16  Reports X11 socket file descriptor in App.
+ *  Version: 3.70  2026/10/17  Checks for MIT-SHM image transfer.
+ *  Version: 3.71  2026/10/17  Frees the pooled Graphics objects.
+ *  Version: 3.72  2026/10/17  Sends batched drawing before closing.
+ *  Version: 3.73  2026/10/17  Checks for XRender.
+ *  Version: 3.74  2026/10/17  Frees the mouse motion history.
  */
 
 /* Copyright (c) L. Patrick
@@ -131,14 +136,25 @@ App *app_new_app(int argc, char *argv[])
 	app->screen_mm.width  = DisplayWidthMM(disp, DefaultScreen(disp));
 	app->screen_mm.height = DisplayHeightMM(disp, DefaultScreen(disp));
 
+	/* Can images be sent through shared memory? */
+	app_init_shm(app);
+#ifdef USE_XRENDER
+	app_init_render(app);
+#endif
+
 	return app;
 }
 
 void app_del_app(App *app)
 {
 	app_app_deinitialise(app);
-	if (app_extra(app)->display)
+	if (app_extra(app)->display) {
+		app_flush_drawing(app);
+		app_del_shm(app);
+		app_del_graphics_pool(app);
 		XCloseDisplay(app_extra(app)->display);
+	}
+	app_free(app_extra(app)->motion);
 	app_free(app_extra(app));
 	app_free(app);
 }
@@ -0,0 +1,214 @@
+/*
+ *  Worker threads.
+ *
+ *  Platform: X-Windows.
+ *
+ *  Version: 3.70  2026/10/17  First release.
+ */
+
+/* Copyright (c) L. Patrick
+
+   This file is part of the App cross-platform programming package.
+   You may redistribute it and/or modify it under the terms of the
+   App Software License. See the file LICENSE.TXT for details.
+*/
+
+/*
+ *  Worker threads
+ *  --------------
+ *  Image operations which compute each row of their result
+ *  independently of the other rows hand the job to app_run_bands.
+ *  It splits the rows into bands, and the calling thread and a
+ *  small pool of worker threads take bands until none are left.
+ *
+ *  Each row is computed by the same code from the same inputs
+ *  however the rows are split up, so the results never depend
+ *  on the number of threads.
+ *
+ *  The pool starts empty, so everything runs on the calling
+ *  thread until app_set_worker_threads asks for more threads.
+ *  Only one job uses the pool at a time; a job started while
+ *  the pool is busy (including from within a band) simply runs
+ *  on the thread which started it.
+ *
+ *  Band functions must not call app_alloc or app_free, which
+ *  are not thread-safe. Scratch memory is allocated beforehand,
+ *  one set per thread, and each band is told which thread it is
+ *  running on.
+ */
+
+#include "appint.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_WORKERS       63	/* threads besides the caller */
+#define BANDS_PER_THREAD  4	/* so uneven bands even out */
+#define MIN_BAND_ROWS     16	/* smaller bands are not worth it */
+
+static pthread_mutex_t  job_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   work_done  = PTHREAD_COND_INITIALIZER;
+
+static pthread_t  workers[MAX_WORKERS];
+static int        num_workers = 0;
+static int        quitting = 0;
+
+/* The current job, guarded by pool_lock: */
+
+static BandFunc   job_func = NULL;
+static void *     job_data = NULL;
+static int        job_rows = 0;
+static int        job_threads = 0;
+static int        job_bands = 0;
+static int        next_band = 0;
+static int        bands_done = 0;
+
+/*
+ *  Take bands of the current job until there are none left.
+ *  Called with pool_lock held, which is released while each
+ *  band runs.
+ */
+static void app_take_bands(int thread)
+{
+	int band, y1, y2;
+
+	while (next_band < job_bands)
+	{
+		band = next_band++;
+		y1 = (int) ((long) job_rows * band / job_bands);
+		y2 = (int) ((long) job_rows * (band+1) / job_bands);
+
+		pthread_mutex_unlock(&pool_lock);
+		job_func(job_data, thread, y1, y2);
+		pthread_mutex_lock(&pool_lock);
+
+		if (++bands_done == job_bands)
+			pthread_cond_broadcast(&work_done);
+	}
+}
+
+static void * app_worker_main(void *arg)
+{
+	int thread = (int) (long) arg;
+
+	pthread_mutex_lock(&pool_lock);
+	for (;;)
+	{
+		while ((! quitting) && ((next_band >= job_bands)
+				|| (thread >= job_threads)))
+			pthread_cond_wait(&work_ready, &pool_lock);
+		if (quitting)
+			break;
+		app_take_bands(thread);
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return NULL;
+}
+
+/*
+ *  Return how many threads app_run_bands might use, so that
+ *  the caller can allocate that many sets of scratch memory.
+ *  Pass the same number to app_run_bands: it never uses more
+ *  threads than it is given, even if the pool has grown since.
+ */
+APP_PRIVATE
+int app_worker_threads(void)
+{
+	return num_workers + 1;
+}
+
+/*
+ *  Call func(data, thread, y1, y2) over bands of rows covering
+ *  0 to rows-1, using at most the given number of threads.
+ *  The thread number passed to func is less than threads.
+ *  The pool can't change while a job runs, since
+ *  app_set_worker_threads waits for job_lock.
+ *  Returns when every band is finished.
+ */
+APP_PRIVATE
+void app_run_bands(BandFunc func, void *data, int rows, int threads)
+{
+	int bands;
+
+	if (rows <= 0)
+		return;
+	if ((threads < 2) || (rows < 2 * MIN_BAND_ROWS)
+		|| (pthread_mutex_trylock(&job_lock) != 0))
+	{
+		func(data, 0, 0, rows);
+		return;
+	}
+	if (num_workers == 0) {
+		pthread_mutex_unlock(&job_lock);
+		func(data, 0, 0, rows);
+		return;
+	}
+
+	if (threads > num_workers + 1)
+		threads = num_workers + 1;
+	bands = threads * BANDS_PER_THREAD;
+	if (bands > rows / MIN_BAND_ROWS)
+		bands = rows / MIN_BAND_ROWS;
+
+	pthread_mutex_lock(&pool_lock);
+	job_func = func;
+	job_data = data;
+	job_rows = rows;
+	job_threads = threads;
+	job_bands = bands;
+	next_band = 0;
+	bands_done = 0;
+	pthread_cond_broadcast(&work_ready);
+
+	app_take_bands(0);
+	while (bands_done < job_bands)
+		pthread_cond_wait(&work_done, &pool_lock);
+	pthread_mutex_unlock(&pool_lock);
+
+	pthread_mutex_unlock(&job_lock);
+}
+
+/*
+ *  Set how many threads image operations may use, counting the
+ *  thread which calls them. One means everything runs on the
+ *  calling thread, as before; zero means one per processor.
+ *  The pool belongs to the process, not to any one App, since
+ *  image operations are not given an App.
+ */
+void app_set_worker_threads(int n)
+{
+	int i;
+
+	if (n <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (n <= 0)
+			n = 1;
+	}
+	if (n > MAX_WORKERS + 1)
+		n = MAX_WORKERS + 1;
+
+	pthread_mutex_lock(&job_lock);
+
+	/* stop the old workers */
+	pthread_mutex_lock(&pool_lock);
+	quitting = 1;
+	pthread_cond_broadcast(&work_ready);
+	pthread_mutex_unlock(&pool_lock);
+	for (i=0; i < num_workers; i++)
+		pthread_join(workers[i], NULL);
+	num_workers = 0;
+	quitting = 0;
+
+	/* start the new ones; thread 0 is always the caller */
+	for (i=0; i < n-1; i++) {
+		if (pthread_create(&workers[i], NULL, app_worker_main,
+				(void *) (long) (i+1)) != 0)
+			break;
+		num_workers++;
+	}
+
+	pthread_mutex_unlock(&job_lock);
+}
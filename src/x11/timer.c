@@ -12,6 +12,8 @@
  *  Version: 3.35  2002/12/23  Renamed active_timers to num_timers.
  *  Version: 3.57  2005/08/16  Uses App->socket_fd (not ConnectionNumber).
  *  Version: 3.60  2007/06/06  Improved timing using poll.
+ *  Version: 3.70  2026/10/17  Sends batched drawing before sleeping.
+ *  Version: 3.71  2026/10/17  Timers kept in a heap, on a monotonic clock.
  */
 
 /* Copyright (c) L. Patrick
@@ -97,6 +99,7 @@ int app_delay(App *app, int milliseconds)
 	t.tv_usec = usec = ((unsigned long) milliseconds % 1000) * 1000;
 
 	if (app) {
+		app_flush_drawing(app);
 		XFlush(app_extra(app)->display);
 		fd = app->socket_fd;
 
@@ -176,15 +179,144 @@ int app_delay(App *app, int milliseconds)
 }
 
 /*
- *  Report current time in milliseconds.	//!!
+ *  Report current time in milliseconds.
+ *  A monotonic clock is used where there is one, so that timers
+ *  are not upset when someone sets the system clock.
  */
 unsigned long app_current_time(App *app)
 {
 	struct timeval tv;
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif
 	gettimeofday (&tv, NULL);
 	return (tv.tv_sec * 1000 + tv.tv_usec / 1000);
 }
 
+/*
+ *  The timer heap
+ *  --------------
+ *  app->timers is kept as a binary heap ordered by when each
+ *  timer is next due, so the first timer is always the next one
+ *  to fire. The event loop sleeps in poll until then, unless an
+ *  X event arrives first, so timers fire on time and an idle
+ *  program does not wake up at all.
+ *
+ *  Times are compared by their difference, so the heap still
+ *  works when the millisecond clock wraps around.
+ */
+#define app_timer_due(t) ((t)->last_time + (unsigned long) (t)->milliseconds)
+#define app_timer_before(a,b) ((long) (app_timer_due(a) - app_timer_due(b)) < 0)
+
+static void app_swap_timers(App *app, int i, int j)
+{
+	Timer *t = app->timers[i];
+	app->timers[i] = app->timers[j];
+	app->timers[j] = t;
+}
+
+static int app_sift_timer_up(App *app, int i)
+{
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (! app_timer_before(app->timers[i], app->timers[parent]))
+			break;
+		app_swap_timers(app, i, parent);
+		i = parent;
+	}
+	return i;
+}
+
+static void app_sift_timer_down(App *app, int i)
+{
+	int child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= app->num_timers)
+			break;
+		if ((child + 1 < app->num_timers)
+		    && app_timer_before(app->timers[child+1], app->timers[child]))
+			child++;
+		if (! app_timer_before(app->timers[child], app->timers[i]))
+			break;
+		app_swap_timers(app, i, child);
+		i = child;
+	}
+}
+
+/*
+ *  Move a timer whose due time changed to its new place.
+ */
+static void app_resort_timer(Timer *t)
+{
+	App *app = t->app;
+	int i;
+
+	for (i=0; i < app->num_timers; i++)
+		if (app->timers[i] == t) {
+			app_sift_timer_down(app, app_sift_timer_up(app, i));
+			break;
+		}
+}
+
+/*
+ *  Return how many milliseconds until the next timer is due,
+ *  zero if one is due now, or -1 if there are no timers.
+ */
+APP_PRIVATE
+long app_next_timer_delay(App *app)
+{
+	long delay;
+
+	if (app->num_timers == 0)
+		return -1;
+	delay = (long) (app_timer_due(app->timers[0]) - app_current_time(app));
+	return (delay > 0) ? delay : 0;
+}
+
+/*
+ *  Call the actions of the timers which are due. Each timer
+ *  fires at most once per call, even if it has fallen behind,
+ *  and then waits a whole interval again. An action may create,
+ *  reset or delete any timer, including its own.
+ *  Returns the number of timers which fired.
+ */
+APP_PRIVATE
+int app_run_timers(App *app)
+{
+	Timer *t;
+	unsigned long now;
+	int n, fired = 0;
+
+	now = app_current_time(app);
+
+	for (n = app->num_timers; (n > 0) && (app->num_timers > 0); n--)
+	{
+		t = app->timers[0];
+		if ((long) (app_timer_due(t) - now) > 0)
+			break;	/* the first timer isn't due yet */
+
+		/* schedule the next time before acting, */
+		/* so that the action can change it */
+		t->last_time += (unsigned long) t->milliseconds;
+		if ((long) (now - t->last_time) >= t->milliseconds)
+			t->last_time = now;	/* fell behind */
+		if (t->milliseconds <= 0)
+			t->last_time = now + 1;	/* not again this call */
+		app_sift_timer_down(app, 0);
+
+		t->action(t);
+		fired++;
+	}
+	return fired;
+}
+
 /*
  *  Create a new timer.
  */
@@ -200,7 +332,7 @@ Timer * app_new_timer(App *app, TimerAction action, int milliseconds) //!!
 	t->app = app;
 	t->action = action;
 	t->milliseconds = milliseconds;
-	t->last_time = app_current_time(app);	//!!
+	t->last_time = app_current_time(app);
 	num = app->num_timers + 1;
 	list = app_realloc(app->timers, num * sizeof(Timer *));
 	if (list == NULL) {
@@ -210,6 +342,7 @@ Timer * app_new_timer(App *app, TimerAction action, int milliseconds) //!!
 	app->timers = list;
 	app->timers[num-1] = t;
 	app->num_timers++;
+	app_sift_timer_up(app, num-1);
 
 #ifdef USE_ALARM
 	/* try to start a generic Alarm timer, failure is okay */
@@ -225,19 +358,24 @@ Timer * app_new_timer(App *app, TimerAction action, int milliseconds) //!!
  */
 void app_del_timer(Timer *t)
 {
-	int i, shift;
+	int i, last;
 	App *app = t->app;
 
-	for (i=shift=0; i < app->num_timers; i++) {
-		if (app->timers[i] == t)
-			shift++;
-		if (shift && (i+shift < app->num_timers))
-			app->timers[i] = app->timers[i+shift];
+	for (i=0; i < app->num_timers; i++) {
+		if (app->timers[i] != t)
+			continue;
+		/* move the last timer into the hole */
+		last = --app->num_timers;
+		if (i < last) {
+			app->timers[i] = app->timers[last];
+			app_sift_timer_down(app, app_sift_timer_up(app, i));
+		}
+		break;
+	}
+	if (app->num_timers == 0) {
+		app_free(app->timers);
+		app->timers = NULL;
 	}
-	if (shift)
-		app->timers = app_realloc(app->timers,
-				(i-shift) * sizeof(Timer *));
-	app->num_timers -= shift;
 
 #ifdef USE_ALARM
 	if (app->num_timers == 0 && app_extra(app)->timer_id) {	//!!
@@ -253,7 +391,9 @@ void app_del_timer(Timer *t)
 /*
  *  Reset the timer.
  */
-void app_reset_timer(Timer *t, int milliseconds) {	//!!
+void app_reset_timer(Timer *t, int milliseconds)
+{
 	t->last_time = app_current_time(t->app);
 	t->milliseconds = milliseconds;
+	app_resort_timer(t);
 }
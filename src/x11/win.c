@@ -14,6 +14,10 @@
  *  Version: 3.50  2004/01/18  Moved many common functions to winutil.c.
  *  Version: 3.51  2004/03/28  Supports delayed-deletion.
  *  Version: 3.52  2004/03/29  Uses type-safe private extra data types.
+ *  Version: 3.70  2026/10/17  Deletes image Bitmaps cached for the window.
+ *  Version: 3.71  2026/10/17  BUFFERED windows are redrawn off-screen.
+ *  Version: 3.72  2026/10/17  Sends batched drawing before deleting.
+ *  Version: 3.73  2026/10/17  Frees XRender pictures.
  */
 
 /* Copyright (c) L. Patrick
@@ -202,6 +206,11 @@ Window *app_new_window(App *app, Rect area, const char *name, long flags)
 
 	app_set_window_manager_style(app, xid, flags);
 
+	/* a buffered window paints every exposed pixel itself, */
+	/* so stop the server clearing it first, which flickers */
+	if (flags & BUFFERED)
+		XSetWindowBackgroundPixmap(disp, xid, None);
+
 	xsh.flags = (PPosition | PSize);
 	xsh.x = actual.x;
 	xsh.y = actual.y;
@@ -283,7 +292,22 @@ void app_del_window(Window *win)
 	for (i = win->num_children - 1; i >= 0; i--)
 		app_del_control(win->children[i]);
 
+	/* Delete any image Bitmaps cached for this window. */
+	app_forget_image_caches(win);
+
 	/* Remove the window from the screen. */
+	app_flush_drawing(win->app);
+#ifdef USE_XRENDER
+	if (win_extra(win)->picture)
+		XRenderFreePicture(app_extra(win->app)->display,
+			win_extra(win)->picture);
+	if (win_extra(win)->back_picture)
+		XRenderFreePicture(app_extra(win->app)->display,
+			win_extra(win)->back_picture);
+#endif
+	if (win_extra(win)->back_buffer)
+		XFreePixmap(app_extra(win->app)->display,
+			win_extra(win)->back_buffer);
 	XDestroyWindow(app_extra(win->app)->display, win_extra(win)->xid);
 
 	/* Discard arrays of function pointers. */
@@ -306,6 +330,89 @@ void app_del_window(Window *win)
 	app_free(win);
 }
 
+/*
+ *  Back buffers:
+ *
+ *  A BUFFERED window is redrawn into a pixmap as big as the window,
+ *  then the damaged part is copied to the window in one request,
+ *  so the user never sees the background drawn without the controls
+ *  on top. Every pixel of the damage is repainted before it is shown,
+ *  so the pixmap need not be kept up to date between redraws. It only
+ *  ever grows, so that resizing a window doesn't keep replacing it.
+ */
+APP_PRIVATE
+int app_use_back_buffer(Graphics *g)
+{
+	Window *win = g->win;
+	Display *disp = app_extra(win->app)->display;
+	WindowExtra *extra = win_extra(win);
+	int width, height;
+
+	if ((extra->back_width < win->area.width)
+	    || (extra->back_height < win->area.height))
+	{
+		if (extra->back_buffer)
+			XFreePixmap(disp, extra->back_buffer);
+#ifdef USE_XRENDER
+		if (extra->back_picture)
+			XRenderFreePicture(disp, extra->back_picture);
+		extra->back_picture = None;
+#endif
+		width  = extra->back_width;
+		height = extra->back_height;
+		if (width < win->area.width)
+			width = win->area.width;
+		if (height < win->area.height)
+			height = win->area.height;
+		extra->back_buffer = XCreatePixmap(disp, extra->xid,
+				width, height,
+				DefaultDepth(disp, DefaultScreen(disp)));
+		extra->back_width  = width;
+		extra->back_height = height;
+		if (! app_bitmap_created(disp, extra->back_buffer)) {
+			/* out of server memory: draw on the window */
+			extra->back_buffer = None;
+			extra->back_width  = 0;
+			extra->back_height = 0;
+		}
+	}
+	if (! extra->back_buffer)
+		return 0;
+
+	graphics_extra(g)->xid = extra->back_buffer;
+	return 1;
+}
+
+/*
+ *  Copy the window's damaged area from its back buffer, and go
+ *  back to drawing on the window itself.
+ */
+APP_PRIVATE
+void app_show_back_buffer(Graphics *g)
+{
+	Window *win = g->win;
+	Rect r;
+
+	app_flush_drawing(win->app);
+	graphics_extra(g)->xid = win_extra(win)->xid;
+
+	g->ctrl = NULL;
+	g->offset = pt(0,0);
+	g->area = app_get_window_area(win);
+	app_set_clip_region(g, NULL);	/* the damaged area */
+
+	r = app_get_clip_rect(g);
+	if ((r.width <= 0) || (r.height <= 0))
+		return;
+
+	app_set_gc_function(g, GXcopy);
+	app_clip_gc(g);
+	XCopyArea(app_extra(win->app)->display,
+		win_extra(win)->back_buffer, win_extra(win)->xid,
+		graphics_extra(g)->gc,
+		r.x, r.y, r.width, r.height, r.x, r.y);
+}
+
 /*
  *  Manipulating windows:
  */